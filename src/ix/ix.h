@@ -25,7 +25,8 @@ public:
 	RC CreateIndex  (const char *fileName,          // Create new index
 	                 int        indexNo,
 	                 AttrType   attrType,
-	                 int        attrLength);
+	                 int        attrLength,
+	                 int        pageSize = PF_DEFAULT_PAGE_SIZE);
 	RC DestroyIndex (const char *fileName,          // Destroy index
 	                 int        indexNo);
 	RC OpenIndex    (const char *fileName,          // Open index
@@ -37,14 +37,15 @@ void yyrestart(FILE*);
 #endif
 
 // The PF_STATS indicates that we will be tracking statistics for the PF
-// Layer.  The Manager is defined within pf_buffermgr.cc.  
+// Layer.  The counters are defined within pf_buffermgr.cc.  
 // We include it within the parser so that a system command can display
 // statistics about the DB.
 #ifdef PF_STATS
 #include "statistics.h"
 
-// This is defined within the pf_buffermgr.cc
-extern StatisticsMgr *pStatisticsMgr;
+// These are defined within the pf_buffermgr.cc
+extern StatCounters pfStats;
+extern StatHistograms pfTimes;
 
 #endif    // PF_STATS
 
@@ -256,7 +257,8 @@ buffer
    }
    | RW_RESIZE RW_BUFFER T_INT
    {
-      pPfm->ResizeBuffer($3);
+      if (pPfm->ResizeBuffer($3))
+         cout << "Trouble resizing buffer!  Things may be pinned.\n";
       $$ = NULL;
    }
    ;
@@ -267,20 +269,20 @@ statistics
       #ifdef PF_STATS
          cout << "Statistics\n";
          cout << "----------\n";
-         pStatisticsMgr->Print();
-      #else
-         cout << "Statitisics not compiled.\n";
+         pfStats.Print();
+         pfTimes.Print();
       #endif
+      pPfm->PrintFileStats();
       $$ = NULL;
    }
    | RW_RESET RW_IO
    {
       #ifdef PF_STATS
-         cout << "Statistics reset.\n";
-         pStatisticsMgr->Reset();
-      #else
-         cout << "Statitisics not compiled.\n";
+         pfStats.Reset();
+         pfTimes.Reset();
       #endif
+      pPfm->ResetFileStats();
+      cout << "Statistics reset.\n";
       $$ = NULL;
    }
    ;
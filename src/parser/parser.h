@@ -80,4 +80,10 @@ void PrintError(RC rc);
 // bQueryPlans is 0 then no query plan is shown.
 extern int bQueryPlans;
 
+#ifdef __cplusplus
+// pPfm is allocated by parse.y.  It is the PF_Manager given to RBparse
+// and lets SM_Manager::Set tune the buffer manager.
+extern PF_Manager *pPfm;
+#endif
+
 #endif
@@ -30,7 +30,76 @@ typedef int PageNum;
 // Unfortunately, we cannot use sizeof(PF_PageHdr) here, but it is an
 // int and we simply use that.
 //
-const int PF_PAGE_SIZE = 4096 - sizeof(int);
+// The size of the pages of a file, header included, is chosen when the
+// file is created: a power of two from PF_DEFAULT_PAGE_SIZE up to
+// PF_MAX_PAGE_SIZE.  PF_PAGE_SIZE is the room for data in a page of the
+// default size; PF_PageDataSize gives it for the other sizes.
+//
+const int PF_DEFAULT_PAGE_SIZE = 4096;
+const int PF_MAX_PAGE_SIZE = 65536;
+const int PF_PAGE_SIZE = PF_DEFAULT_PAGE_SIZE - sizeof(int);
+
+// Room reserved in a file when it runs out of pages, unless changed with
+// PF_FileHandle::SetExtent: PF_EXTENT_PAGES pages, or PF_EXTENT_GROWTH
+// percent of the pages of the file if that is more.  By default a file
+// grows a page at a time: with delayed allocation the file system keeps
+// such pages together already, while small extents reserved by files
+// growing side by side would interleave them.
+const int PF_EXTENT_PAGES = 1;
+const int PF_EXTENT_GROWTH = 0;
+
+inline int PF_PageDataSize(int pageSize)
+{
+	return (pageSize - (int)sizeof(int));
+}
+
+//
+// PF_ReplacePolicy: page replacement policy of the buffer manager
+//
+enum PF_ReplacePolicy {
+	PF_REPLACE_LRU,                                // least recently used
+	PF_REPLACE_CLOCK,                              // second chance
+	PF_REPLACE_2Q,                                 // 2Q (scan resistant)
+	PF_REPLACE_LRUK                                // LRU-2 (scan resistant)
+};
+
+//
+// PF_FileMode: how the pages of the files opened by a PF_Manager are
+// accessed
+//
+enum PF_FileMode {
+	PF_MODE_BUFFERED,                              // through the buffer pool
+	PF_MODE_MMAP,                                  // in a mapping of the file
+	PF_MODE_DIRECT                                 // buffer pool, no OS cache
+};
+
+//
+// PF_FileStats: use of the buffer by the pages of a file
+//
+// The counters are always kept, per file, by the buffer manager (see
+// PF_Manager::GetFileStats).  A pin lasts from the first GetPage of a
+// page to the UnpinPage which releases it last.
+//
+struct PF_FileStats {
+	long      hits;                                // GetPage found the page
+	long      misses;                              // GetPage read the page
+	long      evictions;                           // pages replaced
+	long      writeBacks;                          // dirty pages written
+	long      pins;                                // pins released
+	long long pinNanos;                            // time pinned, in ns
+
+	void Add (const PF_FileStats &stats)
+		{ hits += stats.hits; misses += stats.misses;
+		  evictions += stats.evictions; writeBacks += stats.writeBacks;
+		  pins += stats.pins; pinNanos += stats.pinNanos; }
+};
+
+//
+// PF_RESIDENT_LIST: file of a database directory listing the pages the
+// buffer held when the database was last closed (see
+// PF_Manager::LoadResidentPages)
+//
+#define PF_RESIDENT_LIST "resident.pf"
 
 //
 // PF_PageHandle: PF page interface
@@ -52,20 +121,31 @@ public:
 private:
 	int  pageNum;                                  // page number
 	char *pPageData;                               // pointer to page data
+	int  slot;                                     // slot of the page in the
+	                                               // buffer, -1 if none
 };
 
 //
 // PF_FileHdr: Header structure for files
 //
 struct PF_FileHdr {
-	int firstFree;     // first free page in the linked list
+	int firstFree;     // first free page in the linked list of the files
+	                   // written before the bitmap, now PF_PAGE_LIST_END
 	int numPages;      // # of pages in the file
+	int pageSize;      // size of the pages, 0 for PF_DEFAULT_PAGE_SIZE
+	int flags;         // PF_HDR_BITMAP if the allocation bitmap is kept in
+	                   // the file, PF_HDR_COMPRESSED if the pages are
+	                   // compressed (see pf_compress.h)
 };
 
 //
 // PF_FileHandle: PF File interface
 //
 class PF_BufferMgr;
+struct PF_FileState;
+class PF_PageGuard;
+class PF_ResidentList;
+class PF_StatsTable;
 
 class PF_FileHandle {
 	friend class PF_Manager;
@@ -79,39 +159,130 @@ public:
 	// Overload =
 	PF_FileHandle& operator=(const PF_FileHandle &fileHandle);
 
+	// The methods getting pages take a hint telling how the pages are
+	// used (see ClientHint in redbase.h)
+
 	// Get the first page
-	RC GetFirstPage(PF_PageHandle &pageHandle) const;
+	RC GetFirstPage(PF_PageHandle &pageHandle, ClientHint hint = NO_HINT) const;
 	// Get the next page after current
-	RC GetNextPage (PageNum current, PF_PageHandle &pageHandle) const;
+	RC GetNextPage (PageNum current, PF_PageHandle &pageHandle,
+	                ClientHint hint = NO_HINT) const;
 	// Get a specific page
-	RC GetThisPage (PageNum pageNum, PF_PageHandle &pageHandle) const;
+	RC GetThisPage (PageNum pageNum, PF_PageHandle &pageHandle,
+	                ClientHint hint = NO_HINT) const;
 	// Get the last page
-	RC GetLastPage(PF_PageHandle &pageHandle) const;
+	RC GetLastPage(PF_PageHandle &pageHandle, ClientHint hint = NO_HINT) const;
 	// Get the prev page after current
-	RC GetPrevPage (PageNum current, PF_PageHandle &pageHandle) const;
+	RC GetPrevPage (PageNum current, PF_PageHandle &pageHandle,
+	                ClientHint hint = NO_HINT) const;
 
 	RC AllocatePage(PF_PageHandle &pageHandle);    // Allocate a new page
 	RC DisposePage (PageNum pageNum);              // Dispose of a page
 	RC MarkDirty   (PageNum pageNum) const;        // Mark page as dirty
 	RC UnpinPage   (PageNum pageNum) const;        // Unpin the page
 
+	// Same as above for the page of a handle, found through its slot in
+	// the buffer instead of the hash table
+	RC MarkDirty   (const PF_PageHandle &pageHandle) const;
+	RC UnpinPage   (const PF_PageHandle &pageHandle) const;
+
+	// Same as the methods above, the page being held by pageGuard.  The
+	// page it held before is unpinned first.
+	RC GetFirstPage(PF_PageGuard &pageGuard, ClientHint hint = NO_HINT) const;
+	RC GetNextPage (PageNum current, PF_PageGuard &pageGuard,
+	                ClientHint hint = NO_HINT) const;
+	RC GetThisPage (PageNum pageNum, PF_PageGuard &pageGuard,
+	                ClientHint hint = NO_HINT) const;
+	RC AllocatePage(PF_PageGuard &pageGuard);
+
+	// Room for data in the pages of the file
+	RC GetPageSize (int &length) const;
+	// Most pages of the file the buffer can keep pinned at once, however
+	// they are spread over its shards
+	RC GetPinLimit (int &numPages) const;
+
+	// When the file grows, reserve room for minPages pages at once, or for
+	// growthPct percent of its pages if that is more.  1 and 0 grow the
+	// file a page at a time.  The setting lasts until the file is closed.
+	RC SetExtent   (int minPages, int growthPct = 0);
+	// Reserve room for numPages more pages now, before adding many pages
+	RC ReservePages(int numPages);
+
 	// Flush pages from buffer pool.  Will write dirty pages to disk.
 	RC FlushPages  () const;
 
 	// Force a page or pages to disk (but do not remove from the buffer pool)
 	RC ForcePages  (PageNum pageNum=ALL_PAGES) const;
 
+	// Force all the pages and wait until the OS has them on the device
+	RC SyncPages   () const;
+
 private:
 
 	// IsValidPageNum will return TRUE if page number is valid and FALSE
 	// otherwise
 	int IsValidPageNum (PageNum pageNum) const;
 
+	// Write the file header if it has changed
+	RC WriteHdr () const;
+
+	// Fill the allocation bitmap when the file is opened
+	RC ReadBitmap (const char *hdrBuf);
+	// TRUE if pageNum is a bitmap page
+	int IsBitmapPage (PageNum pageNum) const;
+	// Note that the bit of pageNum changed
+	void BitmapChanged (PageNum pageNum);
+	// Write the bitmap page holding the bit of pageNum
+	RC WriteBitmapPage (PageNum pageNum) const;
+	// Reserve room in the file for the pages before endPage
+	RC Reserve (PageNum endPage) const;
+	// Read a page from the file, bypassing the buffer
+	RC ReadRawPage (PageNum pageNum, char *pBuf) const;
+
+	// Track sequential access and read the next pages ahead of time
+	void ReadAhead (PageNum pageNum, ClientHint hint) const;
+
 	PF_BufferMgr *pBufferMgr;                      // pointer to buffer manager
-	PF_FileHdr hdr;                                // file header
+	PF_FileHdr hdr;                                // file header, numPages
+	                                               // is in pState
 	int bFileOpen;                                 // file open flag
-	int bHdrChanged;                               // dirty flag for file hdr
 	int unixfd;                                    // OS file descriptor
+	PF_FileState *pState;                          // shared by the copies
+};
+
+//
+// PF_PageGuard: holds the pin of a page
+//
+// A guard takes over the pin of a page fetched through a PF_FileHandle
+// and unpins the page when it is destroyed, so that a page is not left
+// pinned when a function returns early on an error.  It can be moved but
+// not copied, so the page is unpinned once.  MarkDirty and the unpin go
+// to the slot of the page in the buffer, without a hash lookup.
+//
+class PF_PageGuard {
+	friend class PF_FileHandle;
+public:
+	PF_PageGuard  ();                             // Holds no page
+	~PF_PageGuard ();                             // Unpins the page
+
+	// Take over the pin of pageHandle, a page of fileHandle
+	PF_PageGuard  (const PF_FileHandle &fileHandle,
+	               const PF_PageHandle &pageHandle);
+
+	// Move the pin from pageGuard, which then holds no page
+	PF_PageGuard  (PF_PageGuard &&pageGuard);
+	PF_PageGuard& operator=(PF_PageGuard &&pageGuard);
+
+	PF_PageGuard  (const PF_PageGuard &) = delete;
+	PF_PageGuard& operator=(const PF_PageGuard &) = delete;
+
+	RC GetData     (char *&pData) const;           // Page contents
+	RC GetPageNum  (PageNum &pageNum) const;       // Page number
+	RC MarkDirty   () const;                       // Mark the page dirty
+	RC Release     ();                             // Unpin the page now
+private:
+	const PF_FileHandle *pFileHandle;              // NULL if no page is held
+	PF_PageHandle pageHandle;                      // page held
 };
 
 //
@@ -119,9 +290,16 @@ private:
 //
 class PF_Manager {
 public:
-	PF_Manager    ();                              // Constructor
+	// Constructor, the buffer pool replaces pages according to policy.
+	// Several threads may use the buffer pool when it is split into
+	// numShards independently latched partitions.
+	PF_Manager    (PF_ReplacePolicy policy = PF_REPLACE_LRU,
+	               int numShards = 1);
 	~PF_Manager   ();                              // Destructor
-	RC CreateFile    (const char *fileName);       // Create a new file
+	// Create a new file of pages of pageSize bytes, kept compressed on
+	// disk if bCompressed
+	RC CreateFile    (const char *fileName, int pageSize = PF_DEFAULT_PAGE_SIZE,
+	                  int bCompressed = FALSE);
 	RC DestroyFile   (const char *fileName);       // Delete a file
 
 	// Open and close file methods
@@ -135,6 +313,45 @@ public:
 	RC PrintBuffer   ();
 	RC ResizeBuffer  (int iNewSize);
 
+	// Switch the page replacement policy of the buffer manager.  Pages
+	// already in the buffer stay there.  Called by SM_Manager::Set.
+	RC SetReplacePolicy (PF_ReplacePolicy policy);
+
+	// Number of pages loaded in background ahead of a file read in page
+	// order.  0, the default, turns read-ahead off.
+	RC SetReadAhead  (int numPages);
+
+	// Have a background thread write the dirty pages which are going to
+	// be replaced next.  The tailPct percent of the buffer to be replaced
+	// next is kept between lowPct and highPct percent clean.  tailPct 0,
+	// the default, turns the writer off.
+	RC SetBgWriter   (int tailPct, int lowPct, int highPct);
+
+	// Set how the files opened from now on are accessed.  In
+	// PF_MODE_MMAP, the page handles point into a mapping of the file.
+	// In PF_MODE_DIRECT, the files are opened with O_DIRECT so that the
+	// pages are only cached in the buffer.
+	RC SetFileMode   (PF_FileMode mode);
+
+	// Advise the kernel to back the buffer with transparent huge pages
+	RC SetHugePages  (int bHugePages);
+
+	// Warm restart.  LoadResidentPages reads the list of pages written by
+	// SaveResidentPages and has the pages of each file loaded in
+	// background when the file is opened.  From then on, the pages in the
+	// buffer when a file is closed are remembered, and SaveResidentPages
+	// writes them out, the hottest first.  File names are as given to
+	// OpenFile.
+	RC LoadResidentPages (const char *listName);
+	RC SaveResidentPages (const char *listName);
+
+	// Counters of the use of the buffer by the file fileName, summed
+	// over the times it was opened since the last ResetFileStats
+	RC GetFileStats  (const char *fileName, PF_FileStats &stats);
+	// Print the counters of every file, which PrintBuffer does too
+	RC PrintFileStats();
+	RC ResetFileStats();
+
 	// Three Methods for manipulating raw memory buffers.  These memory
 	// locations are handled by the buffer manager, but are not
 	// associated with a particular file.  These should be used if you
@@ -156,6 +373,60 @@ public:
 
 private:
 	PF_BufferMgr *pBufferMgr;                      // page-buffer manager
+	PF_FileMode  fileMode;                         // mode of the next files
+	PF_ResidentList *pResident;                    // warm restart or NULL
+	PF_StatsTable *pStats;                         // counters by file name
+};
+
+//
+// PF_BlockArena: small objects carved out of buffer blocks
+//
+// AllocateBlock hands out whole frames, too much for each entry of a hash
+// table or a list of RIDs, and structures allocated with new escape the
+// bound of the buffer.  An arena takes blocks from the buffer as it
+// needs them and bump-allocates objects in them, 16-byte aligned.  An
+// object is at most PF_ARENA_MAX_ALLOC bytes.  The sizes up to
+// PF_ARENA_MAX_CLASS are rounded up to a power of two, and Free puts an
+// object back on the list of its size, where Alloc looks first.  The
+// blocks go back to the buffer all at once with Release or when the arena
+// is destroyed, so a query frees everything it allocated in one call.
+//
+// The blocks held are charged against a budget in bytes, if one is given,
+// beyond which Alloc fails with PF_OVERBUDGET.  An arena is not latched:
+// it belongs to one query, in one thread.
+//
+const int PF_ARENA_MIN_CLASS = 16;   // smallest size class, the alignment
+const int PF_ARENA_MAX_CLASS = 2048; // largest size class
+const int PF_ARENA_CLASSES = 8;      // 16, 32, ..., 2048
+const int PF_ARENA_MAX_ALLOC = PF_DEFAULT_PAGE_SIZE - PF_ARENA_MIN_CLASS;
+
+class PF_BlockArena {
+public:
+	// Arena taking its blocks from pfm, holding at most budget bytes of
+	// blocks if budget is not 0
+	PF_BlockArena  (PF_Manager &pfm, long long budget = 0);
+	~PF_BlockArena ();                             // Releases the blocks
+
+	PF_BlockArena  (const PF_BlockArena &) = delete;
+	PF_BlockArena& operator=(const PF_BlockArena &) = delete;
+
+	RC Alloc      (int size, char *&pData);        // Allocate an object
+	RC Free       (char *pData, int size);         // Reuse an object
+	RC Release    ();                              // Give back every block
+
+	RC SetBudget  (long long budget);              // 0 for no budget
+	long long GetBytesHeld() const;                // Bytes of blocks held
+
+private:
+	RC NewBlock   ();                              // Start a new block
+
+	PF_Manager *pPfm;                              // buffer of the blocks
+	char *pBlock;                                  // current block or NULL,
+	                                               // each links to the last
+	int used;                                      // bytes used in pBlock
+	long long budget;                              // most bytes held, or 0
+	long long bytesHeld;                           // bytes of blocks held
+	char *freeList[PF_ARENA_CLASSES];              // objects freed by size
 };
 
 //
@@ -172,7 +443,9 @@ void PF_PrintError(RC rc);
 #define PF_PAGEUNPINNED    (START_PF_WARN + 6) // page already unpinned
 #define PF_EOF             (START_PF_WARN + 7) // end of file
 #define PF_TOOSMALL        (START_PF_WARN + 8) // Resize buffer too small
-#define PF_LASTWARN        PF_TOOSMALL
+#define PF_BADPARAM        (START_PF_WARN + 9) // invalid buffer parameter
+#define PF_OVERBUDGET      (START_PF_WARN + 10) // arena over its budget
+#define PF_LASTWARN        PF_OVERBUDGET
 
 #define PF_NOMEM           (START_PF_ERR - 0)  // no memory
 #define PF_NOBUF           (START_PF_ERR - 1)  // no buffer space
@@ -0,0 +1,101 @@
+//
+// File:        pf_bgwriter.cc
+// Description: PF_BgWriter class implementation
+//
+
+#include <chrono>
+#include "pf_internal.h"
+#include "pf_buffermgr.h"
+#include "pf_bgwriter.h"
+
+using namespace std;
+
+//
+// PF_BgWriter
+//
+// Desc: Constructor - start the writer thread, suspended until the
+//       watermarks are set
+// In:   pBufferMgr - buffer manager whose pages are written
+//
+PF_BgWriter::PF_BgWriter(PF_BufferMgr *_pBufferMgr)
+{
+	pBufferMgr = _pBufferMgr;
+	tailPct = lowPct = highPct = 0;
+	bWake = bStop = FALSE;
+
+	writer = thread(&PF_BgWriter::Run, this);
+}
+
+//
+// ~PF_BgWriter
+//
+// Desc: Destructor - stop the thread
+//
+PF_BgWriter::~PF_BgWriter()
+{
+	{
+		lock_guard<mutex> guard(latch);
+		bStop = TRUE;
+	}
+	wakeUp.notify_all();
+
+	writer.join();
+}
+
+//
+// SetWatermarks
+//
+// Desc: Set the share of each shard which is kept clean
+// In:   tailPct - percent of the pages of a shard which are watched
+//       lowPct - percent of the watched pages which must be clean
+//       highPct - percent of the watched pages to clean when writing
+//
+void PF_BgWriter::SetWatermarks(int _tailPct, int _lowPct, int _highPct)
+{
+	tailPct = _tailPct;
+	lowPct = _lowPct;
+	highPct = _highPct;
+	Wake();
+}
+
+//
+// Wake
+//
+// Desc: Look at the shards without waiting for the next interval
+//
+void PF_BgWriter::Wake()
+{
+	{
+		lock_guard<mutex> guard(latch);
+		bWake = TRUE;
+	}
+	wakeUp.notify_one();
+}
+
+//
+// Run
+//
+// Desc: Internal.  Body of the thread: clean the shards every interval
+//       or when woken up, until the object is destroyed.
+//
+void PF_BgWriter::Run()
+{
+	unique_lock<mutex> guard(latch);
+
+	while (!bStop) {
+		if (!bWake)
+			wakeUp.wait_for(guard, chrono::milliseconds(PF_BGWRITER_INTERVAL));
+		if (bStop)
+			break;
+		bWake = FALSE;
+
+		if (tailPct <= 0)
+			continue;
+
+		// Errors are ignored, the pages will be written when replaced
+		guard.unlock();
+		for (int s = 0; s < pBufferMgr->GetNumShards(); s++)
+			pBufferMgr->CleanShard(s, tailPct, lowPct, highPct);
+		guard.lock();
+	}
+}
@@ -0,0 +1,56 @@
+//
+// File:        pf_bgwriter.h
+// Description: PF_BgWriter class interface
+//
+// A miss used to write its victim back first when the victim was dirty,
+// so a miss under an update load often cost two I/Os.  PF_BgWriter is a
+// thread that writes the pages the replacement policy will choose next
+// before they are needed, so that misses find clean victims.
+//
+
+#ifndef PF_BGWRITER_H
+#define PF_BGWRITER_H
+
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "pf_internal.h"
+
+class PF_BufferMgr;
+
+//
+// PF_BgWriter - background writer of the cold dirty pages
+//
+// The tail of a shard is its tailPct percent of pages which are the next
+// victims.  When less than lowPct percent of the tail is clean, the dirty
+// pages of the tail are written, coldest first, until highPct percent of
+// it is clean (see PF_BufferMgr::CleanShard).  The thread looks at the
+// shards every PF_BGWRITER_INTERVAL ms and when a miss had to write a
+// dirty victim.
+//
+class PF_BgWriter {
+public:
+	PF_BgWriter  (PF_BufferMgr *pBufferMgr);
+	~PF_BgWriter ();                           // Stops the thread
+
+	// Set the watermarks, tailPct 0 suspends the writer
+	void SetWatermarks (int tailPct, int lowPct, int highPct);
+	// Have a look at the shards now
+	void Wake    ();
+
+private:
+	void Run     ();                           // Body of the thread
+
+	PF_BufferMgr *pBufferMgr;                  // buffer to clean
+	std::atomic<int> tailPct;                  // share of a shard watched
+	std::atomic<int> lowPct;                   // clean share to start at
+	std::atomic<int> highPct;                  // clean share to stop at
+	int bWake;                                 // TRUE if woken up
+	int bStop;                                 // TRUE when shutting down
+	std::mutex latch;                          // protects bWake and bStop
+	std::condition_variable wakeUp;
+	std::thread writer;
+};
+
+#endif
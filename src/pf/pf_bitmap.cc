@@ -0,0 +1,161 @@
+//
+// File:        pf_bitmap.cc
+// Description: PF_Bitmap class implementation
+//
+
+#include "pf_bitmap.h"
+
+using namespace std;
+
+//
+// Resize
+//
+// Desc: Make room for _numBits bits.  The bits added are clear, the bits
+//       cut off are lost.
+// In:   _numBits - new number of bits
+//
+void PF_Bitmap::Resize(int _numBits)
+{
+	words.resize((_numBits + 63) / 64, 0);
+
+	// Clear the bits cut off in the last word
+	if (_numBits < numBits && (_numBits & 63))
+		words[_numBits >> 6] &= (1ULL << (_numBits & 63)) - 1;
+	numBits = _numBits;
+}
+
+//
+// Next
+//
+// Desc: Internal.  First bit in [from, end) which differs from flip.
+//       Whole words are skipped while they hold no such bit.
+// In:   from, end - range to look at
+//       flip - 0 to look for a set bit, all ones to look for a clear bit
+// Ret:  bit number, -1 if there is none
+//
+int PF_Bitmap::Next(int from, int end, unsigned long long flip) const
+{
+	if (end > numBits)
+		end = numBits;
+	if (from < 0)
+		from = 0;
+	if (from >= end)
+		return (-1);
+
+	int w = from >> 6;
+	int last = (end - 1) >> 6;
+	unsigned long long word = (words[w] ^ flip) & (~0ULL << (from & 63));
+
+	for (;;) {
+		if (word) {
+			int bit = (w << 6) + __builtin_ctzll(word);
+			return (bit < end ? bit : -1);
+		}
+		if (++w > last)
+			return (-1);
+		word = words[w] ^ flip;
+	}
+}
+
+int PF_Bitmap::NextSet(int from, int end) const
+{
+	return (Next(from, end, 0));
+}
+
+int PF_Bitmap::NextClear(int from, int end) const
+{
+	return (Next(from, end, ~0ULL));
+}
+
+//
+// PrevSet
+//
+// Desc: Last set bit in [0, from], word by word backwards
+// In:   from - last bit to look at
+// Ret:  bit number, -1 if there is none
+//
+int PF_Bitmap::PrevSet(int from) const
+{
+	if (from >= numBits)
+		from = numBits - 1;
+	if (from < 0)
+		return (-1);
+
+	int w = from >> 6;
+	unsigned long long word = words[w] & (~0ULL >> (63 - (from & 63)));
+
+	for (;;) {
+		if (word)
+			return ((w << 6) + 63 - __builtin_clzll(word));
+		if (--w < 0)
+			return (-1);
+		word = words[w];
+	}
+}
+
+//
+// Count
+//
+// Desc: Number of set bits in [from, end), counted a word at a time
+// In:   from, end - range to count
+// Ret:  number of set bits
+//
+int PF_Bitmap::Count(int from, int end) const
+{
+	if (end > numBits)
+		end = numBits;
+	if (from < 0)
+		from = 0;
+	if (from >= end)
+		return (0);
+
+	int w = from >> 6;
+	int last = (end - 1) >> 6;
+	int count = 0;
+	for (; w <= last; w++) {
+		unsigned long long word = words[w];
+		if (w == from >> 6)
+			word &= ~0ULL << (from & 63);
+		if (w == last && (end & 63))
+			word &= (1ULL << (end & 63)) - 1;
+		count += __builtin_popcountll(word);
+	}
+	return (count);
+}
+
+//
+// Load
+//
+// Desc: Set bits [first, first + 8*numBytes) from bytes read from the
+//       file.  Bits past Size() are ignored.
+// In:   first - first bit, a multiple of 8
+//       pData - bytes of the file
+//       numBytes - number of bytes
+//
+void PF_Bitmap::Load(int first, const char *pData, int numBytes)
+{
+	for (int i = 0; i < numBytes && first + 8 * i < numBits; i++) {
+		int bit = first + 8 * i;
+		unsigned long long byte = (unsigned char)pData[i];
+		words[bit >> 6] &= ~(0xffULL << (bit & 63));
+		words[bit >> 6] |= byte << (bit & 63);
+	}
+}
+
+//
+// Store
+//
+// Desc: Write bits [first, first + 8*numBytes) as bytes for the file.
+//       Bits past Size() are written as 0.
+// In:   first - first bit, a multiple of 8
+//       numBytes - number of bytes
+// Out:  pData - bytes to write
+//
+void PF_Bitmap::Store(int first, char *pData, int numBytes) const
+{
+	for (int i = 0; i < numBytes; i++) {
+		int bit = first + 8 * i;
+		pData[i] = (bit < numBits) ?
+			(char)(words[bit >> 6] >> (bit & 63)) : 0;
+	}
+}
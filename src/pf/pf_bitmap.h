@@ -0,0 +1,59 @@
+//
+// File:        pf_bitmap.h
+// Description: PF_Bitmap class interface
+//
+// GetNextPage used to fetch every page after the current one until it
+// found a used page, so each disposed page was read from the file only
+// to learn that it was free.  A paged file now keeps one bit per page,
+// set when the page is used, and the scans look for the next used or
+// free page in memory, 64 pages at a time.
+//
+
+#ifndef PF_BITMAP_H
+#define PF_BITMAP_H
+
+#include <vector>
+
+//
+// PF_Bitmap - one bit per page of a file, set if the page is used
+//
+// The bits are stored in 64 bit words.  Load and Store copy them to and
+// from the bytes kept in the file, bit i being bit i%8 of byte i/8, so
+// that the file does not depend on the byte order of the machine.
+//
+class PF_Bitmap {
+public:
+	PF_Bitmap  () : numBits(0) {}
+
+	// Make room for numBits bits, the new ones are clear
+	void Resize    (int numBits);
+	int  Size      () const { return numBits; }
+
+	void Set       (int bit)
+		{ words[bit >> 6] |= 1ULL << (bit & 63); }
+	void Clear     (int bit)
+		{ words[bit >> 6] &= ~(1ULL << (bit & 63)); }
+	int  Test      (int bit) const
+		{ return ((words[bit >> 6] >> (bit & 63)) & 1); }
+
+	// First set (clear) bit in [from, end), -1 if there is none
+	int  NextSet   (int from, int end) const;
+	int  NextClear (int from, int end) const;
+	// Last set bit in [0, from], -1 if there is none
+	int  PrevSet   (int from) const;
+	// Number of set bits in [from, end)
+	int  Count     (int from, int end) const;
+
+	// Copy bits [first, first + 8*numBytes) from or to the file format.
+	// first must be a multiple of 8.
+	void Load      (int first, const char *pData, int numBytes);
+	void Store     (int first, char *pData, int numBytes) const;
+
+private:
+	int  Next      (int from, int end, unsigned long long flip) const;
+
+	std::vector<unsigned long long> words;
+	int numBits;
+};
+
+#endif
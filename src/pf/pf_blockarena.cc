@@ -0,0 +1,214 @@
+//
+// File:        pf_blockarena.cc
+// Description: PF_BlockArena class implementation
+//
+// A block starts with a pointer to the block taken before it, in a header
+// of PF_ARENA_MIN_CLASS bytes which keeps the objects aligned, so that
+// Release can walk the blocks without a list of its own.  A freed object
+// holds the pointer to the next one of its size.
+//
+
+#include "pf_internal.h"
+
+//
+// SizeClass
+//
+// Desc: Size class of an object
+// In:   size - bytes asked for, at most PF_ARENA_MAX_CLASS
+// Ret:  index in the free lists; the class holds PF_ARENA_MIN_CLASS << index
+//       bytes
+//
+static int SizeClass(int size)
+{
+	int index = 0;
+	while ((PF_ARENA_MIN_CLASS << index) < size)
+		index++;
+	return (index);
+}
+
+//
+// RoundUp
+//
+// Desc: Bytes taken by an object: its size class, or the size rounded up
+//       to the alignment if it is larger than every class
+//
+static int RoundUp(int size)
+{
+	if (size > PF_ARENA_MAX_CLASS)
+		return ((size + PF_ARENA_MIN_CLASS - 1) & ~(PF_ARENA_MIN_CLASS - 1));
+	return (PF_ARENA_MIN_CLASS << SizeClass(size));
+}
+
+//
+// PF_BlockArena
+//
+// Desc: Constructor.  No block is taken until the first Alloc.
+// In:   pfm - manager of the buffer the blocks come from
+//       budget - most bytes of blocks held at once, or 0 for no budget
+//
+PF_BlockArena::PF_BlockArena(PF_Manager &pfm, long long budget)
+{
+	this->pPfm = &pfm;
+	this->pBlock = NULL;
+	this->used = 0;
+	this->budget = budget < 0 ? 0 : budget;
+	this->bytesHeld = 0;
+	memset(freeList, 0, sizeof(freeList));
+}
+
+//
+// ~PF_BlockArena
+//
+// Desc: Destructor, gives the blocks back to the buffer
+//
+PF_BlockArena::~PF_BlockArena()
+{
+	Release();
+}
+
+//
+// NewBlock
+//
+// Desc: Take a block from the buffer and allocate from it from now on.
+//       What is left at the end of the current block is cut into pieces
+//       of the size classes and put on the free lists.
+// Ret:  PF_OVERBUDGET if the block would go over the budget, or the
+//       errors of AllocateBlock
+//
+RC PF_BlockArena::NewBlock()
+{
+	char *pNew;
+	RC rc;
+
+	if (budget && bytesHeld + PF_DEFAULT_PAGE_SIZE > budget)
+		return (PF_OVERBUDGET);
+	if ((rc = pPfm->AllocateBlock(pNew)))
+		return (rc);
+
+	if (pBlock) {
+		for (int index = PF_ARENA_CLASSES - 1; index >= 0; index--) {
+			int classSize = PF_ARENA_MIN_CLASS << index;
+			while (PF_DEFAULT_PAGE_SIZE - used >= classSize) {
+				char *pObj = pBlock + used;
+				memcpy(pObj, &freeList[index], sizeof(char *));
+				freeList[index] = pObj;
+				used += classSize;
+			}
+		}
+	}
+
+	memcpy(pNew, &pBlock, sizeof(char *));
+	pBlock = pNew;
+	used = PF_ARENA_MIN_CLASS;
+	bytesHeld += PF_DEFAULT_PAGE_SIZE;
+	return (0);
+}
+
+//
+// Alloc
+//
+// Desc: Allocate an object.  The object lives until it is freed or the
+//       blocks are released.
+// In:   size - bytes needed, 1 to PF_ARENA_MAX_ALLOC
+// Out:  pData - the object, aligned on PF_ARENA_MIN_CLASS bytes
+// Ret:  PF_BADPARAM for a bad size, PF_OVERBUDGET, PF_NOBUF if the buffer
+//       has no page left for a block
+//
+RC PF_BlockArena::Alloc(int size, char *&pData)
+{
+	RC rc;
+
+	if (size <= 0 || size > PF_ARENA_MAX_ALLOC)
+		return (PF_BADPARAM);
+
+	// An object of the same size freed before
+	if (size <= PF_ARENA_MAX_CLASS) {
+		int index = SizeClass(size);
+		if (freeList[index]) {
+			pData = freeList[index];
+			memcpy(&freeList[index], pData, sizeof(char *));
+			return (0);
+		}
+	}
+
+	int bytes = RoundUp(size);
+	if ((!pBlock || PF_DEFAULT_PAGE_SIZE - used < bytes) && (rc = NewBlock()))
+		return (rc);
+	pData = pBlock + used;
+	used += bytes;
+	return (0);
+}
+
+//
+// Free
+//
+// Desc: Put an object back on the list of its size for Alloc to reuse.
+//       The objects larger than PF_ARENA_MAX_CLASS are only given back by
+//       Release.
+// In:   pData - object from Alloc of this arena
+//       size - size it was allocated with
+// Ret:  PF_BADPARAM for a bad size
+//
+RC PF_BlockArena::Free(char *pData, int size)
+{
+	if (pData == NULL || size <= 0 || size > PF_ARENA_MAX_ALLOC)
+		return (PF_BADPARAM);
+	if (size > PF_ARENA_MAX_CLASS)
+		return (0);
+
+	int index = SizeClass(size);
+	memcpy(pData, &freeList[index], sizeof(char *));
+	freeList[index] = pData;
+	return (0);
+}
+
+//
+// Release
+//
+// Desc: Give every block back to the buffer.  The objects allocated are
+//       gone; the arena can be used again.
+// Ret:  the first error of DisposeBlock
+//
+RC PF_BlockArena::Release()
+{
+	RC rc = 0, rcBlock;
+
+	while (pBlock) {
+		char *pLast;
+		memcpy(&pLast, pBlock, sizeof(char *));
+		if ((rcBlock = pPfm->DisposeBlock(pBlock)) && !rc)
+			rc = rcBlock;
+		pBlock = pLast;
+	}
+	used = 0;
+	bytesHeld = 0;
+	memset(freeList, 0, sizeof(freeList));
+	return (rc);
+}
+
+//
+// SetBudget
+//
+// Desc: Change the budget.  The blocks already held are kept even if they
+//       go over it, but no more are taken while they do.
+// In:   budget - most bytes of blocks held at once, or 0 for no budget
+// Ret:  PF_BADPARAM if budget is negative
+//
+RC PF_BlockArena::SetBudget(long long budget)
+{
+	if (budget < 0)
+		return (PF_BADPARAM);
+	this->budget = budget;
+	return (0);
+}
+
+//
+// GetBytesHeld
+//
+// Desc: Bytes of the blocks taken from the buffer, which the budget is
+//       charged with
+//
+long long PF_BlockArena::GetBytesHeld() const
+{
+	return (bytesHeld);
+}
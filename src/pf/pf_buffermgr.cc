@@ -11,24 +11,32 @@
 //       relevant stats.  This differs from PF_LOG in that it can give a
 //       summary of the calls.  See statistics.h for interface and
 //       pf_test2.cc for a demo.
-// 1998: The statistics manager is now instantiated in this file and is
-//       created and destroyed by the buffer manager.
+// 1998: The statistics counters, pfStats and pfTimes, are defined in
+//       this file (see statcounters.h).
 //
 
 #include <cstdio>
 #include <unistd.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
 #include <iostream>
+#include <vector>
+#include <algorithm>
 #include "pf_buffermgr.h"
+#include "pf_compress.h"
 
 using namespace std;
 
 // The switch PF_STATS indicates that the user wishes to have statistics
 // tracked for the PF layer
 #ifdef PF_STATS
-#include "statistics.h"   // For StatisticsMgr interface
+#include "statistics.h"   // For the PF statistics keys
 
-// Global variable for the statistics manager
-StatisticsMgr *pStatisticsMgr;
+// Global counters and latencies of the PF layer.  Each thread counts in
+// its own copy, so the shards do not share a latch for them.
+StatCounters pfStats(PF_NUM_STATS, PF_STAT_NAMES);
+StatHistograms pfTimes(PF_NUM_TIMES, PF_TIME_NAMES);
+#define PF_STATS_ADDONE(key) pfStats.Add(key)
 #endif
 
 #ifdef PF_LOG
@@ -76,6 +84,8 @@ void WriteLog(const char *psMessage)
 #endif
 
 
+
+
 //
 // PF_BufferMgr
 //
@@ -84,25 +94,43 @@ void WriteLog(const char *psMessage)
 //       it checks if it is in the buffer.  If so, it pins the page (pages
 //       can be pinned multiple times).  If not, it reads it from the file
 //       and pins it.  If the buffer is full and a new page needs to be
-//       inserted, an unpinned page is replaced according to an LRU
-// In:   numPages - the number of pages in the buffer
-//
-// Note: The constructor will initialize the global pStatisticsMgr.  We
-//       make it global so that other components may use it and to allow
-//       easy access.
+//       inserted, an unpinned page is replaced according to the
+//       replacement policy.
+// In:   numPages - the number of pages in the buffer, for each page size
+//       policy - page replacement policy (see pf_replacer.h)
+//       numShards - number of independently latched partitions.  Each
+//                   shard replaces its own pages, so a single shard
+//                   gives an exact policy over the whole buffer.
+//
+// Note: The constructor will reset the global pfStats and pfTimes.  We
+//       make them global so that other components may use them and to
+//       allow easy access.
 //
 // Aut2003
 // numPages changed to _numPages for to eliminate CC warnings
 
-PF_BufferMgr::PF_BufferMgr(int _numPages) : hashTable(PF_HASH_TBL_SIZE)
+PF_BufferMgr::PF_BufferMgr(int _numPages, PF_ReplacePolicy _policy,
+		int _numShards)
 {
 	// Initialize local variables
 	this->numPages = _numPages;
-	pageSize = PF_PAGE_SIZE + sizeof(PF_PageHdr);
+	this->policy = _policy;
+	this->numShards = _numShards;
+	if (numShards < 1)
+		numShards = 1;
+	if (numShards > numPages)
+		numShards = numPages;
+	nextBlockShard = 0;
+	readAheadPages = 0;
+	pReadAhead = NULL;
+	pBgWriter = NULL;
+	bHugePages = FALSE;
+	numCompressed = 0;
 
 #ifdef PF_STATS
-	// Initialize the global variable for the statistics manager
-	pStatisticsMgr = new StatisticsMgr();
+	// Start the global statistics from 0
+	pfStats.Reset();
+	pfTimes.Reset();
 #endif
 
 #ifdef PF_LOG
@@ -112,25 +140,9 @@ PF_BufferMgr::PF_BufferMgr(int _numPages) : hashTable(PF_HASH_TBL_SIZE)
 	WriteLog(psMessage);
 #endif
 
-	// Allocate memory for buffer page description table
-	bufTable = new PF_BufPageDesc[numPages];
-
-	// Initialize the buffer table and allocate memory for buffer pages.
-	// Initially, the free list contains all pages
-	for (int i = 0; i < numPages; i++) {
-		if ((bufTable[i].pData = new char[pageSize]) == NULL) {
-			cerr << "Not enough memory for buffer\n";
-			exit(1);
-		}
-
-		memset ((void *)bufTable[i].pData, 0, pageSize);
-
-		bufTable[i].prev = i - 1;
-		bufTable[i].next = i + 1;
-	}
-	bufTable[0].prev = bufTable[numPages - 1].next = INVALID_SLOT;
-	free = 0;
-	first = last = INVALID_SLOT;
+	// The shards of the other page sizes are set up when they are needed
+	shards = new PF_BufShard[numShards * PF_NUM_PAGE_SIZES];
+	UsePageSize(PF_DEFAULT_PAGE_SIZE);
 
 #ifdef PF_LOG
 	WriteLog("Succesfully created the buffer manager.\n");
@@ -144,22 +156,143 @@ PF_BufferMgr::PF_BufferMgr(int _numPages) : hashTable(PF_HASH_TBL_SIZE)
 //
 PF_BufferMgr::~PF_BufferMgr()
 {
-	// Free up buffer pages and tables
-	for (int i = 0; i < this->numPages; i++)
-		delete [] bufTable[i].pData;
-
-	delete [] bufTable;
+	// Stop the helper threads before the pages go away
+	delete pReadAhead;
+	delete pBgWriter;
 
-#ifdef PF_STATS
-	// Destroy the global statistics manager
-	delete pStatisticsMgr;
-#endif
+	// Free up buffer pages and tables
+	for (int s = 0; s < numShards * PF_NUM_PAGE_SIZES; s++) {
+		delete [] shards[s].bufTable;
+		delete shards[s].pReplacer;
+	}
+	delete [] shards;
+	for (int c = 0; c < PF_NUM_PAGE_SIZES; c++)
+		for (size_t a = 0; a < arenas[c].size(); a++)
+			FreeArena(arenas[c][a].pFrames, arenas[c][a].numPages,
+					PF_DEFAULT_PAGE_SIZE << c);
 
 #ifdef PF_LOG
 	WriteLog("Destroyed the buffer manager.\n");
 #endif
 }
 
+//
+// UsePageSize
+//
+// Desc: Set up the shards of a page size, unless it is done already.
+//       Called when a file is opened.  The numPages frames of the size
+//       are spread over numShards shards, like those of the default size.
+// In:   pageSize - size of the pages of the file
+// Ret:  PF_BADPARAM if pageSize is not allowed
+//
+RC PF_BufferMgr::UsePageSize(int pageSize)
+{
+	int c = PF_PageSizeClass(pageSize);
+	if (c < 0)
+		return (PF_BADPARAM);
+
+	std::lock_guard<std::mutex> guard(helperLatch);
+	if (!arenas[c].empty())
+		return (0);
+
+	// Each shard takes the next frames of the arena.  The shards are
+	// still empty, but other threads may look at them.
+	PF_Arena arena;
+	arena.pFrames = AllocArena(numPages, pageSize);
+	arena.numPages = numPages;
+	char *pFrames = arena.pFrames;
+	for (int i = 0; i < numShards; i++) {
+		PF_BufShard &sh = shards[c * numShards + i];
+		std::lock_guard<std::mutex> shGuard(sh.latch);
+		InitShard(sh, ShardPages(numPages, i), pageSize, pFrames);
+		pFrames += sh.numPages * (size_t)pageSize;
+	}
+	arenas[c].push_back(arena);
+
+	return (0);
+}
+
+//
+// AllocArena
+//
+// Desc: Internal.  Allocate the frames of numPages pages in one piece.
+//       The arena is mapped, so it is aligned on a page of the system
+//       and zeroed.
+// In:   numPages - number of frames
+//       pageSize - size of the frames
+// Ret:  the arena, exits if there is not enough memory
+//
+char *PF_BufferMgr::AllocArena(int numPages, int pageSize)
+{
+	size_t length = numPages * (size_t)pageSize;
+	void *p = mmap(NULL, length, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (p == MAP_FAILED) {
+		cerr << "Not enough memory for buffer\n";
+		exit(1);
+	}
+
+#ifdef MADV_HUGEPAGE
+	if (bHugePages)
+		madvise(p, length, MADV_HUGEPAGE);
+#endif
+
+	return ((char *)p);
+}
+
+//
+// FreeArena
+//
+// Desc: Internal.  Free an arena returned by AllocArena
+// In:   pArena - the arena
+//       numPages, pageSize - number and size of its frames
+//
+void PF_BufferMgr::FreeArena(char *pArena, int numPages, int pageSize)
+{
+	munmap(pArena, numPages * (size_t)pageSize);
+}
+
+//
+// InitShard
+//
+// Desc: Internal.  Allocate the buffer table of a shard and give it its
+//       frames.  Initially, the free list contains all pages.
+// In:   sh - shard to set up
+//       _numPages - number of pages of the shard
+//       pageSize - size of the pages of the shard
+//       pFrames - the _numPages frames of the shard
+// Ret:  PF return code
+//
+RC PF_BufferMgr::InitShard(PF_BufShard &sh, int _numPages, int pageSize,
+		char *pFrames)
+{
+	sh.numPages = sh.numSlots = _numPages;
+	sh.pageSize = pageSize;
+	sh.pReplacer = PF_NewReplacer(policy, sh.numPages);
+	sh.hashTable.Resize(sh.numPages);
+
+	// Allocate memory for buffer page description table
+	sh.bufTable = new PF_BufPageDesc[sh.numPages];
+
+	// Initialize the buffer table.  Initially, the free list contains
+	// all pages
+	for (int i = 0; i < sh.numPages; i++) {
+		sh.bufTable[i].pData = pFrames + i * (size_t)pageSize;
+		sh.bufTable[i].prev = i - 1;
+		sh.bufTable[i].next = i + 1;
+		sh.bufTable[i].pinCount = 0;
+		sh.bufTable[i].pinStart = 0;
+		sh.bufTable[i].bIoPending = FALSE;
+		sh.bufTable[i].bRing = FALSE;
+	}
+	sh.bufTable[0].prev = sh.bufTable[sh.numPages - 1].next = INVALID_SLOT;
+	sh.free = 0;
+	sh.first = sh.last = sh.spare = INVALID_SLOT;
+
+	// Return ok
+	return (0);
+}
+
 //
 // GetPage
 //
@@ -168,18 +301,28 @@ PF_BufferMgr::~PF_BufferMgr()
 //       to it.  If the page is not in the buffer, read it from the file,
 //       pin it, and return a pointer to it.  If the buffer is full,
 //       replace an unpinned page.
+//       The read is done without holding the shard latch.  The page is
+//       pinned and marked bIoPending meanwhile, so that it cannot be
+//       replaced and so that other threads asking for it wait.
 // In:   fd - OS file descriptor of the file to read
+//       pageSize - size of the pages of the file
 //       pageNum - number of the page to read
 //       bMultiplePins - if FALSE, it is an error to ask for a page that is
 //                       already pinned in the buffer.
+//       hint - SEQUENTIAL_SCAN and ONE_SHOT read a missing page into the
+//              scan ring, and a hit is not a new reference for the
+//              policy.  Without them, a hit takes the page out of the ring.
 // Out:  ppBuffer - set *ppBuffer to point to the page in the buffer
+//       pSlot - if not NULL, set *pSlot to the slot of the page
 // Ret:  PF return code
 //
-RC PF_BufferMgr::GetPage(int fd, PageNum pageNum, char **ppBuffer,
-		int bMultiplePins)
+RC PF_BufferMgr::GetPage(int fd, int pageSize, PageNum pageNum,
+		char **ppBuffer, int bMultiplePins, int *pSlot, ClientHint hint)
 {
 	RC  rc;     // return code
 	int slot;   // buffer slot where page is located
+	PF_BufShard &sh = ShardOf(fd, pageSize, pageNum);
+	std::unique_lock<std::mutex> guard(sh.latch);
 
 #ifdef PF_LOG
 	char psMessage[100];
@@ -189,37 +332,28 @@ RC PF_BufferMgr::GetPage(int fd, PageNum pageNum, char **ppBuffer,
 
 
 #ifdef PF_STATS
-	pStatisticsMgr->Register(PF_GETPAGE, STAT_ADDONE);
+	PF_STATS_ADDONE(PF_GETPAGE);
 #endif
 
-	// Search for page in buffer
-	if ((rc = hashTable.Find(fd, pageNum, slot)) &&
-			(rc != PF_HASHNOTFOUND))
+	// Search for page in buffer, waiting for a read of it to finish
+	while (!(rc = sh.hashTable.Find(fd, pageNum, slot)) &&
+			sh.bufTable[slot].bIoPending)
+		sh.ioDone.wait(guard);
+	if (rc && rc != PF_HASHNOTFOUND)
 		return (rc);                // unexpected error
 
 	// If page not in buffer...
 	if (rc == PF_HASHNOTFOUND) {
 
 #ifdef PF_STATS
-	pStatisticsMgr->Register(PF_PAGENOTFOUND, STAT_ADDONE);
+	PF_STATS_ADDONE(PF_PAGENOTFOUND);
 #endif
 
-		// Allocate an empty page, this will also promote the newly allocated
-		// page to the MRU slot
-		if ((rc = InternalAlloc(slot)))
-			return (rc);
-
-		// read the page, insert it into the hash table,
-		// and initialize the page description entry
-		if ((rc = ReadPage(fd, pageNum, bufTable[slot].pData)) ||
-				(rc = hashTable.Insert(fd, pageNum, slot)) ||
-				(rc = InitPageDesc(fd, pageNum, slot))) {
-
-			// Put the slot back on the free list before returning the error
-			Unlink(slot);
-			InsertFree(slot);
+		// Read the page into a free or replaced slot
+		if ((rc = InternalRead(sh, guard, fd, pageNum, slot,
+				PF_UseRing(hint))))
 			return (rc);
-		}
+		StatsOf(sh, fd).misses++;
 #ifdef PF_LOG
 	WriteLog("Page not found in buffer. Loaded.\n");
 #endif
@@ -227,47 +361,205 @@ RC PF_BufferMgr::GetPage(int fd, PageNum pageNum, char **ppBuffer,
 	else {   // Page is in the buffer...
 
 #ifdef PF_STATS
-	pStatisticsMgr->Register(PF_PAGEFOUND, STAT_ADDONE);
+	PF_STATS_ADDONE(PF_PAGEFOUND);
 #endif
 
 		// Error if we don't want to get a pinned page
-		if (!bMultiplePins && bufTable[slot].pinCount > 0)
+		if (!bMultiplePins && sh.bufTable[slot].pinCount > 0)
 			return (PF_PAGEPINNED);
 
 		// Page is alredy in memory, just increment pin count
-		bufTable[slot].pinCount++;
+		sh.bufTable[slot].pinCount++;
+		StatsOf(sh, fd).hits++;
 #ifdef PF_LOG
 		sprintf (psMessage, "Page found in buffer.  %d pin count.\n",
-				bufTable[slot].pinCount);
+				sh.bufTable[slot].pinCount.load());
 		WriteLog(psMessage);
 #endif
 
-		// Make this page the most recently used page
-		if ((rc = Unlink(slot)) ||
-				(rc = LinkHead (slot)))
-			return (rc);
+		// Tell the replacement policy about the new reference, unless the
+		// page is only passed over by a scan.  A page asked for again
+		// without a hint is kept out of the ring.
+		if (!PF_UseRing(hint)) {
+			sh.bufTable[slot].bRing = FALSE;
+			sh.pReplacer->Access(slot, TRUE);
+		}
 	}
 
+	// The pin is timed from the first user
+	if (!sh.bufTable[slot].pinStart)
+		sh.bufTable[slot].pinStart = PF_Nanos();
+
 	// Point ppBuffer to page
-	*ppBuffer = bufTable[slot].pData;
+	*ppBuffer = sh.bufTable[slot].pData;
+	if (pSlot)
+		*pSlot = slot;
 
 	// Return ok
 	return (0);
 }
 
+//
+// InternalRead
+//
+// Desc: Internal.  Read a page which is not in the buffer into a slot and
+//       pin it.  The slot is pinned and marked bIoPending while the page
+//       is read without the shard latch, so that it cannot be replaced
+//       and so that other threads asking for the page wait.
+// In:   sh - shard of the page, its latch is held through guard
+//       guard - lock of the shard latch
+//       fd - OS file descriptor of the file to read
+//       pageNum - number of the page to read
+//       bRing - TRUE to read the page into the scan ring
+// Out:  slot - slot of the page
+// Ret:  PF return code
+//
+RC PF_BufferMgr::InternalRead(PF_BufShard &sh,
+		std::unique_lock<std::mutex> &guard, int fd, PageNum pageNum,
+		int &slot, int bRing)
+{
+	RC rc;
+
+	// Allocate an empty page, this will also link the newly allocated
+	// page at the head of the used list
+	if ((rc = InternalAlloc(sh, slot, bRing)))
+		return (rc);
+
+	// Insert the page into the hash table and initialize the page
+	// description entry, so that nobody else reads it meanwhile
+	if ((rc = sh.hashTable.Insert(fd, pageNum, slot)) ||
+			(rc = InitPageDesc(sh, fd, pageNum, slot))) {
+
+		// Put the slot back on the free list before returning the error
+		Unlink(sh, slot);
+		InsertFree(sh, slot);
+		return (rc);
+	}
+	sh.bufTable[slot].bIoPending = TRUE;
+	sh.numIoPending++;
+
+	// Read the page
+	guard.unlock();
+	rc = ReadPage(fd, sh.pageSize, pageNum, sh.bufTable[slot].pData);
+	guard.lock();
+
+	sh.bufTable[slot].bIoPending = FALSE;
+	sh.numIoPending--;
+	sh.ioDone.notify_all();
+
+	if (rc) {
+		// Put the slot back on the free list before returning the error
+		sh.bufTable[slot].pinCount = 0;
+		sh.pReplacer->Remove(slot);
+		sh.hashTable.Delete(fd, pageNum);
+		Unlink(sh, slot);
+		InsertFree(sh, slot);
+		return (rc);
+	}
+
+	// Return ok
+	return (0);
+}
+
+//
+// PrefetchPage
+//
+// Desc: Load a page into the buffer without pinning it, unless it is
+//       already there.  Called by the read-ahead threads.
+// In:   fd - OS file descriptor of the file to read
+//       pageSize - size of the pages of the file
+//       pageNum - number of the page to read
+//       hint - hint of the reader the page is loaded for
+// Ret:  PF_NOBUF if all pages are pinned, other PF return code otherwise
+//
+RC PF_BufferMgr::PrefetchPage(int fd, int pageSize, PageNum pageNum,
+		ClientHint hint)
+{
+	RC  rc;     // return code
+	int slot;   // buffer slot where page is located
+	PF_BufShard &sh = ShardOf(fd, pageSize, pageNum);
+	std::unique_lock<std::mutex> guard(sh.latch);
+
+	// Nothing to do if the page is there or being read
+	if (!(rc = sh.hashTable.Find(fd, pageNum, slot)))
+		return (0);
+	if (rc != PF_HASHNOTFOUND)
+		return (rc);
+
+	if ((rc = InternalRead(sh, guard, fd, pageNum, slot, PF_UseRing(hint))))
+		return (rc);
+
+#ifdef PF_STATS
+	PF_STATS_ADDONE(PF_PREFETCHPAGE);
+#endif
+
+	// Release the pin taken for the read.  The page is not counted as a
+	// reference by the policy until somebody asks for it.
+	if (--(sh.bufTable[slot].pinCount) == 0)
+		sh.pReplacer->Access(slot, FALSE);
+
+	// Return ok
+	return (0);
+}
+
+//
+// ResidentPages
+//
+// Desc: List the pages of a file held by the buffer, with how hot they
+//       are.  The heat of a page is its rank in the order in which the
+//       policy of its shard would replace the pages, from near 0 for the
+//       next victim to 1 for a pinned page.
+// In:   fd - OS file descriptor of the file
+//       pageSize - size of the pages of the file
+// Out:  pages - (heat, page number) of each page, in no particular order
+// Ret:  0 for success
+//
+RC PF_BufferMgr::ResidentPages(int fd, int pageSize,
+		std::vector<std::pair<double, PageNum> > &pages)
+{
+	int c = PF_PageSizeClass(pageSize);
+
+	for (int s = c * numShards; s < (c + 1) * numShards; s++) {
+		PF_BufShard &sh = shards[s];
+		std::lock_guard<std::mutex> guard(sh.latch);
+
+		if (sh.first == INVALID_SLOT)
+			continue;
+
+		std::vector<int> slots(sh.numSlots);
+		std::vector<double> heat(sh.numSlots, 1.0);
+		int n = sh.pReplacer->Coldest(sh.bufTable, &slots[0], sh.numSlots);
+		for (int i = 0; i < n; i++)
+			heat[slots[i]] = (double)(i + 1) / (n + 1);
+
+		for (int slot = sh.first; slot != INVALID_SLOT;
+				slot = sh.bufTable[slot].next)
+			if (sh.bufTable[slot].fd == fd && !sh.bufTable[slot].bIoPending)
+				pages.push_back(std::make_pair(heat[slot],
+						sh.bufTable[slot].pageNum));
+	}
+
+	return (0);
+}
+
 //
 // AllocatePage
 //
 // Desc: Allocate a new page in the buffer and return a pointer to it.
 // In:   fd - OS file descriptor of the file associated with the new page
+//       pageSize - size of the pages of the file
 //       pageNum - number of the new page
 // Out:  ppBuffer - set *ppBuffer to point to the page in the buffer
+//       pSlot - if not NULL, set *pSlot to the slot of the page
 // Ret:  PF return code
 //
-RC PF_BufferMgr::AllocatePage(int fd, PageNum pageNum, char **ppBuffer)
+RC PF_BufferMgr::AllocatePage(int fd, int pageSize, PageNum pageNum,
+		char **ppBuffer, int *pSlot)
 {
 	RC  rc;     // return code
 	int slot;   // buffer slot where page is located
+	PF_BufShard &sh = ShardOf(fd, pageSize, pageNum);
+	std::lock_guard<std::mutex> guard(sh.latch);
 
 #ifdef PF_LOG
 	char psMessage[100];
@@ -276,32 +568,35 @@ RC PF_BufferMgr::AllocatePage(int fd, PageNum pageNum, char **ppBuffer)
 #endif
 
 	// If page is already in buffer, return an error
-	if (!(rc = hashTable.Find(fd, pageNum, slot)))
+	if (!(rc = sh.hashTable.Find(fd, pageNum, slot)))
 		return (PF_PAGEINBUF);
 	else if (rc != PF_HASHNOTFOUND)
 		return (rc);              // unexpected error
 
 	// Allocate an empty page
-	if ((rc = InternalAlloc(slot)))
+	if ((rc = InternalAlloc(sh, slot)))
 		return (rc);
 
 	// Insert the page into the hash table,
 	// and initialize the page description entry
-	if ((rc = hashTable.Insert(fd, pageNum, slot)) ||
-			(rc = InitPageDesc(fd, pageNum, slot))) {
+	if ((rc = sh.hashTable.Insert(fd, pageNum, slot)) ||
+			(rc = InitPageDesc(sh, fd, pageNum, slot))) {
 
 		// Put the slot back on the free list before returning the error
-		Unlink(slot);
-		InsertFree(slot);
+		Unlink(sh, slot);
+		InsertFree(sh, slot);
 		return (rc);
 	}
 
 #ifdef PF_LOG
 	WriteLog("Succesfully allocated page.\n");
 #endif
+	sh.bufTable[slot].pinStart = PF_Nanos();
 
 	// Point ppBuffer to page
-	*ppBuffer = bufTable[slot].pData;
+	*ppBuffer = sh.bufTable[slot].pData;
+	if (pSlot)
+		*pSlot = slot;
 
 	// Return ok
 	return (0);
@@ -313,13 +608,16 @@ RC PF_BufferMgr::AllocatePage(int fd, PageNum pageNum, char **ppBuffer)
 // Desc: Mark a page dirty so that when it is discarded from the buffer
 //       it will be written back to the file.
 // In:   fd - OS file descriptor of the file associated with the page
+//       pageSize - size of the pages of the file
 //       pageNum - number of the page to mark dirty
+//       slot - slot of the page given by GetPage, or INVALID_SLOT
 // Ret:  PF return code
 //
-RC PF_BufferMgr::MarkDirty(int fd, PageNum pageNum)
+RC PF_BufferMgr::MarkDirty(int fd, int pageSize, PageNum pageNum, int slot)
 {
 	RC  rc;       // return code
-	int slot;     // buffer slot where page is located
+	PF_BufShard &sh = ShardOf(fd, pageSize, pageNum);
+	std::lock_guard<std::mutex> guard(sh.latch);
 
 #ifdef PF_LOG
 	char psMessage[100];
@@ -328,23 +626,14 @@ RC PF_BufferMgr::MarkDirty(int fd, PageNum pageNum)
 #endif
 
 	// The page must be found and pinned in the buffer
-	if ((rc = hashTable.Find(fd, pageNum, slot))){
-		if (rc == PF_HASHNOTFOUND)
-			return (PF_PAGENOTINBUF);
-		else
-			return (rc);              // unexpected error
-	}
-
-	if (bufTable[slot].pinCount == 0)
-		return (PF_PAGEUNPINNED);
+	if ((rc = FindPinned(sh, fd, pageNum, slot)))
+		return (rc);
 
 	// Mark this page dirty
-	bufTable[slot].bDirty = TRUE;
+	sh.bufTable[slot].bDirty = TRUE;
 
-	// Make this page the most recently used page
-	if ((rc = Unlink(slot)) ||
-			(rc = LinkHead (slot)))
-		return (rc);
+	// The page is still in use
+	sh.pReplacer->Access(slot, FALSE);
 
 	// Return ok
 	return (0);
@@ -355,48 +644,102 @@ RC PF_BufferMgr::MarkDirty(int fd, PageNum pageNum)
 //
 // Desc: Unpin a page so that it can be discarded from the buffer.
 // In:   fd - OS file descriptor of the file associated with the page
+//       pageSize - size of the pages of the file
 //       pageNum - number of the page to unpin
+//       slot - slot of the page given by GetPage, or INVALID_SLOT
 // Ret:  PF return code
 //
-RC PF_BufferMgr::UnpinPage(int fd, PageNum pageNum)
+RC PF_BufferMgr::UnpinPage(int fd, int pageSize, PageNum pageNum, int slot)
+{
+	PF_BufShard &sh = ShardOf(fd, pageSize, pageNum);
+	std::lock_guard<std::mutex> guard(sh.latch);
+
+	return (InternalUnpin(sh, fd, pageNum, slot));
+}
+
+//
+// InternalUnpin
+//
+// Desc: Internal.  Unpin a page of a shard whose latch is held.
+// In:   sh - shard holding the page
+//       fd - OS file descriptor of the file associated with the page
+//       pageNum - number of the page to unpin
+//       slot - slot of the page given by GetPage, or INVALID_SLOT
+// Ret:  PF return code
+//
+RC PF_BufferMgr::InternalUnpin(PF_BufShard &sh, int fd, PageNum pageNum,
+		int slot)
 {
 	RC  rc;       // return code
-	int slot;     // buffer slot where page is located
 
 	// The page must be found and pinned in the buffer
-	if ((rc = hashTable.Find(fd, pageNum, slot))){
-		if (rc == PF_HASHNOTFOUND)
-			return (PF_PAGENOTINBUF);
-		else
-			return (rc);              // unexpected error
-	}
-
-	if (bufTable[slot].pinCount == 0)
-		return (PF_PAGEUNPINNED);
+	if ((rc = FindPinned(sh, fd, pageNum, slot)))
+		return (rc);
 
 #ifdef PF_LOG
 	char psMessage[100];
 	sprintf (psMessage, "Unpinning (%d,%d). %d Pin count\n",
-			fd, pageNum, bufTable[slot].pinCount-1);
+			fd, pageNum, sh.bufTable[slot].pinCount.load()-1);
 	WriteLog(psMessage);
 #endif
 
-	// If unpinning the last pin, make it the most recently used page
-	if (--(bufTable[slot].pinCount) == 0) {
-		if ((rc = Unlink(slot)) ||
-				(rc = LinkHead (slot)))
-			return (rc);
+	// If unpinning the last pin, the page becomes a candidate for
+	// replacement; let the policy know it was used until now
+	if (--(sh.bufTable[slot].pinCount) == 0) {
+		sh.pReplacer->Access(slot, FALSE);
+		EndPin(sh, sh.bufTable[slot]);
 	}
 
 	// Return ok
 	return (0);
 }
 
+//
+// FindPinned
+//
+// Desc: Internal.  Find the slot of a page which must be pinned, in a
+//       shard whose latch is held.  A pinned page is never replaced nor
+//       moved, even by a resize, so the slot given with the page still
+//       holds it as long as it is pinned and the hash table is only
+//       searched when it does not, or when no slot is given.
+// In:   sh - shard holding the page
+//       fd - OS file descriptor of the file associated with the page
+//       pageNum - number of the page
+//       slot - slot to try first, or INVALID_SLOT
+// Out:  slot - slot of the page
+// Ret:  PF_PAGENOTINBUF, PF_PAGEUNPINNED, or other PF return code
+//
+RC PF_BufferMgr::FindPinned(PF_BufShard &sh, int fd, PageNum pageNum,
+		int &slot)
+{
+	RC  rc;       // return code
+
+	if (slot >= 0 && slot < sh.numSlots &&
+			sh.bufTable[slot].pinCount > 0 &&
+			sh.bufTable[slot].fd == fd &&
+			sh.bufTable[slot].pageNum == pageNum)
+		return (0);
+
+	if ((rc = sh.hashTable.Find(fd, pageNum, slot))){
+		if (rc == PF_HASHNOTFOUND)
+			return (PF_PAGENOTINBUF);
+		else
+			return (rc);              // unexpected error
+	}
+
+	if (sh.bufTable[slot].pinCount == 0)
+		return (PF_PAGEUNPINNED);
+
+	return (0);
+}
+
 //
 // FlushPages
 //
 // Desc: Release all pages for this file and put them onto the free list
 //       Returns a warning if any of the file's pages are pinned.
+//       The dirty pages are written first, in page order (see
+//       WriteDirtyPages).  All the shards are latched meanwhile.
 //       A linear search of the buffer is performed.
 //       A better method is not needed because # of buffers are small.
 // In:   fd - file descriptor
@@ -413,46 +756,51 @@ RC PF_BufferMgr::FlushPages(int fd)
 #endif
 
 #ifdef PF_STATS
-	pStatisticsMgr->Register(PF_FLUSHPAGES, STAT_ADDONE);
+	PF_STATS_ADDONE(PF_FLUSHPAGES);
 #endif
 
-	// Do a linear scan of the buffer to find pages belonging to the file
-	int slot = first;
-	while (slot != INVALID_SLOT) {
+	// The pages of the file must not be read behind our back
+	if (pReadAhead)
+		pReadAhead->Cancel(fd);
 
-		int next = bufTable[slot].next;
+	std::vector<std::unique_lock<std::mutex> > guards;
+	LatchShards(fd, ALL_PAGES, guards);
 
-		// If the page belongs to the passed-in file descriptor
-		if (bufTable[slot].fd == fd) {
+	// Write the dirty unpinned pages
+	if ((rc = WriteDirtyPages(fd, ALL_PAGES, FALSE)))
+		return (rc);
+
+	for (int s = 0; s < numShards * PF_NUM_PAGE_SIZES; s++) {
+		PF_BufShard &sh = shards[s];
+
+		// Do a linear scan of the shard to find pages belonging to the file
+		int slot = sh.first;
+		while (slot != INVALID_SLOT) {
+
+			int next = sh.bufTable[slot].next;
+
+			// If the page belongs to the passed-in file descriptor
+			if (sh.bufTable[slot].fd == fd) {
 
 #ifdef PF_LOG
- sprintf (psMessage, "Page (%d) is in buffer manager.\n", bufTable[slot].pageNum);
- WriteLog(psMessage);
-#endif
-			// Ensure the page is not pinned
-			if (bufTable[slot].pinCount) {
-				rcWarn = PF_PAGEPINNED;
-			}
-			else {
-				// Write the page if dirty
-				if (bufTable[slot].bDirty) {
-#ifdef PF_LOG
- sprintf (psMessage, "Page (%d) is dirty\n",bufTable[slot].pageNum);
+ sprintf (psMessage, "Page (%d) is in buffer manager.\n", sh.bufTable[slot].pageNum);
  WriteLog(psMessage);
 #endif
-					if ((rc = WritePage(fd, bufTable[slot].pageNum, bufTable[slot].pData)))
+				// Ensure the page is not pinned
+				if (sh.bufTable[slot].pinCount) {
+					rcWarn = PF_PAGEPINNED;
+				}
+				else {
+					// Remove page from the hash table and add the slot to the free list
+					sh.pReplacer->Remove(slot);
+					if ((rc = sh.hashTable.Delete(fd, sh.bufTable[slot].pageNum)) ||
+							(rc = Unlink(sh, slot)) ||
+							(rc = InsertFree(sh, slot)))
 						return (rc);
-					bufTable[slot].bDirty = FALSE;
 				}
-
-				// Remove page from the hash table and add the slot to the free list
-				if ((rc = hashTable.Delete(fd, bufTable[slot].pageNum)) ||
-						(rc = Unlink(slot)) ||
-						(rc = InsertFree(slot)))
-					return (rc);
 			}
+			slot = next;
 		}
-		slot = next;
 	}
 
 #ifdef PF_LOG
@@ -475,46 +823,231 @@ RC PF_BufferMgr::FlushPages(int fd)
 //
 RC PF_BufferMgr::ForcePages(int fd, PageNum pageNum)
 {
-	RC rc;  // return codes
-
 #ifdef PF_LOG
 	char psMessage[100];
 	sprintf (psMessage, "Forcing page %d for (%d).\n", pageNum, fd);
 	WriteLog(psMessage);
 #endif
 
-	// Do a linear scan of the buffer to find the page for the file
-	int slot = first;
-	while (slot != INVALID_SLOT) {
+	std::vector<std::unique_lock<std::mutex> > guards;
+	LatchShards(fd, pageNum, guards);
 
-		int next = bufTable[slot].next;
+	// I don't care if the page is pinned or not, just write it if
+	// it is dirty.
+	return (WriteDirtyPages(fd, pageNum, TRUE));
+}
 
-		// If the page belongs to the passed-in file descriptor
-		if (bufTable[slot].fd == fd &&
-				(pageNum==ALL_PAGES || bufTable[slot].pageNum == pageNum)) {
+//
+// WriteDirtyPages
+//
+// Desc: Internal.  Write the dirty pages of a file.  The pages are sorted
+//       by page number and each run of consecutive pages is written with
+//       a single pwritev, so that writing back a file takes a few large
+//       sequential writes instead of one write per page.
+//       The latches of the shards holding the pages must be held.  The
+//       pages of a file are all in the shards of its page size.
+// In:   fd - file descriptor
+//       pageNum - page to write, or ALL_PAGES
+//       bPinned - TRUE to write the pinned pages too
+// Ret:  PF return code
+//
+RC PF_BufferMgr::WriteDirtyPages(int fd, PageNum pageNum, int bPinned)
+{
+	RC rc;
+	int numDone, pageSize = 0;
+	std::vector<PF_BufPageDesc *> dirty;
 
-#ifdef PF_LOG
- sprintf (psMessage, "Page (%d) is in buffer pool.\n", bufTable[slot].pageNum);
- WriteLog(psMessage);
-#endif
-			// I don't care if the page is pinned or not, just write it if
-			// it is dirty.
-			if (bufTable[slot].bDirty) {
-#ifdef PF_LOG
-sprintf (psMessage, "Page (%d) is dirty\n",bufTable[slot].pageNum);
-WriteLog(psMessage);
-#endif
-				if ((rc = WritePage(fd, bufTable[slot].pageNum, bufTable[slot].pData)))
-					return (rc);
-				bufTable[slot].bDirty = FALSE;
+	for (int s = 0; s < numShards * PF_NUM_PAGE_SIZES; s++) {
+		PF_BufShard &sh = shards[s];
+
+		if (pageNum != ALL_PAGES && s % numShards != ShardIndex(fd, pageNum))
+			continue;
+
+		for (int slot = sh.first; slot != INVALID_SLOT;
+				slot = sh.bufTable[slot].next) {
+			PF_BufPageDesc *pDesc = &sh.bufTable[slot];
+
+			if (pDesc->fd == fd && pDesc->bDirty &&
+					(pageNum == ALL_PAGES || pDesc->pageNum == pageNum) &&
+					(bPinned || pDesc->pinCount == 0)) {
+				dirty.push_back(pDesc);
+				pageSize = sh.pageSize;
 			}
 		}
-		slot = next;
 	}
 
-	return 0;
+	rc = WriteRuns(dirty, pageSize, numDone);
+
+	for (int i = 0; i < numDone; i++) {
+		dirty[i]->bDirty = FALSE;
+		StatsOf(ShardOf(fd, pageSize, dirty[i]->pageNum), fd).writeBacks++;
+	}
+
+	return (rc);
+}
+
+//
+// WriteRuns
+//
+// Desc: Internal.  Write pages, sorted by file and page number.  Each run
+//       of consecutive pages is written with a single pwritev, so that
+//       writing back a file takes a few large sequential writes instead
+//       of one write per page.  The pages must not change meanwhile.
+// In:   pages - pages to write, sorted by the call
+//       pageSize - size of the pages
+// Out:  numDone - number of pages written, the first ones of pages
+// Ret:  PF return code
+//
+RC PF_BufferMgr::WriteRuns(std::vector<PF_BufPageDesc *> &pages, int pageSize,
+		int &numDone)
+{
+	RC rc;
+
+	numDone = 0;
+	std::sort(pages.begin(), pages.end(), PF_BufPageDesc::PageOrder);
+
+	// Write each run of consecutive pages at once
+	std::vector<struct iovec> iov;
+	for (size_t first = 0, last; first < pages.size(); first = last) {
+		iov.clear();
+		for (last = first; last < pages.size() &&
+				last - first < PF_MAX_IOV &&
+				pages[last]->fd == pages[first]->fd &&
+				pages[last]->pageNum == pages[first]->pageNum +
+				(PageNum)(last - first); last++) {
+			struct iovec v;
+			v.iov_base = pages[last]->pData;
+			v.iov_len = pageSize;
+			iov.push_back(v);
+		}
+
+#ifdef PF_LOG
+		char psMessage[100];
+		sprintf (psMessage, "Pages (%d-%d) are dirty\n", pages[first]->pageNum,
+				pages[last - 1]->pageNum);
+		WriteLog(psMessage);
+#endif
+
+		if ((rc = WritePages(pages[first]->fd, pageSize,
+				pages[first]->pageNum, &iov[0], iov.size())))
+			return (rc);
+
+		numDone = last;
+	}
+
+	return (0);
 }
 
+//
+// LatchShards
+//
+// Desc: Internal.  Latch the shards which may hold a page, or all of them
+//       in order, like every thread latching several shards.  Waits for
+//       the reads and background writes in progress in the shards, so
+//       that their pages are in a stable state.
+// In:   fd - file descriptor
+//       pageNum - page, or ALL_PAGES
+// Out:  guards - locks of the latches
+//
+void PF_BufferMgr::LatchShards(int fd, PageNum pageNum,
+		std::vector<std::unique_lock<std::mutex> > &guards)
+{
+	for (int s = 0; s < numShards * PF_NUM_PAGE_SIZES; s++) {
+		PF_BufShard &sh = shards[s];
+
+		// A single page can only be in its own shard of each page size
+		if (pageNum != ALL_PAGES && s % numShards != ShardIndex(fd, pageNum))
+			continue;
+
+		guards.push_back(std::unique_lock<std::mutex>(sh.latch));
+		while (sh.numIoPending > 0)
+			sh.ioDone.wait(guards.back());
+	}
+}
+
+//
+// CleanShard
+//
+// Desc: Write the dirty pages among the next victims of a shard.  Called
+//       by the background writer (see pf_bgwriter.h).  The next tailPct
+//       percent of the pages to be replaced, free slots first, are the
+//       tail of the shard.  If less than lowPct percent of the tail is
+//       clean, its dirty pages are written, coldest first, until highPct
+//       percent is clean.  The pages stay in the buffer.  They are pinned
+//       and marked bIoPending while they are written without the latch.
+// In:   s - shard number
+//       tailPct, lowPct, highPct - watermarks
+// Ret:  PF return code
+//
+RC PF_BufferMgr::CleanShard(int s, int tailPct, int lowPct, int highPct)
+{
+	RC rc;
+	int i, numDone;
+	PF_BufShard &sh = shards[s];
+	std::vector<PF_BufPageDesc *> pages;
+	std::unique_lock<std::mutex> guard(sh.latch);
+
+	// The shards of the page sizes not in use are empty
+	if (sh.numPages == 0)
+		return (0);
+
+	int tail = sh.numPages * tailPct / 100;
+	if (tail < 1)
+		tail = 1;
+
+	// Free slots are the first victims and they are clean
+	int numClean = 0;
+	for (int slot = sh.free; slot != INVALID_SLOT && numClean < tail;
+			slot = sh.bufTable[slot].next)
+		numClean++;
+
+	std::vector<int> slots(tail);
+	int n = sh.pReplacer->Coldest(sh.bufTable, &slots[0], tail - numClean);
+	for (i = 0; i < n; i++)
+		if (!sh.bufTable[slots[i]].bDirty)
+			numClean++;
+
+	if (numClean * 100 >= lowPct * tail)
+		return (0);
+
+	for (i = 0; i < n && numClean * 100 < highPct * tail; i++) {
+		PF_BufPageDesc *pDesc = &sh.bufTable[slots[i]];
+		if (!pDesc->bDirty || pDesc->fd < 0)
+			continue;
+
+		pDesc->bDirty = FALSE;
+		pDesc->bIoPending = TRUE;
+		pDesc->pinCount++;
+		sh.numIoPending++;
+		pages.push_back(pDesc);
+		numClean++;
+	}
+
+	// Write the pages
+	guard.unlock();
+	rc = WriteRuns(pages, sh.pageSize, numDone);
+	guard.lock();
+
+#ifdef PF_STATS
+	pfStats.Add(PF_BGWRITE, numDone);
+#endif
+
+	for (i = 0; i < (int)pages.size(); i++) {
+		// Pages which could not be written are still dirty
+		if (i >= numDone)
+			pages[i]->bDirty = TRUE;
+		else
+			StatsOf(sh, pages[i]->fd).writeBacks++;
+		pages[i]->bIoPending = FALSE;
+		// A user may have let go of the page meanwhile
+		if (--(pages[i]->pinCount) == 0)
+			EndPin(sh, *pages[i]);
+		sh.numIoPending--;
+	}
+	sh.ioDone.notify_all();
+
+	return (rc);
+}
 
 //
 // PrintBuffer
@@ -527,24 +1060,51 @@ WriteLog(psMessage);
 //
 RC PF_BufferMgr::PrintBuffer()
 {
-	cout << "Buffer contains " << numPages << " pages of size "
-		<< pageSize <<".\n";
-	cout << "Contents in order from most recently used to "
-		<< "least recently used.\n";
+	std::lock_guard<std::mutex> helperGuard(helperLatch);
+
+	for (int c = 0; c < PF_NUM_PAGE_SIZES; c++) {
+		if (arenas[c].empty())
+			continue;
+
+		// A shard holding pinned pages may not have shrunk all the way
+		int numFrames = 0;
+		for (int s = 0; s < numShards; s++)
+			numFrames += shards[c * numShards + s].numPages;
+		cout << "Buffer contains " << numFrames << " pages of size "
+			<< (PF_DEFAULT_PAGE_SIZE << c) <<".\n";
+	}
+	if (numShards > 1)
+		cout << "The pages of each size are spread over " << numShards
+			<< " shards.\n";
+	cout << "Contents in order from most recently loaded to "
+		<< "least recently loaded.\n";
+
+	int bEmpty = TRUE;
+	for (int s = 0; s < numShards * PF_NUM_PAGE_SIZES; s++) {
+		PF_BufShard &sh = shards[s];
+		std::lock_guard<std::mutex> guard(sh.latch);
+
+		if ((numShards > 1 || s >= numShards) && sh.first != INVALID_SLOT)
+			cout << "Shard " << s % numShards << " of the pages of size "
+				<< sh.pageSize << ":\n";
+
+		int slot, next;
+		slot = sh.first;
+		while (slot != INVALID_SLOT) {
+			next = sh.bufTable[slot].next;
+			cout << slot << " :: \n";
+			cout << "  fd = " << sh.bufTable[slot].fd << "\n";
+			cout << "  pageNum = " << sh.bufTable[slot].pageNum << "\n";
+			cout << "  bDirty = " << sh.bufTable[slot].bDirty << "\n";
+			cout << "  pinCount = " << sh.bufTable[slot].pinCount.load() << "\n";
+			slot = next;
+		}
 
-	int slot, next;
-	slot = first;
-	while (slot != INVALID_SLOT) {
-		next = bufTable[slot].next;
-		cout << slot << " :: \n";
-		cout << "  fd = " << bufTable[slot].fd << "\n";
-		cout << "  pageNum = " << bufTable[slot].pageNum << "\n";
-		cout << "  bDirty = " << bufTable[slot].bDirty << "\n";
-		cout << "  pinCount = " << bufTable[slot].pinCount << "\n";
-		slot = next;
+		if (sh.first != INVALID_SLOT)
+			bEmpty = FALSE;
 	}
 
-	if (first==INVALID_SLOT)
+	if (bEmpty)
 		cout << "Buffer is empty!\n";
 	else
 		cout << "All remaining slots are free.\n";
@@ -568,16 +1128,40 @@ RC PF_BufferMgr::ClearBuffer()
 {
 	RC rc;
 
+	for (int s = 0; s < numShards * PF_NUM_PAGE_SIZES; s++) {
+		std::lock_guard<std::mutex> guard(shards[s].latch);
+
+		if ((rc = InternalClear(shards[s])))
+			return (rc);
+	}
+
+	return 0;
+}
+
+//
+// InternalClear
+//
+// Desc: Internal.  Remove the unpinned pages of a shard whose latch is
+//       held.
+// In:   sh - shard to clear
+// Ret:  PF return code
+//
+RC PF_BufferMgr::InternalClear(PF_BufShard &sh)
+{
+	RC rc;
+
 	int slot, next;
-	slot = first;
+	slot = sh.first;
 	while (slot != INVALID_SLOT) {
-		next = bufTable[slot].next;
-		if (bufTable[slot].pinCount == 0)
-			if ((rc = hashTable.Delete(bufTable[slot].fd,
-					bufTable[slot].pageNum)) ||
-				(rc = Unlink(slot)) ||
-				(rc = InsertFree(slot)))
+		next = sh.bufTable[slot].next;
+		if (sh.bufTable[slot].pinCount == 0) {
+			sh.pReplacer->Remove(slot);
+			if ((rc = sh.hashTable.Delete(sh.bufTable[slot].fd,
+					sh.bufTable[slot].pageNum)) ||
+				(rc = Unlink(sh, slot)) ||
+				(rc = InsertFree(sh, slot)))
 			return (rc);
+		}
 		slot = next;
 	}
 
@@ -587,112 +1171,406 @@ RC PF_BufferMgr::ClearBuffer()
 //
 // ResizeBuffer
 //
-// Desc: Resizes the buffer manager to the size passed in.
-//       This routine will be called via the system command.
+// Desc: Resizes the buffer manager to the size passed in, keeping the
+//       pages it holds.  This routine will be called via the system
+//       command.
+//       The new size is spread over the shards of each page size.  The
+//       frames the growing shards lack are taken from one new arena per
+//       page size, so the pages in the buffer do not move.
 // In:   The new buffer size
 // Out:  Nothing
 // Ret:  0 for success or,
-//       Some other PF error (probably PF_NOBUF)
-//
-// Notes: This method attempts to copy all the old pages which I am
-// unable to kick out of the old buffer manager into the new buffer
-// manager.  This obviously cannot always be successfull!
+//       PF_TOOSMALL if every shard cannot get a page,
+//       PF_NOBUF if a shard has too many pinned pages to shrink that far,
+//       the shard then keeps its pinned pages,
+//       Some other PF error
 //
 RC PF_BufferMgr::ResizeBuffer(int iNewSize)
 {
-	int i;
-	RC rc;
+	RC rc = 0;
+	RC shardRc;
+
+	if (iNewSize < numShards)
+		return (PF_TOOSMALL);
+
+	// Only one resize at a time, and no page size may be set up meanwhile
+	std::lock_guard<std::mutex> helperGuard(helperLatch);
+
+	for (int c = 0; c < PF_NUM_PAGE_SIZES; c++) {
+		int pageSize = PF_DEFAULT_PAGE_SIZE << c;
+		if (arenas[c].empty())
+			continue;
+
+		// Count the slots to add.  numSlots only changes under the
+		// helper latch.
+		int numNew = 0;
+		for (int s = 0; s < numShards; s++)
+			numNew += max(0, ShardPages(iNewSize, s) -
+					shards[c * numShards + s].numSlots);
+
+		char *pFrames = NULL;
+		if (numNew > 0) {
+			PF_Arena arena;
+			arena.pFrames = pFrames = AllocArena(numNew, pageSize);
+			arena.numPages = numNew;
+			arenas[c].push_back(arena);
+		}
 
-	// First try and clear out the old buffer!
-	ClearBuffer();
+		for (int s = 0; s < numShards; s++) {
+			PF_BufShard &sh = shards[c * numShards + s];
+			int iShardSize = ShardPages(iNewSize, s);
+			std::unique_lock<std::mutex> guard(sh.latch);
+
+			// The buffer table is replaced when slots are added.  Wait
+			// for the writes of CleanShard, which point into it.
+			int numAdded = max(0, iShardSize - sh.numSlots);
+			if (numAdded > 0)
+				while (sh.numIoPending > 0)
+					sh.ioDone.wait(guard);
+
+			if ((shardRc = InternalResize(sh, iShardSize, pFrames))) {
+				if (shardRc != PF_NOBUF)
+					return (shardRc);
+				rc = shardRc;
+			}
+			pFrames += numAdded * (size_t)pageSize;
+		}
+	}
 
-	// Allocate memory for a new buffer table
-	PF_BufPageDesc *pNewBufTable = new PF_BufPageDesc[iNewSize];
+	numPages = iNewSize;
+	return (rc);
+}
 
-	// Initialize the new buffer table and allocate memory for buffer
-	// pages.  Initially, the free list contains all pages
-	for (i = 0; i < iNewSize; i++) {
-		if ((pNewBufTable[i].pData = new char[pageSize]) == NULL) {
-			cerr << "Not enough memory for buffer\n";
-			exit(1);
+//
+// InternalResize
+//
+// Desc: Internal.  Resizes a shard whose latch is held.
+//       To shrink, slots are taken from the free list, then from the
+//       victims chosen by the replacement policy, written back if they
+//       are dirty, just as if they were needed for a miss.  Their frames
+//       are given back to the system and the slots put on the spare list.
+//       To grow, the spare slots get their frames back, then slots are
+//       added on the new frames.  The pages left keep their slots, so the
+//       hash table only needs resizing and the replacer keeps its history.
+// In:   sh - shard to resize
+//       iNewSize - new number of pages of the shard
+//       pFrames - frames of the slots to add, if iNewSize is above the
+//                 number of slots of the shard
+// Ret:  PF_NOBUF if too many pages are pinned, other PF return code
+//
+RC PF_BufferMgr::InternalResize(PF_BufShard &sh, int iNewSize, char *pFrames)
+{
+	RC rc = 0;
+	int slot;
+
+	// Give up slots, the free ones first
+	while (sh.numPages > iNewSize) {
+		if ((rc = InternalAlloc(sh, slot)))
+			break;
+		Unlink(sh, slot);
+		madvise(sh.bufTable[slot].pData, sh.pageSize, MADV_DONTNEED);
+		sh.bufTable[slot].next = sh.spare;
+		sh.spare = slot;
+		sh.numPages--;
+	}
+
+	// Take the spare slots back
+	while (sh.numPages < iNewSize && sh.spare != INVALID_SLOT) {
+		slot = sh.spare;
+		sh.spare = sh.bufTable[slot].next;
+		InsertFree(sh, slot);
+		sh.numPages++;
+	}
+
+	// Add slots on the new frames.  The descriptions are copied to a
+	// larger buffer table, the frames stay where they are.
+	if (sh.numPages < iNewSize) {
+		int newSlots = sh.numSlots + iNewSize - sh.numPages;
+		PF_BufPageDesc *pNewBufTable = new PF_BufPageDesc[newSlots];
+
+		for (slot = 0; slot < sh.numSlots; slot++) {
+			PF_BufPageDesc &from = sh.bufTable[slot];
+			PF_BufPageDesc &to = pNewBufTable[slot];
+			to.pData = from.pData;
+			to.next = from.next;
+			to.prev = from.prev;
+			to.bDirty = from.bDirty;
+			to.bIoPending = from.bIoPending;
+			to.bRing = from.bRing;
+			to.pinCount = from.pinCount.load();
+			to.pinStart = from.pinStart;
+			to.pageNum = from.pageNum;
+			to.fd = from.fd;
+		}
+		for (; slot < newSlots; slot++) {
+			pNewBufTable[slot].pData = pFrames +
+				(slot - sh.numSlots) * (size_t)sh.pageSize;
+			pNewBufTable[slot].pinCount = 0;
+			pNewBufTable[slot].pinStart = 0;
+			pNewBufTable[slot].bIoPending = FALSE;
+			pNewBufTable[slot].bRing = FALSE;
 		}
 
-		memset ((void *)pNewBufTable[i].pData, 0, pageSize);
+		delete [] sh.bufTable;
+		sh.bufTable = pNewBufTable;
+		for (slot = sh.numSlots; slot < newSlots; slot++)
+			InsertFree(sh, slot);
+		sh.numSlots = newSlots;
+		sh.numPages = iNewSize;
+	}
+
+	sh.pReplacer->Resize(sh.numSlots, sh.numPages);
+
+	// Size the hash table for the new number of pages
+	RC hashRc;
+	if ((hashRc = sh.hashTable.Resize(sh.numPages)))
+		return (hashRc);
+
+	return (rc);
+}
 
-		pNewBufTable[i].prev = i - 1;
-		pNewBufTable[i].next = i + 1;
+//
+// SetReplacePolicy
+//
+// Desc: Replace the page replacement policy.  The pages in the buffer
+//       are handed to the new replacer in the order they were loaded,
+//       so the history kept by the old policy is lost.
+// In:   The new policy
+// Ret:  0 for success
+//
+RC PF_BufferMgr::SetReplacePolicy(PF_ReplacePolicy _policy)
+{
+	// The shards of a page size set up meanwhile must get the new policy
+	std::lock_guard<std::mutex> helperGuard(helperLatch);
+
+	for (int s = 0; s < numShards * PF_NUM_PAGE_SIZES; s++) {
+		PF_BufShard &sh = shards[s];
+		std::lock_guard<std::mutex> guard(sh.latch);
+		if (sh.numPages == 0)
+			continue;
+		PF_Replacer *pNewReplacer = PF_NewReplacer(_policy, sh.numSlots);
+		pNewReplacer->Resize(sh.numSlots, sh.numPages);
+
+		for (int slot = sh.last; slot != INVALID_SLOT;
+				slot = sh.bufTable[slot].prev)
+			pNewReplacer->Admit(slot, sh.bufTable[slot].fd,
+					sh.bufTable[slot].pageNum);
+
+		delete sh.pReplacer;
+		sh.pReplacer = pNewReplacer;
 	}
-	pNewBufTable[0].prev = pNewBufTable[iNewSize - 1].next = INVALID_SLOT;
+	policy = _policy;
 
-	// Now we must remember the old first and last slots and (of course)
-	// the buffer table itself.  Then we use insert methods to insert
-	// each of the entries into the new buffertable
-	int oldFirst = first;
-	PF_BufPageDesc *pOldBufTable = bufTable;
+	return (0);
+}
 
-	// Setup the new number of pages,  first, last and free
-	numPages = iNewSize;
-	first = last = INVALID_SLOT;
-	free = 0;
+//
+// SetReadAhead
+//
+// Desc: Set the number of pages read ahead of a sequential scan.  The
+//       read-ahead threads are started the first time it is turned on.
+// In:   numPages - read-ahead window, 0 turns read-ahead off
+// Ret:  0 for success
+//
+RC PF_BufferMgr::SetReadAhead(int numPages)
+{
+	if (numPages < 0)
+		numPages = 0;
 
-	// Setup the new buffer table
-	bufTable = pNewBufTable;
+	if (numPages > 0) {
+		std::lock_guard<std::mutex> guard(helperLatch);
+		if (pReadAhead == NULL)
+			pReadAhead = new PF_ReadAhead(this, PF_READAHEAD_THREADS);
+	}
 
-	// We must first remove from the hashtable any possible entries
-	int slot, next, newSlot;
-	slot = oldFirst;
-	while (slot != INVALID_SLOT) {
-		next = pOldBufTable[slot].next;
+	readAheadPages = numPages;
+	return (0);
+}
 
-		// Must remove the entry from the hashtable from the
-		if ((rc=hashTable.Delete(pOldBufTable[slot].fd, pOldBufTable[slot].pageNum)))
-			return (rc);
-		slot = next;
+//
+// SetBgWriter
+//
+// Desc: Set the watermarks of the background writer (see pf_bgwriter.h).
+//       The writer thread is started the first time it is turned on.
+// In:   tailPct - percent of each shard kept clean, 0 turns it off
+//       lowPct - percent of clean pages under which the writer starts
+//       highPct - percent of clean pages at which the writer stops
+// Ret:  PF_BADPARAM if the watermarks are not 0 <= low <= high <= 100
+//
+RC PF_BufferMgr::SetBgWriter(int tailPct, int lowPct, int highPct)
+{
+	if (tailPct < 0 || tailPct > 100 || lowPct < 0 || lowPct > highPct ||
+			highPct > 100)
+		return (PF_BADPARAM);
+
+	std::lock_guard<std::mutex> guard(helperLatch);
+	if (pBgWriter == NULL) {
+		if (tailPct == 0)
+			return (0);
+		pBgWriter = new PF_BgWriter(this);
 	}
+	pBgWriter->SetWatermarks(tailPct, lowPct, highPct);
 
-	// Now we traverse through the old buffer table and copy any old
-	// entries into the new one
-	slot = oldFirst;
-	while (slot != INVALID_SLOT) {
+	return (0);
+}
 
-		next = pOldBufTable[slot].next;
-		// Allocate a new slot for the old page
-		if ((rc = InternalAlloc(newSlot)))
-			return (rc);
+//
+// SetHugePages
+//
+// Desc: Advise the kernel to back the frames with transparent huge pages,
+//       or not to.  The frames are one arena, so a scan of the buffer
+//       then takes a TLB entry every 2 MB rather than every page.
+// In:   _bHugePages - TRUE to use huge pages
+// Ret:  PF_BADPARAM if the system has no transparent huge pages
+//
+RC PF_BufferMgr::SetHugePages(int _bHugePages)
+{
+#ifdef MADV_HUGEPAGE
+	std::lock_guard<std::mutex> guard(helperLatch);
+
+	bHugePages = _bHugePages;
+	for (int c = 0; c < PF_NUM_PAGE_SIZES; c++)
+		for (size_t a = 0; a < arenas[c].size(); a++)
+			if (madvise(arenas[c][a].pFrames,
+					arenas[c][a].numPages * ((size_t)PF_DEFAULT_PAGE_SIZE << c),
+					bHugePages ? MADV_HUGEPAGE : MADV_NOHUGEPAGE) < 0)
+				return (PF_UNIX);
+	return (0);
+#else
+	return (_bHugePages ? PF_BADPARAM : 0);
+#endif
+}
 
-		// Insert the page into the hash table,
-		// and initialize the page description entry
-		if ((rc = hashTable.Insert(pOldBufTable[slot].fd,
-				pOldBufTable[slot].pageNum, newSlot)) ||
-				(rc = InitPageDesc(pOldBufTable[slot].fd,
-				pOldBufTable[slot].pageNum, newSlot)))
-			return (rc);
+//
+// ReadAhead
+//
+// Desc: Queue pages to be loaded into the buffer by the read-ahead
+//       threads.  Does nothing if read-ahead is off.
+// In:   fd - OS file descriptor of the file
+//       pageSize - size of the pages of the file
+//       pageNum - first page to load
+//       numPages - number of pages to load
+//       hint - hint of the reader, passed on to PrefetchPage
+// Ret:  0 for success
+//
+RC PF_BufferMgr::ReadAhead(int fd, int pageSize, PageNum pageNum,
+		int numPages, ClientHint hint)
+{
+	if (readAheadPages > 0 && pReadAhead)
+		pReadAhead->Request(fd, pageSize, pageNum, numPages, hint);
 
-		// Put the slot back on the free list before returning the error
-		Unlink(newSlot);
-		InsertFree(newSlot);
+	return (0);
+}
 
-		slot = next;
+//
+// Prefetch
+//
+// Desc: Queue pages to be loaded into the buffer by the read-ahead
+//       threads, whether read-ahead is on or not.  The threads are
+//       started if needed.  Runs of consecutive pages are asked for at
+//       once so that the OS reads them together.
+// In:   fd - OS file descriptor of the file
+//       pageSize - size of the pages of the file
+//       pageNums - pages to load, in increasing order
+// Ret:  0 for success
+//
+RC PF_BufferMgr::Prefetch(int fd, int pageSize,
+		const std::vector<PageNum> &pageNums)
+{
+	{
+		std::lock_guard<std::mutex> guard(helperLatch);
+		if (pReadAhead == NULL)
+			pReadAhead = new PF_ReadAhead(this, PF_READAHEAD_THREADS);
 	}
 
-	// Finally, delete the old buffer table
-	delete [] pOldBufTable;
+	for (size_t i = 0, j; i < pageNums.size(); i = j) {
+		for (j = i + 1; j < pageNums.size() &&
+				pageNums[j] == pageNums[j - 1] + 1; j++)
+			;
+		pReadAhead->Request(fd, pageSize, pageNums[i], j - i, NO_HINT);
+	}
 
-	return 0;
+	return (0);
+}
+
+
+//
+// GetFileStats
+//
+// Desc: Sum the counters of a file over the shards
+// In:   fd - OS file descriptor of the file
+//       bReset - TRUE to reset the counters, as when the file is closed
+// Out:  stats - counters of the file
+// Ret:  0 for success
+//
+RC PF_BufferMgr::GetFileStats(int fd, PF_FileStats &stats, int bReset)
+{
+	stats = PF_FileStats();
+
+	for (int s = 0; s < numShards * PF_NUM_PAGE_SIZES; s++) {
+		PF_BufShard &sh = shards[s];
+		std::lock_guard<std::mutex> guard(sh.latch);
+
+		if ((int)sh.fileStats.size() > fd + 1) {
+			stats.Add(sh.fileStats[fd + 1]);
+			if (bReset)
+				sh.fileStats[fd + 1] = PF_FileStats();
+		}
+	}
+
+	return (0);
 }
 
+//
+// ResetFileStats
+//
+// Desc: Reset the counters of all the files
+// Ret:  0 for success
+//
+RC PF_BufferMgr::ResetFileStats()
+{
+	for (int s = 0; s < numShards * PF_NUM_PAGE_SIZES; s++) {
+		PF_BufShard &sh = shards[s];
+		std::lock_guard<std::mutex> guard(sh.latch);
+
+		sh.fileStats.clear();
+	}
+
+	return (0);
+}
+
+//
+// EndPin
+//
+// Desc: Internal.  Count the time a page was pinned by its users, once it
+//       is released by the last one.  The shard latch must be held.
+// In:   sh - shard of the page
+//       desc - page released
+//
+void PF_BufferMgr::EndPin(PF_BufShard &sh, PF_BufPageDesc &desc)
+{
+	if (desc.pinStart == 0)
+		return;
+
+	PF_FileStats &stats = StatsOf(sh, desc.fd);
+	stats.pins++;
+	stats.pinNanos += PF_Nanos() - desc.pinStart;
+	desc.pinStart = 0;
+}
 
 //
 // InsertFree
 //
 // Desc: Internal.  Insert a slot at the head of the free list
-// In:   slot - slot number to insert
+// In:   sh - shard of the slot
+//       slot - slot number to insert
 // Ret:  PF return code
 //
-RC PF_BufferMgr::InsertFree(int slot)
+RC PF_BufferMgr::InsertFree(PF_BufShard &sh, int slot)
 {
-	bufTable[slot].next = free;
-	free = slot;
+	sh.bufTable[slot].bRing = FALSE;
+	sh.bufTable[slot].next = sh.free;
+	sh.free = slot;
 
 	// Return ok
 	return (0);
@@ -701,26 +1579,26 @@ RC PF_BufferMgr::InsertFree(int slot)
 //
 // LinkHead
 //
-// Desc: Internal.  Insert a slot at the head of the used list, making
-//       it the most-recently used slot.
-// In:   slot - slot number to insert
+// Desc: Internal.  Insert a slot at the head of the used list.
+// In:   sh - shard of the slot
+//       slot - slot number to insert
 // Ret:  PF return code
 //
-RC PF_BufferMgr::LinkHead(int slot)
+RC PF_BufferMgr::LinkHead(PF_BufShard &sh, int slot)
 {
 	// Set next and prev pointers of slot entry
-	bufTable[slot].next = first;
-	bufTable[slot].prev = INVALID_SLOT;
+	sh.bufTable[slot].next = sh.first;
+	sh.bufTable[slot].prev = INVALID_SLOT;
 
 	// If list isn't empty, point old first back to slot
-	if (first != INVALID_SLOT)
-		bufTable[first].prev = slot;
+	if (sh.first != INVALID_SLOT)
+		sh.bufTable[sh.first].prev = slot;
 
-	first = slot;
+	sh.first = slot;
 
 	// if list was empty, set last to slot
-	if (last == INVALID_SLOT)
-		last = first;
+	if (sh.last == INVALID_SLOT)
+		sh.last = sh.first;
 
 	// Return ok
 	return (0);
@@ -733,29 +1611,30 @@ RC PF_BufferMgr::LinkHead(int slot)
 //       slot is valid.  Set prev and next pointers to INVALID_SLOT.
 //       The caller is responsible to either place the unlinked page into
 //       the free list or the used list.
-// In:   slot - slot number to unlink
+// In:   sh - shard of the slot
+//       slot - slot number to unlink
 // Ret:  PF return code
 //
-RC PF_BufferMgr::Unlink(int slot)
+RC PF_BufferMgr::Unlink(PF_BufShard &sh, int slot)
 {
 	// If slot is at head of list, set first to next element
-	if (first == slot)
-		first = bufTable[slot].next;
+	if (sh.first == slot)
+		sh.first = sh.bufTable[slot].next;
 
 	// If slot is at end of list, set last to previous element
-	if (last == slot)
-		last = bufTable[slot].prev;
+	if (sh.last == slot)
+		sh.last = sh.bufTable[slot].prev;
 
 	// If slot not at end of list, point next back to previous
-	if (bufTable[slot].next != INVALID_SLOT)
-		bufTable[bufTable[slot].next].prev = bufTable[slot].prev;
+	if (sh.bufTable[slot].next != INVALID_SLOT)
+		sh.bufTable[sh.bufTable[slot].next].prev = sh.bufTable[slot].prev;
 
 	// If slot not at head of list, point prev forward to next
-	if (bufTable[slot].prev != INVALID_SLOT)
-		bufTable[bufTable[slot].prev].next = bufTable[slot].next;
+	if (sh.bufTable[slot].prev != INVALID_SLOT)
+		sh.bufTable[sh.bufTable[slot].prev].next = sh.bufTable[slot].next;
 
 	// Set next and prev pointers of slot entry
-	bufTable[slot].prev = bufTable[slot].next = INVALID_SLOT;
+	sh.bufTable[slot].prev = sh.bufTable[slot].next = INVALID_SLOT;
 
 	// Return ok
 	return (0);
@@ -766,68 +1645,163 @@ RC PF_BufferMgr::Unlink(int slot)
 //
 // Desc: Internal.  Allocate a buffer slot.  The slot is inserted at the
 //       head of the used list.  Here's how it chooses which slot to use:
-//       If there is something on the free list, then use it.
-//       Otherwise, choose a victim to replace.  If a victim cannot be
+//       For a page of a scan, the next unpinned slot of the scan ring is
+//       reused once the ring is full.
+//       Otherwise, if there is something on the free list, then use it.
+//       Otherwise, ask the replacer for a victim.  If a victim cannot be
 //       chosen (because all the pages are pinned), then return an error.
+//       A slot taken for a scan joins the ring while the ring has room.
+// In:   sh - shard in which to allocate
+//       bRing - TRUE for a page of a scan
 // Out:  slot - set to newly-allocated slot
 // Ret:  PF_NOBUF if all pages are pinned, other PF return code otherwise
 //
-RC PF_BufferMgr::InternalAlloc(int &slot)
+RC PF_BufferMgr::InternalAlloc(PF_BufShard &sh, int &slot, int bRing)
 {
-	RC  rc;       // return code
+	RC  rc;                // return code
+	int bReplace = TRUE;   // TRUE if the slot holds a page to drop
+
+	// A full scan ring replaces its own pages
+	if (bRing && (slot = RingVictim(sh)) != INVALID_SLOT) {
+#ifdef PF_STATS
+		PF_STATS_ADDONE(PF_RINGREUSE);
+#endif
+		sh.pReplacer->Remove(slot);
+	}
 
 	// If the free list is not empty, choose a slot from the free list
-	if (free != INVALID_SLOT) {
-		slot = free;
-		free = bufTable[slot].next;
+	else if (sh.free != INVALID_SLOT) {
+		slot = sh.free;
+		sh.free = sh.bufTable[slot].next;
+		bReplace = FALSE;
 	}
 	else {
 
-		// Choose the least-recently used page that is unpinned
-		for (slot = last; slot != INVALID_SLOT; slot = bufTable[slot].prev) {
-			if (bufTable[slot].pinCount == 0)
-				break;
-		}
+		// Let the replacement policy choose an unpinned page.  Returns
+		// PF_NOBUF if all buffers were pinned
+		if ((rc = sh.pReplacer->Victim(sh.bufTable, slot)))
+			return (rc);
 
-		// Return error if all buffers were pinned
-		if (slot == INVALID_SLOT)
-			return (PF_NOBUF);
+#ifdef PF_STATS
+		PF_STATS_ADDONE(PF_EVICTPAGE);
+#endif
+	}
+
+	if (bReplace) {
 
 		// Write out the page if it is dirty
-		if (bufTable[slot].bDirty) {
-			if ((rc = WritePage(bufTable[slot].fd, bufTable[slot].pageNum,
-					bufTable[slot].pData)))
+		if (sh.bufTable[slot].bDirty) {
+#ifdef PF_STATS
+			PF_STATS_ADDONE(PF_EVICTDIRTY);
+#endif
+			// The background writer is behind
+			if (pBgWriter)
+				pBgWriter->Wake();
+
+			if ((rc = WritePage(sh.bufTable[slot].fd, sh.pageSize,
+					sh.bufTable[slot].pageNum, sh.bufTable[slot].pData))) {
+				// Keep the page, the policy has to see it again
+				sh.pReplacer->Admit(slot, sh.bufTable[slot].fd,
+						sh.bufTable[slot].pageNum);
 				return (rc);
+			}
 
-			bufTable[slot].bDirty = FALSE;
+			sh.bufTable[slot].bDirty = FALSE;
+			StatsOf(sh, sh.bufTable[slot].fd).writeBacks++;
 		}
+		StatsOf(sh, sh.bufTable[slot].fd).evictions++;
 
 		// Remove page from the hash table and slot from the used buffer list
-		if ((rc = hashTable.Delete(bufTable[slot].fd, bufTable[slot].pageNum)) ||
-				(rc = Unlink(slot)))
+		if ((rc = sh.hashTable.Delete(sh.bufTable[slot].fd,
+				sh.bufTable[slot].pageNum)) ||
+				(rc = Unlink(sh, slot)))
 			return (rc);
 	}
 
+	// The slot of a scan joins the ring if there is room, any other slot
+	// leaves it
+	if (!bRing)
+		sh.bufTable[slot].bRing = FALSE;
+	else if (!sh.bufTable[slot].bRing && (int)sh.ring.size() < RingSize(sh)) {
+		sh.bufTable[slot].bRing = TRUE;
+		sh.ring.push_back(slot);
+	}
+
 	// Link slot at the head of the used list
-	if ((rc = LinkHead(slot)))
+	if ((rc = LinkHead(sh, slot)))
 		return (rc);
 
 	// Return ok
 	return (0);
 }
 
+//
+// RingVictim
+//
+// Desc: Internal.  Choose the slot of the scan ring to reuse for the next
+//       page of a scan.  The slots which left the ring are forgotten
+//       first.  The ring is reused in turn once it is full; a ring slot
+//       still pinned by its scan is passed over.
+// In:   sh - shard of the ring, its latch is held
+// Ret:  slot to reuse, INVALID_SLOT if the ring may still grow or if all
+//       its slots are pinned
+//
+int PF_BufferMgr::RingVictim(PF_BufShard &sh)
+{
+	size_t n = 0;
+	for (size_t i = 0; i < sh.ring.size(); i++)
+		if (sh.bufTable[sh.ring[i]].bRing)
+			sh.ring[n++] = sh.ring[i];
+	sh.ring.resize(n);
+
+	if ((int)n < RingSize(sh))
+		return (INVALID_SLOT);
+
+	for (size_t k = 0; k < n; k++) {
+		size_t i = (sh.ringNext + k) % n;
+		int slot = sh.ring[i];
+		if (sh.bufTable[slot].pinCount == 0 &&
+				!sh.bufTable[slot].bIoPending) {
+			sh.ringNext = (i + 1) % n;
+			return (slot);
+		}
+	}
+	return (INVALID_SLOT);
+}
+
+//
+// RingSize
+//
+// Desc: Internal.  Most slots in the scan ring of a shard: its share of
+//       PF_SCAN_RING_PAGES and of the read-ahead window, so that pages
+//       read ahead are not reused before the scan gets to them, but no
+//       more than a quarter of the shard.  At least two, so that a scan
+//       can read its next page while holding one.
+// In:   sh - shard of the ring
+// Ret:  number of slots
+//
+int PF_BufferMgr::RingSize(const PF_BufShard &sh) const
+{
+	int size = (PF_SCAN_RING_PAGES + readAheadPages) / numShards + 1;
+	if (size > sh.numPages / 4)
+		size = sh.numPages / 4;
+	return (size < 2 ? 2 : size);
+}
+
 //
 // ReadPage
 //
-// Desc: Read a page from disk
+// Desc: Read a page from disk.  pread is used so that threads sharing
+//       a file descriptor do not race on its offset.
 //
 // In:   fd - OS file descriptor
+//       pageSize - size of the pages of the file
 //       pageNum - number of page to read
 //       dest - pointer to buffer in which to read page
 // Out:  dest - buffer contains page contents
 // Ret:  PF return code
 //
-RC PF_BufferMgr::ReadPage(int fd, PageNum pageNum, char *dest)
+RC PF_BufferMgr::ReadPage(int fd, int pageSize, PageNum pageNum, char *dest)
 {
 
 #ifdef PF_LOG
@@ -837,16 +1811,26 @@ RC PF_BufferMgr::ReadPage(int fd, PageNum pageNum, char *dest)
 #endif
 
 #ifdef PF_STATS
-	pStatisticsMgr->Register(PF_READPAGE, STAT_ADDONE);
+	PF_STATS_ADDONE(PF_READPAGE);
+	long long start = PF_Nanos();
 #endif
 
-	// seek to the appropriate place (cast to long for PC's)
-	long offset = pageNum * (long)pageSize + PF_FILE_HDR_SIZE;
-	if (lseek(fd, offset, L_SET) < 0)
-		return (PF_UNIX);
+	// The extent of a page of a compressed file is found in its map
+	PF_CompressedFile *pCompressed = CompressedOf(fd);
+	if (pCompressed) {
+		RC rc = pCompressed->ReadPage(pageNum, dest);
+#ifdef PF_STATS
+		pfTimes.Record(PF_READTIME, PF_Nanos() - start);
+#endif
+		return (rc);
+	}
 
-	// Read the data
-	int numBytes = read(fd, dest, pageSize);
+	// Read the data at the appropriate place (cast to long for PC's)
+	long offset = pageNum * (long)pageSize + PF_FILE_HDR_SIZE;
+	int numBytes = pread(fd, dest, pageSize, offset);
+#ifdef PF_STATS
+	pfTimes.Record(PF_READTIME, PF_Nanos() - start);
+#endif
 	if (numBytes < 0)
 		return (PF_UNIX);
 	else if (numBytes != pageSize)
@@ -861,11 +1845,13 @@ RC PF_BufferMgr::ReadPage(int fd, PageNum pageNum, char *dest)
 // Desc: Write a page to disk
 //
 // In:   fd - OS file descriptor
+//       pageSize - size of the pages of the file
 //       pageNum - number of page to write
 //       dest - pointer to buffer containing page contents
 // Ret:  PF return code
 //
-RC PF_BufferMgr::WritePage(int fd, PageNum pageNum, char *source)
+RC PF_BufferMgr::WritePage(int fd, int pageSize, PageNum pageNum,
+		char *source)
 {
 
 #ifdef PF_LOG
@@ -875,40 +1861,149 @@ RC PF_BufferMgr::WritePage(int fd, PageNum pageNum, char *source)
 #endif
 
 #ifdef PF_STATS
-	pStatisticsMgr->Register(PF_WRITEPAGE, STAT_ADDONE);
+	PF_STATS_ADDONE(PF_WRITEPAGE);
+	long long start = PF_Nanos();
 #endif
 
-	// seek to the appropriate place (cast to long for PC's)
+	// A page of a compressed file goes to an extent of its size
+	PF_CompressedFile *pCompressed = CompressedOf(fd);
+	if (pCompressed) {
+		RC rc = pCompressed->WritePage(pageNum, source);
+#ifdef PF_STATS
+		pfTimes.Record(PF_WRITETIME, PF_Nanos() - start);
+#endif
+		return (rc);
+	}
+
+	// Write the data at the appropriate place (cast to long for PC's)
 	long offset = pageNum * (long)pageSize + PF_FILE_HDR_SIZE;
-	if (lseek(fd, offset, L_SET) < 0)
+	int numBytes = pwrite(fd, source, pageSize, offset);
+#ifdef PF_STATS
+	pfTimes.Record(PF_WRITETIME, PF_Nanos() - start);
+#endif
+	if (numBytes < 0)
 		return (PF_UNIX);
+	else if (numBytes != pageSize)
+		return (PF_INCOMPLETEWRITE);
+	else
+		return (0);
+}
+
+//
+// WritePages
+//
+// Desc: Write consecutive pages to disk with a single system call
+//
+// In:   fd - OS file descriptor
+//       pageSize - size of the pages of the file
+//       pageNum - number of the first page to write
+//       iov - contents of the pages
+//       numPages - number of pages to write
+// Ret:  PF return code
+//
+RC PF_BufferMgr::WritePages(int fd, int pageSize, PageNum pageNum,
+		const struct iovec *iov, int numPages)
+{
+
+#ifdef PF_LOG
+	char psMessage[100];
+	sprintf (psMessage, "Writing (%d,%d) and %d more.\n", fd, pageNum,
+			numPages - 1);
+	WriteLog(psMessage);
+#endif
 
-	// Read the data
-	int numBytes = write(fd, source, pageSize);
+	// The pages of a compressed file have extents of their own
+	if (CompressedOf(fd)) {
+		RC rc;
+		for (int i = 0; i < numPages; i++)
+			if ((rc = WritePage(fd, pageSize, pageNum + i,
+					(char *)iov[i].iov_base)))
+				return (rc);
+		return (0);
+	}
+
+#ifdef PF_STATS
+	// Count the pages and the write calls saved by coalescing them
+	pfStats.Add(PF_WRITEPAGE, numPages);
+	pfStats.Add(PF_WRITESAVED, numPages - 1);
+	long long start = PF_Nanos();
+#endif
+
+	// Write the data at the appropriate place (cast to long for PC's)
+	long offset = pageNum * (long)pageSize + PF_FILE_HDR_SIZE;
+	long numBytes = pwritev(fd, iov, numPages, offset);
+#ifdef PF_STATS
+	pfTimes.Record(PF_WRITETIME, PF_Nanos() - start);
+#endif
 	if (numBytes < 0)
 		return (PF_UNIX);
-	else if (numBytes != pageSize)
+	else if (numBytes != numPages * (long)pageSize)
 		return (PF_INCOMPLETEWRITE);
 	else
 		return (0);
 }
 
+//
+// SetCompressed
+//
+// Desc: Read and write the pages of a file through its PF_CompressedFile.
+//       Called by PF_Manager when a compressed file is opened, and with
+//       NULL once it is flushed, before it is closed.
+// In:   fd - OS file descriptor of the file
+//       pFile - compressed file, or NULL
+//
+void PF_BufferMgr::SetCompressed(int fd, PF_CompressedFile *pFile)
+{
+	lock_guard<mutex> guard(compressLatch);
+
+	if ((int)compressed.size() <= fd)
+		compressed.resize(fd + 1, NULL);
+	if (compressed[fd] == NULL && pFile)
+		numCompressed++;
+	else if (compressed[fd] && pFile == NULL)
+		numCompressed--;
+	compressed[fd] = pFile;
+}
+
+//
+// CompressedOf
+//
+// Desc: Internal.  The compressed file of a file descriptor.  The latch
+//       is only taken when a compressed file is open.
+// In:   fd - OS file descriptor
+// Ret:  the PF_CompressedFile of fd, NULL if it has none
+//
+PF_CompressedFile *PF_BufferMgr::CompressedOf(int fd)
+{
+	if (numCompressed == 0)
+		return (NULL);
+
+	lock_guard<mutex> guard(compressLatch);
+	return (fd >= 0 && fd < (int)compressed.size() ? compressed[fd] : NULL);
+}
+
 //
 // InitPageDesc
 //
 // Desc: Internal.  Initialize PF_BufPageDesc to a newly-pinned page
 //       for a newly pinned page
-// In:   fd - file descriptor
+// In:   sh - shard of the slot
+//       fd - file descriptor
 //       pageNum - page number
 // Ret:  PF return code
 //
-RC PF_BufferMgr::InitPageDesc(int fd, PageNum pageNum, int slot)
+RC PF_BufferMgr::InitPageDesc(PF_BufShard &sh, int fd, PageNum pageNum,
+		int slot)
 {
 	// set the slot to refer to a newly-pinned page
-	bufTable[slot].fd       = fd;
-	bufTable[slot].pageNum  = pageNum;
-	bufTable[slot].bDirty   = FALSE;
-	bufTable[slot].pinCount = 1;
+	sh.bufTable[slot].fd       = fd;
+	sh.bufTable[slot].pageNum  = pageNum;
+	sh.bufTable[slot].bDirty   = FALSE;
+	sh.bufTable[slot].pinCount = 1;
+	sh.bufTable[slot].pinStart = 0;
+
+	// Start tracking the slot for replacement
+	sh.pReplacer->Admit(slot, fd, pageNum);
 
 	// Return ok
 	return (0);
@@ -926,11 +2021,11 @@ RC PF_BufferMgr::InitPageDesc(int fd, PageNum pageNum, int slot)
 //
 // Return the size of the block that can be allocated.  This is simply
 // just the size of the page since a block will take up a page in the
-// buffer pool.
+// buffer pool.  Blocks are taken from the shards of the default page size.
 //
 RC PF_BufferMgr::GetBlockSize(int &length) const
 {
-	length = pageSize;
+	length = PF_DEFAULT_PAGE_SIZE;
 	return OK_RC;
 }
 
@@ -940,42 +2035,60 @@ RC PF_BufferMgr::GetBlockSize(int &length) const
 //
 // Allocates a page in the buffer pool that is not associated with a
 // particular file and returns the pointer to the data area back to the
-// user.
+// user.  The shards are tried in turn until one has an unpinned page.
 //
 RC PF_BufferMgr::AllocateBlock(char *&buffer)
 {
 	RC rc = OK_RC;
+	int start = nextBlockShard++;
 
-	// Get an empty slot from the buffer pool
-	int slot;
-	if ((rc = InternalAlloc(slot)) != OK_RC)
-		return rc;
+	for (int i = 0; i < numShards; i++) {
+		PF_BufShard &sh = shards[(unsigned int)(start + i) % numShards];
+		std::lock_guard<std::mutex> guard(sh.latch);
 
-	// Create artificial page number (just needs to be unique for hash table)
-	PageNum pageNum = PTR2PAGENUM(bufTable[slot].pData);
+		// Get an empty slot from the buffer pool
+		int slot;
+		if ((rc = InternalAlloc(sh, slot)) == PF_NOBUF)
+			continue;
+		if (rc != OK_RC)
+			return rc;
 
-	// Insert the page into the hash table, and initialize the page description entry
-	if ((rc = hashTable.Insert(MEMORY_FD, pageNum, slot) != OK_RC) ||
-			(rc = InitPageDesc(MEMORY_FD, pageNum, slot)) != OK_RC) {
-		// Put the slot back on the free list before returning the error
-		Unlink(slot);
-		InsertFree(slot);
-		return rc;
-	}
+		// Create artificial page number (just needs to be unique for hash table)
+		PageNum pageNum = PTR2PAGENUM(sh.bufTable[slot].pData);
 
-	// Return pointer to buffer
-	buffer = bufTable[slot].pData;
+		// Insert the page into the hash table, and initialize the page description entry
+		if ((rc = sh.hashTable.Insert(MEMORY_FD, pageNum, slot) != OK_RC) ||
+				(rc = InitPageDesc(sh, MEMORY_FD, pageNum, slot)) != OK_RC) {
+			// Put the slot back on the free list before returning the error
+			Unlink(sh, slot);
+			InsertFree(sh, slot);
+			return rc;
+		}
 
-	// Return success code
-	return OK_RC;
+		// Return pointer to buffer
+		buffer = sh.bufTable[slot].pData;
+
+		// Return success code
+		return OK_RC;
+	}
+
+	return PF_NOBUF;
 }
 
 //
 // DisposeBlock
 //
-// Free the block of memory from the buffer pool.
+// Free the block of memory from the buffer pool.  The block may live in
+// any shard.
 //
 RC PF_BufferMgr::DisposeBlock(char* buffer)
 {
-	return UnpinPage(MEMORY_FD, PTR2PAGENUM(buffer));
+	RC rc = PF_PAGENOTINBUF;
+
+	for (int s = 0; s < numShards && rc == PF_PAGENOTINBUF; s++) {
+		std::lock_guard<std::mutex> guard(shards[s].latch);
+		rc = InternalUnpin(shards[s], MEMORY_FD, PTR2PAGENUM(buffer));
+	}
+
+	return rc;
 }
@@ -15,8 +15,17 @@
 #ifndef PF_BUFFERMGR_H
 #define PF_BUFFERMGR_H
 
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#include <utility>
+#include <sys/uio.h>
 #include "pf_internal.h"
 #include "pf_hashtable.h"
+#include "pf_replacer.h"
+#include "pf_readahead.h"
+#include "pf_bgwriter.h"
 
 //
 // Defines
@@ -28,37 +37,114 @@
 // next.
 #define INVALID_SLOT  (-1)
 
+//
+// PF_Arena - frames allocated in one piece for the shards of a page size
+//
+struct PF_Arena {
+	char       *pFrames;    // first frame
+	int        numPages;    // number of frames
+};
+
 //
 // PF_BufPageDesc - struct containing data about a page in the buffer
 //
 struct PF_BufPageDesc {
 	char       *pData;      // page contents
-	int        next;        // next in the linked list of buffer pages
-	int        prev;        // prev in the linked list of buffer pages
+	int        next;        // next in the used or free list
+	int        prev;        // prev in the used list
 	int        bDirty;      // TRUE if page is dirty
-	short int  pinCount;    // pin count
+	int        bIoPending;  // TRUE while the page is being read
+	int        bRing;       // TRUE if the slot is in the scan ring
+	std::atomic<int> pinCount; // pin count
+	long long  pinStart;    // PF_Nanos() when pinned by a user, 0 if not
 	PageNum    pageNum;     // page number for this page
 	int        fd;          // OS file descriptor of this page
+
+	// Order of the pages by file and page number
+	static bool PageOrder (const PF_BufPageDesc *a, const PF_BufPageDesc *b)
+		{ return (a->fd < b->fd ||
+		          (a->fd == b->fd && a->pageNum < b->pageNum)); }
+};
+
+//
+// PF_BufShard - one partition of the buffer
+//
+// Pages are spread over the shards by hashing (fd,pageNum).  Each shard
+// has its own slots, hash table, replacer and lists, all protected by
+// the shard latch, so threads working on different shards do not wait
+// for each other.  Slot numbers are local to a shard.  All the pages of a
+// shard have the same size.  A slot is on the used list, on the free list,
+// or, once the shard has shrunk, on the spare list without a frame.
+// The slots of the scan ring are used slots marked bRing; they leave the
+// ring when the policy replaces them or a page is asked for without hint.
+//
+struct PF_BufShard {
+	PF_BufShard () : bufTable(NULL), hashTable(0), pReplacer(NULL),
+	                 numPages(0), numSlots(0), pageSize(0),
+	                 first(INVALID_SLOT), last(INVALID_SLOT),
+	                 free(INVALID_SLOT), spare(INVALID_SLOT),
+	                 ringNext(0), numIoPending(0) {}
+
+	PF_BufPageDesc *bufTable;                     // info on buffer pages
+	PF_HashTable   hashTable;                     // Hash table object
+	PF_Replacer    *pReplacer;                    // chooses victim slots
+	int            numPages;                      // # of pages in the shard
+	int            numSlots;                      // # of slots in bufTable
+	int            pageSize;                      // size of its pages
+	int            first;                         // head of used list
+	int            last;                          // tail of used list
+	int            free;                          // head of free list
+	int            spare;                         // head of the slots
+	                                              // without a frame
+	std::vector<int> ring;                        // slots of the scan ring
+	int            ringNext;                      // next ring slot to reuse
+	int            numIoPending;                  // # of reads in progress
+	std::vector<PF_FileStats> fileStats;          // counters by fd + 1
+	std::mutex     latch;                         // protects the shard
+	std::condition_variable ioDone;               // a read has finished
 };
 
 //
 // PF_BufferMgr - manage the page buffer
 //
+// All public methods may be called by several threads at once.
+// The page to replace is chosen by a PF_Replacer (see pf_replacer.h).
+// Pages can be loaded ahead of time by background threads (see
+// pf_readahead.h) and cold dirty pages written by another one (see
+// pf_bgwriter.h).  Pages read with the SEQUENTIAL_SCAN or ONE_SHOT hint
+// go through the scan ring of their shard.  GetPage gives the slot of
+// the page, which the page handles keep so that UnpinPage and MarkDirty
+// go to it without a hash lookup.  The pages of compressed files are read
+// and written through their PF_CompressedFile (see pf_compress.h).
+//
 class PF_BufferMgr {
 public:
 
-	PF_BufferMgr     (int numPages);             // Constructor - allocate
-												  // numPages buffer pages
+	PF_BufferMgr     (int numPages,              // Constructor - allocate
+					  PF_ReplacePolicy policy,   // numPages buffer pages
+					  int numShards = 1);        // in numShards partitions
 	~PF_BufferMgr    ();                         // Destructor
 
-	// Read pageNum into buffer, point *ppBuffer to location
-	RC  GetPage      (int fd, PageNum pageNum, char **ppBuffer,
-					  int bMultiplePins = TRUE);
+	// Make room for the pages of pageSize bytes of a file being opened.
+	// pageSize is then passed with every page of the file.
+	RC  UsePageSize  (int pageSize);
+
+	// Read pageNum into buffer, point *ppBuffer to location.  If pSlot
+	// is given, *pSlot is set to the slot of the page, which stays the
+	// same while the page is pinned.  hint tells how the page is used.
+	RC  GetPage      (int fd, int pageSize, PageNum pageNum, char **ppBuffer,
+					  int bMultiplePins = TRUE, int *pSlot = NULL,
+					  ClientHint hint = NO_HINT);
 	// Allocate a new page in the buffer, point *ppBuffer to its location
-	RC  AllocatePage (int fd, PageNum pageNum, char **ppBuffer);
+	RC  AllocatePage (int fd, int pageSize, PageNum pageNum, char **ppBuffer,
+					  int *pSlot = NULL);
 
-	RC  MarkDirty    (int fd, PageNum pageNum);  // Mark page dirty
-	RC  UnpinPage    (int fd, PageNum pageNum);  // Unpin page from the buffer
+	// Mark page dirty.  slot, if known, saves the hash lookup.
+	RC  MarkDirty    (int fd, int pageSize, PageNum pageNum,
+					  int slot = INVALID_SLOT);
+	// Unpin page from the buffer.  slot, if known, saves the hash lookup.
+	RC  UnpinPage    (int fd, int pageSize, PageNum pageNum,
+					  int slot = INVALID_SLOT);
 	RC  FlushPages   (int fd);                   // Flush pages for file
 
 	// Force a page to the disk, but do not remove from the buffer pool
@@ -70,9 +156,53 @@ public:
 	// Display all entries in the buffer
 	RC PrintBuffer   ();
 
-	// Attempts to resize the buffer to the new size
+	// Resize the buffer to the new size, keeping the pages it still holds
 	RC ResizeBuffer  (int iNewSize);
 
+	// Replace the page replacement policy
+	RC SetReplacePolicy (PF_ReplacePolicy policy);
+
+	// Read-ahead.  numPages is the number of pages read ahead of a
+	// sequential scan, 0 turns read-ahead off.
+	RC  SetReadAhead (int numPages);
+	int GetReadAhead () const { return readAheadPages; }
+	// Queue pages to be loaded in background for a reader using hint
+	RC  ReadAhead    (int fd, int pageSize, PageNum pageNum, int numPages,
+					  ClientHint hint = NO_HINT);
+	// Load a page unpinned if it is not in the buffer (read-ahead threads)
+	RC  PrefetchPage (int fd, int pageSize, PageNum pageNum,
+					  ClientHint hint = NO_HINT);
+	// Queue sorted pages of a file to be loaded by the read-ahead threads,
+	// even if read-ahead is off
+	RC  Prefetch     (int fd, int pageSize,
+					  const std::vector<PageNum> &pageNums);
+	// (heat, pageNum) of the pages of a file in the buffer, the heat
+	// going from 0 for the next victim to 1 for a pinned page
+	RC  ResidentPages(int fd, int pageSize,
+					  std::vector<std::pair<double, PageNum> > &pages);
+	// Number of pages of each size
+	int GetNumPages  () const { return numPages; }
+	// Number of pages of the smallest shard of each size
+	int GetShardPages() const { return numPages / numShards; }
+	// Counters of file fd summed over the shards, reset if bReset
+	RC  GetFileStats (int fd, PF_FileStats &stats, int bReset = FALSE);
+	// Reset the counters of all the files
+	RC  ResetFileStats ();
+
+	// Background writer.  The share tailPct of each shard which will be
+	// replaced next is kept between lowPct and highPct clean.
+	RC  SetBgWriter  (int tailPct, int lowPct, int highPct);
+	int GetNumShards () const { return numShards * PF_NUM_PAGE_SIZES; }
+	// Write the cold dirty pages of shard s (background writer)
+	RC  CleanShard   (int s, int tailPct, int lowPct, int highPct);
+
+	// Ask for transparent huge pages to back the frames
+	RC  SetHugePages (int bHugePages);
+
+	// Read and write the pages of file fd through pFile, or straight
+	// from the file again if pFile is NULL
+	void SetCompressed (int fd, PF_CompressedFile *pFile);
+
 	// Three Methods for manipulating raw memory buffers.  These memory
 	// locations are handled by the buffer manager, but are not
 	// associated with a particular file.  These should be used if you
@@ -87,27 +217,96 @@ public:
 	RC DisposeBlock  (char *buffer);
 
 private:
-	RC  InsertFree   (int slot);                 // Insert slot at head of free
-	RC  LinkHead     (int slot);                 // Insert slot at head of used
-	RC  Unlink       (int slot);                 // Unlink slot
-	RC  InternalAlloc(int &slot);                // Get a slot to use
+	// Index of the shard holding (fd,pageNum) among those of its size
+	int ShardIndex (int fd, PageNum pageNum) const
+		{ return ((PF_HashPage(fd, pageNum) >> 32) % numShards); }
+	// Shard holding (fd,pageNum), a page of pageSize bytes
+	PF_BufShard &ShardOf (int fd, int pageSize, PageNum pageNum)
+		{ return shards[PF_PageSizeClass(pageSize) * numShards +
+		                ShardIndex(fd, pageNum)]; }
+
+	// Number of pages of shard s among those of a size, out of numPages
+	int ShardPages (int numPages, int s) const
+		{ return (numPages / numShards + (s < numPages % numShards ? 1 : 0)); }
+
+	// Allocate and free the frames of the shards of one page size
+	char *AllocArena (int numPages, int pageSize);
+	void FreeArena   (char *pArena, int numPages, int pageSize);
+	// Set up the slots of a shard on the frames at pFrames
+	RC  InitShard    (PF_BufShard &sh, int numPages, int pageSize,
+	                  char *pFrames);
+
+	// The following methods work on one shard and expect its latch held
+	RC  InsertFree   (PF_BufShard &sh, int slot); // Insert slot at head of free
+	RC  LinkHead     (PF_BufShard &sh, int slot); // Insert slot at head of used
+	RC  Unlink       (PF_BufShard &sh, int slot); // Unlink slot
+	// Get a slot to use, from the scan ring if bRing
+	RC  InternalAlloc(PF_BufShard &sh, int &slot, int bRing = FALSE);
+	// Ring slot to reuse, INVALID_SLOT if the ring may grow or is pinned
+	int RingVictim   (PF_BufShard &sh);
+	// Most slots in the scan ring of a shard
+	int RingSize     (const PF_BufShard &sh) const;
+	RC  InternalUnpin(PF_BufShard &sh, int fd, PageNum pageNum,
+	                  int slot = INVALID_SLOT);
+	// Find the slot of a pinned page, trying slot before the hash table
+	RC  FindPinned   (PF_BufShard &sh, int fd, PageNum pageNum, int &slot);
+	RC  InternalClear(PF_BufShard &sh);           // Drop unpinned pages
+	// Give a shard iNewSize frames, pFrames holding those it lacks
+	RC  InternalResize(PF_BufShard &sh, int iNewSize, char *pFrames);
+	// Load a page which is not in the buffer and pin it, unlocks the
+	// shard latch held by guard during the read
+	RC  InternalRead (PF_BufShard &sh, std::unique_lock<std::mutex> &guard,
+	                  int fd, PageNum pageNum, int &slot, int bRing);
 
 	// Read a page
-	RC  ReadPage     (int fd, PageNum pageNum, char *dest);
+	RC  ReadPage     (int fd, int pageSize, PageNum pageNum, char *dest);
 
 	// Write a page
-	RC  WritePage    (int fd, PageNum pageNum, char *source);
+	RC  WritePage    (int fd, int pageSize, PageNum pageNum, char *source);
+
+	// Write consecutive pages at once
+	RC  WritePages   (int fd, int pageSize, PageNum pageNum,
+	                  const struct iovec *iov, int numPages);
+	// Write the dirty pages of a file in page order, all shards latched
+	RC  WriteDirtyPages (int fd, PageNum pageNum, int bPinned);
+	// Write sorted pages of pageSize bytes, coalescing consecutive ones
+	RC  WriteRuns    (std::vector<PF_BufPageDesc *> &pages, int pageSize,
+	                  int &numDone);
+	// Latch the shards which may hold (fd,pageNum) once their I/O is done
+	void LatchShards (int fd, PageNum pageNum,
+	                  std::vector<std::unique_lock<std::mutex> > &guards);
+
+	// Compressed file of fd, NULL if fd is not compressed
+	PF_CompressedFile *CompressedOf (int fd);
 
+	// Counters of file fd in a shard whose latch is held
+	PF_FileStats &StatsOf (PF_BufShard &sh, int fd)
+		{ if ((int)sh.fileStats.size() <= fd + 1)
+		      sh.fileStats.resize(fd + 2, PF_FileStats());
+		  return sh.fileStats[fd + 1]; }
+	// Count the end of the pin of a page of a shard whose latch is held
+	void EndPin      (PF_BufShard &sh, PF_BufPageDesc &desc);
 	// Init the page desc entry
-	RC  InitPageDesc (int fd, PageNum pageNum, int slot);
+	RC  InitPageDesc (PF_BufShard &sh, int fd, PageNum pageNum, int slot);
 
-	PF_BufPageDesc *bufTable;                     // info on buffer pages
-	PF_HashTable   hashTable;                     // Hash table object
-	int            numPages;                      // # of pages in the buffer
-	int            pageSize;                      // Size of pages in the buffer
-	int            first;                         // MRU page slot
-	int            last;                          // LRU page slot
-	int            free;                          // head of free list
+	// The numShards shards of page size PF_DEFAULT_PAGE_SIZE << c start
+	// at shards[c * numShards].  Their frames are in arenas[c], which is
+	// empty until a file of that size is opened; an arena is added each
+	// time the buffer grows.
+	PF_BufShard    *shards;                       // partitions of the buffer
+	std::vector<PF_Arena> arenas[PF_NUM_PAGE_SIZES]; // frames of each size
+	int            bHugePages;                    // TRUE to advise huge pages
+	int            numShards;                     // # of partitions per size
+	int            numPages;                      // # of pages of each size
+	PF_ReplacePolicy policy;                      // policy of the replacers
+	std::atomic<int> nextBlockShard;              // where AllocateBlock starts
+	std::atomic<int> readAheadPages;              // read-ahead window
+	PF_ReadAhead   *pReadAhead;                   // read-ahead threads or NULL
+	PF_BgWriter    *pBgWriter;                    // writer thread or NULL
+	std::mutex     helperLatch;                   // protects their creation
+	std::vector<PF_CompressedFile *> compressed;  // by fd, NULL if none
+	std::atomic<int> numCompressed;               // non-NULL in compressed
+	std::mutex     compressLatch;                 // protects compressed
 };
 
 #endif
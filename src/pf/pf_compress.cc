@@ -0,0 +1,494 @@
+//
+// File:        pf_compress.cc
+// Description: PF_CompressedFile class implementation and page codec
+//
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <unistd.h>
+#include "pf_compress.h"
+
+using namespace std;
+
+//
+// Codec
+//
+// A compressed page is a list of sequences.  A sequence starts with a
+// token byte: the number of literals in its high nibble and the length
+// of the match minus PF_LZ_MIN_MATCH in its low one, 15 meaning that
+// bytes follow which are added up to the first one below 255.  Then come
+// the literals, the offset of the match back from the current position
+// on two bytes, low byte first, and the bytes extending the match length.
+// The last sequence only has literals and ends the page.
+//
+const int PF_LZ_MIN_MATCH = 4;     // shortest match
+const int PF_LZ_HASH_BITS = 12;    // log2 of entries of the match finder
+const int PF_LZ_MAX_OFFSET = 65535;
+
+static inline unsigned int Load32(const unsigned char *p)
+{
+	unsigned int v;
+	memcpy(&v, p, sizeof(v));
+	return (v);
+}
+
+static inline int Hash(unsigned int v)
+{
+	return ((v * 2654435761U) >> (32 - PF_LZ_HASH_BITS));
+}
+
+//
+// PutLength
+//
+// Write the bytes extending a length whose nibble is 15.  Returns FALSE
+// if they do not fit before end.
+//
+static int PutLength(unsigned char *&d, const unsigned char *end, int length)
+{
+	for (length -= 15; length >= 255; length -= 255) {
+		if (d >= end)
+			return (FALSE);
+		*d++ = 255;
+	}
+	if (d >= end)
+		return (FALSE);
+	*d++ = (unsigned char)length;
+	return (TRUE);
+}
+
+//
+// PutSequence
+//
+// Write a sequence of numLiterals literals and a match of matchLength
+// bytes offset back, or only the literals if matchLength is 0
+//
+static int PutSequence(unsigned char *&d, const unsigned char *end,
+		const unsigned char *pLiterals, int numLiterals, int offset,
+		int matchLength)
+{
+	int matchCode = matchLength ? matchLength - PF_LZ_MIN_MATCH : 0;
+
+	if (d >= end)
+		return (FALSE);
+	unsigned char *pToken = d++;
+	*pToken = (unsigned char)(((numLiterals < 15 ? numLiterals : 15) << 4) |
+		(matchCode < 15 ? matchCode : 15));
+
+	if (numLiterals >= 15 && !PutLength(d, end, numLiterals))
+		return (FALSE);
+	if (end - d < numLiterals)
+		return (FALSE);
+	memcpy(d, pLiterals, numLiterals);
+	d += numLiterals;
+
+	if (matchLength == 0)
+		return (TRUE);
+	if (end - d < 2)
+		return (FALSE);
+	*d++ = (unsigned char)(offset & 0xff);
+	*d++ = (unsigned char)(offset >> 8);
+	return (matchCode < 15 || PutLength(d, end, matchCode));
+}
+
+//
+// PF_Compress
+//
+// Desc: Compress a page.  The match finder remembers the last position
+//       of each hash of four bytes; positions are skipped faster the
+//       longer no match is found, so that data which does not compress
+//       costs little.
+// In:   src - data to compress
+//       srcLen - bytes of src
+//       dstCap - room in dst
+// Out:  dst - compressed data
+// Ret:  length of the compressed data, 0 if more than dstCap
+//
+int PF_Compress(const char *src, int srcLen, char *dst, int dstCap)
+{
+	const unsigned char *s = (const unsigned char *)src;
+	unsigned char *d = (unsigned char *)dst;
+	const unsigned char *end = d + dstCap;
+	int table[1 << PF_LZ_HASH_BITS];
+	int anchor = 0;                    // first literal not written
+	int i = 0;
+
+	memset(table, 0xff, sizeof(table));
+
+	while (i + PF_LZ_MIN_MATCH <= srcLen) {
+		unsigned int v = Load32(s + i);
+		int h = Hash(v);
+		int candidate = table[h];
+		table[h] = i;
+
+		if (candidate < 0 || i - candidate > PF_LZ_MAX_OFFSET ||
+				Load32(s + candidate) != v) {
+			i += 1 + ((i - anchor) >> 6);
+			continue;
+		}
+
+		int length = PF_LZ_MIN_MATCH;
+		while (i + length < srcLen && s[candidate + length] == s[i + length])
+			length++;
+
+		if (!PutSequence(d, end, s + anchor, i - anchor, i - candidate,
+				length))
+			return (0);
+		i += length;
+		anchor = i;
+	}
+
+	if (!PutSequence(d, end, s + anchor, srcLen - anchor, 0, 0))
+		return (0);
+	return ((int)(d - (unsigned char *)dst));
+}
+
+//
+// GetLength
+//
+// Read the bytes extending a length whose nibble is 15.  Returns -1 if
+// they run past end.
+//
+static int GetLength(const unsigned char *&s, const unsigned char *end)
+{
+	int length = 15;
+	unsigned char b;
+	do {
+		if (s >= end)
+			return (-1);
+		b = *s++;
+		length += b;
+	} while (b == 255 && length < (1 << 24));
+	return (length);
+}
+
+//
+// PF_Decompress
+//
+// Desc: Decompress a page, checking every length and offset against the
+//       bounds of src and dst, so that a damaged extent cannot write out
+//       of dst
+// In:   src - compressed data
+//       srcLen - bytes of src
+//       dstCap - room in dst
+// Out:  dst - decompressed data
+// Ret:  length of the data, -1 if src is damaged or it exceeds dstCap
+//
+int PF_Decompress(const char *src, int srcLen, char *dst, int dstCap)
+{
+	const unsigned char *s = (const unsigned char *)src;
+	const unsigned char *sEnd = s + srcLen;
+	unsigned char *d = (unsigned char *)dst;
+	unsigned char *dEnd = d + dstCap;
+
+	for (;;) {
+		if (s >= sEnd)
+			return (-1);
+		int token = *s++;
+
+		int numLiterals = token >> 4;
+		if (numLiterals == 15 && (numLiterals = GetLength(s, sEnd)) < 0)
+			return (-1);
+		if (numLiterals > sEnd - s || numLiterals > dEnd - d)
+			return (-1);
+		memcpy(d, s, numLiterals);
+		s += numLiterals;
+		d += numLiterals;
+
+		// The last sequence has no match
+		if (s == sEnd)
+			break;
+
+		if (sEnd - s < 2)
+			return (-1);
+		int offset = s[0] | (s[1] << 8);
+		s += 2;
+		if (offset == 0 || offset > d - (unsigned char *)dst)
+			return (-1);
+
+		int length = token & 15;
+		if (length == 15 && (length = GetLength(s, sEnd)) < 0)
+			return (-1);
+		length += PF_LZ_MIN_MATCH;
+		if (length > dEnd - d)
+			return (-1);
+
+		// A match may overlap the bytes it produces
+		const unsigned char *pMatch = d - offset;
+		if (offset >= length)
+			memcpy(d, pMatch, length);
+		else
+			for (int k = 0; k < length; k++)
+				d[k] = pMatch[k];
+		d += length;
+	}
+
+	return ((int)(d - (unsigned char *)dst));
+}
+
+// --------------------------------------------------------------
+
+//
+// PF_CompressedFile class
+//
+
+// First int of a map file
+const int PF_MAP_MAGIC = 0x315a4650;    // "PFZ1"
+
+PF_CompressedFile::PF_CompressedFile(int _fd, int _pageSize,
+		const char *fileName)
+{
+	fd = _fd;
+	pageSize = _pageSize;
+	mapName = MapName(fileName);
+	fileEnd = PF_FILE_HDR_SIZE;
+	bMapChanged = FALSE;
+}
+
+//
+// Load
+//
+// Desc: Read the offset map of the file.  The space between the extents
+//       is free.
+// In:   numPages - number of pages in the file header
+// Ret:  PF_UNIX if the map cannot be read, PF_HDRREAD if it is damaged
+//
+RC PF_CompressedFile::Load(int numPages)
+{
+	lock_guard<mutex> guard(latch);
+
+	extents.clear();
+	freeExtents.clear();
+	pendingFree.clear();
+	fileEnd = PF_FILE_HDR_SIZE;
+	bMapChanged = FALSE;
+
+	FILE *pFile = fopen(mapName.c_str(), "rb");
+	if (pFile == NULL) {
+		extents.resize(numPages, PF_Extent());
+		return (errno == ENOENT && numPages == 0 ? 0 : PF_UNIX);
+	}
+
+	int head[2];
+	RC rc = 0;
+	if (fread(head, sizeof(int), 2, pFile) != 2 ||
+			head[0] != PF_MAP_MAGIC || head[1] < 0)
+		rc = PF_HDRREAD;
+	else {
+		extents.resize(max(head[1], numPages), PF_Extent());
+		for (int i = 0; i < head[1] && rc == 0; i++)
+			if (fread(&extents[i].offset, sizeof(long long), 1, pFile) != 1 ||
+					fread(&extents[i].units, sizeof(int), 1, pFile) != 1)
+				rc = PF_HDRREAD;
+	}
+	fclose(pFile);
+	if (rc)
+		return (rc);
+
+	// Free the gaps between the extents, which must not overlap
+	vector<pair<long long, int> > used;
+	for (size_t i = 0; i < extents.size(); i++)
+		if (extents[i].offset)
+			used.push_back(make_pair(extents[i].offset, extents[i].units));
+	sort(used.begin(), used.end());
+
+	for (size_t i = 0; i < used.size(); i++) {
+		if (used[i].first < fileEnd || used[i].second <= 0)
+			return (PF_HDRREAD);
+		if (used[i].first > fileEnd)
+			freeExtents.insert(make_pair(
+					(int)((used[i].first - fileEnd) / PF_EXTENT_UNIT), fileEnd));
+		fileEnd = used[i].first + (long long)used[i].second * PF_EXTENT_UNIT;
+	}
+
+	return (0);
+}
+
+//
+// SaveMap
+//
+// Desc: Write the offset map if it changed, beside and then renamed.
+//       The extents pages moved out of can then be reused.
+// Ret:  PF_UNIX if the map cannot be written
+//
+RC PF_CompressedFile::SaveMap()
+{
+	lock_guard<mutex> guard(latch);
+
+	if (!bMapChanged)
+		return (0);
+
+	string tmpName = mapName + ".tmp";
+	FILE *pFile = fopen(tmpName.c_str(), "wb");
+	if (pFile == NULL)
+		return (PF_UNIX);
+
+	int head[2] = { PF_MAP_MAGIC, (int)extents.size() };
+	int bOk = (fwrite(head, sizeof(int), 2, pFile) == 2);
+	for (size_t i = 0; i < extents.size() && bOk; i++)
+		bOk = (fwrite(&extents[i].offset, sizeof(long long), 1, pFile) == 1 &&
+				fwrite(&extents[i].units, sizeof(int), 1, pFile) == 1);
+
+	if (fclose(pFile) != 0 || !bOk || rename(tmpName.c_str(),
+			mapName.c_str()) < 0) {
+		unlink(tmpName.c_str());
+		return (PF_UNIX);
+	}
+
+	for (size_t i = 0; i < pendingFree.size(); i++)
+		Free(pendingFree[i].offset, pendingFree[i].units);
+	pendingFree.clear();
+	bMapChanged = FALSE;
+	return (0);
+}
+
+//
+// ReadPage
+//
+// Desc: Read the extent of a page and decompress it
+// In:   pageNum - page to read
+// Out:  dest - the page, pageSize bytes
+// Ret:  PF_INCOMPLETEREAD if the page has no extent or the extent is
+//       damaged, other PF return code
+//
+RC PF_CompressedFile::ReadPage(PageNum pageNum, char *dest)
+{
+	PF_Extent extent = PF_Extent();
+	{
+		lock_guard<mutex> guard(latch);
+		if (pageNum >= 0 && pageNum < (PageNum)extents.size())
+			extent = extents[pageNum];
+	}
+	if (extent.offset == 0)
+		return (PF_INCOMPLETEREAD);
+
+	char buf[sizeof(PF_ExtentHdr) + PF_MAX_PAGE_SIZE + PF_EXTENT_UNIT];
+	int length = extent.units * PF_EXTENT_UNIT;
+	if (length > (int)sizeof(buf))
+		return (PF_INCOMPLETEREAD);
+
+	int numBytes = pread(fd, buf, length, extent.offset);
+	if (numBytes < 0)
+		return (PF_UNIX);
+	if (numBytes != length)
+		return (PF_INCOMPLETEREAD);
+
+	PF_ExtentHdr *pHdr = (PF_ExtentHdr *)buf;
+	char *pData = buf + sizeof(PF_ExtentHdr);
+	if (pHdr->pageNum != pageNum || pHdr->length <= 0 ||
+			pHdr->length > pageSize ||
+			pHdr->length > length - (int)sizeof(PF_ExtentHdr))
+		return (PF_INCOMPLETEREAD);
+
+	if (pHdr->length == pageSize)
+		memcpy(dest, pData, pageSize);
+	else if (PF_Decompress(pData, pHdr->length, dest, pageSize) != pageSize)
+		return (PF_INCOMPLETEREAD);
+
+	return (0);
+}
+
+//
+// WritePage
+//
+// Desc: Compress a page and write it to its extent, or to a new one if
+//       it no longer fits there.  A page which does not compress is
+//       written as it is.
+// In:   pageNum - page to write
+//       source - the page, pageSize bytes
+// Ret:  PF return code
+//
+RC PF_CompressedFile::WritePage(PageNum pageNum, const char *source)
+{
+	char buf[sizeof(PF_ExtentHdr) + PF_MAX_PAGE_SIZE + PF_EXTENT_UNIT];
+	PF_ExtentHdr *pHdr = (PF_ExtentHdr *)buf;
+	char *pData = buf + sizeof(PF_ExtentHdr);
+
+	int length = PF_Compress(source, pageSize, pData, pageSize - 1);
+	if (length == 0) {
+		memcpy(pData, source, pageSize);
+		length = pageSize;
+	}
+	pHdr->pageNum = pageNum;
+	pHdr->length = length;
+
+	int numBytes = sizeof(PF_ExtentHdr) + length;
+	int units = (numBytes + PF_EXTENT_UNIT - 1) / PF_EXTENT_UNIT;
+	memset(buf + numBytes, 0, units * PF_EXTENT_UNIT - numBytes);
+
+	long long offset;
+	{
+		lock_guard<mutex> guard(latch);
+
+		if (pageNum >= (PageNum)extents.size())
+			extents.resize(pageNum + 1, PF_Extent());
+		PF_Extent &extent = extents[pageNum];
+
+		if (extent.offset && units <= extent.units) {
+			// Keep the extent, giving back what it no longer needs
+			if (units < extent.units) {
+				Free(extent.offset + (long long)units * PF_EXTENT_UNIT,
+						extent.units - units);
+				extent.units = units;
+				bMapChanged = TRUE;
+			}
+		}
+		else {
+			if (extent.offset)
+				pendingFree.push_back(extent);
+			extent.offset = Allocate(units);
+			extent.units = units;
+			bMapChanged = TRUE;
+		}
+		offset = extent.offset;
+	}
+
+	numBytes = pwrite(fd, buf, units * PF_EXTENT_UNIT, offset);
+	if (numBytes < 0)
+		return (PF_UNIX);
+	if (numBytes != units * PF_EXTENT_UNIT)
+		return (PF_INCOMPLETEWRITE);
+	return (0);
+}
+
+//
+// Allocate
+//
+// Desc: Internal.  Take the smallest free extent which is large enough,
+//       giving back what is left of it, or else one at the end of the
+//       file.  Called with the latch held.
+// In:   units - length of the extent
+// Ret:  offset of the extent
+//
+long long PF_CompressedFile::Allocate(int units)
+{
+	multimap<int, long long>::iterator it = freeExtents.lower_bound(units);
+	if (it == freeExtents.end()) {
+		long long offset = fileEnd;
+		fileEnd += (long long)units * PF_EXTENT_UNIT;
+		return (offset);
+	}
+
+	long long offset = it->second;
+	int extra = it->first - units;
+	freeExtents.erase(it);
+	if (extra > 0)
+		Free(offset + (long long)units * PF_EXTENT_UNIT, extra);
+	return (offset);
+}
+
+//
+// Free
+//
+// Desc: Internal.  Give back an extent.  One at the end of the file
+//       moves the end back instead.  Called with the latch held.
+// In:   offset - start of the extent
+//       units - length of the extent
+//
+void PF_CompressedFile::Free(long long offset, int units)
+{
+	if (offset + (long long)units * PF_EXTENT_UNIT == fileEnd)
+		fileEnd = offset;
+	else
+		freeExtents.insert(make_pair(units, offset));
+}
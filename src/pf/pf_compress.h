@@ -0,0 +1,109 @@
+//
+// File:        pf_compress.h
+// Description: PF_CompressedFile class interface and page codec
+//
+// Archival tables hold mostly fixed width strings padded with blanks or
+// zeros, so most of their pages are a few hundred bytes of data and a lot
+// of padding.  A file created with bCompressed keeps its pages compressed
+// on disk.  The frames in the buffer hold the pages as usual; only
+// PF_BufferMgr::ReadPage and WritePage, and the header and bitmap page
+// I/O of PF_FileHandle, go through PF_CompressedFile.
+//
+// The page codec is a byte oriented LZ77 in the manner of LZ4: runs of
+// literals and back references within the page, no entropy coding.  It
+// compresses a page in a few microseconds and decompresses it faster
+// than it can be read from disk.
+//
+
+#ifndef PF_COMPRESS_H
+#define PF_COMPRESS_H
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "pf_internal.h"
+
+//
+// PF_Compress
+//
+// Compress srcLen bytes of src into dst.  Returns the compressed length,
+// or 0 if it would take more than dstCap bytes.
+//
+int PF_Compress   (const char *src, int srcLen, char *dst, int dstCap);
+
+//
+// PF_Decompress
+//
+// Decompress srcLen bytes of src into dst.  Returns the decompressed
+// length, or -1 if src is damaged or would take more than dstCap bytes.
+//
+int PF_Decompress (const char *src, int srcLen, char *dst, int dstCap);
+
+// Extents are multiples of PF_EXTENT_UNIT bytes
+const int PF_EXTENT_UNIT = 256;
+
+// Suffix of the file holding the offset map of a compressed file
+#define PF_MAP_SUFFIX ".map"
+
+//
+// PF_CompressedFile - pages of a compressed file
+//
+// After the header page, which is not compressed, the file is a heap of
+// extents.  An extent starts with a PF_ExtentHdr giving its page and the
+// length of the compressed page, which follows; a page which does not
+// compress is stored as it is.  The offset map gives the extent of each
+// page.  It is kept in memory and written to fileName + PF_MAP_SUFFIX by
+// SaveMap, beside and then renamed.
+//
+// A page rewritten in place keeps its extent when it still fits, giving
+// back the units it no longer needs.  Otherwise it moves to a new extent,
+// and its old one is only reused once the map has been saved, so that
+// the map on disk always points at extents holding their pages.
+//
+class PF_CompressedFile {
+public:
+	PF_CompressedFile  (int fd, int pageSize, const char *fileName);
+
+	// Read the offset map.  A missing map is empty, which is only right
+	// for a file without pages.
+	RC   Load          (int numPages);
+	// Write the offset map if it changed
+	RC   SaveMap       ();
+
+	// Read page pageNum into dest, pageSize bytes
+	RC   ReadPage      (PageNum pageNum, char *dest);
+	// Compress page pageNum from source and write it
+	RC   WritePage     (PageNum pageNum, const char *source);
+
+	// Name of the map of the file fileName
+	static std::string MapName (const char *fileName)
+		{ return std::string(fileName) + PF_MAP_SUFFIX; }
+
+private:
+	struct PF_Extent {
+		long long offset;       // in the file, 0 if the page has none
+		int       units;        // length in PF_EXTENT_UNIT
+	};
+	struct PF_ExtentHdr {
+		int pageNum;            // page stored in the extent
+		int length;             // bytes which follow, pageSize if raw
+	};
+
+	// Offset of a new extent of units, the latch held
+	long long Allocate (int units);
+	// Give back an extent, the latch held
+	void Free          (long long offset, int units);
+
+	int fd;                                     // OS file descriptor
+	int pageSize;                               // size of the pages
+	std::string mapName;                        // file of the offset map
+	std::vector<PF_Extent> extents;             // offset map by page
+	std::multimap<int, long long> freeExtents;  // (units, offset) free
+	std::vector<PF_Extent> pendingFree;         // free once map is saved
+	long long fileEnd;                          // end of the last extent
+	int bMapChanged;                            // TRUE if map not saved
+	std::mutex latch;                           // protects the members
+};
+
+#endif
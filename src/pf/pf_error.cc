@@ -25,6 +25,8 @@ static char *PF_WarnMsg[] = {
 	(char*)"page already unpinned",
 	(char*)"end of file",
 	(char*)"attempting to resize the buffer too small",
+	(char*)"invalid buffer parameter",
+	(char*)"arena over its memory budget",
 	(char*)"invalid filename"
 };
 
@@ -5,10 +5,15 @@
 //              Dallan Quass (quass@cs.stanford.edu)
 //
 
+#include <algorithm>
+#include <climits>
+#include <fcntl.h>
 #include <unistd.h>
 #include <sys/types.h>
 #include "pf_internal.h"
 #include "pf_buffermgr.h"
+#include "pf_mmap.h"
+#include "pf_compress.h"
 
 //
 // PF_FileHandle
@@ -28,6 +33,7 @@ PF_FileHandle::PF_FileHandle()
 	// Initialize local variables
 	bFileOpen = FALSE;
 	pBufferMgr = NULL;
+	pState = NULL;
 }
 
 //
@@ -54,8 +60,8 @@ PF_FileHandle::PF_FileHandle(const PF_FileHandle &fileHandle)
 	this->pBufferMgr  = fileHandle.pBufferMgr;
 	this->hdr         = fileHandle.hdr;
 	this->bFileOpen   = fileHandle.bFileOpen;
-	this->bHdrChanged = fileHandle.bHdrChanged;
 	this->unixfd      = fileHandle.unixfd;
+	this->pState      = fileHandle.pState;
 }
 
 //
@@ -76,8 +82,8 @@ PF_FileHandle& PF_FileHandle::operator= (const PF_FileHandle &fileHandle)
 		this->pBufferMgr  = fileHandle.pBufferMgr;
 		this->hdr         = fileHandle.hdr;
 		this->bFileOpen   = fileHandle.bFileOpen;
-		this->bHdrChanged = fileHandle.bHdrChanged;
 		this->unixfd      = fileHandle.unixfd;
+		this->pState      = fileHandle.pState;
 	}
 
 	// Return a reference to this
@@ -89,13 +95,15 @@ PF_FileHandle& PF_FileHandle::operator= (const PF_FileHandle &fileHandle)
 //
 // Desc: Get the first page in a file
 //       The file handle must refer to an open file
+// In:   hint - how the page is used
 // Out:  pageHandle - becomes a handle to the first page of the file
 //       The referenced page is pinned in the buffer pool.
 // Ret:  PF return code
 //
-RC PF_FileHandle::GetFirstPage(PF_PageHandle &pageHandle) const
+RC PF_FileHandle::GetFirstPage(PF_PageHandle &pageHandle,
+		ClientHint hint) const
 {
-	return (GetNextPage((PageNum)-1, pageHandle));
+	return (GetNextPage((PageNum)-1, pageHandle, hint));
 }
 
 //
@@ -103,13 +111,15 @@ RC PF_FileHandle::GetFirstPage(PF_PageHandle &pageHandle) const
 //
 // Desc: Get the last page in a file
 //       The file handle must refer to an open file
+// In:   hint - how the page is used
 // Out:  pageHandle - becomes a handle to the last page of the file
 //       The referenced page is pinned in the buffer pool.
 // Ret:  PF return code
 //
-RC PF_FileHandle::GetLastPage(PF_PageHandle &pageHandle) const
+RC PF_FileHandle::GetLastPage(PF_PageHandle &pageHandle,
+		ClientHint hint) const
 {
-	return (GetPrevPage((PageNum)hdr.numPages, pageHandle));
+	return (GetPrevPage((PageNum)pState->numPages, pageHandle, hint));
 }
 
 //
@@ -117,15 +127,20 @@ RC PF_FileHandle::GetLastPage(PF_PageHandle &pageHandle) const
 //
 // Desc: Get the next (valid) page after current
 //       The file handle must refer to an open file
+//       The used pages are found in the allocation bitmap, so the free
+//       pages are skipped without being read.
 // In:   current - get the next valid page after this page number
 //       current can refer to a page that has been disposed
+//       hint - how the page is used
 // Out:  pageHandle - becomes a handle to the next page of the file
 //       The referenced page is pinned in the buffer pool.
 // Ret:  PF_EOF, or another PF return code
 //
-RC PF_FileHandle::GetNextPage(PageNum current, PF_PageHandle &pageHandle) const
+RC PF_FileHandle::GetNextPage(PageNum current, PF_PageHandle &pageHandle,
+		ClientHint hint) const
 {
 	int rc;               // return code
+	PageNum next;         // next used page
 
 	// File must be open
 	if (!bFileOpen)
@@ -135,20 +150,26 @@ RC PF_FileHandle::GetNextPage(PageNum current, PF_PageHandle &pageHandle) const
 	if (current != -1 &&  !IsValidPageNum(current))
 		return (PF_INVALIDPAGE);
 
-	// Scan the file until a valid used page is found
-	for (current++; current < hdr.numPages; current++) {
+	// Scan the bitmap until a used page is found
+	for (;;) {
+		{
+			std::lock_guard<std::mutex> guard(pState->latch);
+			next = pState->used.NextSet(current + 1, pState->numPages);
+		}
 
-		// If this is a valid (used) page, we're done
-		if (!(rc = GetThisPage(current, pageHandle)))
+		// No valid (used) page found
+		if (next < 0)
+			return (PF_EOF);
+
+		// If the page is still used, we're done
+		if (!(rc = GetThisPage(next, pageHandle, hint)))
 			return (0);
 
 		// If unexpected error, return it
 		if (rc != PF_INVALIDPAGE)
 			return (rc);
+		current = next;
 	}
-
-	// No valid (used) page found
-	return (PF_EOF);
 }
 
 //
@@ -158,36 +179,45 @@ RC PF_FileHandle::GetNextPage(PageNum current, PF_PageHandle &pageHandle) const
 //       The file handle must refer to an open file
 // In:   current - get the prev valid page before this page number
 //       current can refer to a page that has been disposed
+//       hint - how the page is used
 // Out:  pageHandle - becomes a handle to the prev page of the file
 //       The referenced page is pinned in the buffer pool.
 // Ret:  PF_EOF, or another PF return code
 //
-RC PF_FileHandle::GetPrevPage(PageNum current, PF_PageHandle &pageHandle) const
+RC PF_FileHandle::GetPrevPage(PageNum current, PF_PageHandle &pageHandle,
+		ClientHint hint) const
 {
 	int rc;               // return code
+	PageNum prev;         // previous used page
 
 	// File must be open
 	if (!bFileOpen)
 		return (PF_CLOSEDFILE);
 
-	// Validate page number (note that hdr.numPages is acceptable here)
-	if (current != hdr.numPages &&  !IsValidPageNum(current))
+	// Validate page number (note that numPages is acceptable here)
+	if (current != pState->numPages &&  !IsValidPageNum(current))
 		return (PF_INVALIDPAGE);
 
-	// Scan the file until a valid used page is found
-	for (current--; current >= 0; current--) {
+	// Scan the bitmap backwards until a used page is found
+	for (;;) {
+		{
+			std::lock_guard<std::mutex> guard(pState->latch);
+			prev = pState->used.PrevSet(current - 1);
+		}
 
-		// If this is a valid (used) page, we're done
-		if (!(rc = GetThisPage(current, pageHandle)))
+		// No valid (used) page found
+		if (prev < 0)
+			return (PF_EOF);
+
+		// If the page is still used, we're done
+		if (!(rc = GetThisPage(prev, pageHandle, hint)))
 			return (0);
 
 		// If unexpected error, return it
 		if (rc != PF_INVALIDPAGE)
 			return (rc);
+		current = prev;
 	}
-
-	// No valid (used) page found
-	return (PF_EOF);
 }
 
 //
@@ -196,15 +226,20 @@ RC PF_FileHandle::GetPrevPage(PageNum current, PF_PageHandle &pageHandle) const
 // Desc: Get a specific page in a file
 //       The file handle must refer to an open file
 // In:   pageNum - the number of the page to get
+//       hint - how the page is used.  The pages of a SEQUENTIAL_SCAN or
+//              ONE_SHOT are read into the scan ring of the buffer, and
+//              RANDOM fetches are left out of the read-ahead tracking.
 // Out:  pageHandle - becomes a handle to the this page of the file
 //                    this function modifies local var's in pageHandle
 //       The referenced page is pinned in the buffer pool.
 // Ret:  PF return code
 //
-RC PF_FileHandle::GetThisPage(PageNum pageNum, PF_PageHandle &pageHandle) const
+RC PF_FileHandle::GetThisPage(PageNum pageNum, PF_PageHandle &pageHandle,
+		ClientHint hint) const
 {
 	int  rc;               // return code
 	char *pPageBuf;        // address of page in buffer pool
+	int  slot = INVALID_SLOT; // slot of the page in the buffer
 
 	// File must be open
 	if (!bFileOpen)
@@ -214,34 +249,106 @@ RC PF_FileHandle::GetThisPage(PageNum pageNum, PF_PageHandle &pageHandle) const
 	if (!IsValidPageNum(pageNum))
 		return (PF_INVALIDPAGE);
 
-	// Get this page from the buffer manager
-	if ((rc = pBufferMgr->GetPage(unixfd, pageNum, &pPageBuf)))
+	// Get this page from the mapping or from the buffer manager
+	if (pState->pMapped) {
+		if ((rc = pState->pMapped->Pin(pageNum, &pPageBuf)))
+			return (rc);
+	}
+	else if ((rc = pBufferMgr->GetPage(unixfd, hdr.pageSize, pageNum,
+			&pPageBuf, TRUE, &slot, hint)))
 		return (rc);
 
+	// Load the following pages if the file is read in order
+	if (hint != RANDOM)
+		ReadAhead(pageNum, hint);
+
 	// If the page is valid, then set pageHandle to this page and return ok
 	if (((PF_PageHdr*)pPageBuf)->nextFree == PF_PAGE_USED) {
 
 		// Set the pageHandle local variables
 		pageHandle.pageNum = pageNum;
 		pageHandle.pPageData = pPageBuf + sizeof(PF_PageHdr);
+		pageHandle.slot = slot;
 
 		// Return ok
 		return (0);
 	}
 
 	// If the page is *not* a valid one, then unpin the page
-	if ((rc = UnpinPage(pageNum)))
+	if (pState->pMapped)
+		rc = pState->pMapped->Unpin(pageNum);
+	else
+		rc = pBufferMgr->UnpinPage(unixfd, hdr.pageSize, pageNum, slot);
+	if (rc)
 		return (rc);
 
 	return (PF_INVALIDPAGE);
 }
 
+//
+// GetFirstPage, GetNextPage, GetThisPage, AllocatePage
+//
+// Desc: Same as the methods taking a PF_PageHandle, the page being held
+//       by a guard.  The page the guard held is unpinned first, so that a
+//       scan can go from page to page with one guard.
+// Out:  pageGuard - holds the page, or no page if an error is returned
+// Ret:  PF return code
+//
+RC PF_FileHandle::GetFirstPage(PF_PageGuard &pageGuard,
+		ClientHint hint) const
+{
+	return (GetNextPage((PageNum)-1, pageGuard, hint));
+}
+
+RC PF_FileHandle::GetNextPage(PageNum current, PF_PageGuard &pageGuard,
+		ClientHint hint) const
+{
+	RC rc;
+	PF_PageHandle pageHandle;
+
+	if ((rc = pageGuard.Release()) ||
+			(rc = GetNextPage(current, pageHandle, hint)))
+		return (rc);
+
+	pageGuard = PF_PageGuard(*this, pageHandle);
+	return (0);
+}
+
+RC PF_FileHandle::GetThisPage(PageNum pageNum, PF_PageGuard &pageGuard,
+		ClientHint hint) const
+{
+	RC rc;
+	PF_PageHandle pageHandle;
+
+	if ((rc = pageGuard.Release()) ||
+			(rc = GetThisPage(pageNum, pageHandle, hint)))
+		return (rc);
+
+	pageGuard = PF_PageGuard(*this, pageHandle);
+	return (0);
+}
+
+RC PF_FileHandle::AllocatePage(PF_PageGuard &pageGuard)
+{
+	RC rc;
+	PF_PageHandle pageHandle;
+
+	if ((rc = pageGuard.Release()) ||
+			(rc = AllocatePage(pageHandle)))
+		return (rc);
+
+	pageGuard = PF_PageGuard(*this, pageHandle);
+	return (0);
+}
+
 //
 // AllocatePage
 //
 // Desc: Allocate a new page in the file (may get a page which was
 //       previously disposed)
 //       The file handle must refer to an open file
+//       The first free page is found in the allocation bitmap.  Its
+//       contents are not needed, so it is not read from the file.
 // Out:  pageHandle - becomes a handle to the newly-allocated page
 //                    this function modifies local var's in pageHandle
 // Ret:  PF return code
@@ -251,55 +358,107 @@ RC PF_FileHandle::AllocatePage(PF_PageHandle &pageHandle)
 	int     rc;               // return code
 	int     pageNum;          // new-page number
 	char    *pPageBuf;        // address of page in buffer pool
+	int     slot = INVALID_SLOT; // slot of the page in the buffer
 
 	// File must be open
 	if (!bFileOpen)
 		return (PF_CLOSEDFILE);
 
-	// If the free list isn't empty...
-	if (hdr.firstFree != PF_PAGE_LIST_END) {
-		pageNum = hdr.firstFree;
-
-		// Get the first free page into the buffer
-		if ((rc = pBufferMgr->GetPage(unixfd,
+	// Only one thread at a time may change the header
+	std::lock_guard<std::mutex> guard(pState->latch);
+
+	// Look for a free page, skipping the bitmap pages
+	pageNum = pState->used.NextClear(pState->freeHint, pState->numPages);
+	while (pageNum >= 0 && IsBitmapPage(pageNum))
+		pageNum = pState->used.NextClear(pageNum + 1, pState->numPages);
+
+	// If there is a free page...
+	if (pageNum >= 0) {
+		pState->freeHint = pageNum + 1;
+
+		// Get a buffer for it, without reading it unless it is there
+		if (pState->pMapped) {
+			if ((rc = pState->pMapped->Pin(pageNum, &pPageBuf)))
+				return (rc);
+		}
+		else if ((rc = pBufferMgr->AllocatePage(unixfd,
+				hdr.pageSize,
 				pageNum,
-				&pPageBuf)))
+				&pPageBuf,
+				&slot)) &&
+				(rc != PF_PAGEINBUF ||
+				(rc = pBufferMgr->GetPage(unixfd,
+					hdr.pageSize,
+					pageNum,
+					&pPageBuf,
+					TRUE,
+					&slot))))
 			return (rc);
-
-		// Set the first free page to the next page on the free list
-		hdr.firstFree = ((PF_PageHdr*)pPageBuf)->nextFree;
 	}
 	else {
 
-		// The free list is empty...
-		pageNum = hdr.numPages;
-
-		// Allocate a new page in the file
-		if ((rc = pBufferMgr->AllocatePage(unixfd,
+		// There is no free page...
+		pageNum = pState->numPages;
+
+		// Start a bitmap page first if it is its turn
+		if (IsBitmapPage(pageNum)) {
+			pState->used.Resize(pageNum + 1);
+			if ((rc = WriteBitmapPage(pageNum)))
+				return (rc);
+			pState->numPages++;
+			pageNum++;
+		}
+		pState->freeHint = pageNum + 1;
+
+		// Past the room reserved in the file, reserve an extent.  If the
+		// OS cannot, the page is added by writing it, as before.
+		if (!pState->pMapped && !pState->pCompressed &&
+				pageNum >= pState->reservedEnd) {
+			int numPages = std::max(pState->extentPages,
+				(int)std::min((long long)pState->numPages *
+					pState->extentGrowth / 100,
+					(long long)PF_EXTENT_MAX_PAGES));
+			if (numPages <= 1 || Reserve(pageNum + numPages))
+				pState->reservedEnd = pageNum + 1;
+		}
+
+		// Allocate a new page in the file, growing the mapping if any
+		if (pState->pMapped) {
+			if ((rc = pState->pMapped->Grow(unixfd, pageNum + 1)) ||
+					(rc = pState->pMapped->Pin(pageNum, &pPageBuf)))
+				return (rc);
+		}
+		else if ((rc = pBufferMgr->AllocatePage(unixfd,
+				hdr.pageSize,
 				pageNum,
-				&pPageBuf)))
+				&pPageBuf,
+				&slot)))
 			return (rc);
 
 		// Increment the number of pages for this file
-		hdr.numPages++;
+		pState->numPages++;
+		pState->used.Resize(pState->numPages);
 	}
 
 	// Mark the header as changed
-	bHdrChanged = TRUE;
+	pState->bHdrChanged = TRUE;
+	pState->used.Set(pageNum);
+	BitmapChanged(pageNum);
 
 	// Mark this page as used
 	((PF_PageHdr *)pPageBuf)->nextFree = PF_PAGE_USED;
 
 	// Zero out the page data
-	memset(pPageBuf + sizeof(PF_PageHdr), 0, PF_PAGE_SIZE);
-
-	// Mark the page dirty because we changed the next pointer
-	if ((rc = MarkDirty(pageNum)))
-		return (rc);
+	memset(pPageBuf + sizeof(PF_PageHdr), 0, PF_PageDataSize(hdr.pageSize));
 
 	// Set the pageHandle local variables
 	pageHandle.pageNum = pageNum;
 	pageHandle.pPageData = pPageBuf + sizeof(PF_PageHdr);
+	pageHandle.slot = slot;
+
+	// Mark the page dirty because we changed the next pointer
+	if ((rc = MarkDirty(pageHandle)))
+		return (rc);
 
 	// Return ok
 	return (0);
@@ -328,8 +487,16 @@ RC PF_FileHandle::DisposePage(PageNum pageNum)
 	if (!IsValidPageNum(pageNum))
 		return (PF_INVALIDPAGE);
 
+	// Only one thread at a time may change the header
+	std::lock_guard<std::mutex> guard(pState->latch);
+
 	// Get the page (but don't re-pin it if it's already pinned)
-	if ((rc = pBufferMgr->GetPage(unixfd,
+	if (pState->pMapped) {
+		if ((rc = pState->pMapped->Pin(pageNum, &pPageBuf, FALSE)))
+			return (rc);
+	}
+	else if ((rc = pBufferMgr->GetPage(unixfd,
+			hdr.pageSize,
 			pageNum,
 			&pPageBuf,
 			FALSE)))
@@ -346,10 +513,13 @@ RC PF_FileHandle::DisposePage(PageNum pageNum)
 		return (PF_PAGEFREE);
 	}
 
-	// Put this page onto the free list
-	((PF_PageHdr *)pPageBuf)->nextFree = hdr.firstFree;
-	hdr.firstFree = pageNum;
-	bHdrChanged = TRUE;
+	// Mark the page free in the page and in the bitmap
+	((PF_PageHdr *)pPageBuf)->nextFree = PF_PAGE_LIST_END;
+	pState->used.Clear(pageNum);
+	if (pageNum < pState->freeHint)
+		pState->freeHint = pageNum;
+	BitmapChanged(pageNum);
+	pState->bHdrChanged = TRUE;
 
 	// Mark the page dirty because we changed the next pointer
 	if ((rc = MarkDirty(pageNum)))
@@ -383,8 +553,12 @@ RC PF_FileHandle::MarkDirty(PageNum pageNum) const
 	if (!IsValidPageNum(pageNum))
 		return (PF_INVALIDPAGE);
 
+	// A mapped page is written by the OS
+	if (pState->pMapped)
+		return (pState->pMapped->MarkDirty(pageNum));
+
 	// Tell the buffer manager to mark the page dirty
-	return (pBufferMgr->MarkDirty(unixfd, pageNum));
+	return (pBufferMgr->MarkDirty(unixfd, hdr.pageSize, pageNum));
 }
 
 //
@@ -408,8 +582,178 @@ RC PF_FileHandle::UnpinPage(PageNum pageNum) const
 	if (!IsValidPageNum(pageNum))
 		return (PF_INVALIDPAGE);
 
+	if (pState->pMapped)
+		return (pState->pMapped->Unpin(pageNum));
+
 	// Tell the buffer manager to unpin the page
-	return (pBufferMgr->UnpinPage(unixfd, pageNum));
+	return (pBufferMgr->UnpinPage(unixfd, hdr.pageSize, pageNum));
+}
+
+//
+// MarkDirty
+//
+// Desc: Mark the page of a handle dirty.  The buffer manager goes
+//       straight to the slot kept in the handle while the page is pinned.
+// In:   pageHandle - handle of a pinned page of the file
+// Ret:  PF return code
+//
+RC PF_FileHandle::MarkDirty(const PF_PageHandle &pageHandle) const
+{
+	PageNum pageNum = pageHandle.pageNum;
+
+	// File must be open
+	if (!bFileOpen)
+		return (PF_CLOSEDFILE);
+
+	// Validate page number
+	if (!IsValidPageNum(pageNum))
+		return (PF_INVALIDPAGE);
+
+	if (pState->pMapped)
+		return (pState->pMapped->MarkDirty(pageNum));
+
+	return (pBufferMgr->MarkDirty(unixfd, hdr.pageSize, pageNum,
+			pageHandle.slot));
+}
+
+//
+// UnpinPage
+//
+// Desc: Unpin the page of a handle, through the slot kept in the handle.
+//       The handle should not be used after making this call.
+// In:   pageHandle - handle of a pinned page of the file
+// Ret:  PF return code
+//
+RC PF_FileHandle::UnpinPage(const PF_PageHandle &pageHandle) const
+{
+	PageNum pageNum = pageHandle.pageNum;
+
+	// File must be open
+	if (!bFileOpen)
+		return (PF_CLOSEDFILE);
+
+	// Validate page number
+	if (!IsValidPageNum(pageNum))
+		return (PF_INVALIDPAGE);
+
+	if (pState->pMapped)
+		return (pState->pMapped->Unpin(pageNum));
+
+	return (pBufferMgr->UnpinPage(unixfd, hdr.pageSize, pageNum,
+			pageHandle.slot));
+}
+
+//
+// GetPageSize
+//
+// Desc: Return the room for data in the pages of the file, which is
+//       PF_PAGE_SIZE unless the file was created with another page size.
+//       The file handle must refer to an open file.
+// Out:  length - number of bytes of data in a page
+// Ret:  PF_CLOSEDFILE or 0
+//
+RC PF_FileHandle::GetPageSize(int &length) const
+{
+	// File must be open
+	if (!bFileOpen)
+		return (PF_CLOSEDFILE);
+
+	length = PF_PageDataSize(hdr.pageSize);
+	return (0);
+}
+
+//
+// GetPinLimit
+//
+// Desc: Number of pages of the file which can be pinned at once.  The
+//       pages of a shard are pinned in its frames only, so the limit is
+//       the size of the smallest shard, as all the pages may fall into
+//       it.  The pages of a mapped file take no frame and have no limit.
+// Out:  numPages - the limit
+// Ret:  PF_CLOSEDFILE or 0
+//
+RC PF_FileHandle::GetPinLimit(int &numPages) const
+{
+	if (!bFileOpen)
+		return (PF_CLOSEDFILE);
+
+	numPages = pState->pMapped ? INT_MAX : pBufferMgr->GetShardPages();
+	return (0);
+}
+
+//
+// SetExtent
+//
+// Desc: Set how much room is reserved in the file when it runs out of
+//       pages.  Reserving many pages at once keeps them together on disk
+//       when several files grow at the same time.
+// In:   minPages - pages reserved at least, 1 to reserve none
+//       growthPct - or this percentage of the pages of the file, if it
+//       gives more pages, up to PF_EXTENT_MAX_PAGES
+// Ret:  PF_CLOSEDFILE, PF_BADPARAM or 0
+//
+RC PF_FileHandle::SetExtent(int minPages, int growthPct)
+{
+	if (!bFileOpen)
+		return (PF_CLOSEDFILE);
+	if (minPages < 1 || growthPct < 0)
+		return (PF_BADPARAM);
+
+	std::lock_guard<std::mutex> guard(pState->latch);
+	pState->extentPages = minPages;
+	pState->extentGrowth = growthPct;
+	return (0);
+}
+
+//
+// ReservePages
+//
+// Desc: Reserve room in the file for numPages pages after the last one,
+//       so that loading them does not grow the file piece by piece.
+//       Mapped and compressed files manage the room of their file
+//       themselves and ignore it.
+// In:   numPages - pages to reserve
+// Ret:  PF_CLOSEDFILE, PF_BADPARAM, PF_UNIX or 0
+//
+RC PF_FileHandle::ReservePages(int numPages)
+{
+	if (!bFileOpen)
+		return (PF_CLOSEDFILE);
+	if (numPages < 0)
+		return (PF_BADPARAM);
+	if (pState->pMapped || pState->pCompressed)
+		return (0);
+
+	std::lock_guard<std::mutex> guard(pState->latch);
+	return (Reserve(pState->numPages + numPages));
+}
+
+//
+// Reserve
+//
+// Desc: Reserve room in the file for the pages before endPage with
+//       posix_fallocate, the latch held.  The pages are handed out by
+//       AllocatePage from then on with neither a system call nor a change
+//       of the file header beyond numPages.  The room reserved is not
+//       recorded in the header: it is the part of the file after the last
+//       page, found again from the length of the file when it is opened.
+// In:   endPage - first page which needs no room
+// Ret:  PF_UNIX or 0
+//
+RC PF_FileHandle::Reserve(PageNum endPage) const
+{
+	if (endPage <= pState->reservedEnd)
+		return (0);
+
+	PageNum start = std::max(pState->reservedEnd, (PageNum)pState->numPages);
+	if (endPage > start &&
+			posix_fallocate(unixfd,
+				PF_FILE_HDR_SIZE + (off_t)start * hdr.pageSize,
+				(off_t)(endPage - start) * hdr.pageSize) != 0)
+		return (PF_UNIX);
+
+	pState->reservedEnd = endPage;
+	return (0);
 }
 
 //
@@ -422,34 +766,29 @@ RC PF_FileHandle::UnpinPage(PageNum pageNum) const
 //
 RC PF_FileHandle::FlushPages() const
 {
+	RC rc;
+
 	// File must be open
 	if (!bFileOpen)
 		return (PF_CLOSEDFILE);
 
 	// If the file header has changed, write it back to the file
-	if (bHdrChanged) {
-
-		// First seek to the appropriate place
-		if (lseek(unixfd, 0, L_SET) < 0)
-			return (PF_UNIX);
-
-		// Write header
-		int numBytes = write(unixfd,
-				(char *)&hdr,
-				sizeof(PF_FileHdr));
-		if (numBytes < 0)
-			return (PF_UNIX);
-		if (numBytes != sizeof(PF_FileHdr))
-			return (PF_HDRWRITE);
+	if ((rc = WriteHdr()))
+		return (rc);
 
-		// This function is declared const, but we need to change the
-		// bHdrChanged variable.  Cast away the constness
-		PF_FileHandle *dummy = (PF_FileHandle *)this;
-		dummy->bHdrChanged = FALSE;
+	// The pages of a mapped file are not in the buffer
+	if (pState->pMapped)
+		return (pState->pMapped->CheckUnpinned());
+
+	// Tell Buffer Manager to flush pages, then save where the pages of a
+	// compressed file went
+	rc = pBufferMgr->FlushPages(unixfd);
+	if (pState->pCompressed) {
+		RC rcMap = pState->pCompressed->SaveMap();
+		if (rcMap)
+			return (rcMap);
 	}
-
-	// Tell Buffer Manager to flush pages
-	return (pBufferMgr->FlushPages(unixfd));
+	return (rc);
 }
 
 //
@@ -464,36 +803,304 @@ RC PF_FileHandle::FlushPages() const
 //
 RC PF_FileHandle::ForcePages(PageNum pageNum) const
 {
+	RC rc;
+
 	// File must be open
 	if (!bFileOpen)
 		return (PF_CLOSEDFILE);
 
 	// If the file header has changed, write it back to the file
-	if (bHdrChanged) {
+	if ((rc = WriteHdr()))
+		return (rc);
 
-		// First seek to the appropriate place
-		if (lseek(unixfd, 0, L_SET) < 0)
-			return (PF_UNIX);
+	// The pages of a mapped file are written by the OS, like the ones
+	// written by the buffer manager
+	if (pState->pMapped)
+		return (0);
+
+	// Tell Buffer Manager to Force the page
+	if ((rc = pBufferMgr->ForcePages(unixfd, pageNum)))
+		return (rc);
+
+	// Save where the pages of a compressed file went
+	if (pState->pCompressed)
+		return (pState->pCompressed->SaveMap());
+	return (0);
+}
+
+//
+// SyncPages
+//
+// Desc: Force all the pages of the file, then wait until the OS has
+//       written them to the device, so that they survive a crash of the
+//       machine and not only of the process
+// Ret:  Standard PF errors
+//
+RC PF_FileHandle::SyncPages() const
+{
+	RC rc;
+
+	if ((rc = ForcePages(ALL_PAGES)))
+		return (rc);
+
+	if (pState->pMapped)
+		return (pState->pMapped->Sync());
+	if (fdatasync(unixfd) < 0)
+		return (PF_UNIX);
+	return (0);
+}
+
+//
+// WriteHdr
+//
+// Desc: Internal.  Write the file header back to the file if it has
+//       changed, with the allocation bits of the header page, and the
+//       bitmap pages which changed.  pwrite is used so that the offset of
+//       the file is not shared with the threads reading pages.  The whole
+//       header page is written from an aligned buffer, as O_DIRECT
+//       requires.
+// Ret:  PF return code
+//
+RC PF_FileHandle::WriteHdr() const
+{
+	RC rc;
+
+	std::lock_guard<std::mutex> guard(pState->latch);
 
-		// Write header
-		int numBytes = write(unixfd,
-				(char *)&hdr,
-				sizeof(PF_FileHdr));
+	if (pState->bHdrChanged) {
+		alignas(PF_IO_ALIGN) char hdrBuf[PF_FILE_HDR_SIZE];
+		PF_FileHdr fileHdr = hdr;
+		int numBytes;
+
+		// Write header, with the number of pages shared by the copies
+		fileHdr.numPages = pState->numPages;
+		memcpy(hdrBuf, &fileHdr, sizeof(PF_FileHdr));
+		pState->used.Store(0, hdrBuf + sizeof(PF_FileHdr),
+				PF_FILE_HDR_SIZE - sizeof(PF_FileHdr));
+		numBytes = pwrite(unixfd, hdrBuf, PF_FILE_HDR_SIZE, 0);
 		if (numBytes < 0)
 			return (PF_UNIX);
-		if (numBytes != sizeof(PF_FileHdr))
+		if (numBytes != PF_FILE_HDR_SIZE)
 			return (PF_HDRWRITE);
 
-		// This function is declared const, but we need to change the
-		// bHdrChanged variable.  Cast away the constness
-		PF_FileHandle *dummy = (PF_FileHandle *)this;
-		dummy->bHdrChanged = FALSE;
+		pState->bHdrChanged = FALSE;
 	}
 
-	// Tell Buffer Manager to Force the page
-	return (pBufferMgr->ForcePages(unixfd, pageNum));
+	// Write the bitmap pages which changed
+	for (size_t j = 0; j < pState->bitmapDirty.size(); j++) {
+		if (!pState->bitmapDirty[j])
+			continue;
+		if ((rc = WriteBitmapPage(PF_HDR_BITMAP_BITS +
+				(PageNum)j * PF_BitmapPageBits(hdr.pageSize))))
+			return (rc);
+		pState->bitmapDirty[j] = FALSE;
+	}
+
+	return (0);
+}
+
+//
+// ReadBitmap
+//
+// Desc: Internal.  Fill the allocation bitmap of a file being opened from
+//       the header page and the bitmap pages.  The files written before
+//       the bitmap was kept have their pages read once to rebuild it.
+//       The bitmap of such a file is kept from then on unless it has more
+//       pages than the header page has bits: its pages may already sit
+//       where the bitmap pages would go, so the bitmap is rebuilt each
+//       time it is opened.
+// In:   hdrBuf - header page of the file
+// Ret:  PF return code
+//
+RC PF_FileHandle::ReadBitmap(const char *hdrBuf)
+{
+	RC rc;
+	PageNum pageNum;
+	int bits = PF_BitmapPageBits(hdr.pageSize);
+	alignas(PF_IO_ALIGN) char pageBuf[PF_MAX_PAGE_SIZE];
+
+	pState->used.Resize(pState->numPages);
+
+	if (hdr.flags & PF_HDR_BITMAP) {
+		pState->used.Load(0, hdrBuf + sizeof(PF_FileHdr),
+				PF_FILE_HDR_SIZE - sizeof(PF_FileHdr));
+		for (pageNum = PF_HDR_BITMAP_BITS; pageNum < pState->numPages;
+				pageNum += bits) {
+			if ((rc = ReadRawPage(pageNum, pageBuf)))
+				return (rc);
+			pState->used.Load(pageNum, pageBuf + sizeof(PF_PageHdr),
+					PF_PageDataSize(hdr.pageSize));
+		}
+	}
+	else {
+		for (pageNum = 0; pageNum < pState->numPages; pageNum++) {
+			if ((rc = ReadRawPage(pageNum, pageBuf)))
+				return (rc);
+			if (((PF_PageHdr *)pageBuf)->nextFree == PF_PAGE_USED)
+				pState->used.Set(pageNum);
+		}
+
+		// The free list is not kept any more
+		hdr.firstFree = PF_PAGE_LIST_END;
+		if (pState->numPages <= PF_HDR_BITMAP_BITS)
+			hdr.flags |= PF_HDR_BITMAP;
+		pState->bHdrChanged = TRUE;
+	}
+
+	pState->freeHint = 0;
+	return (0);
+}
+
+//
+// IsBitmapPage
+//
+// Desc: Internal.  Return TRUE if pageNum is the place of a bitmap page
+// In:   pageNum - page number to test
+// Ret:  TRUE or FALSE
+//
+int PF_FileHandle::IsBitmapPage(PageNum pageNum) const
+{
+	return ((hdr.flags & PF_HDR_BITMAP) &&
+			pageNum >= PF_HDR_BITMAP_BITS &&
+			(pageNum - PF_HDR_BITMAP_BITS) %
+				PF_BitmapPageBits(hdr.pageSize) == 0);
+}
+
+//
+// BitmapChanged
+//
+// Desc: Internal.  Note that the bit of a page changed, so that WriteHdr
+//       writes the bitmap page holding it.  The bits of the header page
+//       are written with the header.  Called with the latch held.
+// In:   pageNum - page whose bit changed
+//
+void PF_FileHandle::BitmapChanged(PageNum pageNum)
+{
+	if (!(hdr.flags & PF_HDR_BITMAP) || pageNum < PF_HDR_BITMAP_BITS)
+		return;
+
+	size_t j = (pageNum - PF_HDR_BITMAP_BITS) /
+		PF_BitmapPageBits(hdr.pageSize);
+	if (pState->bitmapDirty.size() <= j)
+		pState->bitmapDirty.resize(j + 1, FALSE);
+	pState->bitmapDirty[j] = TRUE;
 }
 
+//
+// WriteBitmapPage
+//
+// Desc: Internal.  Write a bitmap page, from an aligned buffer for
+//       O_DIRECT.  The page does not go through the buffer.  Called with
+//       the latch held.
+// In:   pageNum - page number of the bitmap page
+// Ret:  PF return code
+//
+RC PF_FileHandle::WriteBitmapPage(PageNum pageNum) const
+{
+	alignas(PF_IO_ALIGN) char pageBuf[PF_MAX_PAGE_SIZE];
+	int numBytes;
+
+	((PF_PageHdr *)pageBuf)->nextFree = PF_PAGE_BITMAP;
+	pState->used.Store(pageNum, pageBuf + sizeof(PF_PageHdr),
+			PF_PageDataSize(hdr.pageSize));
+
+	if (pState->pCompressed)
+		return (pState->pCompressed->WritePage(pageNum, pageBuf));
+
+	numBytes = pwrite(unixfd, pageBuf, hdr.pageSize,
+			PF_FILE_HDR_SIZE + (off_t)pageNum * hdr.pageSize);
+	if (numBytes < 0)
+		return (PF_UNIX);
+	if (numBytes != hdr.pageSize)
+		return (PF_INCOMPLETEWRITE);
+	return (0);
+}
+
+//
+// ReadRawPage
+//
+// Desc: Internal.  Read a page from the file into pBuf, which must be
+//       aligned for O_DIRECT
+// In:   pageNum - page number
+// Out:  pBuf - the page, header included
+// Ret:  PF return code
+//
+RC PF_FileHandle::ReadRawPage(PageNum pageNum, char *pBuf) const
+{
+	if (pState->pCompressed)
+		return (pState->pCompressed->ReadPage(pageNum, pBuf));
+
+	int numBytes = pread(unixfd, pBuf, hdr.pageSize,
+			PF_FILE_HDR_SIZE + (off_t)pageNum * hdr.pageSize);
+	if (numBytes < 0)
+		return (PF_UNIX);
+	if (numBytes != hdr.pageSize)
+		return (PF_INCOMPLETEREAD);
+	return (0);
+}
+
+//
+// ReadAhead
+//
+// Desc: Internal.  Track the pages fetched from the file.  Once
+//       PF_READAHEAD_TRIGGER pages have been fetched in order, the buffer
+//       manager is asked to load the pages that follow in background.
+//       They are asked for half a window at a time, so that the queue of
+//       the read-ahead threads does not grow by one page per fetch.
+//       Pages are in order when no used page lies between them, and the
+//       window counts the used pages only, so that the free pages of a
+//       sparse file are neither read nor waited for.
+// In:   pageNum - page just fetched
+//       hint - hint of the fetch, passed on with the pages asked for
+//
+void PF_FileHandle::ReadAhead(PageNum pageNum, ClientHint hint) const
+{
+	int window = pBufferMgr->GetReadAhead();
+	if (window <= 0 || pState->pMapped)
+		return;
+
+	std::lock_guard<std::mutex> guard(pState->latch);
+	const PF_Bitmap &used = pState->used;
+
+	if (pageNum == pState->lastPage + 1 ||
+			(pageNum > pState->lastPage &&
+			used.NextSet(pState->lastPage + 1, pageNum) < 0))
+		pState->seqCount++;
+	else
+		pState->seqCount = 0;
+	pState->lastPage = pageNum;
+
+	if (pState->seqCount < PF_READAHEAD_TRIGGER)
+		return;
+
+	// Used pages already asked for
+	int numAsked = used.Count(pageNum + 1, pState->raNext);
+
+	// Start right after the page if it went past what was asked for
+	if (pState->raNext <= pageNum || numAsked > window) {
+		pState->raNext = pageNum + 1;
+		numAsked = 0;
+	}
+
+	if (numAsked > window / 2)
+		return;
+
+	// Ask for the runs of used pages up to a full window
+	PageNum numPages = pState->numPages;
+	PageNum next = pState->raNext;
+	while (numAsked < window &&
+			(next = used.NextSet(next, numPages)) >= 0) {
+		PageNum end = used.NextClear(next, numPages);
+		if (end < 0)
+			end = numPages;
+		if (end - next > window - numAsked)
+			end = next + window - numAsked;
+		pBufferMgr->ReadAhead(unixfd, hdr.pageSize, next, end - next, hint);
+		numAsked += end - next;
+		next = end;
+	}
+	pState->raNext = (next < 0) ? numPages : next;
+}
 
 //
 // IsValidPageNum
@@ -507,6 +1114,6 @@ int PF_FileHandle::IsValidPageNum(PageNum pageNum) const
 {
 	return (bFileOpen &&
 			pageNum >= 0 &&
-			pageNum < hdr.numPages);
+			pageNum < pState->numPages);
 }
 
@@ -0,0 +1,86 @@
+//
+// File:        pf_filestats.cc
+// Description: PF_StatsTable class implementation
+//
+
+#include "pf_buffermgr.h"
+#include "pf_filestats.h"
+
+using namespace std;
+
+//
+// Open
+//
+// Desc: Remember the name of a file being opened
+// In:   fd - OS file descriptor of the file
+//       fileName - name the file is opened with
+//
+void PF_StatsTable::Open(int fd, const char *fileName)
+{
+	lock_guard<mutex> guard(latch);
+
+	openFiles[fd] = fileName;
+}
+
+//
+// Close
+//
+// Desc: Add the counters of a file being closed to the totals of its name
+// In:   fd - OS file descriptor of the file
+//       stats - counters gathered while the file was open
+//
+void PF_StatsTable::Close(int fd, const PF_FileStats &stats)
+{
+	lock_guard<mutex> guard(latch);
+
+	map<int, string>::iterator it = openFiles.find(fd);
+	if (it == openFiles.end())
+		return;
+
+	map<string, PF_FileStats>::iterator total = closedFiles.find(it->second);
+	if (total == closedFiles.end())
+		closedFiles[it->second] = stats;
+	else
+		total->second.Add(stats);
+	openFiles.erase(it);
+}
+
+//
+// Collect
+//
+// Desc: Counters of each file: the totals of the times it was closed
+//       plus what the buffer has counted for it since it was opened
+// In:   bufferMgr - buffer holding the counters of the open files
+// Out:  stats - counters by file name
+//
+void PF_StatsTable::Collect(PF_BufferMgr &bufferMgr,
+		map<string, PF_FileStats> &stats)
+{
+	lock_guard<mutex> guard(latch);
+
+	stats = closedFiles;
+	for (map<int, string>::const_iterator it = openFiles.begin();
+			it != openFiles.end(); ++it) {
+		PF_FileStats fileStats;
+		bufferMgr.GetFileStats(it->first, fileStats);
+
+		map<string, PF_FileStats>::iterator total = stats.find(it->second);
+		if (total == stats.end())
+			stats[it->second] = fileStats;
+		else
+			total->second.Add(fileStats);
+	}
+}
+
+//
+// Reset
+//
+// Desc: Forget the totals of the files closed.  The counters of the open
+//       files are kept by the buffer and reset there.
+//
+void PF_StatsTable::Reset()
+{
+	lock_guard<mutex> guard(latch);
+
+	closedFiles.clear();
+}
@@ -0,0 +1,45 @@
+//
+// File:        pf_filestats.h
+// Description: PF_StatsTable class interface
+//
+// PF_STATS only counted the use of the buffer as a whole, and only when
+// compiled in, so there was no telling which file the misses came from.
+// The buffer manager now always counts the hits, misses, evictions,
+// write-backs and pin time of each file, by file descriptor.  PF_Manager
+// keeps the names of the open files, and adds the counters of a file to
+// the totals of its name when it is closed, so that "print buffer" and
+// "print io" can report them by relation.
+//
+
+#ifndef PF_FILESTATS_H
+#define PF_FILESTATS_H
+
+#include <map>
+#include <mutex>
+#include <string>
+#include "pf_internal.h"
+
+class PF_BufferMgr;
+
+//
+// PF_StatsTable - counters of the files by name
+//
+class PF_StatsTable {
+public:
+	// A file was opened as fd
+	void Open     (int fd, const char *fileName);
+	// File fd is being closed, with the counters it has gathered
+	void Close    (int fd, const PF_FileStats &stats);
+	// Counters of each file, those of the open files taken from the buffer
+	void Collect  (PF_BufferMgr &bufferMgr,
+	               std::map<std::string, PF_FileStats> &stats);
+	// Forget the counters of the files closed
+	void Reset    ();
+
+private:
+	std::map<int, std::string> openFiles;            // names by fd
+	std::map<std::string, PF_FileStats> closedFiles; // totals by name
+	std::mutex latch;                                // protects the maps
+};
+
+#endif
@@ -13,19 +13,14 @@
 //
 // Desc: Constructor for PF_HashTable object, which allows search, insert,
 //       and delete of hash table entries.
-// In:   numBuckets - number of hash table buckets
+// In:   numEntries - number of entries the table is sized for,
+//                    normally the number of pages in the buffer
 //
-PF_HashTable::PF_HashTable(int _numBuckets)
+PF_HashTable::PF_HashTable(int numEntries)
 {
-	// Initialize numBuckets local variable from parameter
-	this->numBuckets = _numBuckets;
-
-	// Allocate memory for hash table
-	hashTable = new PF_HashEntry* [numBuckets];
-
-	// Initialize all buckets to empty
-	for (int i = 0; i < numBuckets; i++)
-		hashTable[i] = NULL;
+	size = numUsed = 0;
+	hashTable = NULL;
+	Resize(numEntries);
 }
 
 //
@@ -35,20 +30,47 @@ PF_HashTable::PF_HashTable(int _numBuckets)
 //
 PF_HashTable::~PF_HashTable()
 {
-	// Clear out all buckets
-	for (int i = 0; i < numBuckets; i++) {
-
-		// Delete all entries in the bucket
-		PF_HashEntry *entry = hashTable[i];
-		while (entry != NULL) {
-			PF_HashEntry *next = entry->next;
-			delete entry;
-			entry = next;
+	delete[] hashTable;
+}
+
+//
+// Resize
+//
+// Desc: Size the table for numEntries entries.  The table is kept at most
+//       half full so that probe sequences stay short.  The entries in the
+//       table are moved to the new array.
+// In:   numEntries - number of entries to make room for
+// Ret:  PF return code
+//
+RC PF_HashTable::Resize(int numEntries)
+{
+	// Smallest power of two that keeps the table half empty
+	int newSize = 8;
+	while (newSize < 2 * numEntries || newSize < 2 * numUsed)
+		newSize <<= 1;
+
+	PF_HashEntry *pOldTable = hashTable;
+	int oldSize = size;
+
+	if ((hashTable = new PF_HashEntry[newSize]) == NULL)
+		return (PF_NOMEM);
+	size = newSize;
+	mask = newSize - 1;
+	for (int i = 0; i < size; i++)
+		hashTable[i].slot = PF_HASH_EMPTY;
+
+	// Move the old entries over, Place counts them again
+	numUsed = 0;
+	for (int i = 0; i < oldSize; i++)
+		if (pOldTable[i].slot != PF_HASH_EMPTY) {
+			pOldTable[i].dist = 0;
+			Place(pOldTable[i]);
 		}
-	}
 
-	// Finally delete the hash table
-	delete[] hashTable;
+	delete[] pOldTable;
+
+	// Return ok
+	return (0);
 }
 
 //
@@ -60,22 +82,20 @@ PF_HashTable::~PF_HashTable()
 // Out:  slot - set to slot associated with fd and pageNum
 // Ret:  PF return code
 //
-RC PF_HashTable::Find(int fd, PageNum pageNum, int &slot)
+RC PF_HashTable::Find(int fd, PageNum pageNum, int &slot) const
 {
-	// Get which bucket it should be in
-	int bucket = Hash(fd, pageNum);
+	// Probe from the home position.  An entry closer to its own home
+	// than we are to ours means the key is not in the table.
+	for (int i = Hash(fd, pageNum), dist = 0; ; i = (i + 1) & mask, dist++) {
+		const PF_HashEntry &entry = hashTable[i];
 
-	if (bucket<0)
-		 return (PF_HASHNOTFOUND);
+		if (entry.slot == PF_HASH_EMPTY || entry.dist < dist)
+			break;
 
-	// Go through the linked list of this bucket
-	for (PF_HashEntry *entry = hashTable[bucket];
-			 entry != NULL;
-			 entry = entry->next) {
-		if (entry->fd == fd && entry->pageNum == pageNum) {
+		if (entry.fd == fd && entry.pageNum == pageNum) {
 
 			// Found it
-			slot = entry->slot;
+			slot = entry.slot;
 			return (0);
 		}
 	}
@@ -87,7 +107,8 @@ RC PF_HashTable::Find(int fd, PageNum pageNum, int &slot)
 //
 // Insert
 //
-// Desc: Insert a hash table entry
+// Desc: Insert a hash table entry.  The table grows if it gets more than
+//       half full.
 // In:   fd - file descriptor
 //       pagenum - page number
 //       slot - slot associated with fd and pageNum
@@ -95,36 +116,55 @@ RC PF_HashTable::Find(int fd, PageNum pageNum, int &slot)
 //
 RC PF_HashTable::Insert(int fd, PageNum pageNum, int slot)
 {
-	// Get which bucket it should be in
-	int bucket = Hash(fd, pageNum);
-
-	// Check entry doesn't already exist in the bucket
-	PF_HashEntry *entry;
-	for (entry = hashTable[bucket];
-			entry != NULL;
-			entry = entry->next) {
-		if (entry->fd == fd && entry->pageNum == pageNum)
-			return (PF_HASHPAGEEXIST);
-	}
+	RC rc;
+	int dummy;
 
-	// Allocate memory for new hash entry
-	if ((entry = new PF_HashEntry) == NULL)
-		return (PF_NOMEM);
+	// Check entry doesn't already exist
+	if (!Find(fd, pageNum, dummy))
+		return (PF_HASHPAGEEXIST);
+
+	// Make room if needed
+	if (2 * (numUsed + 1) > size && (rc = Resize(numUsed + 1)))
+		return (rc);
 
-	// Insert entry at head of list for this bucket
-	entry->fd = fd;
-	entry->pageNum = pageNum;
-	entry->slot = slot;
-	entry->next = hashTable[bucket];
-	entry->prev = NULL;
-	if (hashTable[bucket] != NULL)
-		hashTable[bucket]->prev = entry;
-	hashTable[bucket] = entry;
+	PF_HashEntry entry;
+	entry.fd = fd;
+	entry.pageNum = pageNum;
+	entry.slot = slot;
+	entry.dist = 0;
+	Place(entry);
 
 	// Return ok
 	return (0);
 }
 
+//
+// Place
+//
+// Desc: Internal.  Put an entry into the table, which must have an empty
+//       entry.  Going down the probe sequence, the entry takes the place
+//       of the first entry that is closer to its home, which then goes on
+//       looking for a place (Robin Hood hashing).
+// In:   entry - entry to place, dist must be 0
+//
+void PF_HashTable::Place(PF_HashEntry entry)
+{
+	for (int i = Hash(entry.fd, entry.pageNum); ; i = (i + 1) & mask) {
+		if (hashTable[i].slot == PF_HASH_EMPTY) {
+			hashTable[i] = entry;
+			numUsed++;
+			return;
+		}
+
+		if (hashTable[i].dist < entry.dist) {
+			PF_HashEntry tmp = hashTable[i];
+			hashTable[i] = entry;
+			entry = tmp;
+		}
+		entry.dist++;
+	}
+}
+
 //
 // Delete
 //
@@ -135,33 +175,28 @@ RC PF_HashTable::Insert(int fd, PageNum pageNum, int slot)
 //
 RC PF_HashTable::Delete(int fd, PageNum pageNum)
 {
-	// Get which bucket it should be in
-	int bucket = Hash(fd, pageNum);
-
-	// Find the entry is in this bucket
-	PF_HashEntry *entry;
-	for (entry = hashTable[bucket];
-			entry != NULL;
-			entry = entry->next) {
-		if (entry->fd == fd && entry->pageNum == pageNum)
+	// Find the entry
+	int i, dist;
+	for (i = Hash(fd, pageNum), dist = 0; ; i = (i + 1) & mask, dist++) {
+		if (hashTable[i].slot == PF_HASH_EMPTY || hashTable[i].dist < dist)
+			return (PF_HASHNOTFOUND);
+
+		if (hashTable[i].fd == fd && hashTable[i].pageNum == pageNum)
 			break;
 	}
 
-	// Did we find hash entry?
-	if (entry == NULL)
-		return (PF_HASHNOTFOUND);
-
-	// Remove this entry
-	if (entry == hashTable[bucket])
-		hashTable[bucket] = entry->next;
-	if (entry->prev != NULL)
-		entry->prev->next = entry->next;
-	if (entry->next != NULL)
-		entry->next->prev = entry->prev;
-	delete entry;
+	// Shift the following entries of the probe sequence back by one,
+	// so that no tombstone is needed
+	int next = (i + 1) & mask;
+	while (hashTable[next].slot != PF_HASH_EMPTY && hashTable[next].dist > 0) {
+		hashTable[i] = hashTable[next];
+		hashTable[i].dist--;
+		i = next;
+		next = (next + 1) & mask;
+	}
+	hashTable[i].slot = PF_HASH_EMPTY;
+	numUsed--;
 
-	// Return ook
+	// Return ok
 	return (0);
 }
-
-
@@ -4,6 +4,10 @@
 // Authors:     Hugo Rivero (rivero@cs.stanford.edu)
 //              Dallan Quass (quass@cs.stanford.edu)
 //
+// The table maps (fd,pageNum) to a buffer slot.  It uses open addressing
+// with Robin Hood probing in one array, so that a lookup touches a few
+// adjacent entries instead of walking a chain of allocated nodes.
+//
 
 #ifndef PF_HASHTABLE_H
 #define PF_HASHTABLE_H
@@ -11,36 +15,49 @@
 #include "pf_internal.h"
 
 //
-// HashEntry - Hash table bucket entries
+// HashEntry - Hash table entries
 //
 struct PF_HashEntry {
-		PF_HashEntry *next;   // next hash table element or NULL
-		PF_HashEntry *prev;   // prev hash table element or NULL
 		int          fd;      // file descriptor
 		PageNum      pageNum; // page number
-		int          slot;    // slot of this page in the buffer
+		int          slot;    // slot of this page in the buffer or
+		                      // PF_HASH_EMPTY if the entry is not used
+		int          dist;    // distance from the home position
 };
 
+#define PF_HASH_EMPTY  (-1)
+
 //
 // PF_HashTable - allow search, insertion, and deletion of hash table entries
 //
 class PF_HashTable {
 public:
-		PF_HashTable (int numBuckets);           // Constructor
+		PF_HashTable (int numEntries);           // Constructor
 		~PF_HashTable();                         // Destructor
-		RC  Find     (int fd, PageNum pageNum, int &slot);
+		RC  Find     (int fd, PageNum pageNum, int &slot) const;
 		                                         // Set slot to the hash table
 		                                         // entry for fd and pageNum
 		RC  Insert   (int fd, PageNum pageNum, int slot);
 		                                         // Insert a hash table entry
 		RC  Delete   (int fd, PageNum pageNum);  // Delete a hash table entry
 
+		// Size the table for numEntries entries, keeping the entries
+		RC  Resize   (int numEntries);
+
+		int GetSize  () const { return (size); } // Number of entries
+
 private:
+		// Home position of (fd,pageNum).  fd is -1 for the memory blocks
+		// and their page numbers may be negative, the mixer handles both.
 		int Hash     (int fd, PageNum pageNum) const
-		// Kiprey: 需要考虑到 fd == -1 的情况，因为这种情况指代该 Block 为 memory block
-			{ return ((fd + pageNum + numBuckets) % numBuckets); }   // Hash function
-		int numBuckets;                               // Number of hash table buckets
-		PF_HashEntry **hashTable;                     // Hash table
+			{ return ((int)PF_HashPage(fd, pageNum) & mask); }
+
+		void Place   (PF_HashEntry entry);       // Robin Hood insertion
+
+		int size;                                // Number of entries
+		int numUsed;                             // Number of used entries
+		int mask;                                // size - 1, size is 2^n
+		PF_HashEntry *hashTable;                 // Hash table
 };
 
 #endif
@@ -11,17 +11,46 @@
 
 #include <cstdlib>
 #include <cstring>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
 #include "pf.h"
+#include "pf_bitmap.h"
+
+//
+// PF_Nanos: time from a steady clock, in nanoseconds
+//
+inline long long PF_Nanos()
+{
+	return (std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count());
+}
 
 //
 // Constants and defines
 //
 const int PF_BUFFER_SIZE = 40;     // Number of pages in the buffer
-const int PF_HASH_TBL_SIZE = 20;   // Size of hash table
+const int PF_READAHEAD_THREADS = 2;// Number of read-ahead threads
+const int PF_READAHEAD_TRIGGER = 2;// Sequential fetches before reading ahead
+const int PF_SCAN_RING_PAGES = 16; // Pages of a scan ring, all shards
+const int PF_MAX_IOV = 256;        // Most pages written by one system call
+const int PF_BGWRITER_INTERVAL = 10; // ms between background writer rounds
+const int PF_IO_ALIGN = 4096;      // alignment of O_DIRECT buffers
+const int PF_EXTENT_MAX_PAGES = 4096; // Most pages reserved by the growth
+                                   // percentage of PF_FileHandle::SetExtent
+const size_t PF_MMAP_RESERVE = (size_t)1 << 36; // Most bytes a file can map
 
 #define CREATION_MASK      0600    // r/w privileges to owner only
 #define PF_PAGE_LIST_END  -1       // end of list of free pages
 #define PF_PAGE_USED      -2       // page is being used
+#define PF_PAGE_BITMAP    -3       // page holds allocation bits
+
+// Flags of PF_FileHdr.  The files written before the flags were kept
+// have TRUE there when they have the bitmap.
+#define PF_HDR_BITMAP      0x1     // allocation bitmap kept in the file
+#define PF_HDR_COMPRESSED  0x2     // pages compressed
 
 // L_SET is used to indicate the "whence" argument of the lseek call
 // defined in "/usr/include/unistd.h".  A value of 0 indicates to
@@ -36,11 +65,100 @@ const int PF_HASH_TBL_SIZE = 20;   // Size of hash table
 struct PF_PageHdr {
 	int nextFree;       // nextFree can be any of these values:
 	                    //  - the number of the next free page
-	                    //  - PF_PAGE_LIST_END if this is last free page
+	                    //  - PF_PAGE_LIST_END if this is last free page,
+	                    //    or any free page since the allocation bitmap
 	                    //  - PF_PAGE_USED if the page is not free
+	                    //  - PF_PAGE_BITMAP if the page holds the
+	                    //    allocation bits of the following pages
+};
+
+//
+// PF_FileState: state of an open file shared by all its file handles
+//
+class PF_MappedFile;
+class PF_CompressedFile;
+
+struct PF_FileState {
+	PF_FileState () : numPages(0), bHdrChanged(FALSE), lastPage(-1),
+	                  seqCount(0), raNext(0), pMapped(NULL),
+	                  pCompressed(NULL), bDirect(FALSE), freeHint(0),
+	                  reservedEnd(0), extentPages(PF_EXTENT_PAGES),
+	                  extentGrowth(PF_EXTENT_GROWTH) {}
+
+	std::mutex latch;   // serializes changes of the file header, of the
+	                    // bitmap and of the read-ahead state below
+	std::atomic<PageNum> numPages; // # of pages in the file, changed with
+	                    // the latch held and read without it
+	int bHdrChanged;    // dirty flag for the file header
+	PageNum lastPage;   // last page fetched
+	int seqCount;       // # of fetches in page order up to lastPage
+	PageNum raNext;     // first page not asked to the read-ahead yet
+	PF_MappedFile *pMapped; // mapping of the file in PF_MODE_MMAP
+	PF_CompressedFile *pCompressed; // extents of a compressed file
+	int bDirect;        // TRUE if opened with O_DIRECT
+	PF_Bitmap used;     // bit set for each used page
+	PageNum freeHint;   // no page before this one is free
+	std::vector<char> bitmapDirty; // TRUE for the bitmap pages to write
+	std::string fileName; // name the file was opened with
+	PageNum reservedEnd; // the file has room for the pages before this one
+	int extentPages;    // pages reserved at least when the file grows
+	int extentGrowth;   // or this percentage of its pages
 };
 
-// Justify the file header to the length of one page
+// Justify the file header to the length of one page of the default size
 const int PF_FILE_HDR_SIZE = PF_PAGE_SIZE + sizeof(PF_PageHdr);
 
+// The header page holds the allocation bits of the first
+// PF_HDR_BITMAP_BITS pages after PF_FileHdr.  The bits of the other pages
+// are in bitmap pages: bitmap page j is page PF_HDR_BITMAP_BITS +
+// j * PF_BitmapPageBits(pageSize) and holds the bits of itself and of the
+// pages which follow it, up to the next bitmap page.
+const int PF_HDR_BITMAP_BITS = (PF_FILE_HDR_SIZE - sizeof(PF_FileHdr)) * 8;
+
+inline int PF_BitmapPageBits(int pageSize)
+{
+	return (PF_PageDataSize(pageSize) * 8);
+}
+
+// Page sizes are PF_DEFAULT_PAGE_SIZE << sizeClass
+const int PF_NUM_PAGE_SIZES = 5;
+
+//
+// PF_UseRing: TRUE if the pages read with hint go through the scan ring
+//
+inline int PF_UseRing(ClientHint hint)
+{
+	return (hint == SEQUENTIAL_SCAN || hint == ONE_SHOT);
+}
+
+//
+// PF_PageSizeClass: sizeClass of a page size, -1 if it is not allowed
+//
+inline int PF_PageSizeClass(int pageSize)
+{
+	for (int c = 0; c < PF_NUM_PAGE_SIZES; c++)
+		if (pageSize == PF_DEFAULT_PAGE_SIZE << c)
+			return (c);
+	return (-1);
+}
+
+//
+// PF_HashPage: mix (fd,pageNum) into 64 well distributed bits.  The
+// buffer manager picks a shard with the high half and the hash table
+// an entry with the low half.
+//
+inline unsigned long long PF_HashPage(int fd, PageNum pageNum)
+{
+	unsigned long long h = ((unsigned long long)(unsigned int)fd << 32) |
+		(unsigned int)pageNum;
+
+	// Finalizer of MurmurHash3
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+	return (h);
+}
+
 #endif
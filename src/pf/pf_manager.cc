@@ -6,12 +6,19 @@
 //
 
 #include <cstdio>
+#include <iostream>
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include "pf_internal.h"
 #include "pf_buffermgr.h"
+#include "pf_mmap.h"
+#include "pf_compress.h"
+#include "pf_resident.h"
+#include "pf_filestats.h"
+
+using namespace std;
 
 //
 // PF_Manager
@@ -20,11 +27,16 @@
 //       Handles creation, deletion, opening and closing of files.
 //       It is associated with a PF_BufferMgr that manages the page
 //       buffer and executes the page replacement policies.
+// In:   policy - page replacement policy of the buffer manager
+//       numShards - number of partitions of the buffer
 //
-PF_Manager::PF_Manager()
+PF_Manager::PF_Manager(PF_ReplacePolicy policy, int numShards)
 {
 	// Create Buffer Manager
-	pBufferMgr = new PF_BufferMgr(PF_BUFFER_SIZE);
+	pBufferMgr = new PF_BufferMgr(PF_BUFFER_SIZE, policy, numShards);
+	fileMode = PF_MODE_BUFFERED;
+	pResident = NULL;
+	pStats = new PF_StatsTable;
 }
 
 //
@@ -38,6 +50,8 @@ PF_Manager::~PF_Manager()
 {
 	// Destroy the buffer manager objects
 	delete pBufferMgr;
+	delete pResident;
+	delete pStats;
 }
 
 //
@@ -45,13 +59,22 @@ PF_Manager::~PF_Manager()
 //
 // Desc: Create a new PF file named fileName
 // In:   fileName - name of file to create
-// Ret:  PF return code
+//       pageSize - size of the pages of the file, a power of two from
+//                  PF_DEFAULT_PAGE_SIZE to PF_MAX_PAGE_SIZE
+//       bCompressed - TRUE to keep the pages compressed on disk.  The
+//                     offset map of the file is kept beside it, in
+//                     fileName + PF_MAP_SUFFIX.
+// Ret:  PF_BADPARAM if pageSize is not allowed, other PF return code
 //
-RC PF_Manager::CreateFile (const char *fileName)
+RC PF_Manager::CreateFile (const char *fileName, int pageSize,
+		int bCompressed)
 {
 	int fd;		// unix file descriptor
 	int numBytes;		// return code form write syscall
 
+	if (PF_PageSizeClass(pageSize) < 0)
+		return (PF_BADPARAM);
+
 	// Create file for exclusive use
 	if ((fd = open(fileName,
 #ifdef PC
@@ -71,6 +94,12 @@ RC PF_Manager::CreateFile (const char *fileName)
 	PF_FileHdr *hdr = (PF_FileHdr*)hdrBuf;
 	hdr->firstFree = PF_PAGE_LIST_END;
 	hdr->numPages = 0;
+	hdr->pageSize = pageSize;
+	hdr->flags = PF_HDR_BITMAP | (bCompressed ? PF_HDR_COMPRESSED : 0);
+
+	// A map left by a file of the same name would not match
+	if (bCompressed)
+		unlink(PF_CompressedFile::MapName(fileName).c_str());
 
 	// Write header to file
 	if((numBytes = write(fd, hdrBuf, PF_FILE_HDR_SIZE))
@@ -104,9 +133,14 @@ RC PF_Manager::CreateFile (const char *fileName)
 //
 RC PF_Manager::DestroyFile (const char *fileName)
 {
-	// Remove the file
+	// Remove the file, and its offset map if it is compressed
 	if (unlink(fileName) < 0)
 		return (PF_UNIX);
+	unlink(PF_CompressedFile::MapName(fileName).c_str());
+
+	// Its pages are not to be loaded at the next start
+	if (pResident)
+		pResident->Forget(fileName);
 
 	// Return ok
 	return (0);
@@ -132,6 +166,9 @@ RC PF_Manager::DestroyFile (const char *fileName)
 RC PF_Manager::OpenFile (const char *fileName, PF_FileHandle &fileHandle)
 {
 	int rc;                   // return code
+	int bCompressed;          // TRUE if the pages are compressed
+	int bMapped;              // TRUE if the file is mapped
+	alignas(PF_IO_ALIGN) char hdrBuf[PF_FILE_HDR_SIZE];
 
 	// Ensure file is not already open
 	if (fileHandle.bFileOpen)
@@ -141,27 +178,126 @@ RC PF_Manager::OpenFile (const char *fileName, PF_FileHandle &fileHandle)
 	if ((fileHandle.unixfd = open(fileName,
 #ifdef PC
 			O_BINARY |
+#endif
+#ifdef O_DIRECT
+			(fileMode == PF_MODE_DIRECT ? O_DIRECT : 0) |
 #endif
 			O_RDWR)) < 0)
 		return (PF_UNIX);
 
-	// Read the file header
+	// Read the file header.  The whole header page is read into an
+	// aligned buffer, as O_DIRECT requires.
 	{
-		int numBytes = read(fileHandle.unixfd, (char *)&fileHandle.hdr,
-				sizeof(PF_FileHdr));
-		if (numBytes != sizeof(PF_FileHdr)) {
+		int numBytes = pread(fileHandle.unixfd, hdrBuf, PF_FILE_HDR_SIZE, 0);
+		if (numBytes != PF_FILE_HDR_SIZE) {
 			rc = (numBytes < 0) ? PF_UNIX : PF_HDRREAD;
 			goto err;
 		}
+		memcpy(&fileHandle.hdr, hdrBuf, sizeof(PF_FileHdr));
 	}
 
-	// Set file header to be not changed
-	fileHandle.bHdrChanged = FALSE;
+	// Files created before the page size was stored have 0 there
+	if (fileHandle.hdr.pageSize == 0)
+		fileHandle.hdr.pageSize = PF_DEFAULT_PAGE_SIZE;
+	if (PF_PageSizeClass(fileHandle.hdr.pageSize) < 0) {
+		rc = PF_HDRREAD;
+		goto err;
+	}
+
+	// The pages of a compressed file are copied out of their extents, so
+	// it is neither mapped nor read with O_DIRECT
+	bCompressed = (fileHandle.hdr.flags & PF_HDR_COMPRESSED) != 0;
+	bMapped = (fileMode == PF_MODE_MMAP && !bCompressed);
+#ifdef O_DIRECT
+	if (bCompressed && fileMode == PF_MODE_DIRECT &&
+			fcntl(fileHandle.unixfd, F_SETFL,
+				fcntl(fileHandle.unixfd, F_GETFL) & ~O_DIRECT) < 0) {
+		rc = PF_UNIX;
+		goto err;
+	}
+#endif
+
+	// Make room in the buffer for pages of this size
+	if (!bMapped &&
+			(rc = pBufferMgr->UsePageSize(fileHandle.hdr.pageSize)))
+		goto err;
 
 	// Set local variables in file handle object to refer to open file
 	fileHandle.pBufferMgr = pBufferMgr;
+	fileHandle.pState = new PF_FileState;
+	fileHandle.pState->numPages = fileHandle.hdr.numPages;
+	fileHandle.pState->bDirect = (fileMode == PF_MODE_DIRECT && !bCompressed);
+	fileHandle.pState->fileName = fileName;
 	fileHandle.bFileOpen = TRUE;
 
+	// The room reserved by earlier extents is the end of the file
+	{
+		struct stat st;
+		if (!bCompressed && fstat(fileHandle.unixfd, &st) == 0 &&
+				st.st_size > PF_FILE_HDR_SIZE)
+			fileHandle.pState->reservedEnd =
+				(st.st_size - PF_FILE_HDR_SIZE) / fileHandle.hdr.pageSize;
+	}
+
+	// Load the offset map of a compressed file, through which its pages
+	// are read from now on
+	if (bCompressed) {
+		PF_CompressedFile *pCompressed = new PF_CompressedFile(
+				fileHandle.unixfd, fileHandle.hdr.pageSize, fileName);
+		if ((rc = pCompressed->Load(fileHandle.pState->numPages))) {
+			delete pCompressed;
+			delete fileHandle.pState;
+			fileHandle.pState = NULL;
+			goto err;
+		}
+		fileHandle.pState->pCompressed = pCompressed;
+		pBufferMgr->SetCompressed(fileHandle.unixfd, pCompressed);
+	}
+
+	// Load the allocation bitmap
+	if ((rc = fileHandle.ReadBitmap(hdrBuf))) {
+		if (bCompressed) {
+			pBufferMgr->SetCompressed(fileHandle.unixfd, NULL);
+			delete fileHandle.pState->pCompressed;
+		}
+		delete fileHandle.pState;
+		fileHandle.pState = NULL;
+		goto err;
+	}
+
+	// Map the file in PF_MODE_MMAP
+	if (bMapped) {
+		fileHandle.pState->pMapped = new PF_MappedFile;
+		if ((rc = fileHandle.pState->pMapped->Open(fileHandle.unixfd,
+				fileHandle.pState->numPages, fileHandle.hdr.pageSize))) {
+			delete fileHandle.pState->pMapped;
+			delete fileHandle.pState;
+			fileHandle.pState = NULL;
+			goto err;
+		}
+	}
+
+	// Count the use of the buffer by the file from now on.  A file
+	// closed before under the same fd may have left counters behind.
+	{
+		PF_FileStats stats;
+		pBufferMgr->GetFileStats(fileHandle.unixfd, stats, TRUE);
+		pStats->Open(fileHandle.unixfd, fileName);
+	}
+
+	// Load the pages the buffer held when the file was last closed
+	if (pResident) {
+		vector<PageNum> pageNums, usedPages;
+		pResident->Take(fileName, pageNums);
+		for (size_t i = 0; i < pageNums.size(); i++)
+			if (pageNums[i] < fileHandle.pState->numPages &&
+					fileHandle.pState->used.Test(pageNums[i]))
+				usedPages.push_back(pageNums[i]);
+		if (!usedPages.empty() && !bMapped)
+			pBufferMgr->Prefetch(fileHandle.unixfd, fileHandle.hdr.pageSize,
+					usedPages);
+	}
+
 	// Return ok
 	return 0;
 
@@ -194,10 +330,40 @@ RC PF_Manager::CloseFile(PF_FileHandle &fileHandle)
 	if (!fileHandle.bFileOpen)
 		return (PF_CLOSEDFILE);
 
+	// Remember the pages in the buffer for a warm restart
+	if (pResident && fileHandle.pState->pMapped == NULL) {
+		vector<pair<double, PageNum> > pages;
+		pBufferMgr->ResidentPages(fileHandle.unixfd, fileHandle.hdr.pageSize,
+				pages);
+		pResident->Record(fileHandle.pState->fileName.c_str(),
+				fileHandle.hdr.pageSize, pages);
+	}
+
 	// Flush all buffers for this file and write out the header
 	if ((rc = fileHandle.FlushPages()))
 		return (rc);
 
+	// Add the counters of the file to the totals of its name
+	{
+		PF_FileStats stats;
+		pBufferMgr->GetFileStats(fileHandle.unixfd, stats, TRUE);
+		pStats->Close(fileHandle.unixfd, stats);
+	}
+
+	// Unmap the file in PF_MODE_MMAP
+	if (fileHandle.pState->pMapped) {
+		if ((rc = fileHandle.pState->pMapped->Close(fileHandle.unixfd,
+				fileHandle.pState->numPages)))
+			return (rc);
+		delete fileHandle.pState->pMapped;
+	}
+
+	// The pages of a compressed file are all written and its map saved
+	if (fileHandle.pState->pCompressed) {
+		pBufferMgr->SetCompressed(fileHandle.unixfd, NULL);
+		delete fileHandle.pState->pCompressed;
+	}
+
 	// Close the file
 	if (close(fileHandle.unixfd) < 0)
 		return (PF_UNIX);
@@ -205,11 +371,56 @@ RC PF_Manager::CloseFile(PF_FileHandle &fileHandle)
 
 	// Reset the buffer manager pointer in the file handle
 	fileHandle.pBufferMgr = NULL;
+	delete fileHandle.pState;
+	fileHandle.pState = NULL;
 
 	// Return ok
 	return 0;
 }
 
+//
+// LoadResidentPages
+//
+// Desc: Read the list of pages written by SaveResidentPages.  The pages
+//       listed for a file are queued to the read-ahead threads, in page
+//       order, when the file is next opened.  The pages in the buffer
+//       when a file is closed are remembered from now on.
+//       A list which does not exist is taken as empty.
+// In:   listName - name of the list file
+// Ret:  PF_UNIX if the list cannot be read
+//
+RC PF_Manager::LoadResidentPages(const char *listName)
+{
+	if (pResident == NULL)
+		pResident = new PF_ResidentList;
+
+	return pResident->Load(listName);
+}
+
+//
+// SaveResidentPages
+//
+// Desc: Write the pages remembered when the files were closed to a list
+//       for LoadResidentPages, the hottest first: the files closed last
+//       come first, and the pages of a file are in the order the policy
+//       would keep them.  The list holds no more pages than the buffer.
+//       Pages are no longer remembered afterwards.  The files should be
+//       closed first; nothing is written if LoadResidentPages was not
+//       called.
+// In:   listName - name of the list file
+// Ret:  PF_UNIX if the list cannot be written
+//
+RC PF_Manager::SaveResidentPages(const char *listName)
+{
+	if (pResident == NULL)
+		return (0);
+
+	RC rc = pResident->Save(listName, pBufferMgr->GetNumPages());
+	delete pResident;
+	pResident = NULL;
+	return (rc);
+}
+
 //
 // ClearBuffer
 //
@@ -239,25 +450,172 @@ RC PF_Manager::ClearBuffer()
 //
 RC PF_Manager::PrintBuffer()
 {
-	return pBufferMgr->PrintBuffer();
+	RC rc;
+
+	if ((rc = pBufferMgr->PrintBuffer()))
+		return (rc);
+	return PrintFileStats();
+}
+
+//
+// GetFileStats
+//
+// Desc: Get the counters of the use of the buffer by a file, over all
+//       the times it was opened since the counters were last reset.
+//       The files opened in PF_MODE_MMAP do not use the buffer and only
+//       have zeros.
+// In:   fileName - name the file is opened with
+// Out:  stats - counters of the file, zeros if it was never opened
+// Ret:  0 for success
+//
+RC PF_Manager::GetFileStats(const char *fileName, PF_FileStats &stats)
+{
+	map<string, PF_FileStats> allStats;
+	pStats->Collect(*pBufferMgr, allStats);
+
+	map<string, PF_FileStats>::const_iterator it =
+		allStats.find(fileName);
+	stats = (it == allStats.end()) ? PF_FileStats() : it->second;
+	return (0);
+}
+
+//
+// PrintFileStats
+//
+// Desc: Display the counters of the use of the buffer by each file.
+//       This routine will be called via the system command.
+// Ret:  0 for success
+//
+RC PF_Manager::PrintFileStats()
+{
+	map<string, PF_FileStats> allStats;
+	pStats->Collect(*pBufferMgr, allStats);
+
+	char line[128];
+	cout << "Buffer use by file:\n";
+	snprintf(line, sizeof(line), "%-20s %9s %9s %6s %9s %9s %12s\n", "File",
+			"Hits", "Misses", "Hit %", "Evicted", "Written", "Avg pin (us)");
+	cout << line;
+	for (map<string, PF_FileStats>::const_iterator it = allStats.begin();
+			it != allStats.end(); ++it) {
+		const PF_FileStats &stats = it->second;
+		long gets = stats.hits + stats.misses;
+		snprintf(line, sizeof(line), "%-20s %9ld %9ld %6.1f %9ld %9ld %12.1f\n",
+				it->first.c_str(), stats.hits, stats.misses,
+				gets ? 100.0 * stats.hits / gets : 0.0,
+				stats.evictions, stats.writeBacks,
+				stats.pins ? stats.pinNanos / 1000.0 / stats.pins : 0.0);
+		cout << line;
+	}
+	if (allStats.empty())
+		cout << "No file was opened.\n";
+
+	return (0);
+}
+
+//
+// ResetFileStats
+//
+// Desc: Reset the counters of all the files.
+//       This routine will be called via the system command.
+// Ret:  0 for success
+//
+RC PF_Manager::ResetFileStats()
+{
+	pStats->Reset();
+	return pBufferMgr->ResetFileStats();
+}
+
+//
+// SetReadAhead
+//
+// Desc: Set the number of pages loaded ahead of a file read in page
+//       order.  Called by SM_Manager::Set.
+// In:   numPages - read-ahead window, 0 turns read-ahead off
+// Ret:  Returns the result of PF_BufferMgr::SetReadAhead
+//
+RC PF_Manager::SetReadAhead(int numPages)
+{
+	return pBufferMgr->SetReadAhead(numPages);
+}
+
+//
+// SetBgWriter
+//
+// Desc: Set the watermarks of the background writer.  Called by
+//       SM_Manager::Set.
+// In:   tailPct - percent of the buffer kept clean, 0 turns it off
+//       lowPct - percent of clean pages under which the writer starts
+//       highPct - percent of clean pages at which the writer stops
+// Ret:  Returns the result of PF_BufferMgr::SetBgWriter
+//
+RC PF_Manager::SetBgWriter(int tailPct, int lowPct, int highPct)
+{
+	return pBufferMgr->SetBgWriter(tailPct, lowPct, highPct);
+}
+
+//
+// SetFileMode
+//
+// Desc: Set how the files opened from now on are accessed.  The files
+//       already open keep their mode.  Called by SM_Manager::Set.
+// In:   mode - PF_MODE_BUFFERED, PF_MODE_MMAP or PF_MODE_DIRECT
+// Ret:  PF_BADPARAM if the system has no O_DIRECT
+//
+RC PF_Manager::SetFileMode(PF_FileMode mode)
+{
+#ifndef O_DIRECT
+	if (mode == PF_MODE_DIRECT)
+		return (PF_BADPARAM);
+#endif
+	fileMode = mode;
+	return (0);
+}
+
+//
+// SetHugePages
+//
+// Desc: Advise the kernel to back the buffer with transparent huge pages,
+//       or not to.  Called by SM_Manager::Set.
+// In:   bHugePages - TRUE to use huge pages
+// Ret:  Returns the result of PF_BufferMgr::SetHugePages
+//
+RC PF_Manager::SetHugePages(int bHugePages)
+{
+	return pBufferMgr->SetHugePages(bHugePages);
 }
 
 //
 // ResizeBuffer
 //
-// Desc: Resizes the buffer manager to the size passed in.
+// Desc: Resizes the buffer manager to the size passed in.  The pages
+//       which still fit stay in the buffer.
 //       This routine will be called via the system command.
 // In:   The new buffer size
 // Out:  Nothing
 // Ret:  Returns the result of PF_BufferMgr::ResizeBuffer
 //       It is a code: 0 for success, PF_TOOSMALL when iNewSize
-//       would be too small.
+//       would be too small, PF_NOBUF when pinned pages keep the buffer
+//       from shrinking that far.
 //
 RC PF_Manager::ResizeBuffer(int iNewSize)
 {
 	return pBufferMgr->ResizeBuffer(iNewSize);
 }
 
+//
+// SetReplacePolicy
+//
+// Desc: Switch the page replacement policy of the buffer manager.
+//       This routine will be called via SM_Manager::Set.
+// In:   The new policy
+// Ret:  Returns the result of PF_BufferMgr::SetReplacePolicy
+//
+RC PF_Manager::SetReplacePolicy(PF_ReplacePolicy policy)
+{
+	return pBufferMgr->SetReplacePolicy(policy);
+}
+
 //------------------------------------------------------------------------------
 // Three Methods for manipulating raw memory buffers.  These memory
 // locations are handled by the buffer manager, but are not
@@ -0,0 +1,220 @@
+//
+// File:        pf_mmap.cc
+// Description: PF_MappedFile class implementation
+//
+
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "pf_internal.h"
+#include "pf_mmap.h"
+
+using namespace std;
+
+//
+// RoundUp
+//
+// Round a length up to the page size of the system, which mmap requires
+// for file offsets
+//
+static size_t RoundUp(size_t length)
+{
+	size_t sysPage = sysconf(_SC_PAGESIZE);
+	return ((length + sysPage - 1) / sysPage * sysPage);
+}
+
+PF_MappedFile::PF_MappedFile()
+{
+	pBase = NULL;
+	mapped = 0;
+	pageSize = PF_DEFAULT_PAGE_SIZE;
+	bGrown = FALSE;
+}
+
+PF_MappedFile::~PF_MappedFile()
+{
+	if (pBase)
+		munmap(pBase, PF_MMAP_RESERVE);
+}
+
+//
+// Open
+//
+// Desc: Reserve the address range and map the file at its start
+// In:   fd - OS file descriptor, open for reading and writing
+//       numPages - number of pages in the file
+//       _pageSize - size of the pages of the file
+// Ret:  PF return code
+//
+RC PF_MappedFile::Open(int fd, int numPages, int _pageSize)
+{
+	pageSize = _pageSize;
+
+	void *p = mmap(NULL, PF_MMAP_RESERVE, PROT_NONE,
+			MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (p == MAP_FAILED)
+		return (PF_UNIX);
+	pBase = (char *)p;
+
+	return (Grow(fd, numPages));
+}
+
+//
+// Close
+//
+// Desc: Drop the room added at the end of the file by Grow, so that the
+//       file looks as if it had been written through the buffer, and
+//       unmap it
+// In:   fd - OS file descriptor
+//       numPages - number of pages in the file
+// Ret:  PF return code
+//
+RC PF_MappedFile::Close(int fd, int numPages)
+{
+	if (bGrown &&
+			ftruncate(fd, PF_FILE_HDR_SIZE + (off_t)numPages * pageSize) < 0)
+		return (PF_UNIX);
+
+	if (munmap(pBase, PF_MMAP_RESERVE) < 0)
+		return (PF_UNIX);
+	pBase = NULL;
+	mapped = 0;
+
+	return (0);
+}
+
+//
+// Sync
+//
+// Desc: Write the changed pages of the mapping to the file and wait
+//       until they are on the device
+// Ret:  PF return code
+//
+RC PF_MappedFile::Sync()
+{
+	lock_guard<mutex> guard(latch);
+
+	if (mapped > 0 && msync(pBase, mapped, MS_SYNC) < 0)
+		return (PF_UNIX);
+	return (0);
+}
+
+//
+// Grow
+//
+// Desc: Map the file up to page numPages.  The file is extended if needed,
+//       by doubling the mapped length so that allocating page after page
+//       does not cost a system call each time.
+// In:   fd - OS file descriptor
+//       numPages - number of pages which must be mapped
+// Ret:  PF return code
+//
+RC PF_MappedFile::Grow(int fd, int numPages)
+{
+	lock_guard<mutex> guard(latch);
+
+	size_t needed = PF_FILE_HDR_SIZE + (size_t)numPages * pageSize;
+	if (needed <= mapped) {
+		if ((int)pins.size() < numPages)
+			pins.resize(numPages, 0);
+		return (0);
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) < 0)
+		return (PF_UNIX);
+
+	// Map what is in the file, or twice what is mapped to add pages
+	size_t length = RoundUp(needed);
+	if (length < (size_t)st.st_size)
+		length = RoundUp(st.st_size);
+	else if (mapped > 0 && length < 2 * mapped)
+		length = 2 * mapped;
+	if (length > PF_MMAP_RESERVE)
+		return (PF_NOMEM);
+
+	if ((size_t)st.st_size < length) {
+		if (ftruncate(fd, length) < 0)
+			return (PF_UNIX);
+		bGrown = TRUE;
+	}
+
+	// Map the new part in place
+	if (mmap(pBase + mapped, length - mapped, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_FIXED, fd, mapped) == MAP_FAILED)
+		return (PF_UNIX);
+	mapped = length;
+
+	if ((int)pins.size() < numPages)
+		pins.resize(numPages, 0);
+
+	return (0);
+}
+
+//
+// Pin
+//
+// Desc: Pin a page of the mapping
+// In:   pageNum - page number, must be mapped
+//       bMultiplePins - if FALSE, it is an error to pin a pinned page
+// Out:  ppBuffer - set *ppBuffer to point to the page
+// Ret:  PF_PAGEPINNED or 0
+//
+RC PF_MappedFile::Pin(PageNum pageNum, char **ppBuffer, int bMultiplePins)
+{
+	lock_guard<mutex> guard(latch);
+
+	if (!bMultiplePins && pins[pageNum] > 0)
+		return (PF_PAGEPINNED);
+	pins[pageNum]++;
+
+	*ppBuffer = pBase + PF_FILE_HDR_SIZE + (size_t)pageNum * pageSize;
+	return (0);
+}
+
+//
+// Unpin
+//
+// Desc: Unpin a page of the mapping
+// In:   pageNum - page number
+// Ret:  PF_PAGEUNPINNED if the page is not pinned, 0 otherwise
+//
+RC PF_MappedFile::Unpin(PageNum pageNum)
+{
+	lock_guard<mutex> guard(latch);
+
+	if (pins[pageNum] == 0)
+		return (PF_PAGEUNPINNED);
+	pins[pageNum]--;
+	return (0);
+}
+
+//
+// MarkDirty
+//
+// Desc: The mapping is shared with the file, so there is nothing to
+//       write later.  The page must be pinned all the same.
+// In:   pageNum - page number
+// Ret:  PF_PAGEUNPINNED if the page is not pinned, 0 otherwise
+//
+RC PF_MappedFile::MarkDirty(PageNum pageNum)
+{
+	lock_guard<mutex> guard(latch);
+
+	return (pins[pageNum] == 0 ? PF_PAGEUNPINNED : 0);
+}
+
+//
+// CheckUnpinned
+//
+// Ret:  PF_PAGEPINNED if a page of the file is pinned, 0 otherwise
+//
+RC PF_MappedFile::CheckUnpinned()
+{
+	lock_guard<mutex> guard(latch);
+
+	for (size_t i = 0; i < pins.size(); i++)
+		if (pins[i] > 0)
+			return (PF_PAGEPINNED);
+	return (0);
+}
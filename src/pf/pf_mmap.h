@@ -0,0 +1,58 @@
+//
+// File:        pf_mmap.h
+// Description: PF_MappedFile class interface
+//
+// In the PF_MODE_MMAP file mode the pages of a file are not copied into
+// the buffer pool.  The file is mapped into memory and the page handles
+// point straight into the mapping, so fetching a page costs neither a
+// copy nor a hash lookup.  This is meant for read-mostly files which fit
+// in memory.
+//
+
+#ifndef PF_MMAP_H
+#define PF_MMAP_H
+
+#include <vector>
+#include <mutex>
+#include "pf_internal.h"
+
+//
+// PF_MappedFile - mapping of an open paged file
+//
+// A large range of addresses is reserved when the file is opened, and
+// the file is mapped at its start.  The mapping grows in place when
+// pages are added, so the pointers given out stay valid.  The pin counts
+// are only kept to report the same errors as the buffer manager.
+//
+class PF_MappedFile {
+public:
+	PF_MappedFile  ();
+	~PF_MappedFile ();
+
+	// Map the file, which holds numPages pages of pageSize bytes
+	RC Open        (int fd, int numPages, int pageSize);
+	// Cut the file down to numPages pages and unmap it
+	RC Close       (int fd, int numPages);
+	// Make the mapping cover numPages pages, growing the file
+	RC Grow        (int fd, int numPages);
+	// Write the changed pages of the mapping and wait for them
+	RC Sync        ();
+
+	// Pin a page and point ppBuffer to it (its PF_PageHdr)
+	RC Pin         (PageNum pageNum, char **ppBuffer, int bMultiplePins = TRUE);
+	RC Unpin       (PageNum pageNum);
+	// Check that a page is pinned, as MarkDirty would
+	RC MarkDirty   (PageNum pageNum);
+	// PF_PAGEPINNED if a page is pinned, like FlushPages
+	RC CheckUnpinned ();
+
+private:
+	char   *pBase;                         // start of the reserved range
+	size_t mapped;                         // bytes of the file mapped
+	int    pageSize;                       // size of the pages of the file
+	int    bGrown;                         // TRUE if the file was extended
+	std::vector<int> pins;                 // pin count of each page
+	std::mutex latch;                      // protects pins and mapped
+};
+
+#endif
@@ -0,0 +1,143 @@
+//
+// File:        pf_pageguard.cc
+// Description: PF_PageGuard class implementation
+//
+// Callers used to pair each GetThisPage with an UnpinPage by page number,
+// which looked the page up in the hash table again, and the pages were
+// left pinned whenever a function returned on an error in between.  The
+// guard unpins its page when it goes out of scope, and reaches the page
+// through the slot kept in the page handle.
+//
+
+#include "pf_internal.h"
+
+//
+// PF_PageGuard
+//
+// Desc: Default constructor.  The guard holds no page until it is given
+//       one by a PF_FileHandle method or by a move.
+//
+PF_PageGuard::PF_PageGuard()
+{
+	pFileHandle = NULL;
+}
+
+//
+// PF_PageGuard
+//
+// Desc: Take over the pin of a page.  The page is unpinned when the
+//       guard is destroyed, unless it is released or moved before.
+// In:   fileHandle - open file of the page, must outlive the guard
+//       pageHandle - handle of the pinned page
+//
+PF_PageGuard::PF_PageGuard(const PF_FileHandle &fileHandle,
+		const PF_PageHandle &pageHandle)
+{
+	this->pFileHandle = &fileHandle;
+	this->pageHandle = pageHandle;
+}
+
+//
+// ~PF_PageGuard
+//
+// Desc: Unpin the page held, if any.  The return code is lost, so code
+//       which cares about it calls Release first.
+//
+PF_PageGuard::~PF_PageGuard()
+{
+	Release();
+}
+
+//
+// PF_PageGuard
+//
+// Desc: Move constructor
+// In:   pageGuard - guard whose page is taken over, left holding no page
+//
+PF_PageGuard::PF_PageGuard(PF_PageGuard &&pageGuard)
+{
+	this->pFileHandle = pageGuard.pFileHandle;
+	this->pageHandle = pageGuard.pageHandle;
+	pageGuard.pFileHandle = NULL;
+}
+
+//
+// operator=
+//
+// Desc: Move assignment.  The page held until now is unpinned.
+// In:   pageGuard - guard whose page is taken over, left holding no page
+// Ret:  reference to *this
+//
+PF_PageGuard& PF_PageGuard::operator= (PF_PageGuard &&pageGuard)
+{
+	if (this != &pageGuard) {
+		Release();
+		this->pFileHandle = pageGuard.pFileHandle;
+		this->pageHandle = pageGuard.pageHandle;
+		pageGuard.pFileHandle = NULL;
+	}
+
+	return (*this);
+}
+
+//
+// GetData
+//
+// Desc: Access the contents of the page held
+// Out:  pData - set to point to the page contents
+// Ret:  PF_PAGEUNPINNED if no page is held, 0 otherwise
+//
+RC PF_PageGuard::GetData(char *&pData) const
+{
+	if (pFileHandle == NULL)
+		return (PF_PAGEUNPINNED);
+
+	return (pageHandle.GetData(pData));
+}
+
+//
+// GetPageNum
+//
+// Desc: Access the number of the page held
+// Out:  pageNum - page number
+// Ret:  PF_PAGEUNPINNED if no page is held, 0 otherwise
+//
+RC PF_PageGuard::GetPageNum(PageNum &pageNum) const
+{
+	if (pFileHandle == NULL)
+		return (PF_PAGEUNPINNED);
+
+	return (pageHandle.GetPageNum(pageNum));
+}
+
+//
+// MarkDirty
+//
+// Desc: Mark the page held dirty, through its slot in the buffer
+// Ret:  PF return code
+//
+RC PF_PageGuard::MarkDirty() const
+{
+	if (pFileHandle == NULL)
+		return (PF_PAGEUNPINNED);
+
+	return (pFileHandle->MarkDirty(pageHandle));
+}
+
+//
+// Release
+//
+// Desc: Unpin the page held, through its slot in the buffer.  The guard
+//       then holds no page.  Releasing a guard which holds no page does
+//       nothing.
+// Ret:  PF return code
+//
+RC PF_PageGuard::Release()
+{
+	if (pFileHandle == NULL)
+		return (0);
+
+	const PF_FileHandle *pFH = pFileHandle;
+	pFileHandle = NULL;
+	return (pFH->UnpinPage(pageHandle));
+}
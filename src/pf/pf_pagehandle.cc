@@ -11,6 +11,7 @@
 // Defines
 //
 #define INVALID_PAGE   (-1)
+#define INVALID_SLOT   (-1)
 
 //
 // PF_PageHandle
@@ -27,6 +28,7 @@ PF_PageHandle::PF_PageHandle()
 {
 	pageNum = INVALID_PAGE;
 	pPageData = NULL;
+	slot = INVALID_SLOT;
 }
 
 //
@@ -55,6 +57,7 @@ PF_PageHandle::PF_PageHandle(const PF_PageHandle &pageHandle)
 	// allocation involved
 	this->pageNum = pageHandle.pageNum;
 	this->pPageData = pageHandle.pPageData;
+	this->slot = pageHandle.slot;
 }
 
 //
@@ -75,6 +78,7 @@ PF_PageHandle& PF_PageHandle::operator= (const PF_PageHandle &pageHandle)
 		// allocation involved
 		this->pageNum = pageHandle.pageNum;
 		this->pPageData = pageHandle.pPageData;
+		this->slot = pageHandle.slot;
 	}
 
 	// Return a reference to this
@@ -0,0 +1,130 @@
+//
+// File:        pf_readahead.cc
+// Description: PF_ReadAhead class implementation
+//
+
+#include <algorithm>
+#include <fcntl.h>
+#include "pf_internal.h"
+#include "pf_buffermgr.h"
+#include "pf_readahead.h"
+
+using namespace std;
+
+//
+// PF_ReadAhead
+//
+// Desc: Constructor - start the I/O threads
+// In:   pBufferMgr - buffer manager the pages are loaded into
+//       numThreads - number of I/O threads
+//
+PF_ReadAhead::PF_ReadAhead(PF_BufferMgr *_pBufferMgr, int numThreads)
+{
+	pBufferMgr = _pBufferMgr;
+	bStop = FALSE;
+
+	for (int i = 0; i < numThreads; i++)
+		threads.push_back(thread(&PF_ReadAhead::Run, this));
+}
+
+//
+// ~PF_ReadAhead
+//
+// Desc: Destructor - drop the queued pages and wait for the threads
+//
+PF_ReadAhead::~PF_ReadAhead()
+{
+	{
+		lock_guard<mutex> guard(latch);
+		bStop = TRUE;
+		queue.clear();
+	}
+	wakeUp.notify_all();
+
+	for (size_t i = 0; i < threads.size(); i++)
+		threads[i].join();
+}
+
+//
+// Request
+//
+// Desc: Queue pages to be loaded into the buffer
+// In:   fd - OS file descriptor of the file
+//       pageSize - size of the pages of the file
+//       pageNum - first page to load
+//       numPages - number of pages to load
+//       hint - hint of the reader the pages are loaded for
+//
+void PF_ReadAhead::Request(int fd, int pageSize, PageNum pageNum,
+		int numPages, ClientHint hint)
+{
+	// Have the OS start reading the whole run now, the threads only
+	// copy the pages into the buffer as they come
+	posix_fadvise(fd, PF_FILE_HDR_SIZE + (off_t)pageNum * pageSize,
+			(off_t)numPages * pageSize, POSIX_FADV_WILLNEED);
+
+	{
+		lock_guard<mutex> guard(latch);
+		for (int i = 0; i < numPages; i++) {
+			PF_ReadRequest r;
+			r.fd = fd;
+			r.pageSize = pageSize;
+			r.pageNum = pageNum + i;
+			r.hint = hint;
+			queue.push_back(r);
+		}
+	}
+	wakeUp.notify_all();
+}
+
+//
+// Cancel
+//
+// Desc: Forget the queued pages of a file and wait for the pages of the
+//       file being read.  Must be called before the file is closed.
+// In:   fd - OS file descriptor of the file
+//
+void PF_ReadAhead::Cancel(int fd)
+{
+	unique_lock<mutex> guard(latch);
+
+	for (deque<PF_ReadRequest>::iterator it = queue.begin();
+			it != queue.end(); )
+		if (it->fd == fd)
+			it = queue.erase(it);
+		else
+			++it;
+
+	while (find(inFlight.begin(), inFlight.end(), fd) != inFlight.end())
+		readDone.wait(guard);
+}
+
+//
+// Run
+//
+// Desc: Internal.  Body of the I/O threads: load the queued pages until
+//       the object is destroyed.
+//
+void PF_ReadAhead::Run()
+{
+	unique_lock<mutex> guard(latch);
+
+	for (;;) {
+		while (!bStop && queue.empty())
+			wakeUp.wait(guard);
+		if (bStop)
+			return;
+
+		PF_ReadRequest r = queue.front();
+		queue.pop_front();
+		inFlight.push_back(r.fd);
+
+		// Errors are ignored, the page will be read when it is needed
+		guard.unlock();
+		pBufferMgr->PrefetchPage(r.fd, r.pageSize, r.pageNum, r.hint);
+		guard.lock();
+
+		inFlight.erase(find(inFlight.begin(), inFlight.end(), r.fd));
+		readDone.notify_all();
+	}
+}
@@ -0,0 +1,63 @@
+//
+// File:        pf_readahead.h
+// Description: PF_ReadAhead class interface
+//
+// A file scanned in page order used to wait for every page it missed.
+// PF_FileHandle::GetThisPage now spots sequential access and asks for
+// the next pages ahead of time.  The reads are done by a few background
+// threads of PF_ReadAhead, so that the I/O overlaps with the work done
+// on the pages already fetched.
+//
+
+#ifndef PF_READAHEAD_H
+#define PF_READAHEAD_H
+
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "pf_internal.h"
+
+class PF_BufferMgr;
+
+//
+// PF_ReadAhead - queue of pages to load into the buffer in background
+//
+// The pages are loaded unpinned through PF_BufferMgr::PrefetchPage.
+// Loading a page is only a hint, errors are ignored and the page will be
+// read again when it is asked for.
+//
+class PF_ReadAhead {
+public:
+	PF_ReadAhead  (PF_BufferMgr *pBufferMgr, int numThreads);
+	~PF_ReadAhead ();                          // Stops the threads
+
+	// Queue numPages pages of file fd starting at pageNum, for a reader
+	// using hint
+	void Request  (int fd, int pageSize, PageNum pageNum, int numPages,
+	               ClientHint hint);
+	// Drop the queued pages of file fd and wait for those being read
+	void Cancel   (int fd);
+
+private:
+	struct PF_ReadRequest {
+		int     fd;
+		int     pageSize;
+		PageNum pageNum;
+		ClientHint hint;
+	};
+
+	void Run      ();                          // Body of the threads
+
+	PF_BufferMgr *pBufferMgr;                  // buffer to load pages into
+	std::deque<PF_ReadRequest> queue;          // pages waiting to be read
+	std::vector<int> inFlight;                 // fd of the pages being read
+	std::vector<std::thread> threads;          // I/O threads
+	int bStop;                                 // TRUE when shutting down
+	std::mutex latch;                          // protects the members above
+	std::condition_variable wakeUp;            // a page was queued or stop
+	std::condition_variable readDone;          // a read has finished
+};
+
+#endif
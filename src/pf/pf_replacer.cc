@@ -0,0 +1,656 @@
+//
+// File:        pf_replacer.cc
+// Description: Page replacement policies for PF_BufferMgr
+//
+
+#include "pf_internal.h"
+#include "pf_buffermgr.h"
+#include "pf_replacer.h"
+
+using namespace std;
+
+//
+// PF_NewReplacer
+//
+// Desc: Build the replacer for a policy
+// In:   policy - one of the PF_ReplacePolicy values
+//       numPages - number of slots in the buffer
+// Ret:  new replacer object, to be deleted by the caller
+//
+PF_Replacer *PF_NewReplacer(PF_ReplacePolicy policy, int numPages)
+{
+	switch (policy) {
+	case PF_REPLACE_CLOCK:
+		return new PF_ClockReplacer(numPages);
+	case PF_REPLACE_2Q:
+		return new PF_2QReplacer(numPages);
+	case PF_REPLACE_LRUK:
+		return new PF_LRUKReplacer(numPages);
+	case PF_REPLACE_LRU:
+	default:
+		return new PF_LRUReplacer(numPages);
+	}
+}
+
+//
+// GrowArray
+//
+// Desc: Make an array of oldSize elements hold newSize elements.  The
+//       elements are kept and the new ones zeroed.
+//
+template <class T>
+static void GrowArray(T *&array, int oldSize, int newSize)
+{
+	if (newSize <= oldSize)
+		return;
+
+	T *newArray = new T[newSize];
+	memcpy(newArray, array, oldSize * sizeof(T));
+	memset(newArray + oldSize, 0, (newSize - oldSize) * sizeof(T));
+	delete [] array;
+	array = newArray;
+}
+
+//------------------------------------------------------------------------------
+// PF_GhostList
+//------------------------------------------------------------------------------
+
+PF_GhostList::PF_GhostList(int _capacity)
+{
+	this->capacity = _capacity;
+}
+
+PF_GhostList::~PF_GhostList()
+{
+	// Don't need to do anything
+}
+
+//
+// Insert
+//
+// Desc: Remember (fd,pageNum).  The oldest entry is forgotten when the
+//       list is full.
+//
+void PF_GhostList::Insert(int fd, PageNum pageNum, long value)
+{
+	long long key = Key(fd, pageNum);
+	long dummy;
+
+	if (capacity <= 0)
+		return;
+
+	// A page is remembered only once
+	Take(fd, pageNum, dummy);
+
+	if ((int)fifo.size() >= capacity) {
+		index.erase(fifo.back().key);
+		fifo.pop_back();
+	}
+
+	Ghost ghost;
+	ghost.key = key;
+	ghost.value = value;
+	fifo.push_front(ghost);
+	index[key] = fifo.begin();
+}
+
+//
+// SetCapacity
+//
+// Desc: Change the number of entries remembered, forgetting the oldest
+//       ones if there are too many
+//
+void PF_GhostList::SetCapacity(int _capacity)
+{
+	capacity = _capacity;
+	while ((int)fifo.size() > capacity && !fifo.empty()) {
+		index.erase(fifo.back().key);
+		fifo.pop_back();
+	}
+}
+
+//
+// Take
+//
+// Desc: Look for (fd,pageNum).  If found it is forgotten.
+// Out:  value - value given to Insert
+// Ret:  TRUE if (fd,pageNum) was remembered
+//
+int PF_GhostList::Take(int fd, PageNum pageNum, long &value)
+{
+	unordered_map<long long, list<Ghost>::iterator>::iterator it =
+		index.find(Key(fd, pageNum));
+
+	if (it == index.end())
+		return (FALSE);
+
+	value = it->second->value;
+	fifo.erase(it->second);
+	index.erase(it);
+	return (TRUE);
+}
+
+//------------------------------------------------------------------------------
+// PF_LRUReplacer
+//------------------------------------------------------------------------------
+
+PF_LRUReplacer::PF_LRUReplacer(int numPages)
+{
+	numSlots = numPages;
+	next = new int[numPages];
+	prev = new int[numPages];
+	bInList = new char[numPages];
+	memset(bInList, 0, numPages);
+	head = tail = INVALID_SLOT;
+}
+
+PF_LRUReplacer::~PF_LRUReplacer()
+{
+	delete [] next;
+	delete [] prev;
+	delete [] bInList;
+}
+
+void PF_LRUReplacer::Admit(int slot, int fd, PageNum pageNum)
+{
+	LinkHead(slot);
+}
+
+//
+// Access
+//
+// Desc: Any use of the page makes it the most recently used one.  This
+//       is what the buffer manager has always done for MarkDirty and for
+//       the last UnpinPage, so it is kept for the LRU policy.
+//
+void PF_LRUReplacer::Access(int slot, int bNewRef)
+{
+	if (!bInList[slot])
+		return;
+	Unlink(slot);
+	LinkHead(slot);
+}
+
+void PF_LRUReplacer::Remove(int slot)
+{
+	if (bInList[slot])
+		Unlink(slot);
+}
+
+//
+// Victim
+//
+// Desc: Choose the least-recently used page that is unpinned
+//
+RC PF_LRUReplacer::Victim(const PF_BufPageDesc *bufTable, int &slot)
+{
+	for (slot = tail; slot != INVALID_SLOT; slot = prev[slot]) {
+		if (bufTable[slot].pinCount == 0)
+			break;
+	}
+
+	// Return error if all buffers were pinned
+	if (slot == INVALID_SLOT)
+		return (PF_NOBUF);
+
+	Unlink(slot);
+	return (0);
+}
+
+//
+// Coldest
+//
+// Desc: The unpinned pages from the LRU end
+//
+int PF_LRUReplacer::Coldest(const PF_BufPageDesc *bufTable, int *slots,
+		int numSlots) const
+{
+	int n = 0;
+	for (int slot = tail; slot != INVALID_SLOT && n < numSlots;
+			slot = prev[slot])
+		if (bufTable[slot].pinCount == 0)
+			slots[n++] = slot;
+	return (n);
+}
+
+//
+// Resize
+//
+// Desc: Make room for the new slots.  The order of the pages is kept.
+//
+void PF_LRUReplacer::Resize(int _numSlots, int numPages)
+{
+	GrowArray(next, numSlots, _numSlots);
+	GrowArray(prev, numSlots, _numSlots);
+	GrowArray(bInList, numSlots, _numSlots);
+	if (_numSlots > numSlots)
+		numSlots = _numSlots;
+}
+
+void PF_LRUReplacer::LinkHead(int slot)
+{
+	next[slot] = head;
+	prev[slot] = INVALID_SLOT;
+	if (head != INVALID_SLOT)
+		prev[head] = slot;
+	head = slot;
+	if (tail == INVALID_SLOT)
+		tail = slot;
+	bInList[slot] = TRUE;
+}
+
+void PF_LRUReplacer::Unlink(int slot)
+{
+	if (head == slot)
+		head = next[slot];
+	if (tail == slot)
+		tail = prev[slot];
+	if (next[slot] != INVALID_SLOT)
+		prev[next[slot]] = prev[slot];
+	if (prev[slot] != INVALID_SLOT)
+		next[prev[slot]] = next[slot];
+	next[slot] = prev[slot] = INVALID_SLOT;
+	bInList[slot] = FALSE;
+}
+
+//------------------------------------------------------------------------------
+// PF_ClockReplacer
+//------------------------------------------------------------------------------
+
+PF_ClockReplacer::PF_ClockReplacer(int numPages)
+{
+	numSlots = numPages;
+	bInUse = new char[numSlots];
+	bRef = new char[numSlots];
+	memset(bInUse, 0, numSlots);
+	memset(bRef, 0, numSlots);
+	hand = 0;
+}
+
+PF_ClockReplacer::~PF_ClockReplacer()
+{
+	delete [] bInUse;
+	delete [] bRef;
+}
+
+void PF_ClockReplacer::Admit(int slot, int fd, PageNum pageNum)
+{
+	bInUse[slot] = TRUE;
+	bRef[slot] = TRUE;
+}
+
+void PF_ClockReplacer::Access(int slot, int bNewRef)
+{
+	bRef[slot] = TRUE;
+}
+
+void PF_ClockReplacer::Remove(int slot)
+{
+	bInUse[slot] = FALSE;
+	bRef[slot] = FALSE;
+}
+
+//
+// Victim
+//
+// Desc: Sweep the hand over the slots, clearing reference bits, until an
+//       unpinned slot with a clear bit is found.  Two full turns are
+//       enough: the first clears every bit.
+//
+RC PF_ClockReplacer::Victim(const PF_BufPageDesc *bufTable, int &slot)
+{
+	for (int i = 0; i < 2 * numSlots; i++) {
+		slot = hand;
+		hand = (hand + 1) % numSlots;
+
+		if (!bInUse[slot] || bufTable[slot].pinCount > 0)
+			continue;
+		if (bRef[slot]) {
+			bRef[slot] = FALSE;
+			continue;
+		}
+
+		bInUse[slot] = FALSE;
+		return (0);
+	}
+
+	return (PF_NOBUF);
+}
+
+//
+// Coldest
+//
+// Desc: The unpinned pages the hand will reach first, those without a
+//       reference bit before the others
+//
+int PF_ClockReplacer::Coldest(const PF_BufPageDesc *bufTable, int *slots,
+		int numSlots) const
+{
+	int n = 0;
+	for (int ref = 0; ref <= 1; ref++)
+		for (int i = 0; i < this->numSlots && n < numSlots; i++) {
+			int slot = (hand + i) % this->numSlots;
+			if (bInUse[slot] && bRef[slot] == ref &&
+					bufTable[slot].pinCount == 0)
+				slots[n++] = slot;
+		}
+	return (n);
+}
+
+//
+// Resize
+//
+// Desc: The new slots join the clock after the old ones, the hand and the
+//       reference bits are kept.  Slots without a frame are not in use
+//       and are skipped.
+//
+void PF_ClockReplacer::Resize(int _numSlots, int numPages)
+{
+	GrowArray(bInUse, numSlots, _numSlots);
+	GrowArray(bRef, numSlots, _numSlots);
+	if (_numSlots > numSlots)
+		numSlots = _numSlots;
+}
+
+//------------------------------------------------------------------------------
+// PF_2QReplacer
+//------------------------------------------------------------------------------
+
+//
+// The sizes are the ones recommended in the 2Q paper: A1in holds a
+// quarter of the buffer and A1out remembers half as many pages as the
+// buffer holds.
+//
+PF_2QReplacer::PF_2QReplacer(int numPages) : a1Out(numPages / 2)
+{
+	numSlots = numPages;
+	next = new int[numPages];
+	prev = new int[numPages];
+	queueOf = new char[numPages];
+	memset(queueOf, NONE, numPages);
+	for (int i = 0; i < 3; i++) {
+		head[i] = tail[i] = INVALID_SLOT;
+		length[i] = 0;
+	}
+	kIn = numPages / 4;
+	if (kIn < 1)
+		kIn = 1;
+}
+
+PF_2QReplacer::~PF_2QReplacer()
+{
+	delete [] next;
+	delete [] prev;
+	delete [] queueOf;
+}
+
+//
+// Admit
+//
+// Desc: A page remembered by A1out was referenced again after leaving
+//       A1in, so it is hot and goes to Am.  Anything else starts in A1in.
+//
+void PF_2QReplacer::Admit(int slot, int fd, PageNum pageNum)
+{
+	long dummy;
+
+	if (queueOf[slot] != NONE)
+		Unlink(slot);
+
+	if (a1Out.Take(fd, pageNum, dummy))
+		LinkHead(AM, slot);
+	else
+		LinkHead(A1IN, slot);
+}
+
+//
+// Access
+//
+// Desc: A hit in Am promotes the page.  A hit in A1in does nothing: the
+//       page is likely only being referenced again by the same scan.
+//
+void PF_2QReplacer::Access(int slot, int bNewRef)
+{
+	if (queueOf[slot] == AM && bNewRef) {
+		Unlink(slot);
+		LinkHead(AM, slot);
+	}
+}
+
+void PF_2QReplacer::Remove(int slot)
+{
+	if (queueOf[slot] != NONE)
+		Unlink(slot);
+}
+
+//
+// Victim
+//
+// Desc: Take the oldest unpinned page of A1in while A1in is above its
+//       target size, remembering it in A1out; otherwise take the LRU
+//       unpinned page of Am.  If the preferred queue has nothing unpinned
+//       the other one is tried.
+//
+RC PF_2QReplacer::Victim(const PF_BufPageDesc *bufTable, int &slot)
+{
+	int first = (length[A1IN] > kIn) ? A1IN : AM;
+	int second = (first == A1IN) ? AM : A1IN;
+
+	if ((slot = Unpinned(first, bufTable)) == INVALID_SLOT &&
+			(slot = Unpinned(second, bufTable)) == INVALID_SLOT)
+		return (PF_NOBUF);
+
+	if (queueOf[slot] == A1IN && bufTable[slot].fd >= 0)
+		a1Out.Insert(bufTable[slot].fd, bufTable[slot].pageNum, 0);
+
+	Unlink(slot);
+	return (0);
+}
+
+//
+// Coldest
+//
+// Desc: The unpinned pages of the queue Victim prefers, from its tail,
+//       then those of the other queue
+//
+int PF_2QReplacer::Coldest(const PF_BufPageDesc *bufTable, int *slots,
+		int numSlots) const
+{
+	int queues[2];
+	queues[0] = (length[A1IN] > kIn) ? A1IN : AM;
+	queues[1] = (queues[0] == A1IN) ? AM : A1IN;
+
+	int n = 0;
+	for (int q = 0; q < 2; q++)
+		for (int slot = tail[queues[q]]; slot != INVALID_SLOT && n < numSlots;
+				slot = prev[slot])
+			if (bufTable[slot].pinCount == 0)
+				slots[n++] = slot;
+	return (n);
+}
+
+//
+// Resize
+//
+// Desc: Make room for the new slots and size A1in and A1out for the new
+//       number of pages.  The queues are kept; A1in shrinks on the next
+//       victims if it is now above its target.
+//
+void PF_2QReplacer::Resize(int _numSlots, int numPages)
+{
+	GrowArray(next, numSlots, _numSlots);
+	GrowArray(prev, numSlots, _numSlots);
+	GrowArray(queueOf, numSlots, _numSlots);
+	if (_numSlots > numSlots)
+		numSlots = _numSlots;
+
+	kIn = numPages / 4;
+	if (kIn < 1)
+		kIn = 1;
+	a1Out.SetCapacity(numPages / 2);
+}
+
+int PF_2QReplacer::Unpinned(int queue, const PF_BufPageDesc *bufTable) const
+{
+	int slot;
+	for (slot = tail[queue]; slot != INVALID_SLOT; slot = prev[slot])
+		if (bufTable[slot].pinCount == 0)
+			break;
+	return (slot);
+}
+
+void PF_2QReplacer::LinkHead(int queue, int slot)
+{
+	next[slot] = head[queue];
+	prev[slot] = INVALID_SLOT;
+	if (head[queue] != INVALID_SLOT)
+		prev[head[queue]] = slot;
+	head[queue] = slot;
+	if (tail[queue] == INVALID_SLOT)
+		tail[queue] = slot;
+	queueOf[slot] = queue;
+	length[queue]++;
+}
+
+void PF_2QReplacer::Unlink(int slot)
+{
+	int queue = queueOf[slot];
+
+	if (head[queue] == slot)
+		head[queue] = next[slot];
+	if (tail[queue] == slot)
+		tail[queue] = prev[slot];
+	if (next[slot] != INVALID_SLOT)
+		prev[next[slot]] = prev[slot];
+	if (prev[slot] != INVALID_SLOT)
+		next[prev[slot]] = next[slot];
+	next[slot] = prev[slot] = INVALID_SLOT;
+	queueOf[slot] = NONE;
+	length[queue]--;
+}
+
+//------------------------------------------------------------------------------
+// PF_LRUKReplacer
+//------------------------------------------------------------------------------
+
+PF_LRUKReplacer::PF_LRUKReplacer(int numPages) : retained(numPages)
+{
+	numSlots = numPages;
+	bInUse = new char[numSlots];
+	memset(bInUse, 0, numSlots);
+	hist = new long[numSlots][PF_LRUK_K];
+	clock = 0;
+}
+
+PF_LRUKReplacer::~PF_LRUKReplacer()
+{
+	delete [] bInUse;
+	delete [] hist;
+}
+
+//
+// Admit
+//
+// Desc: Record the reference which brought the page in.  If the page was
+//       evicted recently its previous reference is restored from the
+//       retained history.
+//
+void PF_LRUKReplacer::Admit(int slot, int fd, PageNum pageNum)
+{
+	long last;
+
+	Remove(slot);
+	for (int k = 0; k < PF_LRUK_K; k++)
+		hist[slot][k] = 0;
+	if (fd >= 0 && retained.Take(fd, pageNum, last))
+		hist[slot][0] = last;
+
+	Access(slot, TRUE);
+	bInUse[slot] = TRUE;
+	order.insert(KeyOf(slot));
+}
+
+//
+// Access
+//
+// Desc: Only new requests for a page count as references.  MarkDirty and
+//       UnpinPage belong to the reference that pinned the page.
+//
+void PF_LRUKReplacer::Access(int slot, int bNewRef)
+{
+	if (!bNewRef)
+		return;
+
+	if (bInUse[slot])
+		order.erase(KeyOf(slot));
+	for (int k = PF_LRUK_K - 1; k > 0; k--)
+		hist[slot][k] = hist[slot][k - 1];
+	hist[slot][0] = ++clock;
+	if (bInUse[slot])
+		order.insert(KeyOf(slot));
+}
+
+void PF_LRUKReplacer::Remove(int slot)
+{
+	if (bInUse[slot])
+		order.erase(KeyOf(slot));
+	bInUse[slot] = FALSE;
+}
+
+//
+// Victim
+//
+// Desc: Choose the unpinned page with the largest backward K-distance,
+//       that is the oldest K-th reference.  Pages without K references
+//       have an infinite distance (hist = 0) and are ordered by their most
+//       recent reference.
+//
+RC PF_LRUKReplacer::Victim(const PF_BufPageDesc *bufTable, int &slot)
+{
+	set<Key>::iterator it;
+	for (it = order.begin(); it != order.end(); ++it)
+		if (bufTable[it->second].pinCount == 0)
+			break;
+
+	if (it == order.end())
+		return (PF_NOBUF);
+
+	slot = it->second;
+	order.erase(it);
+	if (bufTable[slot].fd >= 0)
+		retained.Insert(bufTable[slot].fd, bufTable[slot].pageNum,
+				hist[slot][0]);
+	bInUse[slot] = FALSE;
+	return (0);
+}
+
+//
+// Coldest
+//
+// Desc: The unpinned pages in the order Victim would choose them
+//
+int PF_LRUKReplacer::Coldest(const PF_BufPageDesc *bufTable, int *slots,
+		int numSlots) const
+{
+	int n = 0;
+	for (set<Key>::const_iterator it = order.begin();
+			it != order.end() && n < numSlots; ++it)
+		if (bufTable[it->second].pinCount == 0)
+			slots[n++] = it->second;
+	return (n);
+}
+
+//
+// Resize
+//
+// Desc: Make room for the new slots and retain the history of as many
+//       evicted pages as the buffer now holds
+//
+void PF_LRUKReplacer::Resize(int _numSlots, int numPages)
+{
+	GrowArray(bInUse, numSlots, _numSlots);
+	GrowArray(hist, numSlots, _numSlots);
+	if (_numSlots > numSlots)
+		numSlots = _numSlots;
+	retained.SetCapacity(numPages);
+}
@@ -0,0 +1,225 @@
+//
+// File:        pf_replacer.h
+// Description: PF_Replacer class interface and the page replacement
+//              policies used by PF_BufferMgr
+//
+// The buffer manager used to hard-wire LRU by keeping its list of used
+// slots in recency order.  The choice of a victim is now delegated to a
+// PF_Replacer object so that a scan over a large relation does not have
+// to flush the hot catalog and index pages out of the buffer.
+//
+
+#ifndef PF_REPLACER_H
+#define PF_REPLACER_H
+
+#include <list>
+#include <set>
+#include <unordered_map>
+#include "pf_internal.h"
+
+struct PF_BufPageDesc;
+
+//
+// PF_Replacer - decide which buffer slot is replaced on a miss
+//
+// Slots are indexes into the bufTable of the buffer manager.  The buffer
+// manager tells the replacer when a slot receives a page (Admit), when
+// the page in a slot is used again (Access) and when a slot is released
+// without being replaced (Remove).  Victim chooses an unpinned slot and
+// forgets about it.  When the buffer is resized, the slots keep their
+// numbers and their history (Resize).
+//
+class PF_Replacer {
+public:
+	virtual ~PF_Replacer() {}
+
+	// A page (fd,pageNum) has just been placed into slot
+	virtual void Admit  (int slot, int fd, PageNum pageNum) = 0;
+	// The page in slot is used again.  bNewRef is TRUE when this is a
+	// new request for the page (GetPage) and FALSE when the page is only
+	// being marked dirty or unpinned by the current user.
+	virtual void Access (int slot, int bNewRef) = 0;
+	// The page in slot leaves the buffer without being a victim
+	virtual void Remove (int slot) = 0;
+	// Choose an unpinned slot to replace and stop tracking it
+	virtual RC   Victim (const PF_BufPageDesc *bufTable, int &slot) = 0;
+	// List up to numSlots unpinned slots, the next victims first, without
+	// changing anything.  Returns the number of slots listed.
+	virtual int  Coldest(const PF_BufPageDesc *bufTable, int *slots,
+	                     int numSlots) const = 0;
+	// The buffer now has slots numbered below numSlots, which may only
+	// grow, and numPages of them have a frame
+	virtual void Resize (int numSlots, int numPages) = 0;
+};
+
+//
+// PF_NewReplacer - build the replacer implementing a policy for a
+//                  buffer of numPages slots
+//
+PF_Replacer *PF_NewReplacer(PF_ReplacePolicy policy, int numPages);
+
+//
+// PF_GhostList - bounded FIFO of (fd,pageNum) pairs for pages which are
+//                no longer in the buffer but whose history is still useful
+//                (the A1out queue of 2Q and the retained history of LRU-K)
+//
+class PF_GhostList {
+public:
+	PF_GhostList  (int capacity);
+	~PF_GhostList ();
+
+	// Remember (fd,pageNum) with value, dropping the oldest entry if full
+	void Insert   (int fd, PageNum pageNum, long value);
+	// If (fd,pageNum) is remembered, forget it and set value
+	int  Take     (int fd, PageNum pageNum, long &value);
+	// Remember at most capacity entries, forgetting the oldest ones
+	void SetCapacity (int capacity);
+
+private:
+	static long long Key(int fd, PageNum pageNum)
+		{ return ((long long)fd << 32) | (unsigned int)pageNum; }
+
+	struct Ghost {
+		long long key;
+		long      value;
+	};
+
+	int capacity;
+	std::list<Ghost> fifo;                          // oldest at the back
+	std::unordered_map<long long, std::list<Ghost>::iterator> index;
+};
+
+//
+// PF_LRUReplacer - least recently used
+//
+class PF_LRUReplacer : public PF_Replacer {
+public:
+	PF_LRUReplacer  (int numPages);
+	~PF_LRUReplacer ();
+
+	void Admit  (int slot, int fd, PageNum pageNum);
+	void Access (int slot, int bNewRef);
+	void Remove (int slot);
+	RC   Victim (const PF_BufPageDesc *bufTable, int &slot);
+	int  Coldest(const PF_BufPageDesc *bufTable, int *slots,
+	             int numSlots) const;
+	void Resize (int numSlots, int numPages);
+
+private:
+	void LinkHead (int slot);
+	void Unlink   (int slot);
+
+	int numSlots;                                // size of the arrays
+	int *next;                                   // towards the LRU end
+	int *prev;                                   // towards the MRU end
+	char *bInList;                               // slot is being tracked
+	int head;                                    // MRU slot
+	int tail;                                    // LRU slot
+};
+
+//
+// PF_ClockReplacer - second chance.  A hit only sets a reference bit, so
+//                    nothing has to be relinked on the hot path.
+//
+class PF_ClockReplacer : public PF_Replacer {
+public:
+	PF_ClockReplacer  (int numPages);
+	~PF_ClockReplacer ();
+
+	void Admit  (int slot, int fd, PageNum pageNum);
+	void Access (int slot, int bNewRef);
+	void Remove (int slot);
+	RC   Victim (const PF_BufPageDesc *bufTable, int &slot);
+	int  Coldest(const PF_BufPageDesc *bufTable, int *slots,
+	             int numSlots) const;
+	void Resize (int numSlots, int numPages);
+
+private:
+	int numSlots;                                // size of the arrays
+	char *bInUse;                                // slot is being tracked
+	char *bRef;                                  // reference bit
+	int hand;                                    // clock hand
+};
+
+//
+// PF_2QReplacer - 2Q (Johnson & Shasha).  Pages seen for the first time
+//                 wait in the FIFO A1in; only pages referenced again after
+//                 leaving A1in (remembered by the ghost queue A1out) make
+//                 it to the LRU queue Am.  A single scan therefore only
+//                 cycles through A1in.
+//
+class PF_2QReplacer : public PF_Replacer {
+public:
+	PF_2QReplacer  (int numPages);
+	~PF_2QReplacer ();
+
+	void Admit  (int slot, int fd, PageNum pageNum);
+	void Access (int slot, int bNewRef);
+	void Remove (int slot);
+	RC   Victim (const PF_BufPageDesc *bufTable, int &slot);
+	int  Coldest(const PF_BufPageDesc *bufTable, int *slots,
+	             int numSlots) const;
+	void Resize (int numSlots, int numPages);
+
+private:
+	enum { NONE, A1IN, AM };
+
+	void LinkHead (int queue, int slot);
+	void Unlink   (int slot);
+	int  Unpinned (int queue, const PF_BufPageDesc *bufTable) const;
+
+	int numSlots;                                // size of the arrays
+	int *next;                                   // towards the tail
+	int *prev;                                   // towards the head
+	char *queueOf;                               // NONE, A1IN or AM
+	int head[3];                                 // per queue
+	int tail[3];
+	int length[3];
+	int kIn;                                     // target size of A1in
+	PF_GhostList a1Out;                          // pages evicted from A1in
+};
+
+//
+// PF_LRUKReplacer - LRU-K (O'Neil, O'Neil & Weikum) with K = 2.  The
+//                   victim is the page whose K-th most recent reference is
+//                   the oldest; pages referenced fewer than K times go
+//                   first, in LRU order.  The history of evicted pages is
+//                   retained for a while so that a page coming back is not
+//                   treated as new.  The tracked slots are kept ordered by
+//                   their references, so a victim is found without looking
+//                   at every slot; pinned slots on the way are skipped.
+//
+const int PF_LRUK_K = 2;
+
+class PF_LRUKReplacer : public PF_Replacer {
+public:
+	PF_LRUKReplacer  (int numPages);
+	~PF_LRUKReplacer ();
+
+	void Admit  (int slot, int fd, PageNum pageNum);
+	void Access (int slot, int bNewRef);
+	void Remove (int slot);
+	RC   Victim (const PF_BufPageDesc *bufTable, int &slot);
+	int  Coldest(const PF_BufPageDesc *bufTable, int *slots,
+	             int numSlots) const;
+	void Resize (int numSlots, int numPages);
+
+private:
+	// (K-th reference, last reference) of slot, then slot
+	typedef std::pair<std::pair<long, long>, int> Key;
+	Key KeyOf   (int slot) const
+		{ return (Key(std::make_pair(hist[slot][PF_LRUK_K - 1],
+		                             hist[slot][0]), slot)); }
+
+	int numSlots;                                // size of the arrays
+	char *bInUse;                                // slot is being tracked
+	long (*hist)[PF_LRUK_K];                     // hist[slot][0] is the
+	                                             // most recent reference
+	std::set<Key> order;                         // tracked slots, the next
+	                                             // victim first
+	long clock;                                  // logical time
+	PF_GhostList retained;                       // K-th reference of
+	                                             // evicted pages
+};
+
+#endif
@@ -0,0 +1,145 @@
+//
+// File:        pf_resident.cc
+// Description: PF_ResidentList class implementation
+//
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <unistd.h>
+#include "pf_resident.h"
+
+using namespace std;
+
+//
+// Load
+//
+// Desc: Read the list written by Save.  A list which does not exist is
+//       empty, and the reading stops at the first line which cannot be
+//       parsed.
+// In:   listName - name of the list file
+// Ret:  PF_UNIX if the list cannot be read, 0 otherwise
+//
+RC PF_ResidentList::Load(const char *listName)
+{
+	FILE *pFile = fopen(listName, "r");
+	if (pFile == NULL)
+		return (errno == ENOENT ? 0 : PF_UNIX);
+
+	lock_guard<mutex> guard(latch);
+
+	char fileName[1024];
+	PageNum pageNum;
+	while (fscanf(pFile, "%1023s %d", fileName, &pageNum) == 2)
+		if (pageNum >= 0)
+			toLoad[fileName].push_back(pageNum);
+
+	fclose(pFile);
+	return (0);
+}
+
+//
+// Save
+//
+// Desc: Write the pages recorded, the hottest first.  Only the numPages
+//       hottest pages of each page size are kept, as the buffer could not
+//       hold more.  The list is written beside and then renamed, so that
+//       a crash leaves the previous one.
+// In:   listName - name of the list file
+//       numPages - number of pages of each size in the buffer
+// Ret:  PF_UNIX if the list cannot be written, 0 otherwise
+//
+RC PF_ResidentList::Save(const char *listName, int numPages)
+{
+	lock_guard<mutex> guard(latch);
+
+	vector<pair<double, pair<const string *, const PF_ResidentPage *> > > pages;
+	for (map<string, vector<PF_ResidentPage> >::const_iterator it =
+			found.begin(); it != found.end(); ++it)
+		for (size_t i = 0; i < it->second.size(); i++)
+			pages.push_back(make_pair(-it->second[i].heat,
+					make_pair(&it->first, &it->second[i])));
+	sort(pages.begin(), pages.end());
+
+	string tmpName = string(listName) + ".tmp";
+	FILE *pFile = fopen(tmpName.c_str(), "w");
+	if (pFile == NULL)
+		return (PF_UNIX);
+
+	int count[PF_NUM_PAGE_SIZES] = { 0 };
+	for (size_t i = 0; i < pages.size(); i++) {
+		const PF_ResidentPage *pPage = pages[i].second.second;
+		if (count[PF_PageSizeClass(pPage->pageSize)]++ >= numPages)
+			continue;
+		fprintf(pFile, "%s %d\n", pages[i].second.first->c_str(),
+				pPage->pageNum);
+	}
+
+	if (fclose(pFile) != 0 || rename(tmpName.c_str(), listName) < 0) {
+		unlink(tmpName.c_str());
+		return (PF_UNIX);
+	}
+	return (0);
+}
+
+//
+// Record
+//
+// Desc: Remember the pages of a file being closed.  Their heat, from 0
+//       to 1, is added to the number of files closed so far, so that the
+//       files closed last are the hottest.
+// In:   fileName - name the file was opened with
+//       pageSize - size of the pages of the file
+//       pages - (heat, pageNum) of the pages in the buffer
+//
+void PF_ResidentList::Record(const char *fileName, int pageSize,
+		const vector<pair<double, PageNum> > &pages)
+{
+	lock_guard<mutex> guard(latch);
+
+	vector<PF_ResidentPage> &filePages = found[fileName];
+	filePages.clear();
+	clock++;
+	for (size_t i = 0; i < pages.size(); i++) {
+		PF_ResidentPage page;
+		page.heat = clock + pages[i].first;
+		page.pageSize = pageSize;
+		page.pageNum = pages[i].second;
+		filePages.push_back(page);
+	}
+}
+
+//
+// Take
+//
+// Desc: Give the pages of a file listed by Load, once
+// In:   fileName - name the file is opened with
+// Out:  pageNums - pages of the file, in increasing order
+//
+void PF_ResidentList::Take(const char *fileName, vector<PageNum> &pageNums)
+{
+	lock_guard<mutex> guard(latch);
+
+	map<string, vector<PageNum> >::iterator it = toLoad.find(fileName);
+	if (it == toLoad.end())
+		return;
+
+	pageNums.swap(it->second);
+	toLoad.erase(it);
+	sort(pageNums.begin(), pageNums.end());
+	pageNums.erase(unique(pageNums.begin(), pageNums.end()), pageNums.end());
+}
+
+//
+// Forget
+//
+// Desc: Drop the pages of a file which is destroyed
+// In:   fileName - name of the file
+//
+void PF_ResidentList::Forget(const char *fileName)
+{
+	lock_guard<mutex> guard(latch);
+
+	toLoad.erase(fileName);
+	found.erase(fileName);
+}
@@ -0,0 +1,65 @@
+//
+// File:        pf_resident.h
+// Description: PF_ResidentList class interface
+//
+// The buffer used to start empty each time redbase was run, so the first
+// commands read every page they needed from disk until the buffer held
+// the working set again.  PF_Manager now records the pages of each file
+// that are in the buffer when the file is closed and writes the list out
+// when the database is closed, hottest first.  The next time the
+// database is opened, the pages listed for a file are loaded by the
+// read-ahead threads as soon as the file is opened, in page order.
+//
+
+#ifndef PF_RESIDENT_H
+#define PF_RESIDENT_H
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+#include "pf_internal.h"
+
+//
+// PF_ResidentList - pages to load at open and pages found at close
+//
+// The list file has a line "fileName pageNum" for each page, the hottest
+// first.  The files closed last come first, and the pages of a file are
+// in the order in which the policy would keep them.  The list is only a
+// hint: a missing or damaged list loads nothing.
+//
+class PF_ResidentList {
+public:
+	PF_ResidentList () : clock(0) {}
+
+	// Read the pages to load from the list listName
+	RC   Load     (const char *listName);
+	// Write the pages recorded, at most numPages of each page size, to
+	// the list listName
+	RC   Save     (const char *listName, int numPages);
+
+	// Remember the (heat, pageNum) pages of a file being closed, in place
+	// of those remembered before
+	void Record   (const char *fileName, int pageSize,
+	               const std::vector<std::pair<double, PageNum> > &pages);
+	// Pages of a file being opened which were listed by Load, in page
+	// order.  They are given once.
+	void Take     (const char *fileName, std::vector<PageNum> &pageNums);
+	// Forget a file which is destroyed
+	void Forget   (const char *fileName);
+
+private:
+	struct PF_ResidentPage {
+		double  heat;         // close order of the file plus heat
+		int     pageSize;     // size of the pages of the file
+		PageNum pageNum;
+	};
+
+	std::map<std::string, std::vector<PageNum> > toLoad;      // from Load
+	std::map<std::string, std::vector<PF_ResidentPage> > found; // at close
+	int clock;                // number of files recorded
+	std::mutex latch;         // protects the members above
+};
+
+#endif
@@ -18,46 +18,47 @@
 
 using namespace std;
 
-// This is defined within pf_buffermgr.cc
-extern StatisticsMgr *pStatisticsMgr;
+// These are defined within pf_buffermgr.cc
+extern StatCounters pfStats;
+extern StatHistograms pfTimes;
 
 void PF_Statistics()
 {
-	// First get all the statistics, must remember to delete memory returned
-	int *piGP = pStatisticsMgr->Get(PF_GETPAGE);
-	int *piPF = pStatisticsMgr->Get(PF_PAGEFOUND);
-	int *piPNF = pStatisticsMgr->Get(PF_PAGENOTFOUND);
-	int *piRP = pStatisticsMgr->Get(PF_READPAGE);
-	int *piWP = pStatisticsMgr->Get(PF_WRITEPAGE);
-	int *piFP = pStatisticsMgr->Get(PF_FLUSHPAGES);
+	long gp = pfStats.Get(PF_GETPAGE);
 
 	cout << "PF Layer Statistics\n";
 	cout << "-------------------\n";
 
-	cout << "Total number of calls to GetPage Routine: ";
-	if (piGP) cout << *piGP; else cout << "None";
-	cout << "\n  Number found: ";
-	if (piPF) cout << *piPF; else cout << "None";
-	cout << "\n  Number not found: ";
-	if (piPNF) cout << *piPNF; else cout << "None";
+	cout << "Total number of calls to GetPage Routine: " << gp;
+	cout << "\n  Number found: " << pfStats.Get(PF_PAGEFOUND);
+	cout << "\n  Number not found: " << pfStats.Get(PF_PAGENOTFOUND);
+	cout << "\n  Hit ratio: ";
+	if (gp) cout << 100.0 * pfStats.Get(PF_PAGEFOUND) / gp << "%";
+	else cout << "None";
+	cout << "\n  Number of pages replaced: " << pfStats.Get(PF_EVICTPAGE);
+	cout << "\n  Replaced within scan rings: " << pfStats.Get(PF_RINGREUSE);
 	cout << "\n-------------------\n";
 
-	cout << "Number of read requests: ";
-	if (piRP) cout << *piRP; else cout << "None";
-	cout << "\nNumber of write requests: ";
-	if (piWP) cout << *piWP; else cout << "None";
+	cout << "Number of read requests: " << pfStats.Get(PF_READPAGE);
+	cout << "\n  Read ahead: " << pfStats.Get(PF_PREFETCHPAGE);
+	cout << "\n  Median read time (ns): < "
+		<< pfTimes.Percentile(PF_READTIME, 50);
+	cout << "\n  99th percentile (ns): < "
+		<< pfTimes.Percentile(PF_READTIME, 99);
+	cout << "\nNumber of write requests: " << pfStats.Get(PF_WRITEPAGE);
+	cout << "\n  Written by misses (foreground): "
+		<< pfStats.Get(PF_EVICTDIRTY);
+	cout << "\n  Written by the background writer: "
+		<< pfStats.Get(PF_BGWRITE);
+	cout << "\n  Write calls saved by coalescing: "
+		<< pfStats.Get(PF_WRITESAVED);
+	cout << "\n  Median write time (ns): < "
+		<< pfTimes.Percentile(PF_WRITETIME, 50);
+	cout << "\n  99th percentile (ns): < "
+		<< pfTimes.Percentile(PF_WRITETIME, 99);
 	cout << "\n-------------------\n";
-	cout << "Number of flushes: ";
-	if (piFP) cout << *piFP; else cout << "None";
+	cout << "Number of flushes: " << pfStats.Get(PF_FLUSHPAGES);
 	cout << "\n-------------------\n";
-
-	// Must delete the memory returned from StatisticsMgr::Get
-	delete piGP;
-	delete piPF;
-	delete piPNF;
-	delete piRP;
-	delete piWP;
-	delete piFP;
 }
 
 #endif
@@ -8,6 +8,7 @@
 #include <iostream>
 #include <cstdio>
 #include <cstring>
+#include <string>
 #include <unistd.h>
 #include "redbase.h"
 #include "rm.h"
@@ -39,8 +40,14 @@ int main(int argc, char *argv[])
         exit(1);
     }
 
-    // Opens up the database folder    
+    // Have the pages the buffer held when the database was last closed
+    // loaded again as its files are opened
     dbname = argv[1];
+    string residentList = string(dbname) + "/" + PF_RESIDENT_LIST;
+    if ((rc = pfm.LoadResidentPages(residentList.c_str())))
+        PrintError(rc);
+
+    // Opens up the database folder    
     if ((rc = smm.OpenDb(dbname))) {
         PrintError(rc);
         return (1);
@@ -54,6 +61,10 @@ int main(int argc, char *argv[])
         PrintError(rc);
         return (1);
     }
+
+    // OpenDb went into the database folder
+    if ((rc = pfm.SaveResidentPages(PF_RESIDENT_LIST)))
+        PrintError(rc);
     
 
     cout << "Bye.\n";
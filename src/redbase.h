@@ -76,8 +76,16 @@ enum CompOp {
 //
 // Pin Strategy Hint
 //
+// The hint tells the buffer manager how the pages fetched are used.  The
+// pages of a sequential scan or fetched only once are read into a small
+// ring of frames, so that they do not push the pages used over and over
+// out of the buffer.
+//
 enum ClientHint {
-	NO_HINT                                     // default value
+	NO_HINT,                                    // default value
+	SEQUENTIAL_SCAN,                            // pages read in order once
+	RANDOM,                                     // no order, no read-ahead
+	ONE_SHOT                                    // a page read only once
 };
 
 //
@@ -23,6 +23,10 @@
 #include "pf.h"
 
 #include <cstring>
+#include <vector>
+
+class RM_Log;
+class RM_FileHandle;
 
 //
 // RM_Record: RM Record interface
@@ -45,20 +49,118 @@ public:
 	RC GetRid (RID &rid) const;
 
 private:
+    // 复制 size 字节的记录，大小不变时沿用原来的内存
+    void SetData(const char *pData, size_t size, const RID &rid);
+
     char *pData_;
     size_t size_;
     RID rid_;
     Boolean isValid_;
 };
 
+//
+// RM_RecordView: a record read in place, without a copy
+//
+// The data points into the page holding the record, which stays pinned
+// until the view is given another record, released or destroyed.  It
+// must not be used after that; RM_Record keeps a copy of its own.  Views
+// must be released before their file is closed.  The records of slotted
+// files are decoded, into a buffer of the scan (valid until the scan
+// moves on) or of the view for GetRec.
+//
+class RM_RecordView {
+    friend class RM_FileScan;
+    friend class RM_FileHandle;
+public:
+	RM_RecordView ();
+	~RM_RecordView();
+
+	// Return the data of the record, valid while the view holds it
+	RC GetData(char *&pData) const;
+
+	// Return the RID associated with the record
+	RC GetRid (RID &rid) const;
+
+	// Unpin the page of the record now
+	RC Release();
+
+private:
+    RM_RecordView (const RM_RecordView &) = delete;
+    RM_RecordView& operator= (const RM_RecordView &) = delete;
+
+    PF_PageGuard page_;             // pin 住的页面
+    const RM_FileHandle *pFH_;      // page_ 所属的文件，NULL 表示没有
+    PageNum pageNum_;               // page_ 的页号
+    char *pData_;                   // 记录的内容
+    char *buf_;                     // 槽页格式中 GetRec 解码记录的缓冲区
+    int bufSize_;
+    RID rid_;
+    Boolean isValid_;
+};
+
+//
+// RM_RecordBatch: records returned together by RM_FileScan::GetNextBatch
+//
+// A batch holds the matching records of one page of the scan.  Their data
+// points into the page, which stays pinned until the next batch is taken,
+// the batch is released or destroyed, like an RM_RecordView.  The records
+// of slotted files are decoded into a buffer of the batch.
+//
+class RM_RecordBatch {
+    friend class RM_FileScan;
+public:
+	RM_RecordBatch ();
+	~RM_RecordBatch();
+
+	int GetCount () const;                       // Records in the batch
+
+	// Return the data and the RID of record i, 0 <= i < GetCount()
+	RC GetData   (int i, char *&pData) const;
+	RC GetRid    (int i, RID &rid) const;
+
+	// Unpin the page of the records now
+	RC Release   ();
+
+private:
+    RM_RecordBatch (const RM_RecordBatch &) = delete;
+    RM_RecordBatch& operator= (const RM_RecordBatch &) = delete;
+
+    // 保证能放下 capacity 条记录，解码时每条 recordSize 字节
+    void Reserve (int capacity, int recordSize);
+
+    PF_PageGuard page_;             // pin 住的页面
+    int count_;                     // 记录数
+    int capacity_;                  // pRecords_ 与 rids_ 的大小
+    char **pRecords_;               // 各条记录的内容
+    RID *rids_;                     // 各条记录的 RID
+    char *buf_;                     // 槽页格式中解码记录的缓冲区
+    int bufSize_;
+};
+
+//
+// RM_FileFormat: how the records are laid out in the pages of a file
+//
+// RM_FORMAT_FIXED keeps every record at its full size in an array of
+// slots.  RM_FORMAT_SLOTTED keeps each record in as many bytes as it
+// needs once the runs of zeros (the unused ends of strings) are left out,
+// behind a slot directory, so that a page holds more of them.  The
+// records are still of the size given to CreateFile, and RIDs stay the
+// same when records are moved.
+//
+enum RM_FileFormat {
+	RM_FORMAT_FIXED = 0,
+	RM_FORMAT_SLOTTED = 1
+};
+
 // RM_FileHdr: RM File header
 
 struct RM_FileHdr {
     int recordSize;         // 每一条记录的大小
-    int numRecordsPerPage;  // 每页中可存放的记录数量
+    int numRecordsPerPage;  // 每页中可存放的记录数量，槽页格式中为最多的槽数
     int numPages;       // 当前文件的总 **存放记录** 的页数(不包括头页)
 
     int nextFreePage;   // 指向下一个空闲记录的页面索引
+    int format;         // RM_FileFormat，以前的文件中为 0 (RM_FORMAT_FIXED)
 };
 
 //
@@ -67,12 +169,15 @@ struct RM_FileHdr {
 class RM_FileHandle {
 	friend class RM_Manager;
     friend class RM_FileScan;
+    friend class RM_Log;
 public:
 	RM_FileHandle ();
 	~RM_FileHandle();
 
 	// Given a RID, return the record
 	RC GetRec     (const RID &rid, RM_Record &rec) const;
+	// Same, the record being read in place (see RM_RecordView)
+	RC GetRec     (const RID &rid, RM_RecordView &view) const;
 
 	RC InsertRec  (const char *pData, RID &rid);       // Insert a new record
 
@@ -83,13 +188,70 @@ public:
 	// from the buffer pool to disk.  Default value forces all pages.
 	RC ForcePages (PageNum pageNum = ALL_PAGES);
 
+	// Forces all pages and waits until they are on the device
+	RC SyncPages  ();
+
+	// Grow the file by large extents while many records are inserted
+	// (see PF_FileHandle::SetExtent), or by the default ones again
+	RC SetBulkLoad(Boolean bBulkLoad);
+
 private:
     Boolean IsValidSlotNum(SlotNum) const;
+    // 让 view pin 住页面 pageNum，它已经 pin 住这个页面时什么也不做
+    RC PinView    (PageNum pageNum, RM_RecordView &view,
+                   ClientHint hint = NO_HINT) const;
+    // 写回文件头和日志没有 pin 住的页面，有未提交修改的页面留在 buffer 中
+    RC FlushPages ();
+    // 文件头有变化时把它写进页面 0
+    RC WriteFileHdr();
+    // 标记页面为脏。记录日志时再 pin 住它一次，下一次 Append 把这个 pin
+    // 交给日志，修改提交后才放开，之前页面不会被写回 (见 rm_log.h)
+    RC MarkDirty  (const PF_PageGuard &page);
+    // 重做一条 redo 记录，不记录日志
+    RC RedoRec    (int type, PageNum pageNum, SlotNum slotNum,
+                   const char *pData, int length);
+    // 根据各页面的 bitmap 重建空闲页链表与 fHdr_
+    RC RebuildFreeList();
+
+    // 槽页格式 (rm_slotted.cc)
+    // 读出 RID 处的记录，解码到 recordSize 字节的 pRecord
+    RC GetSlotted     (PageNum pageNum, SlotNum slotNum, char *pRecord) const;
+    RC InsertSlotted  (const char *pData, RID &rid);
+    RC DeleteSlotted  (PageNum pageNum, SlotNum slotNum, Boolean bRedo);
+    RC UpdateSlotted  (PageNum pageNum, SlotNum slotNum, const char *pData,
+                       Boolean bRedo);
+    // 把编码为 pCode 的记录存进已经 pin 住的页面 pData 的槽 slotNum，
+    // 槽中原有的记录被替换，本页放不下时搬到别的页面。
+    // 出错时槽中仍是原有的记录
+    RC StoreSlotted   (PageNum pageNum, char *pData, SlotNum slotNum,
+                       const char *pCode, int codeLength);
+    // 在空闲页链表的页面中存一条记录，kind 为 RM_TUPLE_MOVED 时带上
+    // 原来的 RID (homePage, homeSlot)，返回记录的 RID
+    RC PlaceTuple     (int kind, PageNum homePage, SlotNum homeSlot,
+                       const char *pCode, int codeLength, PageNum &pageNum,
+                       SlotNum &slotNum);
+    // 删除 FORWARD 记录 pForward 所指向的 MOVED 记录
+    RC RemoveMoved    (PageNum homePage, SlotNum homeSlot,
+                       const char *pForward);
+    // 检查 MOVED 或 FORWARD 记录与它指向的记录是否成对
+    RC IsPaired       (PageNum pageNum, SlotNum slotNum, const char *pTuple,
+                       Boolean &bPaired) const;
+    // 去掉不成对的 MOVED 与 FORWARD，重建空闲页链表
+    RC RebuildSlotted ();
+    // 页面修改后，空闲空间足够的页面放回空闲页链表
+    void UpdateFreeList(PageNum pageNum, char *pData);
+    // 放回空闲页链表的页面至少要有的空闲字节数
+    int SlotReserve   () const;
+    // 页面中存放数据的字节数
+    int DataSize      () const;
 
     PF_FileHandle pfFH_;
     RM_FileHdr fHdr_;
     Boolean modified_;
     Boolean isOpened_;
+    RM_Log *pLog_;          // 记录修改的日志，NULL 表示不记录
+    int logFileNo_;         // 该文件在日志中的编号
+    std::vector<PageNum> dirtyPages_;   // 修改后还没交给日志的页面
 };
 
 //
@@ -108,10 +270,28 @@ public:
 	              void       *value,
 	              ClientHint pinHint = NO_HINT); // Initialize a file scan
 	RC GetNextRec(RM_Record &rec);               // Get next matching record
+	// Same, the record being read in place (see RM_RecordView).  A view
+	// given again keeps its page pinned while the scan stays on it.
+	RC GetNextRec(RM_RecordView &view);
+	// Get the next matching records, those of the next page holding any
+	// (see RM_RecordBatch).  RM_EOF when there are no more.
+	RC GetNextBatch(RM_RecordBatch &batch);
 	RC CloseScan ();                             // Close the scan
 private:
+    // 判断记录是否满足条件
+    Boolean IsMatch  (const char *pRecord);
+    // 在页面 pData 中从 nextSlotNum_ 起找下一条满足条件的记录。
+    // FindFixed 返回记录在页面中的位置，FindSlotted 把记录解码到 pRecord
+    Boolean FindFixed   (char *pData, char *&pRecord, RID &rid);
+    Boolean FindSlotted (char *pData, char *pRecord, RID &rid);
+    // 用 RM_Filter 找出页面 pData 中余下的满足条件的记录，放入 batch
+    void FilterFixed    (char *pData, RM_RecordBatch &batch);
+
     Boolean isOpened_;
     const RM_FileHandle* rmFH_;
+    char *recBuf_;          // 槽页格式中解码记录的缓冲区
+    Boolean filter_;        // GetNextBatch 是否用 RM_Filter 比较条件
+    unsigned char *matchBits_;  // GetNextBatch 中一个页面的比较结果
     // 下一个待扫描的位置
     PageNum curPageNum_;
     SlotNum nextSlotNum_;
@@ -140,16 +320,47 @@ public:
 	RM_Manager    (PF_Manager &pfm);
 	~RM_Manager   ();
 
-	RC CreateFile (const char *fileName, int recordSize);
+	// pageSize is the size of the PF pages of the file (see pf.h), format
+	// the layout of its records
+	RC CreateFile (const char *fileName, int recordSize,
+	               int pageSize = PF_DEFAULT_PAGE_SIZE,
+	               RM_FileFormat format = RM_FORMAT_FIXED);
 	RC DestroyFile(const char *fileName);
 	RC OpenFile   (const char *fileName, RM_FileHandle &fileHandle);
 
+	// A logged file is closed, and a file destroyed, only once the
+	// changes made through the log are committed (RM_UNCOMMITTED)
 	RC CloseFile  (RM_FileHandle &fileHandle);
+
+	// Log the changes of the files opened from now on to pLog (see
+	// rm_log.h), or stop logging them if pLog is NULL
+	void SetLog   (RM_Log *pLog);
 private:
 
     PF_Manager & pfMgr_;
+    RM_Log *pLog_;
 };
 
+//
+// RM_FilterLevel: how RM_FileScan::GetNextBatch compares INT and FLOAT
+// attributes in fixed-format files
+//
+// Above RM_FILTER_OFF the attribute of every slot left in the page is
+// compared at once, eight slots at a time, giving the matching records as
+// a bitmap.  The default is the best level the CPU supports.
+//
+enum RM_FilterLevel {
+	RM_FILTER_OFF,                                 // one record at a time
+	RM_FILTER_SCALAR,                              // plain C++
+	RM_FILTER_SSE2,                                // 4 attributes per compare
+	RM_FILTER_AVX2                                 // gather 8 attributes
+};
+
+// Use level, or the best supported level below it, for the scans opened
+// from now on; returns the level used
+int RM_SetFilterLevel(int level);
+int RM_GetFilterLevel();
+
 //
 // Print-error function
 //
@@ -166,9 +377,11 @@ void RM_PrintError(RC rc);
 #define RM_SCAN_ALREADY_OPENED      (START_RM_WARN + 8) // last opened scan is not closed
 #define RM_SCAN_NOT_OPENED          (START_RM_WARN + 9) // FileScan is not opened
 #define RM_OTHER_HINT_NOT_SUPPORT   (START_RM_WARN + 10) // Other hint not support
-#define RM_LASTWARN                 RM_OTHER_HINT_NOT_SUPPORT
+#define RM_LOG_NOT_OPENED           (START_RM_WARN + 11) // Log is not opened
+#define RM_UNCOMMITTED              (START_RM_WARN + 12) // uncommitted changes remain
+#define RM_LASTWARN                 RM_UNCOMMITTED
 
-#define RM_LARGE_RECORDSIZE         (START_RM_ERR - 0) // record size larger than PF_PAGE_SIZE
+#define RM_LARGE_RECORDSIZE         (START_RM_ERR - 0) // record size larger than a page
 #define RM_SMALL_RECORDSIZE         (START_RM_ERR - 1) // record size is too small
 #define RM_BAD_ATTRTYPE             (START_RM_ERR - 2) // Bad attribute type
 #define RM_BAD_COMPOP               (START_RM_ERR - 3) // Bad compare operator
@@ -176,6 +389,9 @@ void RM_PrintError(RC rc);
 #define RM_INCONSISTENT_ATTR        (START_RM_ERR - 5) // Attribute is incosistent
 #define RM_ATTRLENGTH_OUT_OF_RANGE  (START_RM_ERR - 6) // Attribute length is out of range
 #define RM_NULL_VALUE               (START_RM_ERR - 7) // Value is null
-#define RM_LASTERROR                RM_NULL_VALUE
+#define RM_LOG_UNIX                 (START_RM_ERR - 8) // Unix error on the log
+#define RM_NO_ROOM                  (START_RM_ERR - 9) // no room in the page
+#define RM_LOG_FULL                 (START_RM_ERR - 10) // uncommitted changes fill the buffer
+#define RM_LASTERROR                RM_LOG_FULL
 
 #endif
@@ -24,6 +24,8 @@ static char *RM_WarnMsg[] = {
 	(char*) "last opened scan is not closed",
 	(char*) "scan is not opened",
     (char*) "Other hint not support",
+    (char*) "log is not opened",
+    (char*) "uncommitted changes remain, commit them first",
 };
 
 static char *RM_ErrorMsg[] = {
@@ -34,7 +36,10 @@ static char *RM_ErrorMsg[] = {
 	(char*) "Attribute offset is out of range",
 	(char*) "Attribute is incosistent",
 	(char*) "Attribute length is out of range",
-    (char*) "Value is null"
+    (char*) "Value is null",
+    (char*) "Unix error on the log",
+    (char*) "no room in the page for the record",
+    (char*) "uncommitted changes fill the buffer, commit them first"
 };
 
 void RM_PrintError(RC rc) {
@@ -43,7 +48,7 @@ void RM_PrintError(RC rc) {
 		// Print warning
 		cerr << "RM warning: " << RM_WarnMsg[rc - START_RM_WARN] << "\n";
 		// Error codes are negative, so invert everything
-	else if (-rc >= -START_RM_ERR && -rc < -RM_LASTERROR)
+	else if (-rc >= -START_RM_ERR && -rc <= -RM_LASTERROR)
 		// Print error
 		cerr << "RM error: " << RM_ErrorMsg[-rc + START_RM_ERR] << "\n";
 	else if (rc == 0)
@@ -1,19 +1,31 @@
 #include "rm.h"
 #include "rm_internal.h"
+#include "rm_log.h"
 
 #include <cassert>
 
-RM_FileHandle::RM_FileHandle () : modified_(FALSE), isOpened_(FALSE) {}
+RM_FileHandle::RM_FileHandle () : modified_(FALSE), isOpened_(FALSE),
+    pLog_(NULL), logFileNo_(-1) {}
 
 RM_FileHandle::~RM_FileHandle() {
 	// Don't need to do anything
 }
 
 RC RM_FileHandle::GetRec (const RID &rid, RM_Record &rec) const {
+    int rc;
+    RM_RecordView view;
+
+    // 出错时 rec 保持不变
+    if((rc = GetRec(rid, view)))
+        return rc;
+    rec.SetData(view.pData_, fHdr_.recordSize, rid);
+    return view.Release();
+}
+
+RC RM_FileHandle::GetRec (const RID &rid, RM_RecordView &view) const {
     int rc;
     PageNum pageNum;
     SlotNum slotNum;
-    PF_PageHandle pfPH;
     char* pData;
 
     if(!isOpened_)
@@ -26,38 +38,46 @@ RC RM_FileHandle::GetRec (const RID &rid, RM_Record &rec) const {
     if(!IsValidSlotNum(slotNum))
         return RM_INVALID_SLOT;
 
-    if((rc = pfFH_.GetThisPage(pageNum, pfPH)) || (rc = pfPH.GetData(pData)))
+    view.isValid_ = FALSE;
+
+    // 槽页格式中记录解码到 view 的缓冲区，不必 pin 住页面
+    if(fHdr_.format == RM_FORMAT_SLOTTED) {
+        if(view.bufSize_ < fHdr_.recordSize) {
+            delete[] view.buf_;
+            view.buf_ = new char[fHdr_.recordSize];
+            view.bufSize_ = fHdr_.recordSize;
+        }
+        if((rc = view.Release())
+            || (rc = GetSlotted(pageNum, slotNum, view.buf_)))
+            return rc;
+        view.pData_ = view.buf_;
+        view.rid_ = rid;
+        view.isValid_ = TRUE;
+        return OK_RC;
+    }
+
+    // 页面由 view 来 unpin，出错返回时也不会泄漏 pin
+    if((rc = PinView(pageNum, view)) || (rc = view.page_.GetData(pData)))
         return rc;
-    
-    // 检查 record 是否为空
-    int ret;
 
+    // 检查 record 是否为空
     char* bitmap = pData + sizeof(RM_PageHdr);
-    // 如果不为空
-    if(bitmap[slotNum / 8] & (1 << (slotNum % 8))) {
-        rec.isValid_ = TRUE;
-        rec.size_ = fHdr_.recordSize;
-        rec.rid_ = rid;
-        if(rec.pData_)
-            delete[] rec.pData_;
-        rec.pData_ = new char[rec.size_];
-
-        memcpy(rec.pData_, 
-                bitmap + fHdr_.numRecordsPerPage / 8 + fHdr_.recordSize * slotNum, 
-                rec.size_);
-        ret = OK_RC;
+    if(!(bitmap[slotNum / 8] & (1 << (slotNum % 8)))) {
+        if((rc = view.Release()))
+            return rc;
+        return RM_RECORD_NOT_FOUND;
     }
-    else
-        ret = RM_RECORD_NOT_FOUND;
 
-    if(rc = pfFH_.UnpinPage(pageNum))
-        return rc;
-    return ret;
+    view.pData_ = bitmap + fHdr_.numRecordsPerPage / 8
+        + fHdr_.recordSize * slotNum;
+    view.rid_ = rid;
+    view.isValid_ = TRUE;
+    return OK_RC;
 }
 
 RC RM_FileHandle::InsertRec (const char *pData, RID &rid) {
     int rc;
-    PF_PageHandle pfPH;
+    PF_PageGuard page;
     PageNum pageNum;
     char* data;
     size_t slot;
@@ -65,20 +85,27 @@ RC RM_FileHandle::InsertRec (const char *pData, RID &rid) {
     if(!isOpened_)
         return RM_FILE_NOT_OPENED;
 
+    if(fHdr_.format == RM_FORMAT_SLOTTED)
+        return InsertSlotted(pData, rid);
+
+    // 记录日志时，未提交的修改占满 buffer 之前就停下 (见 rm_log.h)
+    if(pLog_ && (rc = pLog_->Reserve(this, 1)))
+        return rc;
+
     // 尝试寻找存在空闲条目的页目录
     int nextFreePos = fHdr_.nextFreePage;
     if(nextFreePos == RM_NO_FREE_PAGE) {
-        if((rc = pfFH_.AllocatePage(pfPH)))
+        if((rc = pfFH_.AllocatePage(page)))
             return rc;
         // RM_PageHdr 在后面做初始化
         // bitmap 无需初始化，因为 AllocatePage 分配的内存已经是初始化为0的
     } else {
-        if((rc = pfFH_.GetThisPage(nextFreePos, pfPH)))
+        if((rc = pfFH_.GetThisPage(nextFreePos, page)))
             return rc;
     }
 
     // 此时已经有了一个可以写入的 record slot
-    if((rc = pfPH.GetData(data)) || (rc = pfPH.GetPageNum(pageNum)))
+    if((rc = page.GetData(data)) || (rc = page.GetPageNum(pageNum)))
         return rc;
         
     char* bitmap = data + sizeof(RM_PageHdr);
@@ -105,7 +132,7 @@ RC RM_FileHandle::InsertRec (const char *pData, RID &rid) {
     // 复制数据进 Page 中
     int recordSize = fHdr_.recordSize;
     memcpy(bitmap + (numRecords / 8) + recordSize * slot, pData, recordSize);
-    if((rc = pfFH_.MarkDirty(pageNum)) || (rc = pfFH_.UnpinPage(pageNum)))
+    if((rc = MarkDirty(page)))
         return rc;
     // 更新 RID
     rid.pageNum_ = pageNum;
@@ -118,6 +145,7 @@ RC RM_FileHandle::InsertRec (const char *pData, RID &rid) {
         pHdr->nextFreePage = fHdr_.nextFreePage;
         fHdr_.nextFreePage = pageNum;
         fHdr_.numPages++;
+        modified_ = TRUE;
     }
     else {
         // 判断当前页是否写满，以判断是否需要更新 RM_PageHdr
@@ -128,16 +156,22 @@ RC RM_FileHandle::InsertRec (const char *pData, RID &rid) {
             RM_PageHdr* pHdr = (RM_PageHdr*)data;
             fHdr_.nextFreePage = pHdr->nextFreePage;
             pHdr->nextFreePage = RM_PAGE_FULL_USED;
+            modified_ = TRUE;
         }
     }
-    return OK_RC;
+
+    // 记录 redo 日志
+    if(pLog_ && (rc = pLog_->Append(this, RM_LOG_INSERT, rid.pageNum_,
+                                    rid.slotNum_, pData, recordSize)))
+        return rc;
+    return page.Release();
 }
 
 RC RM_FileHandle::DeleteRec (const RID &rid) {
     int rc;
     PageNum pageNum;
     SlotNum slotNum;
-    PF_PageHandle pfPH;
+    PF_PageGuard page;
     char* pData;
 
     if(!isOpened_)
@@ -150,7 +184,13 @@ RC RM_FileHandle::DeleteRec (const RID &rid) {
     if(!IsValidSlotNum(slotNum))
         return RM_INVALID_SLOT;
 
-    if((rc = pfFH_.GetThisPage(pageNum, pfPH)) || (rc = pfPH.GetData(pData)))
+    if(fHdr_.format == RM_FORMAT_SLOTTED)
+        return DeleteSlotted(pageNum, slotNum, FALSE);
+
+    if(pLog_ && (rc = pLog_->Reserve(this, 1)))
+        return rc;
+
+    if((rc = pfFH_.GetThisPage(pageNum, page)) || (rc = page.GetData(pData)))
         return rc;
     
     // 检查 record 是否为空
@@ -160,6 +200,8 @@ RC RM_FileHandle::DeleteRec (const RID &rid) {
     // 如果不为空
     if(bitmap[slotNum / 8] & (1 << (slotNum % 8))) {
         bitmap[slotNum / 8] &= ~(1 << (slotNum % 8));
+        if((rc = MarkDirty(page)))
+            return rc;
         ret = OK_RC;
 
         // 如果当前页面是从完全满中删除一个 rec，则将该页面追加到 fHdr 中
@@ -167,7 +209,11 @@ RC RM_FileHandle::DeleteRec (const RID &rid) {
         if(pHdr->nextFreePage == RM_PAGE_FULL_USED) {
             pHdr->nextFreePage = fHdr_.nextFreePage;
             fHdr_.nextFreePage = pageNum;
+            modified_ = TRUE;
         }
+        if(pLog_ && (rc = pLog_->Append(this, RM_LOG_DELETE, pageNum,
+                                        slotNum, NULL, 0)))
+            return rc;
         /*
             如果当前页面被删除后已经完全为空了，则可以试着删除该页面
             不过由于无法在 O(1) 下找到上一个 nextFreePage 为当前页面的页面（最主要的原因）
@@ -178,7 +224,7 @@ RC RM_FileHandle::DeleteRec (const RID &rid) {
     else
         ret = RM_RECORD_NOT_FOUND;
 
-    if(rc = pfFH_.UnpinPage(pageNum))
+    if((rc = page.Release()))
         return rc;
     return ret;
 }
@@ -187,7 +233,7 @@ RC RM_FileHandle::UpdateRec (const RM_Record &rec) {
     int rc;
     PageNum pageNum;
     SlotNum slotNum;
-    PF_PageHandle pfPH;
+    PF_PageGuard page;
     char* pData;
     RID rid;
 
@@ -206,7 +252,13 @@ RC RM_FileHandle::UpdateRec (const RM_Record &rec) {
     if(!IsValidSlotNum(slotNum))
         return RM_INVALID_SLOT;
 
-    if((rc = pfFH_.GetThisPage(pageNum, pfPH)) || (rc = pfPH.GetData(pData)))
+    if(fHdr_.format == RM_FORMAT_SLOTTED)
+        return UpdateSlotted(pageNum, slotNum, rec.pData_, FALSE);
+
+    if(pLog_ && (rc = pLog_->Reserve(this, 1)))
+        return rc;
+
+    if((rc = pfFH_.GetThisPage(pageNum, page)) || (rc = page.GetData(pData)))
         return rc;
     
     // 检查 record 是否为空
@@ -218,14 +270,17 @@ RC RM_FileHandle::UpdateRec (const RM_Record &rec) {
         memcpy(bitmap + fHdr_.numRecordsPerPage / 8 + fHdr_.recordSize * slotNum, 
                 rec.pData_, 
                 rec.size_);
-        if((rc = pfFH_.MarkDirty(pageNum)))
+        if((rc = MarkDirty(page)))
+            return rc;
+        if(pLog_ && (rc = pLog_->Append(this, RM_LOG_UPDATE, pageNum,
+                                        slotNum, rec.pData_, rec.size_)))
             return rc;
         ret = OK_RC;
     }
     else
         ret = RM_RECORD_NOT_FOUND;
 
-    if(rc = pfFH_.UnpinPage(pageNum))
+    if((rc = page.Release()))
         return rc;
     return ret;
 }
@@ -235,29 +290,183 @@ RC RM_FileHandle::ForcePages (PageNum pageNum) {
     if(!isOpened_)
         return RM_FILE_NOT_OPENED;
 
-    if(modified_) {
-        PF_PageHandle pfPH;
+    if((rc = WriteFileHdr()) || (rc = pfFH_.ForcePages(pageNum)))
+        return rc;
+
+    modified_ = FALSE;
+    return OK_RC;
+}
+
+RC RM_FileHandle::FlushPages () {
+    int rc;
+    if((rc = WriteFileHdr()))
+        return rc;
+
+    // 日志 pin 住的页面不会被写回，PF 为此给出的警告不是错误
+    if((rc = pfFH_.FlushPages()) && rc != PF_PAGEPINNED)
+        return rc;
+
+    modified_ = FALSE;
+    return OK_RC;
+}
+
+RC RM_FileHandle::WriteFileHdr () {
+    int rc;
+    if(!modified_)
+        return OK_RC;
+
+    PF_PageGuard page;
+    if((rc = pfFH_.GetFirstPage(page)))
+        return rc;
+
+    char *pData;
+    if((rc = page.GetData(pData)))
+        return rc;
+
+    memcpy(pData, &fHdr_, sizeof(RM_FileHdr));
+
+    if((rc = page.MarkDirty()) || (rc = page.Release()))
+        return rc;
+    return OK_RC;
+}
+
+RC RM_FileHandle::SyncPages () {
+    int rc;
+    if((rc = ForcePages()) || (rc = pfFH_.SyncPages()))
+        return rc;
+    return OK_RC;
+}
+
+RC RM_FileHandle::SetBulkLoad (Boolean bBulkLoad) {
+    if(!isOpened_)
+        return RM_FILE_NOT_OPENED;
+
+    // 批量导入时一次预留大块的空间，文件在磁盘上更连续，扩展文件的次数也更少
+    if(bBulkLoad)
+        return pfFH_.SetExtent(RM_BULK_EXTENT_PAGES, RM_BULK_EXTENT_GROWTH);
+    return pfFH_.SetExtent(PF_EXTENT_PAGES, PF_EXTENT_GROWTH);
+}
+
+RC RM_FileHandle::MarkDirty (const PF_PageGuard &page) {
+    int rc;
+    PageNum pageNum;
+    PF_PageHandle pfPH;
 
-        if((rc = pfFH_.GetFirstPage(pfPH)))
+    if((rc = page.MarkDirty()) || !pLog_)
+        return rc;
+
+    // 同一条语句接着修改同一个页面时，已经 pin 过了
+    if((rc = page.GetPageNum(pageNum)))
+        return rc;
+    if(!dirtyPages_.empty() && dirtyPages_.back() == pageNum)
+        return OK_RC;
+    if((rc = pfFH_.GetThisPage(pageNum, pfPH, RANDOM)))
+        return rc;
+    dirtyPages_.push_back(pageNum);
+    return OK_RC;
+}
+
+RC RM_FileHandle::RedoRec (int type, PageNum pageNum, SlotNum slotNum,
+                           const char *pData, int length) {
+    int rc;
+    PF_PageGuard page;
+    char* data;
+
+    // 长度与记录大小不符的记录属于之前的同名文件，跳过
+    if(!IsValidSlotNum(slotNum)
+        || (type != RM_LOG_DELETE && length != fHdr_.recordSize))
+        return OK_RC;
+
+    if(fHdr_.format == RM_FORMAT_SLOTTED) {
+        if(type == RM_LOG_DELETE)
+            return DeleteSlotted(pageNum, slotNum, TRUE);
+        return UpdateSlotted(pageNum, slotNum, pData, TRUE);
+    }
+
+    // 崩溃前才分配的页面可能还不在 PF 的文件头中，分配页面直到得到它为止
+    // 期间分配的空页面在 RebuildFreeList 中会被放进空闲页链表
+    rc = pfFH_.GetThisPage(pageNum, page);
+    while(rc == PF_INVALIDPAGE) {
+        PageNum allocated;
+        if((rc = pfFH_.AllocatePage(page)) || (rc = page.GetPageNum(allocated)))
             return rc;
+        if(allocated == pageNum)
+            break;
+        if(allocated > pageNum)
+            return PF_INVALIDPAGE;
+        rc = pfFH_.GetThisPage(pageNum, page);
+    }
+    if(rc || (rc = page.GetData(data)))
+        return rc;
 
-        char *pData;
-        if((rc = pfPH.GetData(pData)))
+    char* bitmap = data + sizeof(RM_PageHdr);
+    if(type == RM_LOG_DELETE)
+        bitmap[slotNum / 8] &= ~(1 << (slotNum % 8));
+    else {
+        bitmap[slotNum / 8] |= (1 << (slotNum % 8));
+        memcpy(bitmap + fHdr_.numRecordsPerPage / 8 + fHdr_.recordSize * slotNum,
+                pData, length);
+    }
+    if((rc = page.MarkDirty()))
+        return rc;
+    return page.Release();
+}
+
+RC RM_FileHandle::RebuildFreeList () {
+    int rc;
+    PF_PageGuard page;
+    PageNum pageNum;
+    char* data;
+
+    if(fHdr_.format == RM_FORMAT_SLOTTED)
+        return RebuildSlotted();
+
+    fHdr_.numPages = 0;
+    fHdr_.nextFreePage = RM_NO_FREE_PAGE;
+
+    // 第一个页面是文件头，从它之后的页面开始
+    if((rc = pfFH_.GetFirstPage(page)) || (rc = page.GetPageNum(pageNum)))
+        return rc;
+    while(!(rc = pfFH_.GetNextPage(pageNum, page))) {
+        if((rc = page.GetPageNum(pageNum)) || (rc = page.GetData(data)))
             return rc;
 
-        memcpy(pData, &fHdr_, sizeof(RM_FileHdr));
-        
-        PageNum pageNum;
-        if((rc = pfPH.GetPageNum(pageNum)) 
-            || (rc = pfFH_.MarkDirty(pageNum)) 
-            || (rc = pfFH_.UnpinPage(pageNum)))
+        char* bitmap = data + sizeof(RM_PageHdr);
+        int slot;
+        for(slot = 0; slot < fHdr_.numRecordsPerPage; slot += 8)
+            if(bitmap[slot / 8] != -1)
+                break;
+
+        RM_PageHdr* pHdr = (RM_PageHdr*)data;
+        if(slot == fHdr_.numRecordsPerPage)
+            pHdr->nextFreePage = RM_PAGE_FULL_USED;
+        else {
+            pHdr->nextFreePage = fHdr_.nextFreePage;
+            fHdr_.nextFreePage = pageNum;
+        }
+        fHdr_.numPages++;
+        if((rc = page.MarkDirty()))
             return rc;
     }
-
-    if((rc = pfFH_.ForcePages(pageNum))) 
+    if(rc != PF_EOF)
         return rc;
 
-    modified_ = FALSE;
+    modified_ = TRUE;
+    return OK_RC;
+}
+
+RC RM_FileHandle::PinView (PageNum pageNum, RM_RecordView &view,
+                           ClientHint hint) const {
+    int rc;
+
+    if(view.pFH_ == this && view.pageNum_ == pageNum)
+        return OK_RC;
+    // GetThisPage 会先 unpin view 之前 pin 住的页面
+    view.pFH_ = NULL;
+    if((rc = pfFH_.GetThisPage(pageNum, view.page_, hint)))
+        return rc;
+    view.pFH_ = this;
+    view.pageNum_ = pageNum;
     return OK_RC;
 }
 
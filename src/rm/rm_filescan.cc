@@ -3,8 +3,12 @@
 
 #include <cstdlib>
 
-RM_FileScan::RM_FileScan () : isOpened_(FALSE) {}
-RM_FileScan::~RM_FileScan () {}
+RM_FileScan::RM_FileScan () : isOpened_(FALSE), recBuf_(NULL), filter_(FALSE),
+    matchBits_(NULL) {}
+RM_FileScan::~RM_FileScan () {
+    delete[] recBuf_;
+    delete[] matchBits_;
+}
 
 RC RM_FileScan::OpenScan  (const RM_FileHandle &fileHandle,
                             AttrType   attrType,
@@ -40,24 +44,24 @@ RC RM_FileScan::OpenScan  (const RM_FileHandle &fileHandle,
     // 判断 value
     if(compOp != NO_OP && !value)
         return RM_NULL_VALUE;
-    // 判断 Hint
-    if(pinHint != NO_HINT)
+    // 判断 Hint，SEQUENTIAL_SCAN 与 ONE_SHOT 会让扫描的页面使用 buffer 中的 scan ring
+    if(pinHint != NO_HINT && pinHint != SEQUENTIAL_SCAN
+        && pinHint != RANDOM && pinHint != ONE_SHOT)
         return RM_OTHER_HINT_NOT_SUPPORT;
 
     isOpened_ = TRUE;
     rmFH_ = &fileHandle;
     // 设置初始时的 PageNum
     int rc;
-    PF_PageHandle pfPH;
+    PF_PageGuard page;
     // 首先获取 head Page
-    if((rc = rmFH_->pfFH_.GetFirstPage(pfPH)) 
-        || (rc = pfPH.GetPageNum(curPageNum_)) 
-        || (rc = rmFH_->pfFH_.UnpinPage(curPageNum_)))
+    if((rc = rmFH_->pfFH_.GetFirstPage(page)) 
+        || (rc = page.GetPageNum(curPageNum_)))
         return rc;
-    // 接着获取 first data page
-    if((rc = rmFH_->pfFH_.GetNextPage(curPageNum_, pfPH)) 
-        || (rc = pfPH.GetPageNum(curPageNum_)) 
-        || (rc = rmFH_->pfFH_.UnpinPage(curPageNum_)))
+    // 接着获取 first data page，GetNextPage 会先 unpin head page
+    if((rc = rmFH_->pfFH_.GetNextPage(curPageNum_, page, pinHint)) 
+        || (rc = page.GetPageNum(curPageNum_)) 
+        || (rc = page.Release()))
         return rc;
 
     nextSlotNum_ = 0;
@@ -70,129 +74,275 @@ RC RM_FileScan::OpenScan  (const RM_FileHandle &fileHandle,
 
     value_ = getValueFromPtr(value);
 
+    if(rmFH_->fHdr_.format == RM_FORMAT_SLOTTED) {
+        delete[] recBuf_;
+        recBuf_ = new char[rmFH_->fHdr_.recordSize];
+    }
+
+    // 定长格式中 GetNextBatch 用 RM_Filter 比较 INT 与 FLOAT 的条件
+    filter_ = (rmFH_->fHdr_.format == RM_FORMAT_FIXED && compOp != NO_OP
+               && attrType != STRING && RM_GetFilterLevel() != RM_FILTER_OFF);
+    if(filter_) {
+        delete[] matchBits_;
+        matchBits_ = new unsigned char[rmFH_->fHdr_.numRecordsPerPage / 8];
+    }
+
     return OK_RC;
 }
 
 RC RM_FileScan::GetNextRec(RM_Record &rec) {
+    int rc;
+    RM_RecordView view;
+
+    if((rc = GetNextRec(view)))
+        return rc;
+    rec.SetData(view.pData_, rmFH_->fHdr_.recordSize, view.rid_);
+    return view.Release();
+}
+
+RC RM_FileScan::GetNextRec(RM_RecordView &view) {
     if(!isOpened_)
         return RM_SCAN_NOT_OPENED;
 
     int rc;
     char *pData;
-    PF_PageHandle pfPH;
-    Boolean isFound = FALSE;
+    Boolean isSlotted = (rmFH_->fHdr_.format == RM_FORMAT_SLOTTED);
+
+    // view 还 pin 着当前页面时直接使用，每个页面只 pin 一次
+    view.isValid_ = FALSE;
+    if((rc = rmFH_->PinView(curPageNum_, view, pinHint_)))
+        return rc;
 
-    // 如果说当前 slotNum 没问题，则获取当前页面
-    if(nextSlotNum_ < rmFH_->fHdr_.numRecordsPerPage) {
-        if((rc = rmFH_->pfFH_.GetThisPage(curPageNum_, pfPH)))
+    for(;;) {
+        if((rc = view.page_.GetData(pData)))
             return rc;
-    }
+        if(isSlotted ? FindSlotted(pData, recBuf_, view.rid_)
+                     : FindFixed(pData, view.pData_, view.rid_)) {
+            if(isSlotted)
+                view.pData_ = recBuf_;
+            view.isValid_ = TRUE;
+            return OK_RC;
+        }
 
-    while(!isFound) {
-        // 如果 next slot 超过了，则获取下一个页面
-        if(nextSlotNum_ >= rmFH_->fHdr_.numRecordsPerPage) {
-            // 获取下一个页面
-            if((rc = rmFH_->pfFH_.GetNextPage(curPageNum_, pfPH))) {
-                if (rc == PF_EOF)
-                    return RM_EOF;
-                return rc;
-            }
-            // 更新 curPageNum_ & nextSlotNum_
-            if((rc = pfPH.GetPageNum(curPageNum_)))
-                return rc;
-            nextSlotNum_ = 0;
+        // 当前页面查找结束，获取下一个页面，GetNextPage 会先 unpin 当前页面
+        view.pFH_ = NULL;
+        if((rc = rmFH_->pfFH_.GetNextPage(curPageNum_, view.page_, pinHint_))) {
+            view.Release();
+            if (rc == PF_EOF)
+                return RM_EOF;
+            return rc;
         }
-        
-        // 获取当前页面的 bitmap 
-        if((rc = pfPH.GetData(pData)))
+        // 更新 curPageNum_ & nextSlotNum_
+        if((rc = view.page_.GetPageNum(curPageNum_)))
             return rc;
-        char* bitmap = pData + sizeof(RM_PageHdr);
-
-        // 在单个页面中进行查找
-        void* recordP = NULL;
-        for(/* nop */; !isFound && nextSlotNum_ < rmFH_->fHdr_.numRecordsPerPage; nextSlotNum_++) {
-            // 如果存在记录
-            if(bitmap[nextSlotNum_ / 8] & (1 << nextSlotNum_ % 8)) {
-                recordP = bitmap + (rmFH_->fHdr_.numRecordsPerPage / 8) + nextSlotNum_ * rmFH_->fHdr_.recordSize;
-                if(compOp_ == NO_OP)
-                    isFound = TRUE;
-                else {
-                    // 判断该记录是否满足要求
-                    ValueTy uValue = getValueFromPtr((char*)recordP + attrOffset_);
-                    switch(attrType_) {
-                        case INT: 
-                            switch(compOp_) {
-                                case EQ_OP: isFound = (uValue.intNum == value_.intNum); break;
-                                case LT_OP: isFound = (uValue.intNum < value_.intNum); break;
-                                case GT_OP: isFound = (uValue.intNum > value_.intNum); break;
-                                case LE_OP: isFound = (uValue.intNum <= value_.intNum); break;
-                                case GE_OP: isFound = (uValue.intNum >= value_.intNum); break;
-                                case NE_OP: isFound = (uValue.intNum != value_.intNum); break;
-                                default: abort();
-                            }
-                            break;
-                        case FLOAT:{
-                            switch(compOp_) {
-                                case EQ_OP: isFound = (uValue.floatNum == value_.floatNum); break;
-                                case LT_OP: isFound = (uValue.floatNum < value_.floatNum); break;
-                                case GT_OP: isFound = (uValue.floatNum > value_.floatNum); break;
-                                case LE_OP: isFound = (uValue.floatNum <= value_.floatNum); break;
-                                case GE_OP: isFound = (uValue.floatNum >= value_.floatNum); break;
-                                case NE_OP: isFound = (uValue.floatNum != value_.floatNum); break;
-                                default: abort();
-                            }
-                            break;
-                        }
-                        case STRING:{
-                            int res = strncmp(uValue.str, value_.str, attrLength_);
-                            switch(compOp_) {
-                                case EQ_OP: isFound = res == 0; break;
-                                case LT_OP: isFound = res < 0; break;
-                                case GT_OP: isFound = res > 0; break;
-                                case LE_OP: isFound = res <= 0; break;
-                                case GE_OP: isFound = res >= 0; break;
-                                case NE_OP: isFound = res != 0; break;
-                                default: abort();
-                            }
-                            break;
-                        }
-                        default: abort();
-                    }
-                }
+        view.pFH_ = rmFH_;
+        view.pageNum_ = curPageNum_;
+        nextSlotNum_ = 0;
+    }
+}
+
+RC RM_FileScan::GetNextBatch(RM_RecordBatch &batch) {
+    if(!isOpened_)
+        return RM_SCAN_NOT_OPENED;
+
+    int rc;
+    char *pData;
+    const RM_FileHdr &fHdr = rmFH_->fHdr_;
+    Boolean isSlotted = (fHdr.format == RM_FORMAT_SLOTTED);
+
+    // 一个批次最多是一个页面中的全部记录
+    batch.count_ = 0;
+    batch.Reserve(fHdr.numRecordsPerPage, isSlotted ? fHdr.recordSize : 0);
+    if((rc = rmFH_->pfFH_.GetThisPage(curPageNum_, batch.page_, pinHint_)))
+        return rc;
+
+    for(;;) {
+        if((rc = batch.page_.GetData(pData)))
+            return rc;
+        int &n = batch.count_;
+        if(isSlotted) {
+            while(n < batch.capacity_ && FindSlotted(pData,
+                    batch.buf_ + n * fHdr.recordSize, batch.rids_[n])) {
+                batch.pRecords_[n] = batch.buf_ + n * fHdr.recordSize;
+                n++;
             }
         }
-        
-        // 如果找到了，则 nextSlotNum_ 自增1，为下一次做准备
-        if(isFound) {
-            // 设置 record
-            rec.isValid_ = TRUE;
-            rec.size_ = rmFH_->fHdr_.recordSize;
-            if(rec.pData_)
-                delete[] rec.pData_;
-            rec.pData_ = new char[rec.size_];
-            memcpy(rec.pData_, recordP, rec.size_);
-
-            rec.rid_.isValid_ = TRUE;
-            rec.rid_.pageNum_ = curPageNum_;
-            // 查找完成后， nextSlotNum_ 会自动加1, 因此这里要减去 1
-            rec.rid_.slotNum_ = nextSlotNum_ - 1;
+        else if(filter_)
+            FilterFixed(pData, batch);
+        else {
+            while(n < batch.capacity_
+                && FindFixed(pData, batch.pRecords_[n], batch.rids_[n]))
+                n++;
         }
+        if(n > 0)
+            return OK_RC;
 
-        // 当前页面查找结束， unpin 当前页面
-        if((rc = rmFH_->pfFH_.UnpinPage(curPageNum_)))
+        // 这个页面中没有满足条件的记录，获取下一个页面
+        if((rc = rmFH_->pfFH_.GetNextPage(curPageNum_, batch.page_,
+                                          pinHint_))) {
+            batch.Release();
+            if (rc == PF_EOF)
+                return RM_EOF;
+            return rc;
+        }
+        if((rc = batch.page_.GetPageNum(curPageNum_)))
             return rc;
+        nextSlotNum_ = 0;
     }
+}
 
-    return OK_RC;
+Boolean RM_FileScan::FindFixed(char *pData, char *&pRecord, RID &rid) {
+    const RM_FileHdr &fHdr = rmFH_->fHdr_;
+    unsigned char *bitmap = (unsigned char *)pData + sizeof(RM_PageHdr);
+    char *pRecords = (char *)bitmap + fHdr.numRecordsPerPage / 8;
+
+    // 每次看 bitmap 的一个字节，即 8 个槽，只比较其中存在的记录
+    while(nextSlotNum_ < fHdr.numRecordsPerPage) {
+        int group = nextSlotNum_ / 8;
+        unsigned bits = bitmap[group] & (0xff << (nextSlotNum_ % 8));
+        for(/* nop */; bits; bits &= bits - 1) {
+            SlotNum slot = group * 8 + __builtin_ctz(bits);
+            char *recordP = pRecords + slot * fHdr.recordSize;
+            if(!IsMatch(recordP))
+                continue;
+
+            pRecord = recordP;
+            rid.isValid_ = TRUE;
+            rid.pageNum_ = curPageNum_;
+            rid.slotNum_ = slot;
+            // 下一次从下一个槽开始
+            nextSlotNum_ = slot + 1;
+            return TRUE;
+        }
+        nextSlotNum_ = (group + 1) * 8;
+    }
+    return FALSE;
+}
+
+void RM_FileScan::FilterFixed(char *pData, RM_RecordBatch &batch) {
+    const RM_FileHdr &fHdr = rmFH_->fHdr_;
+    unsigned char *bitmap = (unsigned char *)pData + sizeof(RM_PageHdr);
+    char *pRecords = (char *)bitmap + fHdr.numRecordsPerPage / 8;
+    int first = nextSlotNum_ / 8;
+    int groups = fHdr.numRecordsPerPage / 8 - first;
+
+    if(groups <= 0)
+        return;
+    // 一次比较页面中余下的全部槽
+    RM_Filter(attrType_, compOp_,
+              pRecords + first * 8 * fHdr.recordSize + attrOffset_,
+              fHdr.recordSize, groups * 8, &value_, bitmap + first, matchBits_);
+    matchBits_[0] &= 0xff << (nextSlotNum_ % 8);
+
+    int &n = batch.count_;
+    for(int g = 0; g < groups; g++) {
+        for(unsigned bits = matchBits_[g]; bits; bits &= bits - 1) {
+            SlotNum slot = (first + g) * 8 + __builtin_ctz(bits);
+            batch.pRecords_[n] = pRecords + slot * fHdr.recordSize;
+            batch.rids_[n].isValid_ = TRUE;
+            batch.rids_[n].pageNum_ = curPageNum_;
+            batch.rids_[n].slotNum_ = slot;
+            n++;
+        }
+    }
+    nextSlotNum_ = fHdr.numRecordsPerPage;
+}
+
+Boolean RM_FileScan::FindSlotted(char *pData, char *pRecord, RID &rid) {
+    const RM_FileHdr &fHdr = rmFH_->fHdr_;
+    char *pTuple;
+    int length;
+
+    // FORWARD 跳过，搬走的记录在 MOVED 处以原来的 RID 返回
+    RM_SlotPage sp(pData, rmFH_->DataSize());
+    for(/* nop */; nextSlotNum_ < sp.Hdr()->numSlots; nextSlotNum_++) {
+        if(!sp.Get(nextSlotNum_, pTuple, length)
+            || pTuple[0] == RM_TUPLE_FORWARD)
+            continue;
+
+        PageNum pageNum = curPageNum_;
+        SlotNum slotNum = nextSlotNum_;
+        int offset = 1;
+        if(pTuple[0] == RM_TUPLE_MOVED) {
+            memcpy(&pageNum, pTuple + 1, sizeof(PageNum));
+            memcpy(&slotNum, pTuple + 1 + sizeof(PageNum), sizeof(SlotNum));
+            offset += sizeof(PageNum) + sizeof(SlotNum);
+        }
+        RM_DecodeRecord(pTuple + offset, length - offset, pRecord,
+                        fHdr.recordSize);
+        if(!IsMatch(pRecord))
+            continue;
+
+        rid.isValid_ = TRUE;
+        rid.pageNum_ = pageNum;
+        rid.slotNum_ = slotNum;
+        nextSlotNum_++;
+        return TRUE;
+    }
+    return FALSE;
 }
 
 RC RM_FileScan::CloseScan () {
     if(!isOpened_)
         return RM_SCAN_NOT_OPENED;
     isOpened_ = FALSE;
+    delete[] recBuf_;
+    recBuf_ = NULL;
+    delete[] matchBits_;
+    matchBits_ = NULL;
     return OK_RC;
 }
 
+Boolean RM_FileScan::IsMatch (const char *pRecord) {
+    Boolean isFound = FALSE;
+
+    if(compOp_ == NO_OP)
+        return TRUE;
+
+    // 判断该记录是否满足要求
+    ValueTy uValue = getValueFromPtr((char*)pRecord + attrOffset_);
+    switch(attrType_) {
+        case INT: 
+            switch(compOp_) {
+                case EQ_OP: isFound = (uValue.intNum == value_.intNum); break;
+                case LT_OP: isFound = (uValue.intNum < value_.intNum); break;
+                case GT_OP: isFound = (uValue.intNum > value_.intNum); break;
+                case LE_OP: isFound = (uValue.intNum <= value_.intNum); break;
+                case GE_OP: isFound = (uValue.intNum >= value_.intNum); break;
+                case NE_OP: isFound = (uValue.intNum != value_.intNum); break;
+                default: abort();
+            }
+            break;
+        case FLOAT:{
+            switch(compOp_) {
+                case EQ_OP: isFound = (uValue.floatNum == value_.floatNum); break;
+                case LT_OP: isFound = (uValue.floatNum < value_.floatNum); break;
+                case GT_OP: isFound = (uValue.floatNum > value_.floatNum); break;
+                case LE_OP: isFound = (uValue.floatNum <= value_.floatNum); break;
+                case GE_OP: isFound = (uValue.floatNum >= value_.floatNum); break;
+                case NE_OP: isFound = (uValue.floatNum != value_.floatNum); break;
+                default: abort();
+            }
+            break;
+        }
+        case STRING:{
+            int res = strncmp(uValue.str, value_.str, attrLength_);
+            switch(compOp_) {
+                case EQ_OP: isFound = res == 0; break;
+                case LT_OP: isFound = res < 0; break;
+                case GT_OP: isFound = res > 0; break;
+                case LE_OP: isFound = res <= 0; break;
+                case GE_OP: isFound = res >= 0; break;
+                case NE_OP: isFound = res != 0; break;
+                default: abort();
+            }
+            break;
+        }
+        default: abort();
+    }
+    return isFound;
+}
+
 RM_FileScan::ValueTy RM_FileScan::getValueFromPtr(void* value) {
     ValueTy uValue;
     // 根据类型设置 value
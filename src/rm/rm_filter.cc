@@ -0,0 +1,287 @@
+#include "rm.h"
+#include "rm_internal.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define RM_FILTER_X86
+#endif
+
+//
+// 标量实现，也用于没有 SSE2 的平台
+//
+
+// 比较 a 与 b，OP 为 CompOp
+template <int OP, typename T>
+static inline bool Compare(T a, T b) {
+    switch(OP) {
+        case EQ_OP: return a == b;
+        case LT_OP: return a < b;
+        case GT_OP: return a > b;
+        case LE_OP: return a <= b;
+        case GE_OP: return a >= b;
+        default:    return a != b;
+    }
+}
+
+template <typename T>
+static inline T LoadAttr(const char *pAttr) {
+    T value;
+    memcpy(&value, pAttr, sizeof(T));
+    return value;
+}
+
+template <int OP, typename T>
+static void FilterScalar(const char *pAttr, int stride, int count,
+                         const void *pValue, const unsigned char *pLive,
+                         unsigned char *pMatch) {
+    T value = LoadAttr<T>((const char *)pValue);
+    for(int g = 0; g < count / 8; g++) {
+        unsigned char bits = 0;
+        if(pLive[g]) {
+            const char *p = pAttr + g * 8 * stride;
+            for(int j = 0; j < 8; j++)
+                if(Compare<OP>(LoadAttr<T>(p + j * stride), value))
+                    bits |= 1 << j;
+        }
+        pMatch[g] = bits & pLive[g];
+    }
+}
+
+#ifdef RM_FILTER_X86
+
+//
+// SSE2 实现：每 4 个属性装进一个向量比较
+//
+// 整数只有 ==、<、>，其余三种比较对结果取反。浮点数不能这样做，
+// NaN 与任何数比较都不成立，所以各用各的比较指令。
+//
+
+template <int OP>
+__attribute__((target("sse2")))
+static inline int CompareSse2(__m128i a, __m128i v) {
+    __m128i m;
+    switch(OP) {
+        case EQ_OP: case NE_OP: m = _mm_cmpeq_epi32(a, v); break;
+        case LT_OP: case GE_OP: m = _mm_cmplt_epi32(a, v); break;
+        default:                m = _mm_cmpgt_epi32(a, v); break;
+    }
+    int bits = _mm_movemask_ps(_mm_castsi128_ps(m));
+    if(OP == NE_OP || OP == GE_OP || OP == LE_OP)
+        bits ^= 0xf;
+    return bits;
+}
+
+template <int OP>
+__attribute__((target("sse2")))
+static inline int CompareSse2(__m128 a, __m128 v) {
+    __m128 m;
+    switch(OP) {
+        case EQ_OP: m = _mm_cmpeq_ps(a, v); break;
+        case LT_OP: m = _mm_cmplt_ps(a, v); break;
+        case GT_OP: m = _mm_cmpgt_ps(a, v); break;
+        case LE_OP: m = _mm_cmple_ps(a, v); break;
+        case GE_OP: m = _mm_cmpge_ps(a, v); break;
+        default:    m = _mm_cmpneq_ps(a, v); break;
+    }
+    return _mm_movemask_ps(m);
+}
+
+template <int OP>
+__attribute__((target("sse2")))
+static void FilterIntSse2(const char *pAttr, int stride, int count,
+                          const void *pValue, const unsigned char *pLive,
+                          unsigned char *pMatch) {
+    __m128i v = _mm_set1_epi32(LoadAttr<int>((const char *)pValue));
+    for(int g = 0; g < count / 8; g++) {
+        if(!pLive[g]) {
+            pMatch[g] = 0;
+            continue;
+        }
+        const char *p = pAttr + g * 8 * stride;
+        int bits = 0;
+        for(int h = 0; h < 2; h++, p += 4 * stride) {
+            __m128i a = _mm_set_epi32(LoadAttr<int>(p + 3 * stride),
+                                      LoadAttr<int>(p + 2 * stride),
+                                      LoadAttr<int>(p + stride),
+                                      LoadAttr<int>(p));
+            bits |= CompareSse2<OP>(a, v) << (4 * h);
+        }
+        pMatch[g] = bits & pLive[g];
+    }
+}
+
+template <int OP>
+__attribute__((target("sse2")))
+static void FilterFloatSse2(const char *pAttr, int stride, int count,
+                            const void *pValue, const unsigned char *pLive,
+                            unsigned char *pMatch) {
+    __m128 v = _mm_set1_ps(LoadAttr<float>((const char *)pValue));
+    for(int g = 0; g < count / 8; g++) {
+        if(!pLive[g]) {
+            pMatch[g] = 0;
+            continue;
+        }
+        const char *p = pAttr + g * 8 * stride;
+        int bits = 0;
+        for(int h = 0; h < 2; h++, p += 4 * stride) {
+            __m128 a = _mm_set_ps(LoadAttr<float>(p + 3 * stride),
+                                  LoadAttr<float>(p + 2 * stride),
+                                  LoadAttr<float>(p + stride),
+                                  LoadAttr<float>(p));
+            bits |= CompareSse2<OP>(a, v) << (4 * h);
+        }
+        pMatch[g] = bits & pLive[g];
+    }
+}
+
+//
+// AVX2 实现：一组 8 个属性用一条 gather 读出，正好是 bitmap 的一个字节
+//
+
+template <int OP>
+__attribute__((target("avx2")))
+static void FilterIntAvx2(const char *pAttr, int stride, int count,
+                          const void *pValue, const unsigned char *pLive,
+                          unsigned char *pMatch) {
+    __m256i v = _mm256_set1_epi32(LoadAttr<int>((const char *)pValue));
+    __m256i index = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7),
+                                       _mm256_set1_epi32(stride));
+    for(int g = 0; g < count / 8; g++) {
+        if(!pLive[g]) {
+            pMatch[g] = 0;
+            continue;
+        }
+        __m256i a = _mm256_i32gather_epi32((const int *)(pAttr + g * 8 * stride),
+                                           index, 1);
+        __m256i m;
+        switch(OP) {
+            case EQ_OP: case NE_OP: m = _mm256_cmpeq_epi32(a, v); break;
+            case LT_OP: case GE_OP: m = _mm256_cmpgt_epi32(v, a); break;
+            default:                m = _mm256_cmpgt_epi32(a, v); break;
+        }
+        int bits = _mm256_movemask_ps(_mm256_castsi256_ps(m));
+        if(OP == NE_OP || OP == GE_OP || OP == LE_OP)
+            bits ^= 0xff;
+        pMatch[g] = bits & pLive[g];
+    }
+}
+
+template <int OP>
+__attribute__((target("avx2")))
+static void FilterFloatAvx2(const char *pAttr, int stride, int count,
+                            const void *pValue, const unsigned char *pLive,
+                            unsigned char *pMatch) {
+    __m256 v = _mm256_set1_ps(LoadAttr<float>((const char *)pValue));
+    __m256i index = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7),
+                                       _mm256_set1_epi32(stride));
+    for(int g = 0; g < count / 8; g++) {
+        if(!pLive[g]) {
+            pMatch[g] = 0;
+            continue;
+        }
+        __m256 a = _mm256_i32gather_ps((const float *)(pAttr + g * 8 * stride),
+                                       index, 1);
+        __m256 m;
+        switch(OP) {
+            case EQ_OP: m = _mm256_cmp_ps(a, v, _CMP_EQ_OQ); break;
+            case LT_OP: m = _mm256_cmp_ps(a, v, _CMP_LT_OQ); break;
+            case GT_OP: m = _mm256_cmp_ps(a, v, _CMP_GT_OQ); break;
+            case LE_OP: m = _mm256_cmp_ps(a, v, _CMP_LE_OQ); break;
+            case GE_OP: m = _mm256_cmp_ps(a, v, _CMP_GE_OQ); break;
+            default:    m = _mm256_cmp_ps(a, v, _CMP_NEQ_UQ); break;
+        }
+        pMatch[g] = _mm256_movemask_ps(m) & pLive[g];
+    }
+}
+
+#endif
+
+//
+// 按实现、类型与比较方式选出的函数
+//
+
+typedef void (*FilterFunc)(const char *pAttr, int stride, int count,
+                           const void *pValue, const unsigned char *pLive,
+                           unsigned char *pMatch);
+
+// 各比较方式的函数，按 EQ、LT、GT、LE、GE、NE 的顺序
+#define RM_FILTER_OPS(f) \
+    { f<EQ_OP>, f<LT_OP>, f<GT_OP>, f<LE_OP>, f<GE_OP>, f<NE_OP> }
+
+template <int OP> static void FilterIntScalar(const char *pAttr, int stride,
+        int count, const void *pValue, const unsigned char *pLive,
+        unsigned char *pMatch) {
+    FilterScalar<OP, int>(pAttr, stride, count, pValue, pLive, pMatch);
+}
+template <int OP> static void FilterFloatScalar(const char *pAttr, int stride,
+        int count, const void *pValue, const unsigned char *pLive,
+        unsigned char *pMatch) {
+    FilterScalar<OP, float>(pAttr, stride, count, pValue, pLive, pMatch);
+}
+
+static const FilterFunc scalarFuncs[2][6] = {
+    RM_FILTER_OPS(FilterIntScalar), RM_FILTER_OPS(FilterFloatScalar)
+};
+#ifdef RM_FILTER_X86
+static const FilterFunc sse2Funcs[2][6] = {
+    RM_FILTER_OPS(FilterIntSse2), RM_FILTER_OPS(FilterFloatSse2)
+};
+static const FilterFunc avx2Funcs[2][6] = {
+    RM_FILTER_OPS(FilterIntAvx2), RM_FILTER_OPS(FilterFloatAvx2)
+};
+#endif
+
+// CPU 支持的最好的实现
+static int BestFilterLevel() {
+#ifdef RM_FILTER_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2"))
+        return RM_FILTER_AVX2;
+    if(__builtin_cpu_supports("sse2"))
+        return RM_FILTER_SSE2;
+#endif
+    return RM_FILTER_SCALAR;
+}
+
+static const int bestFilterLevel = BestFilterLevel();
+static int filterLevel = bestFilterLevel;
+
+int RM_SetFilterLevel(int level) {
+    if(level < RM_FILTER_OFF)
+        level = RM_FILTER_OFF;
+    if(level > bestFilterLevel)
+        level = bestFilterLevel;
+    filterLevel = level;
+    return level;
+}
+
+int RM_GetFilterLevel() {
+    return filterLevel;
+}
+
+void RM_Filter(AttrType attrType, CompOp compOp, const char *pAttr,
+               int stride, int count, const void *pValue,
+               const unsigned char *pLive, unsigned char *pMatch) {
+    int type = (attrType == FLOAT);
+    int op;
+    switch(compOp) {
+        case EQ_OP: op = 0; break;
+        case LT_OP: op = 1; break;
+        case GT_OP: op = 2; break;
+        case LE_OP: op = 3; break;
+        case GE_OP: op = 4; break;
+        default:    op = 5; break;
+    }
+
+#ifdef RM_FILTER_X86
+    if(filterLevel == RM_FILTER_AVX2) {
+        avx2Funcs[type][op](pAttr, stride, count, pValue, pLive, pMatch);
+        return;
+    }
+    if(filterLevel == RM_FILTER_SSE2) {
+        sse2Funcs[type][op](pAttr, stride, count, pValue, pLive, pMatch);
+        return;
+    }
+#endif
+    scalarFuncs[type][op](pAttr, stride, count, pValue, pLive, pMatch);
+}
@@ -6,8 +6,107 @@
 #define RM_NO_FREE_PAGE     -1
 #define RM_PAGE_FULL_USED   -2
 
+// 批量导入时文件每次至少预留的页面数，或者文件页面数的百分比
+#define RM_BULK_EXTENT_PAGES    256
+#define RM_BULK_EXTENT_GROWTH   25
+
 struct RM_PageHdr {
     int nextFreePage;   // 指向下一个空闲记录的页面索引
 };
 
-#endif
\ No newline at end of file
+//
+// 槽页格式 (RM_FORMAT_SLOTTED)
+//
+// 页面开头是 RM_SlotPageHdr，随后是向后增长的槽目录，记录从页尾向前存放。
+// 槽的编号就是 RID 的 slotNum，记录在页内移动 (整理碎片) 时只改槽中的偏移，
+// 所以 RID 不会变。槽中的记录以一个字节的 RM_TupleKind 开头：
+//   RM_TUPLE_HOME    记录本身，后面是编码后的记录
+//   RM_TUPLE_FORWARD 记录变长后本页放不下，搬到了别的页面，后面是它的 RID
+//   RM_TUPLE_MOVED   搬来的记录，后面是它原来的 RID 和编码后的记录
+// 扫描时跳过 FORWARD，在 MOVED 处以原来的 RID 返回记录。
+//
+// 记录按长度不小于 RM_ZERO_RUN_MIN 的 0 字节串压缩：定长字符串属性没用到的
+// 部分都是 0，存储时被去掉，读出时再补回。编码由若干段组成，每段是
+// 两个 unsigned short (字面字节数、其后的 0 字节数) 加上字面字节，
+// 最后一段之后到记录结尾都是 0。编码后最多比记录长 RM_ENCODE_SLACK 字节。
+//
+struct RM_SlotPageHdr {
+    int nextFreePage;   // 与 RM_PageHdr 相同，空闲页链表
+    int numSlots;       // 槽目录中的槽数
+    int tupleStart;     // 记录区的开始，记录区一直延伸到页尾
+    int freeBytes;      // 空闲的字节数，包括记录区中的空洞
+};
+
+struct RM_Slot {
+    unsigned short offset;  // 记录在页中的偏移，0 表示空槽
+    unsigned short length;  // 记录的长度
+};
+
+enum RM_TupleKind {
+    RM_TUPLE_HOME = 0,
+    RM_TUPLE_FORWARD,
+    RM_TUPLE_MOVED
+};
+
+// FORWARD 的长度，每条记录至少这么长，原地改成 FORWARD 时总能放下
+#define RM_TUPLE_MIN        (1 + (int)sizeof(PageNum) + (int)sizeof(SlotNum))
+#define RM_ZERO_RUN_MIN     8
+#define RM_ENCODE_SLACK     4
+
+// 把 recordSize 字节的记录编码到 pOut (至少 recordSize + RM_ENCODE_SLACK
+// 字节)，返回编码后的长度
+int RM_EncodeRecord(const char *pRecord, int recordSize, char *pOut);
+// 把 length 字节的编码解码成 recordSize 字节的记录
+void RM_DecodeRecord(const char *pIn, int length, char *pRecord,
+                     int recordSize);
+
+//
+// RM_SlotPage: 槽页格式的一个页面
+//
+class RM_SlotPage {
+public:
+    RM_SlotPage (char *pData, int dataSize) : pData_(pData),
+        dataSize_(dataSize) {}
+
+    // 初始化一个新页面
+    void Init      ();
+    RM_SlotPageHdr *Hdr() const { return (RM_SlotPageHdr *)pData_; }
+
+    // 槽 slot 中的记录，空槽返回 FALSE
+    Boolean Get    (SlotNum slot, char *&pTuple, int &length) const;
+    // 一个可用的槽：第一个空槽，没有时为 numSlots
+    SlotNum FreeSlot() const;
+    // 能否在 (空的) 槽 slot 中放下 length 字节的记录，slot 可以超出槽目录
+    Boolean Fits   (SlotNum slot, int length) const;
+    // 在槽 slot 中分配 length 字节，必要时先整理碎片，返回记录的位置
+    // 调用前 Fits 必须成立
+    char *Put      (SlotNum slot, int length);
+    // 清空槽 slot
+    void Remove    (SlotNum slot);
+    // 把槽 slot 中的记录缩短为 length 字节
+    void Shrink    (SlotNum slot, int length);
+
+private:
+    RM_Slot *Slots () const {
+        return (RM_Slot *)(pData_ + sizeof(RM_SlotPageHdr));
+    }
+    // 把记录紧凑地移到页尾
+    void Compact   ();
+
+    char *pData_;
+    int dataSize_;
+};
+
+//
+// 扫描条件的批量比较 (见 RM_FilterLevel)
+//
+// 把 count 个 (8 的倍数) 属性与 *pValue 比较，第 i 个属性位于
+// pAttr + i * stride。pLive 与 pMatch 是与页面 bitmap 相同的位图，
+// 满足条件且 pLive 中置位的属性在 pMatch 中置位，pLive 为 0 的字节跳过。
+// attrType 为 INT 或 FLOAT，compOp 不能是 NO_OP
+//
+void RM_Filter(AttrType attrType, CompOp compOp, const char *pAttr,
+               int stride, int count, const void *pValue,
+               const unsigned char *pLive, unsigned char *pMatch);
+
+#endif
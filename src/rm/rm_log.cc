@@ -0,0 +1,413 @@
+#include "rm.h"
+#include "rm_internal.h"
+#include "rm_log.h"
+
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+
+// 计算 [pData, pData + length) 的 FNV-1a 校验和
+static unsigned int Checksum(const char *pData, int length) {
+    unsigned int h = 2166136261u;
+    for(int i = 0; i < length; i++) {
+        h ^= (unsigned char)pData[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+RM_Log::RM_Log () : fd_(-1), fileEnd_(0), zeroedEnd_(0), appendedLsn_(0),
+    flushedLsn_(0), flushing_(false) {}
+
+RM_Log::~RM_Log() {
+    if(fd_ >= 0)
+        close(fd_);
+}
+
+RC RM_Log::Open (const char *logName) {
+    if(fd_ >= 0)
+        return RM_FILE_ALREADY_OPENED;
+
+    int fd = open(logName, O_RDWR | O_CREAT, 0600);
+    if(fd < 0)
+        return RM_LOG_UNIX;
+
+    // 找到最后一条完整的提交记录的结尾，其后的记录要么不完整，要么未提交
+    // 预先写的零的 length 为 0，也在这里结束
+    std::vector<char> buf;
+    long long end = 0, committed = 0;
+    for(;;) {
+        RM_LogRecHdr hdr;
+        if(pread(fd, &hdr, sizeof(hdr), end) != sizeof(hdr)
+            || hdr.length < (int)sizeof(hdr))
+            break;
+        buf.resize(hdr.length);
+        if(pread(fd, buf.data(), hdr.length, end) != hdr.length
+            || Checksum(buf.data() + sizeof(unsigned int),
+                        hdr.length - sizeof(unsigned int)) != hdr.checksum)
+            break;
+        end += hdr.length;
+        if(hdr.type == RM_LOG_COMMIT)
+            committed = end;
+    }
+    if(ftruncate(fd, committed) < 0) {
+        close(fd);
+        return RM_LOG_UNIX;
+    }
+
+    std::lock_guard<std::mutex> guard(latch_);
+    fd_ = fd;
+    fileEnd_ = committed;
+    zeroedEnd_ = committed;
+    pending_.clear();
+    return OK_RC;
+}
+
+RC RM_Log::Close () {
+    std::unique_lock<std::mutex> guard(latch_);
+    if(fd_ < 0)
+        return RM_LOG_NOT_OPENED;
+
+    // 等待正在进行的写日志结束
+    flushed_.wait(guard, [this] { return !flushing_; });
+    if(close(fd_) < 0) {
+        fd_ = -1;
+        return RM_LOG_UNIX;
+    }
+    fd_ = -1;
+    pending_.clear();
+    return OK_RC;
+}
+
+RC RM_Log::Register (const char *fileName, RM_FileHandle *pFileHandle,
+                     int &fileNo) {
+    std::lock_guard<std::mutex> guard(latch_);
+    if(fd_ < 0)
+        return RM_LOG_NOT_OPENED;
+
+    // 第一次见到的文件名，分配一个编号
+    std::map<std::string, int>::iterator it = fileNos_.find(fileName);
+    if(it == fileNos_.end()) {
+        fileNo = (int)names_.size();
+        fileNos_[fileName] = fileNo;
+        names_.push_back(fileName);
+        logged_.push_back(false);
+    }
+    else
+        fileNo = it->second;
+
+    LogFileNo(fileNo);
+    files_[pFileHandle] = fileNo;
+    return OK_RC;
+}
+
+void RM_Log::LogFileNo (int fileNo) {
+    if(logged_[fileNo])
+        return;
+    AppendLocked(RM_LOG_FILE, fileNo, 0, 0, names_[fileNo].c_str(),
+                 names_[fileNo].size());
+    logged_[fileNo] = true;
+}
+
+RC RM_Log::Unregister (RM_FileHandle *pFileHandle) {
+    int rc = OK_RC, ret;
+    std::lock_guard<std::mutex> guard(latch_);
+    files_.erase(pFileHandle);
+
+    // CloseFile 不会关闭有未提交修改的文件，这里通常没有要放开的 pin
+    std::vector<PageNum> &dirty = pFileHandle->dirtyPages_;
+    for(size_t i = 0; i < dirty.size(); i++)
+        if((ret = pFileHandle->pfFH_.UnpinPage(dirty[i])) && !rc)
+            rc = ret;
+    dirty.clear();
+    if((ret = Release(pFileHandle, appendedLsn_)) && !rc)
+        rc = ret;
+    return rc;
+}
+
+bool RM_Log::Holds (RM_FileHandle *pFileHandle) {
+    std::lock_guard<std::mutex> guard(latch_);
+    if(!pFileHandle->dirtyPages_.empty())
+        return true;
+    std::map<std::pair<RM_FileHandle*, PageNum>, long long>::iterator it =
+        held_.lower_bound(std::make_pair(pFileHandle, (PageNum)0));
+    return it != held_.end() && it->first.first == pFileHandle;
+}
+
+RC RM_Log::Release (RM_FileHandle *pFileHandle, long long lsn) {
+    int rc = OK_RC, ret;
+    std::map<std::pair<RM_FileHandle*, PageNum>, long long>::iterator it;
+    for(it = held_.begin(); it != held_.end(); ) {
+        if((pFileHandle && it->first.first != pFileHandle)
+            || it->second > lsn) {
+            ++it;
+            continue;
+        }
+        if((ret = it->first.first->pfFH_.UnpinPage(it->first.second)) && !rc)
+            rc = ret;
+        held_.erase(it++);
+    }
+    return rc;
+}
+
+long long RM_Log::AppendLocked (int type, int fileNo, PageNum pageNum,
+                                SlotNum slotNum, const char *pData,
+                                int length) {
+    RM_LogRecHdr hdr;
+    hdr.length = sizeof(hdr) + length;
+    hdr.type = type;
+    hdr.fileNo = fileNo;
+    hdr.pageNum = pageNum;
+    hdr.slotNum = slotNum;
+
+    size_t start = pending_.size();
+    pending_.resize(start + hdr.length);
+    char *pRec = pending_.data() + start;
+    memcpy(pRec, &hdr, sizeof(hdr));
+    if(length > 0)
+        memcpy(pRec + sizeof(hdr), pData, length);
+    hdr.checksum = Checksum(pRec + sizeof(unsigned int),
+                            hdr.length - sizeof(unsigned int));
+    memcpy(pRec, &hdr.checksum, sizeof(unsigned int));
+
+    appendedLsn_ += hdr.length;
+    return appendedLsn_;
+}
+
+RC RM_Log::Reserve (RM_FileHandle *pFileHandle, int numPages) {
+    int rc, limit;
+    if((rc = pFileHandle->pfFH_.GetPinLimit(limit)))
+        return rc;
+
+    // 所有文件持有的页面都算上，它们可能和这个文件的页面在同一片中
+    std::lock_guard<std::mutex> guard(latch_);
+    if((long long)held_.size() + pFileHandle->dirtyPages_.size() + numPages
+        + RM_LOG_SPARE_PAGES > limit)
+        return RM_LOG_FULL;
+    return OK_RC;
+}
+
+RC RM_Log::Append (RM_FileHandle *pFileHandle, int type, PageNum pageNum,
+                   SlotNum slotNum, const char *pData, int length) {
+    int rc = OK_RC, ret;
+    std::lock_guard<std::mutex> guard(latch_);
+    if(fd_ < 0)
+        return RM_LOG_NOT_OPENED;
+    long long lsn = AppendLocked(type, pFileHandle->logFileNo_, pageNum,
+                                 slotNum, pData, length);
+
+    // 这条记录修改过的页面要等它提交后才能写回，已经持有的页面不必再 pin
+    std::vector<PageNum> &dirty = pFileHandle->dirtyPages_;
+    for(size_t i = 0; i < dirty.size(); i++) {
+        std::pair<RM_FileHandle*, PageNum> key(pFileHandle, dirty[i]);
+        std::map<std::pair<RM_FileHandle*, PageNum>, long long>::iterator it =
+            held_.find(key);
+        if(it == held_.end())
+            held_[key] = lsn;
+        else {
+            it->second = lsn;
+            if((ret = pFileHandle->pfFH_.UnpinPage(dirty[i])) && !rc)
+                rc = ret;
+        }
+    }
+    dirty.clear();
+    return rc;
+}
+
+RC RM_Log::WriteAll (const std::vector<char> &buf) {
+    // 不够时先用零把文件扩展一段，它和这次的记录一起被 fdatasync
+    if(fileEnd_ + (long long)buf.size() > zeroedEnd_) {
+        long long end = fileEnd_ + buf.size() + RM_LOG_CHUNK;
+        std::vector<char> zeros(end - zeroedEnd_, 0);
+        for(size_t done = 0; done < zeros.size(); ) {
+            ssize_t n = pwrite(fd_, zeros.data() + done, zeros.size() - done,
+                               zeroedEnd_ + done);
+            if(n < 0 && errno == EINTR)
+                continue;
+            if(n <= 0)
+                return RM_LOG_UNIX;
+            done += n;
+        }
+        zeroedEnd_ = end;
+    }
+
+    size_t done = 0;
+    while(done < buf.size()) {
+        ssize_t n = pwrite(fd_, buf.data() + done, buf.size() - done,
+                           fileEnd_ + done);
+        if(n < 0 && errno == EINTR)
+            continue;
+        if(n <= 0)
+            return RM_LOG_UNIX;
+        done += n;
+    }
+    fileEnd_ += done;
+    return OK_RC;
+}
+
+RC RM_Log::Commit () {
+    std::unique_lock<std::mutex> guard(latch_);
+    if(fd_ < 0)
+        return RM_LOG_NOT_OPENED;
+
+    long long lsn = AppendLocked(RM_LOG_COMMIT, 0, 0, 0, NULL, 0);
+
+    // 已经有线程在写日志时，等它写完；如果它没有带上本次的提交记录，
+    // 由醒来的第一个线程把这段时间内所有线程追加的记录一次写出
+    while(flushedLsn_ < lsn) {
+        if(flushing_) {
+            flushed_.wait(guard);
+            continue;
+        }
+
+        std::vector<char> buf;
+        buf.swap(pending_);
+        long long target = appendedLsn_;
+        long long start = fileEnd_;
+        flushing_ = true;
+        guard.unlock();
+
+        RC rc = WriteAll(buf);
+        if(!rc && fdatasync(fd_) < 0)
+            rc = RM_LOG_UNIX;
+
+        guard.lock();
+        flushing_ = false;
+        if(!rc) {
+            flushedLsn_ = target;
+            // 已提交的修改可以写回了
+            rc = Release(NULL, target);
+        }
+        else {
+            // 这些记录不知道是否已在磁盘上，放回 pending_ 的前面，
+            // 下一次写日志从同一位置把它们重新写出并 fdatasync
+            fileEnd_ = start;
+            pending_.insert(pending_.begin(), buf.begin(), buf.end());
+        }
+        flushed_.notify_all();
+        if(rc)
+            return rc;
+    }
+    return OK_RC;
+}
+
+RC RM_Log::Truncate () {
+    int rc;
+    pending_.clear();
+    if(ftruncate(fd_, 0) < 0)
+        return RM_LOG_UNIX;
+    fileEnd_ = 0;
+    zeroedEnd_ = 0;
+    flushedLsn_ = appendedLsn_;
+    if((rc = Release(NULL, appendedLsn_)))
+        return rc;
+
+    // 新的日志先给出仍然登记的文件的编号，之后的记录才能找到它们
+    logged_.assign(logged_.size(), false);
+    for(std::map<RM_FileHandle*, int>::iterator it = files_.begin();
+        it != files_.end(); ++it)
+        LogFileNo(it->second);
+
+    return OK_RC;
+}
+
+RC RM_Log::Checkpoint () {
+    int rc;
+    std::unique_lock<std::mutex> guard(latch_);
+    if(fd_ < 0)
+        return RM_LOG_NOT_OPENED;
+    flushed_.wait(guard, [this] { return !flushing_; });
+
+    // 有未提交修改的页面不能写回，而它们中已提交的修改还只在日志中，
+    // 所以只写回其余的页面，日志 (包括 pending_ 中未提交的记录) 原样保留
+    bool uncommitted = !held_.empty();
+    std::map<RM_FileHandle*, int>::iterator it;
+    for(it = files_.begin(); it != files_.end(); ++it)
+        if(!it->first->dirtyPages_.empty())
+            uncommitted = true;
+    if(uncommitted) {
+        for(it = files_.begin(); it != files_.end(); ++it)
+            if((rc = it->first->FlushPages()))
+                return rc;
+        return RM_UNCOMMITTED;
+    }
+
+    // 先把文件写到磁盘上，此后日志中的记录都不再需要
+    for(it = files_.begin(); it != files_.end(); ++it)
+        if((rc = it->first->SyncPages()))
+            return rc;
+
+    return Truncate();
+}
+
+RC RM_Log::Recover (RM_Manager &rmm) {
+    int rc;
+    std::vector<char> buf;
+
+    {
+        std::unique_lock<std::mutex> guard(latch_);
+        if(fd_ < 0)
+            return RM_LOG_NOT_OPENED;
+        flushed_.wait(guard, [this] { return !flushing_; });
+        buf.resize(fileEnd_);
+        if(pread(fd_, buf.data(), fileEnd_, 0) != fileEnd_)
+            return RM_LOG_UNIX;
+    }
+
+    // Open 已经截掉了不完整和未提交的记录，这里的记录都是完整的
+    // 已经被删除的文件打不开，它的记录被跳过
+    std::map<int, std::string> names;
+    std::map<int, RM_FileHandle*> handles;
+    RC ret = OK_RC;
+    for(size_t off = 0; off < buf.size() && !ret; ) {
+        RM_LogRecHdr hdr;
+        memcpy(&hdr, buf.data() + off, sizeof(hdr));
+        const char *pData = buf.data() + off + sizeof(hdr);
+        int length = hdr.length - sizeof(hdr);
+        off += hdr.length;
+
+        if(hdr.type == RM_LOG_FILE) {
+            names[hdr.fileNo] = std::string(pData, length);
+            continue;
+        }
+        if(hdr.type == RM_LOG_COMMIT)
+            continue;
+
+        if(handles.find(hdr.fileNo) == handles.end()) {
+            RM_FileHandle *pFH = new RM_FileHandle;
+            if(rmm.OpenFile(names[hdr.fileNo].c_str(), *pFH)) {
+                delete pFH;
+                pFH = NULL;
+            }
+            else if(pFH->pLog_) {
+                // 重做的修改不能再记录到日志中
+                pFH->pLog_->Unregister(pFH);
+                pFH->pLog_ = NULL;
+            }
+            handles[hdr.fileNo] = pFH;
+        }
+        if(handles[hdr.fileNo])
+            ret = handles[hdr.fileNo]->RedoRec(hdr.type, hdr.pageNum,
+                                               hdr.slotNum, pData, length);
+    }
+
+    // 重建空闲页链表后写回并关闭文件
+    for(std::map<int, RM_FileHandle*>::iterator it = handles.begin();
+        it != handles.end(); ++it) {
+        RM_FileHandle *pFH = it->second;
+        if(!pFH)
+            continue;
+        if(!ret)
+            ret = pFH->RebuildFreeList();
+        if(!ret)
+            ret = pFH->SyncPages();
+        if((rc = rmm.CloseFile(*pFH)) && !ret)
+            ret = rc;
+        delete pFH;
+    }
+    if(ret)
+        return ret;
+
+    std::lock_guard<std::mutex> guard(latch_);
+    return Truncate();
+}
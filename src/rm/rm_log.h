@@ -0,0 +1,143 @@
+//
+// rm_log.h
+//
+//   RM 的 redo 日志 (write-ahead log)
+//
+// 原先要让一条语句落盘只能调用 ForcePages，它会把整个 4 KiB 的页面写回到
+// 文件中它所在的位置，每条语句都是整页的随机写。
+// RM_Manager::SetLog 之后打开的文件，InsertRec / DeleteRec / UpdateRec
+// 会向 RM_Log 追加一条很短的 redo 记录 (文件编号、RID 和记录内容)。
+// Commit 追加一条提交记录并把日志 fdatasync 到磁盘，同时在等待的多个线程
+// 只需要一次 fdatasync (group commit)。数据页面则在提交之后由 buffer
+// 按需写回。
+//
+// 崩溃之后，Open 丢弃日志末尾不完整或者未提交的记录，Recover 按顺序重做
+// 其余的记录，重建每个文件的空闲页链表，把文件写到磁盘之后清空日志。
+// Checkpoint 把所有打开的文件写到磁盘之后清空日志，让日志不会无限增长；
+// 记录日志的文件在 CloseFile 时也会写到磁盘上。
+//
+// 日志只有 redo，没有 undo，所以未提交的修改不能先于提交写回 (no-steal)：
+// 记录日志的文件修改页面时再 pin 住它一次，Append 把这些 pin 交给日志，
+// 直到写出了最后修改页面的那条记录的 Commit 成功后才放开。pin 住的页面
+// 不会被替换，也不会被后台写回，所以未提交的修改最多能占满 buffer
+// (分片的 buffer 中是最小的一片，见 PF_FileHandle::GetPinLimit)。
+// 修改记录之前先检查剩下的页面够不够这次修改 pin 住，不够时在改动任何
+// 页面之前返回 RM_LOG_FULL，要先 Commit。
+// 有未提交的修改时，Checkpoint 只写回其余的页面，并且保留日志，因为
+// pin 住的页面中已提交的修改还只在日志中；
+// CloseFile 和 DestroyFile 则返回 RM_UNCOMMITTED，要先 Commit。
+// 只有 RM_FileHandle 的 ForcePages 和 SyncPages 会带上未提交的修改，
+// 之后它们不能再被丢弃。用 mmap 访问的文件由操作系统写回，不受这条规则
+// 保护。
+//
+
+#ifndef RM_LOG_H
+#define RM_LOG_H
+
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+#include "rm.h"
+
+// 日志记录的类型
+enum RM_LogRecType {
+    RM_LOG_FILE = 1,    // 给文件名分配一个文件编号，数据为文件名
+    RM_LOG_INSERT,      // 在 RID 处插入记录，数据为记录内容
+    RM_LOG_DELETE,      // 删除 RID 处的记录，没有数据
+    RM_LOG_UPDATE,      // 更新 RID 处的记录，数据为记录内容
+    RM_LOG_COMMIT       // 之前的记录都已提交，没有数据
+};
+
+// 日志文件每次预先写零扩展的长度。写入文件已有的部分时，fdatasync 不必
+// 再提交文件长度的变化，这样它才和覆盖写一个页面一样快。
+const int RM_LOG_CHUNK = 1 << 20;
+
+// 未提交的修改占满 buffer 之前，Reserve 为读取记录留下的页面数
+const int RM_LOG_SPARE_PAGES = 1;
+
+// 每条日志记录的头部，后面紧跟 length - sizeof(RM_LogRecHdr) 字节的数据
+struct RM_LogRecHdr {
+    unsigned int checksum;  // 除 checksum 外整条记录的校验和
+    int length;             // 整条记录的长度
+    int type;               // RM_LogRecType
+    int fileNo;             // 文件编号
+    PageNum pageNum;
+    SlotNum slotNum;
+};
+
+//
+// RM_Log: redo 日志
+//
+class RM_Log {
+public:
+    RM_Log ();
+    ~RM_Log();
+
+    // 打开 (必要时创建) 日志文件，截掉末尾不完整或未提交的记录
+    RC Open      (const char *logName);
+    // 关闭日志，不会提交尚未提交的记录
+    RC Close     ();
+
+    // 提交到目前为止追加的所有记录，返回时它们已在磁盘上。
+    // 出错时这些记录留在日志中，之后的 Commit 会再次写出它们
+    RC Commit    ();
+    // 写回所有登记的文件并清空日志，此时不能有别的线程在修改这些文件。
+    // 有未提交的修改时只写回其余的页面，保留日志并返回 RM_UNCOMMITTED
+    RC Checkpoint();
+    // 重做日志中已提交的记录并清空日志，应在打开任何要记录日志的文件之前调用
+    RC Recover   (RM_Manager &rmm);
+
+private:
+    friend class RM_Manager;
+    friend class RM_FileHandle;
+
+    // RM_Manager::OpenFile / CloseFile 登记文件，返回其文件编号。
+    // Unregister 放开为这个文件持有的 pin
+    RC Register  (const char *fileName, RM_FileHandle *pFileHandle,
+                  int &fileNo);
+    RC Unregister (RM_FileHandle *pFileHandle);
+    // pFileHandle 是否有未提交的修改
+    bool Holds   (RM_FileHandle *pFileHandle);
+    // RM_FileHandle 修改记录之前检查 buffer 中是否还能再 pin 住 numPages
+    // 个页面，不能时返回 RM_LOG_FULL，而不是在修改到一半时得到 PF_NOBUF
+    RC Reserve   (RM_FileHandle *pFileHandle, int numPages);
+    // RM_FileHandle 追加一条记录，接过它修改过的页面的 pin
+    RC Append    (RM_FileHandle *pFileHandle, int type, PageNum pageNum,
+                  SlotNum slotNum, const char *pData, int length);
+
+    // 在 latch 持有时把一条记录放进 pending_，返回它之后的 LSN
+    long long AppendLocked (int type, int fileNo, PageNum pageNum,
+                            SlotNum slotNum, const char *pData, int length);
+    // 在 latch 持有时确保 fileNo 的 RM_LOG_FILE 记录在当前日志中
+    void LogFileNo (int fileNo);
+    // 在 latch 持有时放开 pFileHandle (NULL 表示所有文件) 中最后修改
+    // 不晚于 lsn 的页面
+    RC Release   (RM_FileHandle *pFileHandle, long long lsn);
+    // 在 latch 持有时清空日志，并为登记的文件重新写出 RM_LOG_FILE 记录
+    RC Truncate  ();
+    // 把 buf 写到日志文件末尾
+    RC WriteAll  (const std::vector<char> &buf);
+
+    int fd_;                                    // 日志文件，-1 表示未打开
+    long long fileEnd_;                         // 日志记录的结尾
+    long long zeroedEnd_;                       // 文件中已写零的部分的结尾
+    std::vector<char> pending_;                 // 尚未写出的记录
+    long long appendedLsn_;                     // 追加的字节数，即 LSN
+    long long flushedLsn_;                      // 已经 fdatasync 的 LSN
+    bool flushing_;                             // 是否有线程正在写日志
+    std::map<std::string, int> fileNos_;        // 文件名 -> 文件编号
+    std::vector<std::string> names_;            // 文件编号 -> 文件名
+    std::vector<bool> logged_;                  // 编号的 RM_LOG_FILE 记录
+                                                // 是否在当前日志中
+    std::map<RM_FileHandle*, int> files_;       // 登记的文件 -> 文件编号
+    std::map<std::pair<RM_FileHandle*, PageNum>, long long> held_;
+                                                // 有未提交修改的页面 ->
+                                                // 最后修改它的记录的 LSN
+    std::mutex latch_;                          // 保护以上成员
+    std::condition_variable flushed_;           // 写日志结束时通知
+};
+
+#endif
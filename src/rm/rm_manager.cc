@@ -1,7 +1,8 @@
 #include "rm.h"
 #include "rm_internal.h"
+#include "rm_log.h"
 
-RM_Manager::RM_Manager(PF_Manager &pfm) : pfMgr_(pfm) {
+RM_Manager::RM_Manager(PF_Manager &pfm) : pfMgr_(pfm), pLog_(NULL) {
     // do nothing
 }
 
@@ -9,15 +10,22 @@ RM_Manager::~RM_Manager() {
     // do nothing
 }
 
-RC RM_Manager::CreateFile (const char *fileName, int recordSize) {
+RC RM_Manager::CreateFile (const char *fileName, int recordSize, int pageSize,
+                           RM_FileFormat format) {
     int rc;
+    int dataSize = PF_PageDataSize(pageSize);
 
     if(recordSize <= 0)
         return RM_SMALL_RECORDSIZE;
-    if(recordSize >= PF_PAGE_SIZE - sizeof(RM_PageHdr))
+    if(recordSize >= dataSize - (int)sizeof(RM_PageHdr))
+        return RM_LARGE_RECORDSIZE;
+    // 槽页格式中，搬来的记录加上它的槽要能放进一个空页面
+    if(format == RM_FORMAT_SLOTTED
+        && (int)sizeof(RM_Slot) + RM_TUPLE_MIN + recordSize + RM_ENCODE_SLACK
+            > dataSize - (int)sizeof(RM_SlotPageHdr))
         return RM_LARGE_RECORDSIZE;
 
-    if((rc = pfMgr_.CreateFile(fileName)))
+    if((rc = pfMgr_.CreateFile(fileName, pageSize)))
         return rc;
 
     PF_FileHandle pfFH;
@@ -40,12 +48,20 @@ RC RM_Manager::CreateFile (const char *fileName, int recordSize) {
     hdr.recordSize = recordSize;
     hdr.numPages = 0;
     hdr.nextFreePage = RM_NO_FREE_PAGE;
+    hdr.format = format;
 
-    // 计算每页中可存放的记录数量
-    // recordSize*x(records) + x/8(bitmap) <= 4088(freePageSize)
-    int records = 8 * (PF_PAGE_SIZE - sizeof(RM_PageHdr)) / (8 * recordSize + 1);
-    // records 向下取8的倍数
-    hdr.numRecordsPerPage = (records / 8) * 8; 
+    if(format == RM_FORMAT_SLOTTED) {
+        // 槽数的上限：每条记录最短为 RM_TUPLE_MIN
+        hdr.numRecordsPerPage = (dataSize - sizeof(RM_SlotPageHdr))
+            / (sizeof(RM_Slot) + RM_TUPLE_MIN);
+    }
+    else {
+        // 计算每页中可存放的记录数量
+        // recordSize*x(records) + x/8(bitmap) <= dataSize - sizeof(RM_PageHdr)
+        int records = 8 * (dataSize - sizeof(RM_PageHdr)) / (8 * recordSize + 1);
+        // records 向下取8的倍数
+        hdr.numRecordsPerPage = (records / 8) * 8; 
+    }
 
     memcpy(pData, &hdr, sizeof(RM_FileHdr));
     if((rc = pfFH.MarkDirty(pageNum)))
@@ -61,6 +77,13 @@ RC RM_Manager::CreateFile (const char *fileName, int recordSize) {
 }
 
 RC RM_Manager::DestroyFile(const char *fileName) {
+    int rc;
+
+    // 日志中不能留下这个文件的记录，否则它们会被重做到之后的同名文件中。
+    // 还有未提交的修改时日志不能清空，Checkpoint 返回 RM_UNCOMMITTED
+    if(pLog_ && (rc = pLog_->Checkpoint()))
+        return rc;
+
     return pfMgr_.DestroyFile(fileName);
 }
 
@@ -94,6 +117,14 @@ RC RM_Manager::OpenFile (const char *fileName, RM_FileHandle &fileHandle) {
     if((rc = pfFH.UnpinPage(pageNum)))
         return rc;
 
+    // 之后对该文件的修改都记录到日志中
+    fileHandle.pLog_ = pLog_;
+    if(pLog_ && (rc = pLog_->Register(fileName, &fileHandle,
+                                      fileHandle.logFileNo_))) {
+        fileHandle.pLog_ = NULL;
+        return rc;
+    }
+
     return OK_RC;
 }
 
@@ -103,6 +134,10 @@ RC RM_Manager::CloseFile (RM_FileHandle &fileHandle) {
     if(!fileHandle.isOpened_)
         return RM_FILE_NOT_OPENED;
 
+    // 未提交的修改既不能写回，也不能随着关闭文件丢掉，要先 Commit
+    if(fileHandle.pLog_ && fileHandle.pLog_->Holds(&fileHandle))
+        return RM_UNCOMMITTED;
+
     if(fileHandle.modified_) {
         PF_PageHandle pfPH;
 
@@ -126,10 +161,25 @@ RC RM_Manager::CloseFile (RM_FileHandle &fileHandle) {
             return rc;
     }
 
+    // 之后的 Checkpoint 不会再写回这个文件，所以现在就把它写到磁盘上。
+    // 它的修改都已提交，日志不再 pin 住它的页面
+    if(fileHandle.pLog_) {
+        if((rc = fileHandle.pfFH_.SyncPages()))
+            return rc;
+        rc = fileHandle.pLog_->Unregister(&fileHandle);
+        fileHandle.pLog_ = NULL;
+        if(rc)
+            return rc;
+    }
+
     if((rc = pfMgr_.CloseFile(fileHandle.pfFH_)))
         return rc;
     
     fileHandle.isOpened_ = FALSE;
     fileHandle.modified_ = FALSE;
     return OK_RC;
+}
+
+void RM_Manager::SetLog (RM_Log *pLog) {
+    pLog_ = pLog;
 }
\ No newline at end of file
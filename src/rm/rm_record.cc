@@ -2,38 +2,38 @@
 
 RM_Record::RM_Record () : isValid_(FALSE), pData_(NULL) {}
 
-RM_Record::RM_Record (const RM_Record& r) {
-    size_ = r.size_;
-    rid_ = r.rid_;
-    isValid_ = r.isValid_;
-
-    if(isValid_) {
-        char *pData_ = new char[size_];
-        memcpy(pData_, r.pData_, size_);
-    }
+RM_Record::RM_Record (const RM_Record& r) : pData_(NULL), isValid_(FALSE) {
+    if(r.isValid_)
+        SetData(r.pData_, r.size_, r.rid_);
 }
 
 RM_Record& RM_Record::operator= (const RM_Record &r)
 {
 	if (this != &r) {
-        size_ = r.size_;
-        rid_ = r.rid_;
-        isValid_ = r.isValid_;
-
-        if(isValid_) {
-            char *pData_ = new char[size_];
-            memcpy(pData_, r.pData_, size_);
-        }
+        if(r.isValid_)
+            SetData(r.pData_, r.size_, r.rid_);
+        else
+            isValid_ = FALSE;
 	}
 
 	return (*this);
 }
 
 RM_Record::~RM_Record() {
-    if(isValid_) {
+    delete[] pData_;
+    isValid_ = FALSE;
+}
+
+void RM_Record::SetData(const char *pData, size_t size, const RID &rid) {
+    // 扫描时每条记录都复制到这里，大小相同时不必重新分配
+    if(!pData_ || size_ != size) {
         delete[] pData_;
-        isValid_ = FALSE;
+        pData_ = new char[size];
     }
+    memcpy(pData_, pData, size);
+    size_ = size;
+    rid_ = rid;
+    isValid_ = TRUE;
 }
 
 RC RM_Record::GetData(char *&pData) const {
@@ -48,4 +48,4 @@ RC RM_Record::GetRid (RID &rid) const {
         return RM_RECORD_INVALID;
     rid = rid_;
     return OK_RC;
-}
\ No newline at end of file
+}
@@ -0,0 +1,49 @@
+#include "rm.h"
+
+RM_RecordBatch::RM_RecordBatch () : count_(0), capacity_(0), pRecords_(NULL),
+    rids_(NULL), buf_(NULL), bufSize_(0) {}
+
+RM_RecordBatch::~RM_RecordBatch () {
+    // page_ 析构时会 unpin 页面
+    delete[] pRecords_;
+    delete[] rids_;
+    delete[] buf_;
+}
+
+int RM_RecordBatch::GetCount () const {
+    return count_;
+}
+
+RC RM_RecordBatch::GetData (int i, char *&pData) const {
+    if(i < 0 || i >= count_)
+        return RM_RECORD_INVALID;
+    pData = pRecords_[i];
+    return OK_RC;
+}
+
+RC RM_RecordBatch::GetRid (int i, RID &rid) const {
+    if(i < 0 || i >= count_)
+        return RM_RECORD_INVALID;
+    rid = rids_[i];
+    return OK_RC;
+}
+
+RC RM_RecordBatch::Release () {
+    count_ = 0;
+    return page_.Release();
+}
+
+void RM_RecordBatch::Reserve (int capacity, int recordSize) {
+    if(capacity > capacity_) {
+        delete[] pRecords_;
+        delete[] rids_;
+        pRecords_ = new char *[capacity];
+        rids_ = new RID[capacity];
+        capacity_ = capacity;
+    }
+    if(capacity * recordSize > bufSize_) {
+        delete[] buf_;
+        buf_ = new char[capacity * recordSize];
+        bufSize_ = capacity * recordSize;
+    }
+}
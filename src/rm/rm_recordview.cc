@@ -0,0 +1,30 @@
+#include "rm.h"
+
+RM_RecordView::RM_RecordView () : pFH_(NULL), pageNum_(-1), pData_(NULL),
+    buf_(NULL), bufSize_(0), isValid_(FALSE) {}
+
+RM_RecordView::~RM_RecordView () {
+    // page_ 析构时会 unpin 页面
+    delete[] buf_;
+}
+
+RC RM_RecordView::GetData (char *&pData) const {
+    if(!isValid_)
+        return RM_RECORD_INVALID;
+    pData = pData_;
+    return OK_RC;
+}
+
+RC RM_RecordView::GetRid (RID &rid) const {
+    if(!isValid_)
+        return RM_RECORD_INVALID;
+    rid = rid_;
+    return OK_RC;
+}
+
+RC RM_RecordView::Release () {
+    isValid_ = FALSE;
+    pFH_ = NULL;
+    pageNum_ = -1;
+    return page_.Release();
+}
@@ -0,0 +1,149 @@
+#include "rm.h"
+#include "rm_internal.h"
+
+#include <vector>
+
+int RM_EncodeRecord(const char *pRecord, int recordSize, char *pOut) {
+    int out = 0;
+    int i = 0;
+
+    while(i < recordSize) {
+        // 找到下一段足够长的 0，或者延伸到记录结尾的 0
+        int litEnd = i, zeroEnd = i;
+        while(litEnd < recordSize) {
+            if(pRecord[litEnd] != 0) {
+                litEnd++;
+                continue;
+            }
+            zeroEnd = litEnd;
+            while(zeroEnd < recordSize && pRecord[zeroEnd] == 0)
+                zeroEnd++;
+            if(zeroEnd - litEnd >= RM_ZERO_RUN_MIN || zeroEnd == recordSize)
+                break;
+            litEnd = zeroEnd;
+        }
+        if(litEnd == recordSize)
+            zeroEnd = recordSize;
+
+        unsigned short lit = litEnd - i, zeros = zeroEnd - litEnd;
+        memcpy(pOut + out, &lit, sizeof(lit));
+        memcpy(pOut + out + sizeof(lit), &zeros, sizeof(zeros));
+        memcpy(pOut + out + 2 * sizeof(lit), pRecord + i, lit);
+        out += 2 * sizeof(lit) + lit;
+        i = zeroEnd;
+    }
+    return out;
+}
+
+void RM_DecodeRecord(const char *pIn, int length, char *pRecord,
+                     int recordSize) {
+    int in = 0, pos = 0;
+
+    // 记录末尾可能有补齐到 RM_TUPLE_MIN 的 0，它们解码为空段
+    while(in + 2 * (int)sizeof(unsigned short) <= length) {
+        unsigned short lit, zeros;
+        memcpy(&lit, pIn + in, sizeof(lit));
+        memcpy(&zeros, pIn + in + sizeof(lit), sizeof(zeros));
+        in += 2 * sizeof(lit);
+        if(lit > recordSize - pos || lit > length - in)
+            break;
+        memcpy(pRecord + pos, pIn + in, lit);
+        in += lit;
+        pos += lit;
+        if(zeros > recordSize - pos)
+            zeros = recordSize - pos;
+        memset(pRecord + pos, 0, zeros);
+        pos += zeros;
+    }
+    memset(pRecord + pos, 0, recordSize - pos);
+}
+
+void RM_SlotPage::Init () {
+    RM_SlotPageHdr *pHdr = Hdr();
+    pHdr->numSlots = 0;
+    pHdr->tupleStart = dataSize_;
+    pHdr->freeBytes = dataSize_ - sizeof(RM_SlotPageHdr);
+}
+
+Boolean RM_SlotPage::Get (SlotNum slot, char *&pTuple, int &length) const {
+    if(slot < 0 || slot >= Hdr()->numSlots || Slots()[slot].offset == 0)
+        return FALSE;
+    pTuple = pData_ + Slots()[slot].offset;
+    length = Slots()[slot].length;
+    return TRUE;
+}
+
+SlotNum RM_SlotPage::FreeSlot () const {
+    SlotNum slot;
+    for(slot = 0; slot < Hdr()->numSlots; slot++)
+        if(Slots()[slot].offset == 0)
+            break;
+    return slot;
+}
+
+Boolean RM_SlotPage::Fits (SlotNum slot, int length) const {
+    int newSlots = slot + 1 - Hdr()->numSlots;
+    if(newSlots < 0)
+        newSlots = 0;
+    return length + newSlots * (int)sizeof(RM_Slot) <= Hdr()->freeBytes;
+}
+
+char *RM_SlotPage::Put (SlotNum slot, int length) {
+    RM_SlotPageHdr *pHdr = Hdr();
+
+    // 扩展槽目录，其间的槽都是空槽
+    int newSlots = slot + 1 - pHdr->numSlots;
+    if(newSlots < 0)
+        newSlots = 0;
+    int dirEnd = sizeof(RM_SlotPageHdr)
+        + (pHdr->numSlots + newSlots) * sizeof(RM_Slot);
+    if(dirEnd + length > pHdr->tupleStart)
+        Compact();
+    for(; pHdr->numSlots <= slot; pHdr->numSlots++) {
+        Slots()[pHdr->numSlots].offset = 0;
+        Slots()[pHdr->numSlots].length = 0;
+    }
+
+    pHdr->tupleStart -= length;
+    pHdr->freeBytes -= length + newSlots * sizeof(RM_Slot);
+    Slots()[slot].offset = pHdr->tupleStart;
+    Slots()[slot].length = length;
+    return pData_ + pHdr->tupleStart;
+}
+
+void RM_SlotPage::Remove (SlotNum slot) {
+    RM_SlotPageHdr *pHdr = Hdr();
+
+    pHdr->freeBytes += Slots()[slot].length;
+    if(Slots()[slot].offset == pHdr->tupleStart)
+        pHdr->tupleStart += Slots()[slot].length;
+    Slots()[slot].offset = 0;
+    Slots()[slot].length = 0;
+
+    // 去掉槽目录末尾的空槽
+    while(pHdr->numSlots > 0 && Slots()[pHdr->numSlots - 1].offset == 0) {
+        pHdr->numSlots--;
+        pHdr->freeBytes += sizeof(RM_Slot);
+    }
+}
+
+void RM_SlotPage::Shrink (SlotNum slot, int length) {
+    Hdr()->freeBytes += Slots()[slot].length - length;
+    Slots()[slot].length = length;
+}
+
+void RM_SlotPage::Compact () {
+    RM_SlotPageHdr *pHdr = Hdr();
+    std::vector<char> copy(pData_, pData_ + dataSize_);
+
+    int end = dataSize_;
+    for(SlotNum slot = 0; slot < pHdr->numSlots; slot++) {
+        RM_Slot &s = Slots()[slot];
+        if(s.offset == 0)
+            continue;
+        end -= s.length;
+        memcpy(pData_ + end, copy.data() + s.offset, s.length);
+        s.offset = end;
+    }
+    pHdr->tupleStart = end;
+}
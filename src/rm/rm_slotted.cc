@@ -0,0 +1,449 @@
+#include "rm.h"
+#include "rm_internal.h"
+#include "rm_log.h"
+
+#include <vector>
+
+// 编码后长度为 codeLength 的记录，按 kind 存放时的长度
+static int TupleLength(int kind, int codeLength) {
+    int length = 1 + codeLength;
+    if(kind != RM_TUPLE_HOME)
+        length += sizeof(PageNum) + sizeof(SlotNum);
+    return length < RM_TUPLE_MIN ? RM_TUPLE_MIN : length;
+}
+
+// 在 pTuple 处写一条 length 字节的记录，FORWARD 与 MOVED 带上 RID
+static void WriteTuple(char *pTuple, int length, int kind, PageNum pageNum,
+                       SlotNum slotNum, const char *pCode, int codeLength) {
+    memset(pTuple, 0, length);
+    pTuple[0] = (char)kind;
+    char *p = pTuple + 1;
+    if(kind != RM_TUPLE_HOME) {
+        memcpy(p, &pageNum, sizeof(PageNum));
+        memcpy(p + sizeof(PageNum), &slotNum, sizeof(SlotNum));
+        p += sizeof(PageNum) + sizeof(SlotNum);
+    }
+    if(codeLength > 0)
+        memcpy(p, pCode, codeLength);
+}
+
+// FORWARD 与 MOVED 记录中的 RID
+static void ReadTupleRid(const char *pTuple, PageNum &pageNum,
+                         SlotNum &slotNum) {
+    memcpy(&pageNum, pTuple + 1, sizeof(PageNum));
+    memcpy(&slotNum, pTuple + 1 + sizeof(PageNum), sizeof(SlotNum));
+}
+
+// 记录中编码部分的开始
+static int CodeOffset(int kind) {
+    if(kind == RM_TUPLE_HOME)
+        return 1;
+    return 1 + sizeof(PageNum) + sizeof(SlotNum);
+}
+
+int RM_FileHandle::DataSize () const {
+    int dataSize;
+    if(pfFH_.GetPageSize(dataSize))
+        return PF_PAGE_SIZE;
+    return dataSize;
+}
+
+int RM_FileHandle::SlotReserve () const {
+    return sizeof(RM_Slot) + TupleLength(RM_TUPLE_MOVED,
+                                         fHdr_.recordSize + RM_ENCODE_SLACK);
+}
+
+void RM_FileHandle::UpdateFreeList (PageNum pageNum, char *pData) {
+    RM_SlotPageHdr *pHdr = (RM_SlotPageHdr *)pData;
+    if(pHdr->nextFreePage == RM_PAGE_FULL_USED
+        && pHdr->freeBytes >= SlotReserve()) {
+        pHdr->nextFreePage = fHdr_.nextFreePage;
+        fHdr_.nextFreePage = pageNum;
+        modified_ = TRUE;
+    }
+}
+
+RC RM_FileHandle::IsPaired (PageNum pageNum, SlotNum slotNum,
+                            const char *pTuple, Boolean &bPaired) const {
+    int rc;
+    PageNum otherPage;
+    SlotNum otherSlot;
+    PF_PageGuard page;
+    char *pData, *pOther;
+    int length;
+
+    bPaired = FALSE;
+    ReadTupleRid(pTuple, otherPage, otherSlot);
+    rc = pfFH_.GetThisPage(otherPage, page);
+    if(rc == PF_INVALIDPAGE)
+        return OK_RC;
+    if(rc || (rc = page.GetData(pData)))
+        return rc;
+
+    // FORWARD 指向 MOVED，MOVED 指回 FORWARD
+    RM_SlotPage other(pData, DataSize());
+    int kind = pTuple[0] == RM_TUPLE_FORWARD ? RM_TUPLE_MOVED : RM_TUPLE_FORWARD;
+    if(other.Get(otherSlot, pOther, length) && pOther[0] == kind) {
+        PageNum backPage;
+        SlotNum backSlot;
+        ReadTupleRid(pOther, backPage, backSlot);
+        bPaired = (backPage == pageNum && backSlot == slotNum);
+    }
+    return page.Release();
+}
+
+RC RM_FileHandle::GetSlotted (PageNum pageNum, SlotNum slotNum,
+                              char *pRecord) const {
+    int rc;
+    PF_PageGuard page;
+    char *pData, *pTuple;
+    int length;
+
+    if((rc = pfFH_.GetThisPage(pageNum, page)) || (rc = page.GetData(pData)))
+        return rc;
+
+    RM_SlotPage sp(pData, DataSize());
+    if(!sp.Get(slotNum, pTuple, length) || pTuple[0] == RM_TUPLE_MOVED)
+        return RM_RECORD_NOT_FOUND;
+    if(pTuple[0] == RM_TUPLE_HOME) {
+        RM_DecodeRecord(pTuple + 1, length - 1, pRecord, fHdr_.recordSize);
+        return page.Release();
+    }
+
+    // 记录被搬到了别的页面
+    PageNum movedPage;
+    SlotNum movedSlot;
+    ReadTupleRid(pTuple, movedPage, movedSlot);
+    if((rc = page.Release())
+        || (rc = pfFH_.GetThisPage(movedPage, page))
+        || (rc = page.GetData(pData)))
+        return rc;
+
+    RM_SlotPage moved(pData, DataSize());
+    PageNum homePage;
+    SlotNum homeSlot;
+    if(!moved.Get(movedSlot, pTuple, length) || pTuple[0] != RM_TUPLE_MOVED)
+        return RM_RECORD_NOT_FOUND;
+    ReadTupleRid(pTuple, homePage, homeSlot);
+    if(homePage != pageNum || homeSlot != slotNum)
+        return RM_RECORD_NOT_FOUND;
+    int offset = CodeOffset(RM_TUPLE_MOVED);
+    RM_DecodeRecord(pTuple + offset, length - offset, pRecord,
+                    fHdr_.recordSize);
+    return page.Release();
+}
+
+RC RM_FileHandle::PlaceTuple (int kind, PageNum homePage, SlotNum homeSlot,
+                              const char *pCode, int codeLength,
+                              PageNum &pageNum, SlotNum &slotNum) {
+    int rc;
+    int length = TupleLength(kind, codeLength);
+
+    for(;;) {
+        PF_PageGuard page;
+        char *pData;
+        Boolean isNew = (fHdr_.nextFreePage == RM_NO_FREE_PAGE);
+
+        if(isNew) {
+            if((rc = pfFH_.AllocatePage(page)))
+                return rc;
+        }
+        else if((rc = pfFH_.GetThisPage(fHdr_.nextFreePage, page))) {
+            // 重做时文件头中的空闲页链表可能指向还不在文件中的页面
+            if(rc != PF_INVALIDPAGE)
+                return rc;
+            fHdr_.nextFreePage = RM_NO_FREE_PAGE;
+            modified_ = TRUE;
+            continue;
+        }
+        if((rc = page.GetData(pData)) || (rc = page.GetPageNum(pageNum)))
+            return rc;
+
+        RM_SlotPage sp(pData, DataSize());
+        if(isNew) {
+            // 新页面放到空闲页链表的开头
+            sp.Init();
+            sp.Hdr()->nextFreePage = fHdr_.nextFreePage;
+            fHdr_.nextFreePage = pageNum;
+            fHdr_.numPages++;
+            modified_ = TRUE;
+        }
+
+        SlotNum slot = sp.FreeSlot();
+        if(slot < fHdr_.numRecordsPerPage && sp.Fits(slot, length)) {
+            WriteTuple(sp.Put(slot, length), length, kind, homePage, homeSlot,
+                       pCode, codeLength);
+            slotNum = slot;
+            if((rc = MarkDirty(page)))
+                return rc;
+            return page.Release();
+        }
+        if(isNew)
+            return RM_NO_ROOM;
+
+        // 放不下这条记录的页面移出空闲页链表，等删除记录后再放回来。
+        // 它因此被日志 pin 住，还要能再 pin 住链表中的下一个页面
+        if(pLog_ && (rc = pLog_->Reserve(this, 2)))
+            return rc;
+        fHdr_.nextFreePage = sp.Hdr()->nextFreePage;
+        sp.Hdr()->nextFreePage = RM_PAGE_FULL_USED;
+        modified_ = TRUE;
+        if((rc = MarkDirty(page)) || (rc = page.Release()))
+            return rc;
+    }
+}
+
+RC RM_FileHandle::RemoveMoved (PageNum homePage, SlotNum homeSlot,
+                               const char *pForward) {
+    int rc;
+    PageNum movedPage;
+    SlotNum movedSlot;
+    PF_PageGuard page;
+    char *pData, *pTuple;
+    int length;
+    Boolean bPaired;
+
+    // 不成对的 FORWARD 没有要删除的 MOVED
+    if((rc = IsPaired(homePage, homeSlot, pForward, bPaired)) || !bPaired)
+        return rc;
+
+    ReadTupleRid(pForward, movedPage, movedSlot);
+    if((rc = pfFH_.GetThisPage(movedPage, page)) || (rc = page.GetData(pData)))
+        return rc;
+    RM_SlotPage sp(pData, DataSize());
+    if(sp.Get(movedSlot, pTuple, length))
+        sp.Remove(movedSlot);
+    UpdateFreeList(movedPage, pData);
+    if((rc = MarkDirty(page)))
+        return rc;
+    return page.Release();
+}
+
+RC RM_FileHandle::StoreSlotted (PageNum pageNum, char *pData, SlotNum slotNum,
+                                const char *pCode, int codeLength) {
+    int rc;
+    RM_SlotPage sp(pData, DataSize());
+    int homeLength = TupleLength(RM_TUPLE_HOME, codeLength);
+    char *pTuple;
+    int length;
+    std::vector<char> old;
+    Boolean bPaired = FALSE;
+    PF_PageGuard movedPage;
+
+    if(sp.Get(slotNum, pTuple, length)) {
+        // 放得下时原地更新
+        if(pTuple[0] == RM_TUPLE_HOME && homeLength <= length) {
+            WriteTuple(pTuple, homeLength, RM_TUPLE_HOME, 0, 0, pCode,
+                       codeLength);
+            sp.Shrink(slotNum, homeLength);
+            return OK_RC;
+        }
+        // 旧记录留一份副本，新记录存不下时放回去。旧记录搬到别的页面时，
+        // 先 pin 住那个页面，等新记录存好后再删除 MOVED 就不会失败
+        if(pTuple[0] == RM_TUPLE_FORWARD) {
+            if((rc = IsPaired(pageNum, slotNum, pTuple, bPaired)))
+                return rc;
+            PageNum page;
+            SlotNum slot;
+            ReadTupleRid(pTuple, page, slot);
+            if(bPaired && (rc = pfFH_.GetThisPage(page, movedPage)))
+                return rc;
+        }
+        old.assign(pTuple, pTuple + length);
+        sp.Remove(slotNum);
+    }
+
+    if(sp.Fits(slotNum, homeLength))
+        WriteTuple(sp.Put(slotNum, homeLength), homeLength, RM_TUPLE_HOME,
+                   0, 0, pCode, codeLength);
+    else {
+        // 本页放不下，先占住一个 FORWARD 的位置，再把记录搬到别的页面
+        PageNum movedNum;
+        SlotNum movedSlot;
+        if(!sp.Fits(slotNum, RM_TUPLE_MIN))
+            rc = RM_NO_ROOM;
+        else {
+            WriteTuple(sp.Put(slotNum, RM_TUPLE_MIN), RM_TUPLE_MIN,
+                       RM_TUPLE_FORWARD, -1, -1, NULL, 0);
+            if((rc = PlaceTuple(RM_TUPLE_MOVED, pageNum, slotNum, pCode,
+                                codeLength, movedNum, movedSlot)))
+                sp.Remove(slotNum);
+        }
+        if(rc) {
+            // 放回旧记录，它原来就在这个页面上，一定放得下
+            if(!old.empty())
+                memcpy(sp.Put(slotNum, old.size()), old.data(), old.size());
+            return rc;
+        }
+        // 记录可能被搬到了本页，整理碎片后 FORWARD 的位置会变
+        sp.Get(slotNum, pTuple, length);
+        WriteTuple(pTuple, RM_TUPLE_MIN, RM_TUPLE_FORWARD, movedNum,
+                   movedSlot, NULL, 0);
+    }
+
+    // 新记录已经存好，删除旧记录搬走的部分
+    if(bPaired)
+        return RemoveMoved(pageNum, slotNum, old.data());
+    return OK_RC;
+}
+
+RC RM_FileHandle::InsertSlotted (const char *pData, RID &rid) {
+    int rc;
+    std::vector<char> code(fHdr_.recordSize + RM_ENCODE_SLACK);
+    int codeLength = RM_EncodeRecord(pData, fHdr_.recordSize, code.data());
+    PageNum pageNum;
+    SlotNum slotNum;
+
+    // 记录日志时，未提交的修改占满 buffer 之前就停下 (见 rm_log.h)
+    if(pLog_ && (rc = pLog_->Reserve(this, 1)))
+        return rc;
+    if((rc = PlaceTuple(RM_TUPLE_HOME, 0, 0, code.data(), codeLength,
+                        pageNum, slotNum)))
+        return rc;
+
+    rid.pageNum_ = pageNum;
+    rid.slotNum_ = slotNum;
+    rid.isValid_ = TRUE;
+
+    if(pLog_ && (rc = pLog_->Append(this, RM_LOG_INSERT, pageNum,
+                                    slotNum, pData, fHdr_.recordSize)))
+        return rc;
+    return OK_RC;
+}
+
+RC RM_FileHandle::DeleteSlotted (PageNum pageNum, SlotNum slotNum,
+                                 Boolean bRedo) {
+    int rc;
+    PF_PageGuard page;
+    char *pData, *pTuple;
+    int length;
+
+    // 记录所在的页面，以及它搬去的页面
+    if(pLog_ && (rc = pLog_->Reserve(this, 2)))
+        return rc;
+
+    // 重做时还不在文件中的页面里没有记录
+    rc = pfFH_.GetThisPage(pageNum, page);
+    if(bRedo && rc == PF_INVALIDPAGE)
+        return OK_RC;
+    if(rc || (rc = page.GetData(pData)))
+        return rc;
+
+    // 搬来的记录不能用它现在的 RID 删除，重做时则直接清空这个槽
+    RM_SlotPage sp(pData, DataSize());
+    if(!sp.Get(slotNum, pTuple, length))
+        return bRedo ? page.Release() : RM_RECORD_NOT_FOUND;
+    if(pTuple[0] == RM_TUPLE_MOVED && !bRedo)
+        return RM_RECORD_NOT_FOUND;
+    if(pTuple[0] == RM_TUPLE_FORWARD
+        && (rc = RemoveMoved(pageNum, slotNum, pTuple)))
+        return rc;
+    sp.Remove(slotNum);
+    UpdateFreeList(pageNum, pData);
+    if((rc = MarkDirty(page)))
+        return rc;
+
+    if(pLog_ && (rc = pLog_->Append(this, RM_LOG_DELETE, pageNum,
+                                    slotNum, NULL, 0)))
+        return rc;
+    return page.Release();
+}
+
+RC RM_FileHandle::UpdateSlotted (PageNum pageNum, SlotNum slotNum,
+                                 const char *pRecord, Boolean bRedo) {
+    int rc;
+    PF_PageGuard page;
+    char *pData, *pTuple;
+    int length;
+    std::vector<char> code(fHdr_.recordSize + RM_ENCODE_SLACK);
+    int codeLength = RM_EncodeRecord(pRecord, fHdr_.recordSize, code.data());
+
+    // 记录所在的页面、旧记录搬去的页面和新记录搬去的页面
+    if(pLog_ && (rc = pLog_->Reserve(this, 3)))
+        return rc;
+
+    // 重做时页面可能还不在文件中，也可能还没有初始化
+    rc = pfFH_.GetThisPage(pageNum, page);
+    while(bRedo && rc == PF_INVALIDPAGE) {
+        PageNum allocated;
+        if((rc = pfFH_.AllocatePage(page)) || (rc = page.GetPageNum(allocated)))
+            return rc;
+        if(allocated == pageNum)
+            break;
+        if(allocated > pageNum)
+            return PF_INVALIDPAGE;
+        rc = pfFH_.GetThisPage(pageNum, page);
+    }
+    if(rc || (rc = page.GetData(pData)))
+        return rc;
+
+    RM_SlotPage sp(pData, DataSize());
+    if(bRedo && sp.Hdr()->tupleStart == 0) {
+        sp.Init();
+        sp.Hdr()->nextFreePage = RM_PAGE_FULL_USED;
+    }
+
+    // 重做时槽中可能是之后搬来的别的记录，它会在之后的重做中再被搬一次
+    Boolean found = sp.Get(slotNum, pTuple, length);
+    if(!bRedo && (!found || pTuple[0] == RM_TUPLE_MOVED))
+        return RM_RECORD_NOT_FOUND;
+    if(found && pTuple[0] == RM_TUPLE_MOVED)
+        sp.Remove(slotNum);
+
+    if((rc = StoreSlotted(pageNum, pData, slotNum, code.data(), codeLength)))
+        return rc;
+    UpdateFreeList(pageNum, pData);
+    if((rc = MarkDirty(page)))
+        return rc;
+
+    if(pLog_ && (rc = pLog_->Append(this, RM_LOG_UPDATE, pageNum,
+                                    slotNum, pRecord, fHdr_.recordSize)))
+        return rc;
+    return page.Release();
+}
+
+RC RM_FileHandle::RebuildSlotted () {
+    int rc;
+    PF_PageGuard page;
+    PageNum pageNum;
+    char *pData, *pTuple;
+    int length;
+
+    fHdr_.numPages = 0;
+    fHdr_.nextFreePage = RM_NO_FREE_PAGE;
+
+    // 第一个页面是文件头，从它之后的页面开始
+    if((rc = pfFH_.GetFirstPage(page)) || (rc = page.GetPageNum(pageNum)))
+        return rc;
+    while(!(rc = pfFH_.GetNextPage(pageNum, page))) {
+        if((rc = page.GetPageNum(pageNum)) || (rc = page.GetData(pData)))
+            return rc;
+
+        // 重做时分配却没有用到的页面
+        RM_SlotPage sp(pData, DataSize());
+        if(sp.Hdr()->tupleStart == 0)
+            sp.Init();
+
+        // 崩溃时只写回了一半的搬动
+        for(SlotNum slot = sp.Hdr()->numSlots - 1; slot >= 0; slot--) {
+            Boolean bPaired;
+            if(!sp.Get(slot, pTuple, length) || pTuple[0] == RM_TUPLE_HOME)
+                continue;
+            if((rc = IsPaired(pageNum, slot, pTuple, bPaired)))
+                return rc;
+            if(!bPaired)
+                sp.Remove(slot);
+        }
+
+        sp.Hdr()->nextFreePage = RM_PAGE_FULL_USED;
+        UpdateFreeList(pageNum, pData);
+        fHdr_.numPages++;
+        if((rc = page.MarkDirty()))
+            return rc;
+    }
+    if(rc != PF_EOF)
+        return rc;
+
+    modified_ = TRUE;
+    return OK_RC;
+}
@@ -5,10 +5,12 @@
 //
 
 #include <cstdio>
+#include <cstdlib>
 #include <iostream>
 #include <sstream>
 #include <fstream>
 #include <unistd.h>
+#include <strings.h>
 #include "redbase.h"
 #include "sm.h"
 #include "ix.h"
@@ -45,11 +47,14 @@ bool recInsert_float(char *location, string value, int length){
 }
 
 bool recInsert_string(char *location, string value, int length){
+  // The rest of the field is zeroed so that no bytes of the previous tuple
+  // are left behind a shorter string; slotted files do not store them
+  memset(location, 0, length);
   if(value.length() > length){
     memcpy(location, value.c_str(), length);
     return true;
   }
-  memcpy(location, value.c_str(), value.length()+1);
+  memcpy(location, value.c_str(), value.length());
   return true;
 }
 
@@ -58,6 +63,7 @@ bool recInsert_string(char *location, string value, int length){
  */
 SM_Manager::SM_Manager(IX_Manager &ixm, RM_Manager &rmm) : ixm(ixm), rmm(rmm){
   printIndex = false;
+  recordFormat = RM_FORMAT_FIXED;
 }
 
 SM_Manager::~SM_Manager()
@@ -183,7 +189,13 @@ RC SM_Manager::CreateTable(const char *relName,
 
   // Create a file for this relation. This will check for duplicate tables
   // of the same name.
-  if((rc = rmm.CreateFile(relName, totalRecSize)))
+  // The format is chosen with Set("recordFormat", ...).  Tuples close to a
+  // page long only fit in the fixed format
+  rc = rmm.CreateFile(relName, totalRecSize, PF_DEFAULT_PAGE_SIZE,
+                      recordFormat);
+  if(rc == RM_LARGE_RECORDSIZE && recordFormat == RM_FORMAT_SLOTTED)
+    rc = rmm.CreateFile(relName, totalRecSize);
+  if(rc)
     return (SM_BADRELNAME);
 
   // For each attribute, insert into attrcat:
@@ -389,7 +401,7 @@ RC SM_Manager::CreateIndex(const char *relName,
     return (rc);
 
   // scan through the entire file:
-  if((rc = fs.OpenScan(fh, INT, 4, 0, NO_OP, NULL))){
+  if((rc = fs.OpenScan(fh, INT, 4, 0, NO_OP, NULL, SEQUENTIAL_SCAN))){
     return (rc);
   }
   RM_Record rec;
@@ -569,9 +581,9 @@ RC SM_Manager::Load(const char *relName,
   if((rc = PrepareAttr(rEntry, attributes)))
     return (rc);
 
-  // Open the file and load contents
+  // Open the file and load contents, growing it by large extents
   RM_FileHandle relFH;
-  if((rc = rmm.OpenFile(relName, relFH)))
+  if((rc = rmm.OpenFile(relName, relFH)) || (rc = relFH.SetBulkLoad(TRUE)))
     return (rc);
 
   rc = OpenAndLoadFile(relFH, fileName, attributes, rEntry->attrCount,
@@ -717,13 +729,13 @@ RC SM_Manager::Print(const char *relName)
   // open the file, and a scan through the entire file
   RM_FileHandle fh;
   RM_FileScan fs;
-  if((rc = rmm.OpenFile(relName, fh)) || (rc = fs.OpenScan(fh, INT, 4, 0, NO_OP, NULL))){
+  if((rc = rmm.OpenFile(relName, fh)) || (rc = fs.OpenScan(fh, INT, 4, 0, NO_OP, NULL, SEQUENTIAL_SCAN))){
     free(attributes);
     return (rc);
   }
 
-  // Retrieve each record and print it
-  RM_Record rec;
+  // Retrieve each record and print it where it lies in its page
+  RM_RecordView rec;
   while(fs.GetNextRec(rec) != RM_EOF){
     char *pData;
     if((rec.GetData(pData))){
@@ -732,6 +744,7 @@ RC SM_Manager::Print(const char *relName)
     }
     printer.Print(cout, pData);
   }
+  rec.Release();
   fs.CloseScan();
 
   printer.PrintFooter(cout);
@@ -775,7 +788,14 @@ RC SM_Manager::SetUpPrint(RelCatEntry* rEntry, DataAttrInfo *attributes){
 }
 
 /*
- * This sets printIndex to true or false, depending on what's specified
+ * This sets printIndex to true or false, depending on what's specified.
+ * bufferPolicy selects the page replacement policy of the buffer
+ * manager: lru, clock, 2q or lru-k.
+ * readAhead, bgWriter, fileMode (buffered, mmap or direct) and hugePages
+ * (on or off) are passed on to the PF_Manager.
+ * recordFormat (fixed or slotted) is the format of the tables created
+ * afterwards.  Slotted tables store short strings in less room, fixed
+ * ones are scanned with the vectorized filters.
  * Otherwise, any other call will do nothing.
  */
 RC SM_Manager::Set(const char *paramName, const char *value)
@@ -789,6 +809,51 @@ RC SM_Manager::Set(const char *paramName, const char *value)
     else if(strncmp(paramName, "printIndex", 10) == 0 && strncmp(value, "false", 5) ==0){
       printIndex = false;
     }
+    else if(strcmp(paramName, "bufferPolicy") == 0){
+      if(strcasecmp(value, "lru") == 0)
+        return pPfm->SetReplacePolicy(PF_REPLACE_LRU);
+      if(strcasecmp(value, "clock") == 0)
+        return pPfm->SetReplacePolicy(PF_REPLACE_CLOCK);
+      if(strcasecmp(value, "2q") == 0)
+        return pPfm->SetReplacePolicy(PF_REPLACE_2Q);
+      if(strcasecmp(value, "lru-k") == 0 || strcasecmp(value, "lruk") == 0)
+        return pPfm->SetReplacePolicy(PF_REPLACE_LRUK);
+      cout << "Unknown buffer policy " << value
+           << " (expected lru, clock, 2q or lru-k)\n";
+    }
+    else if(strcmp(paramName, "readAhead") == 0){
+      return pPfm->SetReadAhead(atoi(value));
+    }
+    else if(strcmp(paramName, "fileMode") == 0){
+      if(strcasecmp(value, "buffered") == 0)
+        return pPfm->SetFileMode(PF_MODE_BUFFERED);
+      if(strcasecmp(value, "mmap") == 0)
+        return pPfm->SetFileMode(PF_MODE_MMAP);
+      if(strcasecmp(value, "direct") == 0)
+        return pPfm->SetFileMode(PF_MODE_DIRECT);
+      cout << "Unknown file mode " << value
+           << " (expected buffered, mmap or direct)\n";
+    }
+    else if(strcmp(paramName, "hugePages") == 0){
+      return pPfm->SetHugePages(strcasecmp(value, "on") == 0 ||
+                                strcasecmp(value, "true") == 0);
+    }
+    else if(strcmp(paramName, "recordFormat") == 0){
+      if(strcasecmp(value, "fixed") == 0)
+        recordFormat = RM_FORMAT_FIXED;
+      else if(strcasecmp(value, "slotted") == 0)
+        recordFormat = RM_FORMAT_SLOTTED;
+      else
+        cout << "Unknown record format " << value
+             << " (expected fixed or slotted)\n";
+    }
+    else if(strcmp(paramName, "bgWriter") == 0){
+      // "off", "tail" or "tail,low,high" in percent
+      int tailPct = 0, lowPct = 50, highPct = 90;
+      if(strcasecmp(value, "off") != 0)
+        sscanf(value, "%d,%d,%d", &tailPct, &lowPct, &highPct);
+      return pPfm->SetBgWriter(tailPct, lowPct, highPct);
+    }
 
     return (0);
 }
@@ -818,7 +883,7 @@ RC SM_Manager::Help()
     return (rc);
   }
 
-  RM_Record rec; // iterate through all relation entries
+  RM_RecordView rec; // iterate through all relation entries
   while(fs.GetNextRec(rec) != RM_EOF){
     char *pData;
     if((rec.GetData(pData))){
@@ -828,6 +893,7 @@ RC SM_Manager::Help()
     printer.Print(cout, pData);
   }
 
+  rec.Release();
   fs.CloseScan();
   printer.PrintFooter(cout);
   free(attributes);
@@ -908,14 +974,15 @@ RC SM_Manager::Help(const char *relName)
   if((rc = fs.OpenScan(attrcatFH, STRING, MAXNAME+1, 0, EQ_OP, const_cast<char*>(relName))))
     return (rc);
 
-  while(fs.GetNextRec(rec) != RM_EOF){
+  RM_RecordView view;
+  while(fs.GetNextRec(view) != RM_EOF){
     char *pData;
-    if((rec.GetData(pData)))
+    if((view.GetData(pData)))
       return (rc);
     printer.Print(cout, pData);
   }
 
-  if((rc = fs.CloseScan() ))
+  if((rc = view.Release()) || (rc = fs.CloseScan()))
     return (rc);
 
   // If we are to print the index, itereate through again, and print
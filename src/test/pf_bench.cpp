@@ -0,0 +1,1076 @@
+//
+// File:        pf_bench.cc
+// Description: Benchmarks of the PF component
+//
+// Each benchmark prints one line per configuration.  The benchmarks named
+// on the command line are run, all of them without arguments, and "suite"
+// stands for the workloads of the suite below.  Build without the address
+// sanitizer (-DASAN_ENABLE=False) for numbers worth comparing.
+//
+//   lookup  - cost of fetching a page which is already in the buffer,
+//             for growing buffer sizes.  The whole file fits in the
+//             buffer, so the time is spent finding the page.
+//   scan    - cold scan of a file with GetNextPage, with some work done
+//             on every page, with read-ahead off and on.  The file is
+//             dropped from the OS cache before each scan.
+//   flush   - time to write back a buffer full of dirty pages, updated
+//             in random order, when the file is closed.
+//   update  - random updates of a file larger than the buffer, with the
+//             background writer off and on.  Compile with -DPF_STATS to
+//             see how many pages were written by misses and how many by
+//             the background writer.
+//   sparse  - cold scan of a file of which one page out of SPARSE_STRIDE
+//             is kept, next to a file of the kept pages only, with
+//             read-ahead on.  The free
+//             pages are skipped in the allocation bitmap, so both should
+//             take about the same time.
+//   mmap    - warm scan and random lookups of a file which fits in the
+//             buffer, through the buffer and in the mmap file mode.
+//   extent  - two files loaded side by side, growing a page at a time,
+//             by small and large extents and by extents growing with the
+//             files, as RM bulk loads do.  Prints the time and the number
+//             of pieces the files take on disk, as FIEMAP reports them.
+//   compress - disk bytes of a file of padded name records, plain and
+//             compressed, and the time of a cold scan of each.  The
+//             bytes include the offset map.
+//   stats   - with -DPF_STATS only: cost of counting an event in the
+//             StatCounters and in a StatisticsMgr, and the share of a
+//             buffer hit spent counting.
+//
+// The suite compares builds of the buffer manager.  Each configuration is
+// printed as one JSON object on a line starting with '{': the workload
+// and its parameters, then ops, ops_per_sec, the median and 99th
+// percentile time of an operation in p50_ns and p99_ns, the read and write
+// system calls of the process in read_calls and write_calls, and the hits,
+// misses, evictions and write_backs of the file.
+//
+//   seq     - GetNextPage over a file four times the buffer, cold with
+//             read-ahead off and on, then warm in the OS cache.
+//   uniform - random GetThisPage of a file which fits in the buffer.
+//   zipf    - GetThisPage following a Zipf distribution (theta 0.99) over
+//             files 4 and 16 times the buffer.
+//   churn   - uniform GetThisPage over files 2 to 16 times the buffer,
+//             where most fetches evict a page.
+//   storm   - random updates of a file four times the buffer, every page
+//             dirtied, with the background writer off and on.
+//
+
+#include <cstdio>
+#include <iostream>
+#include <cstring>
+#include <cstdlib>
+#include <unistd.h>
+#include <fcntl.h>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#include <linux/fiemap.h>
+#include "pf.h"
+#include "pf_internal.h"
+#include "pf_compress.h"
+
+using namespace std;
+
+#ifdef PF_STATS
+#include <mutex>
+#include "statistics.h"
+
+// This is defined within pf_buffermgr.cc
+extern StatCounters pfStats;
+
+//
+// Stat
+//
+// Current value of a statistic
+//
+static int Stat(int key)
+{
+	return ((int)pfStats.Get(key));
+}
+#endif
+
+//
+// Defines
+//
+#define FILE1        "file1"
+#define NUM_LOOKUPS  2000000     // pages fetched per configuration
+#define SCAN_PAGES   16384       // pages in the scanned file
+#define SCAN_BUFFER  256         // pages in the buffer for the scan
+#define SCAN_WORK    8           // passes over each scanned page
+#define FLUSH_PAGES  4096        // dirty pages written back
+#define UPDATE_PAGES 4096        // pages in the updated file
+#define UPDATE_OPS   100000      // pages updated
+#define UPDATE_WORK  2           // passes over each updated page
+#define SPARSE_STRIDE 16         // one page kept out of SPARSE_STRIDE
+#define MMAP_PAGES   4096        // pages in the file read in both modes
+#define MMAP_SCANS   20          // scans of the file per mode
+#define NAME_LENGTH  28          // like the sname column of the examples
+#define FILE2        "file2"
+#define EXTENT_PAGES 8192        // pages loaded into each file
+#define SUITE_POOL   1024        // buffer pages of the suite
+#define SUITE_OPS    200000      // pages fetched per random workload
+
+//
+// Elapsed
+//
+// Seconds since start
+//
+static double Elapsed(chrono::steady_clock::time_point start)
+{
+	chrono::duration<double> d = chrono::steady_clock::now() - start;
+	return (d.count());
+}
+
+//
+// Selected
+//
+// Whether the benchmark name was asked for on the command line.  Without
+// arguments everything runs; "suite" selects the workloads of the suite.
+//
+static int Selected(int argc, char *argv[], const char *name, int bSuite)
+{
+	if (argc < 2)
+		return (TRUE);
+	for (int i = 1; i < argc; i++)
+		if (!strcmp(argv[i], name) || (bSuite && !strcmp(argv[i], "suite")))
+			return (TRUE);
+	return (FALSE);
+}
+
+//
+// CreatePages
+//
+// Create and open a file of numPages pages, each holding its number
+//
+RC CreatePages(PF_Manager &pfm, PF_FileHandle &fh, int numPages)
+{
+	PF_PageHandle ph;
+	char *pData;
+	PageNum pageNum;
+	RC rc;
+
+	unlink(FILE1);
+	if ((rc = pfm.CreateFile(FILE1)) ||
+			(rc = pfm.OpenFile(FILE1, fh)))
+		return (rc);
+
+	for (int i = 0; i < numPages; i++) {
+		if ((rc = fh.AllocatePage(ph)) ||
+				(rc = ph.GetData(pData)) ||
+				(rc = ph.GetPageNum(pageNum)))
+			return (rc);
+		memcpy(pData, &pageNum, sizeof(int));
+		if ((rc = fh.UnpinPage(pageNum)))
+			return (rc);
+	}
+
+	return (0);
+}
+
+//
+// BenchLookup
+//
+// Fetch random resident pages out of a buffer of numPages pages
+//
+RC BenchLookup(int numPages)
+{
+	PF_Manager pfm;
+	PF_FileHandle fh;
+	PF_PageHandle ph;
+	RC rc;
+
+	if ((rc = pfm.ResizeBuffer(numPages)) ||
+			(rc = CreatePages(pfm, fh, numPages)))
+		return (rc);
+
+	unsigned int seed = 1;
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	for (int i = 0; i < NUM_LOOKUPS; i++) {
+		PageNum pageNum = rand_r(&seed) % numPages;
+		if ((rc = fh.GetThisPage(pageNum, ph)) ||
+				(rc = fh.UnpinPage(pageNum)))
+			return (rc);
+	}
+	double secs = Elapsed(start);
+
+	printf("lookup  buffer=%-6d %8.1f ns/page\n", numPages,
+			secs * 1e9 / NUM_LOOKUPS);
+
+	if ((rc = pfm.CloseFile(fh)) ||
+			(rc = pfm.DestroyFile(FILE1)))
+		return (rc);
+
+	return (0);
+}
+
+//
+// DropCache
+//
+// Ask the OS to forget the cached pages of a file
+//
+static void DropCache(const char *fileName)
+{
+	int fd = open(fileName, O_RDONLY);
+	if (fd < 0)
+		return;
+	fdatasync(fd);
+	posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+	close(fd);
+}
+
+//
+// BenchScan
+//
+// Scan a cold file, summing its contents SCAN_WORK times per page to
+// stand for the evaluation of a predicate
+//
+RC BenchScan(int readAhead)
+{
+	PF_Manager pfm;
+	PF_FileHandle fh;
+	PF_PageHandle ph;
+	PageNum pageNum;
+	char *pData;
+	RC rc;
+
+	if ((rc = pfm.ResizeBuffer(SCAN_BUFFER)) ||
+			(rc = CreatePages(pfm, fh, SCAN_PAGES)) ||
+			(rc = pfm.CloseFile(fh)))
+		return (rc);
+	DropCache(FILE1);
+
+	if ((rc = pfm.SetReadAhead(readAhead)) ||
+			(rc = pfm.OpenFile(FILE1, fh)))
+		return (rc);
+
+	unsigned int sum = 0;
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	for (rc = fh.GetFirstPage(ph); rc == 0; rc = fh.GetNextPage(pageNum, ph)) {
+		if ((rc = ph.GetData(pData)) ||
+				(rc = ph.GetPageNum(pageNum)))
+			return (rc);
+		for (int w = 0; w < SCAN_WORK; w++)
+			for (int i = 0; i < PF_PAGE_SIZE; i++)
+				sum = sum * 31 + (unsigned char)pData[i];
+		if ((rc = fh.UnpinPage(pageNum)))
+			return (rc);
+	}
+	if (rc != PF_EOF)
+		return (rc);
+	double secs = Elapsed(start);
+
+	printf("scan    readahead=%-3d %8.1f MB/s  (%u)\n", readAhead,
+			SCAN_PAGES * (double)PF_PAGE_SIZE / secs / (1 << 20), sum % 10);
+
+	if ((rc = pfm.CloseFile(fh)) ||
+			(rc = pfm.DestroyFile(FILE1)))
+		return (rc);
+
+	return (0);
+}
+
+//
+// BenchSparse
+//
+// Cold scan of a file of SCAN_PAGES pages from which all but one page out
+// of stride were disposed
+//
+RC BenchSparse(int stride)
+{
+	PF_Manager pfm;
+	PF_FileHandle fh;
+	PF_PageHandle ph;
+	PageNum pageNum;
+	RC rc;
+	int numPages = SCAN_PAGES / SPARSE_STRIDE * stride;
+
+	if ((rc = pfm.ResizeBuffer(SCAN_BUFFER)) ||
+			(rc = CreatePages(pfm, fh, numPages)))
+		return (rc);
+	for (int i = 0; i < numPages; i++)
+		if (i % stride && (rc = fh.DisposePage(i)))
+			return (rc);
+	if ((rc = pfm.CloseFile(fh)))
+		return (rc);
+	DropCache(FILE1);
+
+	if ((rc = pfm.SetReadAhead(32)) ||
+			(rc = pfm.OpenFile(FILE1, fh)))
+		return (rc);
+
+	int numFound = 0;
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	for (rc = fh.GetFirstPage(ph); rc == 0; rc = fh.GetNextPage(pageNum, ph)) {
+		if ((rc = ph.GetPageNum(pageNum)) ||
+				(rc = fh.UnpinPage(pageNum)))
+			return (rc);
+		numFound++;
+	}
+	if (rc != PF_EOF)
+		return (rc);
+	double secs = Elapsed(start);
+
+	printf("sparse  pages=%-6d live=%-6d %8.1f ms\n", numPages, numFound,
+			secs * 1e3);
+
+	if ((rc = pfm.CloseFile(fh)) ||
+			(rc = pfm.DestroyFile(FILE1)))
+		return (rc);
+
+	return (0);
+}
+
+//
+// BenchFlush
+//
+// Dirty every page of a file held in the buffer in random order, then
+// time the close which writes them back
+//
+RC BenchFlush()
+{
+	PF_Manager pfm;
+	PF_FileHandle fh;
+	PF_PageHandle ph;
+	char *pData;
+	RC rc;
+	int i;
+
+	if ((rc = pfm.ResizeBuffer(FLUSH_PAGES)) ||
+			(rc = CreatePages(pfm, fh, FLUSH_PAGES)) ||
+			(rc = fh.FlushPages()))
+		return (rc);
+
+	// Visit the pages in a random order
+	vector<PageNum> order(FLUSH_PAGES);
+	for (i = 0; i < FLUSH_PAGES; i++)
+		order[i] = i;
+	unsigned int seed = 1;
+	for (i = FLUSH_PAGES - 1; i > 0; i--)
+		swap(order[i], order[rand_r(&seed) % (i + 1)]);
+
+	for (i = 0; i < FLUSH_PAGES; i++) {
+		if ((rc = fh.GetThisPage(order[i], ph)) ||
+				(rc = ph.GetData(pData)))
+			return (rc);
+		pData[sizeof(int)]++;
+		if ((rc = fh.MarkDirty(order[i])) ||
+				(rc = fh.UnpinPage(order[i])))
+			return (rc);
+	}
+
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	if ((rc = pfm.CloseFile(fh)))
+		return (rc);
+	double secs = Elapsed(start);
+
+	printf("flush   pages=%-6d %8.1f ms\n", FLUSH_PAGES, secs * 1e3);
+
+	if ((rc = pfm.DestroyFile(FILE1)))
+		return (rc);
+
+	return (0);
+}
+
+//
+// BenchUpdate
+//
+// Update random pages of a file four times as large as the buffer,
+// with the background writer set to tailPct (0 is off)
+//
+RC BenchUpdate(int tailPct)
+{
+	PF_Manager pfm;
+	PF_FileHandle fh;
+	PF_PageHandle ph;
+	char *pData;
+	RC rc;
+
+	if ((rc = pfm.ResizeBuffer(UPDATE_PAGES / 4)) ||
+			(rc = CreatePages(pfm, fh, UPDATE_PAGES)) ||
+			(rc = fh.FlushPages()) ||
+			(rc = pfm.SetBgWriter(tailPct, 50, 90)))
+		return (rc);
+
+#ifdef PF_STATS
+	int fgWrites = Stat(PF_EVICTDIRTY);
+	int bgWrites = Stat(PF_BGWRITE);
+#endif
+
+	unsigned int seed = 1;
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	for (int i = 0; i < UPDATE_OPS; i++) {
+		PageNum pageNum = rand_r(&seed) % UPDATE_PAGES;
+		if ((rc = fh.GetThisPage(pageNum, ph)) ||
+				(rc = ph.GetData(pData)))
+			return (rc);
+		for (int w = 0; w < UPDATE_WORK; w++)
+			for (int j = sizeof(int); j < PF_PAGE_SIZE; j++)
+				pData[j] += pData[j - 1];
+		if ((rc = fh.MarkDirty(pageNum)) ||
+				(rc = fh.UnpinPage(pageNum)))
+			return (rc);
+	}
+	double secs = Elapsed(start);
+
+	printf("update  bgwriter=%-3d %10.0f pages/s", tailPct, UPDATE_OPS / secs);
+#ifdef PF_STATS
+	printf("  foreground writes %d, background writes %d",
+			Stat(PF_EVICTDIRTY) - fgWrites, Stat(PF_BGWRITE) - bgWrites);
+#endif
+	printf("\n");
+
+	if ((rc = pfm.CloseFile(fh)) ||
+			(rc = pfm.DestroyFile(FILE1)))
+		return (rc);
+
+	return (0);
+}
+
+//
+// BenchMmap
+//
+// Scan a warm file MMAP_SCANS times, then fetch NUM_LOOKUPS random pages
+// of it, in the given file mode.  The buffer holds the whole file.
+//
+RC BenchMmap(PF_FileMode mode)
+{
+	PF_Manager pfm;
+	PF_FileHandle fh;
+	PF_PageHandle ph;
+	PageNum pageNum;
+	char *pData;
+	RC rc;
+	int i;
+
+	if ((rc = pfm.ResizeBuffer(MMAP_PAGES)) ||
+			(rc = CreatePages(pfm, fh, MMAP_PAGES)) ||
+			(rc = pfm.CloseFile(fh)) ||
+			(rc = pfm.SetFileMode(mode)) ||
+			(rc = pfm.OpenFile(FILE1, fh)))
+		return (rc);
+
+	// Read the file once so that both modes start warm
+	unsigned int sum = 0;
+	chrono::steady_clock::time_point start;
+	for (i = 0; i <= MMAP_SCANS; i++) {
+		if (i == 1)
+			start = chrono::steady_clock::now();
+		for (rc = fh.GetFirstPage(ph); rc == 0;
+				rc = fh.GetNextPage(pageNum, ph)) {
+			if ((rc = ph.GetData(pData)) ||
+					(rc = ph.GetPageNum(pageNum)))
+				return (rc);
+			sum += *(int *)pData;
+			if ((rc = fh.UnpinPage(pageNum)))
+				return (rc);
+		}
+		if (rc != PF_EOF)
+			return (rc);
+	}
+	double scanSecs = Elapsed(start);
+
+	unsigned int seed = 1;
+	start = chrono::steady_clock::now();
+	for (i = 0; i < NUM_LOOKUPS; i++) {
+		pageNum = rand_r(&seed) % MMAP_PAGES;
+		if ((rc = fh.GetThisPage(pageNum, ph)) ||
+				(rc = ph.GetData(pData)))
+			return (rc);
+		sum += *(int *)pData;
+		if ((rc = fh.UnpinPage(pageNum)))
+			return (rc);
+	}
+	double lookupSecs = Elapsed(start);
+
+	printf("mmap    mode=%-8s scan %6.1f ns/page  lookup %6.1f ns/page  (%u)\n",
+			mode == PF_MODE_MMAP ? "mmap" : "buffered",
+			scanSecs * 1e9 / ((double)MMAP_SCANS * MMAP_PAGES),
+			lookupSecs * 1e9 / NUM_LOOKUPS, sum % 10);
+
+	if ((rc = pfm.CloseFile(fh)) ||
+			(rc = pfm.DestroyFile(FILE1)))
+		return (rc);
+
+	return (0);
+}
+
+#ifdef PF_STATS
+//
+// BenchStats
+//
+// Time NUM_LOOKUPS events counted in a StatCounters, and in a
+// StatisticsMgr under a latch as the PF layer used to, then the buffer
+// hits of BenchLookup.  The share of a hit spent counting is the number
+// of counters added per hit times the cost of one.
+//
+RC BenchStats()
+{
+	StatCounters counters(PF_NUM_STATS, PF_STAT_NAMES);
+	StatisticsMgr statsMgr;
+	mutex statsLatch;
+	int i;
+
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	for (i = 0; i < NUM_LOOKUPS; i++)
+		counters.Add(i % PF_NUM_STATS);
+	double addNs = Elapsed(start) * 1e9 / NUM_LOOKUPS;
+
+	start = chrono::steady_clock::now();
+	for (i = 0; i < NUM_LOOKUPS; i++) {
+		lock_guard<mutex> statsGuard(statsLatch);
+		statsMgr.Register(PF_STAT_NAMES[i % PF_NUM_STATS], STAT_ADDONE);
+	}
+	double registerNs = Elapsed(start) * 1e9 / NUM_LOOKUPS;
+
+	PF_Manager pfm;
+	PF_FileHandle fh;
+	PF_PageHandle ph;
+	RC rc;
+
+	if ((rc = pfm.ResizeBuffer(MMAP_PAGES)) ||
+			(rc = CreatePages(pfm, fh, MMAP_PAGES)))
+		return (rc);
+
+	long added = 0;
+	for (int key = 0; key < PF_NUM_STATS; key++)
+		added -= pfStats.Get(key);
+
+	unsigned int seed = 1;
+	start = chrono::steady_clock::now();
+	for (i = 0; i < NUM_LOOKUPS; i++) {
+		PageNum pageNum = rand_r(&seed) % MMAP_PAGES;
+		if ((rc = fh.GetThisPage(pageNum, ph)) ||
+				(rc = fh.UnpinPage(pageNum)))
+			return (rc);
+	}
+	double hitNs = Elapsed(start) * 1e9 / NUM_LOOKUPS;
+
+	for (int key = 0; key < PF_NUM_STATS; key++)
+		added += pfStats.Get(key);
+	double perHit = (double)added / NUM_LOOKUPS;
+
+	printf("stats   add %5.1f ns  register %6.1f ns  hit %6.1f ns  "
+			"%.1f adds/hit  overhead %4.1f%% (was %5.1f%%)\n",
+			addNs, registerNs, hitNs, perHit,
+			100.0 * perHit * addNs / hitNs,
+			100.0 * perHit * registerNs / hitNs);
+
+	if ((rc = pfm.CloseFile(fh)) ||
+			(rc = pfm.DestroyFile(FILE1)))
+		return (rc);
+
+	return (0);
+}
+#endif
+
+//
+// CountExtents
+//
+// Number of pieces a file takes on disk, -1 if FIEMAP is not supported
+//
+static int CountExtents(const char *fileName)
+{
+	int fd = open(fileName, O_RDONLY);
+	if (fd < 0)
+		return (-1);
+
+	struct fiemap fm;
+	memset(&fm, 0, sizeof(fm));
+	fm.fm_length = ~0ULL;
+	fm.fm_flags = FIEMAP_FLAG_SYNC;
+	fm.fm_extent_count = 0;          // only count them
+	int ret = ioctl(fd, FS_IOC_FIEMAP, &fm);
+	close(fd);
+	return (ret < 0 ? -1 : (int)fm.fm_mapped_extents);
+}
+
+//
+// BenchExtent
+//
+// Load EXTENT_PAGES pages into each of two files in turn, through the
+// default buffer, reserving extentPages pages or growthPct percent of the
+// file at a time
+//
+RC BenchExtent(int extentPages, int growthPct)
+{
+	PF_Manager pfm;
+	PF_FileHandle fh1, fh2;
+	PF_PageHandle ph;
+	PageNum pageNum;
+	char *pData;
+	RC rc;
+
+	unlink(FILE1);
+	unlink(FILE2);
+	if ((rc = pfm.CreateFile(FILE1)) ||
+			(rc = pfm.CreateFile(FILE2)) ||
+			(rc = pfm.OpenFile(FILE1, fh1)) ||
+			(rc = pfm.OpenFile(FILE2, fh2)) ||
+			(rc = fh1.SetExtent(extentPages, growthPct)) ||
+			(rc = fh2.SetExtent(extentPages, growthPct)))
+		return (rc);
+
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	for (int i = 0; i < 2 * EXTENT_PAGES; i++) {
+		PF_FileHandle &fh = (i % 2) ? fh2 : fh1;
+		if ((rc = fh.AllocatePage(ph)) ||
+				(rc = ph.GetData(pData)) ||
+				(rc = ph.GetPageNum(pageNum)))
+			return (rc);
+		memcpy(pData, &pageNum, sizeof(int));
+		if ((rc = fh.UnpinPage(pageNum)))
+			return (rc);
+	}
+	if ((rc = fh1.SyncPages()) ||
+			(rc = fh2.SyncPages()))
+		return (rc);
+	double secs = Elapsed(start);
+
+	printf("extent  pages=%-4d growth=%-3d%% %8.1f ms  pieces %d + %d\n",
+			extentPages, growthPct, secs * 1e3, CountExtents(FILE1),
+			CountExtents(FILE2));
+
+	if ((rc = pfm.CloseFile(fh1)) ||
+			(rc = pfm.CloseFile(fh2)) ||
+			(rc = pfm.DestroyFile(FILE1)) ||
+			(rc = pfm.DestroyFile(FILE2)))
+		return (rc);
+
+	return (0);
+}
+
+//
+// FileSize
+//
+// Size of a file, 0 if it does not exist
+//
+static long long FileSize(const char *fileName)
+{
+	struct stat st;
+	return (stat(fileName, &st) < 0 ? 0 : (long long)st.st_size);
+}
+
+//
+// BenchCompress
+//
+// Write SCAN_PAGES pages of records made of a padded name and a number,
+// then scan the file cold
+//
+RC BenchCompress(int bCompressed)
+{
+	PF_Manager pfm;
+	PF_FileHandle fh;
+	PF_PageHandle ph;
+	PageNum pageNum;
+	char *pData;
+	unsigned int seed = 1;
+	RC rc;
+
+	unlink(FILE1);
+	if ((rc = pfm.ResizeBuffer(SCAN_BUFFER)) ||
+			(rc = pfm.CreateFile(FILE1, PF_DEFAULT_PAGE_SIZE, bCompressed)) ||
+			(rc = pfm.OpenFile(FILE1, fh)))
+		return (rc);
+	for (int i = 0; i < SCAN_PAGES; i++) {
+		if ((rc = fh.AllocatePage(ph)) ||
+				(rc = ph.GetData(pData)) ||
+				(rc = ph.GetPageNum(pageNum)))
+			return (rc);
+		memset(pData, 0, PF_PAGE_SIZE);
+		for (int off = 0; off + NAME_LENGTH + 4 <= PF_PAGE_SIZE;
+				off += NAME_LENGTH + 4) {
+			snprintf(pData + off, NAME_LENGTH, "student%d", rand_r(&seed) % 500);
+			int value = rand_r(&seed) % 100;
+			memcpy(pData + off + NAME_LENGTH, &value, sizeof(int));
+		}
+		if ((rc = fh.MarkDirty(pageNum)) ||
+				(rc = fh.UnpinPage(pageNum)))
+			return (rc);
+	}
+	if ((rc = pfm.CloseFile(fh)))
+		return (rc);
+	long long bytes = FileSize(FILE1) +
+		FileSize(PF_CompressedFile::MapName(FILE1).c_str());
+	DropCache(FILE1);
+
+	if ((rc = pfm.SetReadAhead(32)) ||
+			(rc = pfm.OpenFile(FILE1, fh)))
+		return (rc);
+
+	unsigned int sum = 0;
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	for (rc = fh.GetFirstPage(ph); rc == 0; rc = fh.GetNextPage(pageNum, ph)) {
+		if ((rc = ph.GetData(pData)) ||
+				(rc = ph.GetPageNum(pageNum)))
+			return (rc);
+		for (int i = 0; i < PF_PAGE_SIZE; i++)
+			sum = sum * 31 + (unsigned char)pData[i];
+		if ((rc = fh.UnpinPage(pageNum)))
+			return (rc);
+	}
+	if (rc != PF_EOF)
+		return (rc);
+	double secs = Elapsed(start);
+
+	printf("compress compressed=%d %10lld bytes %8.1f ms  (%u)\n",
+			bCompressed, bytes, secs * 1e3, sum % 10);
+
+	if ((rc = pfm.CloseFile(fh)) ||
+			(rc = pfm.DestroyFile(FILE1)))
+		return (rc);
+
+	return (0);
+}
+
+//
+// The suite: workloads on the buffer manager, each configuration printed
+// as one JSON object on a line of its own.
+//
+
+//
+// IoCounts: read and write system calls of the process, from /proc/self/io
+//
+struct IoCounts {
+	long long readCalls;                         // read, pread, preadv...
+	long long writeCalls;                        // write, pwrite, pwritev...
+};
+
+//
+// GetIoCounts
+//
+// Counts of the whole process, the background threads included.  Both are
+// 0 if /proc/self/io cannot be read.
+//
+static IoCounts GetIoCounts()
+{
+	IoCounts io = { 0, 0 };
+	char buf[512];
+
+	int fd = open("/proc/self/io", O_RDONLY);
+	if (fd < 0)
+		return (io);
+	ssize_t n = read(fd, buf, sizeof(buf) - 1);
+	close(fd);
+	if (n <= 0)
+		return (io);
+	buf[n] = '\0';
+
+	char *p;
+	if ((p = strstr(buf, "syscr:")))
+		io.readCalls = atoll(p + 6);
+	if ((p = strstr(buf, "syscw:")))
+		io.writeCalls = atoll(p + 6);
+	return (io);
+}
+
+//
+// SuiteRun: what a workload measures while it runs
+//
+struct SuiteRun {
+	vector<long long> nanos;                     // time of each operation
+	IoCounts io;                                 // counts at the start
+	PF_FileStats stats;                          // counters at the start
+	chrono::steady_clock::time_point start;
+
+	// Take the counts and start the clock
+	void Start(PF_Manager &pfm, int numOps) {
+		nanos.clear();
+		nanos.reserve(numOps);
+		pfm.GetFileStats(FILE1, stats);
+		io = GetIoCounts();
+		start = chrono::steady_clock::now();
+	}
+};
+
+//
+// Report
+//
+// Print a workload: its name and parameters, already formatted as JSON
+// members, the operations per second, the median and 99th percentile of
+// the time of an operation, the system calls made and the counters of the
+// buffer for the file.  The read of /proc/self/io at the start is counted
+// once and taken out.
+//
+static void Report(PF_Manager &pfm, SuiteRun &run, const char *workload,
+		const char *params)
+{
+	double secs = Elapsed(run.start);
+	IoCounts io = GetIoCounts();
+	PF_FileStats stats;
+	pfm.GetFileStats(FILE1, stats);
+
+	long long p50 = 0, p99 = 0;
+	size_t numOps = run.nanos.size();
+	if (numOps > 0) {
+		nth_element(run.nanos.begin(), run.nanos.begin() + numOps / 2,
+				run.nanos.end());
+		p50 = run.nanos[numOps / 2];
+		nth_element(run.nanos.begin(), run.nanos.begin() + numOps * 99 / 100,
+				run.nanos.end());
+		p99 = run.nanos[numOps * 99 / 100];
+	}
+
+	printf("{\"bench\":\"%s\",%s,\"ops\":%zu,\"ops_per_sec\":%.0f,"
+			"\"p50_ns\":%lld,\"p99_ns\":%lld,"
+			"\"read_calls\":%lld,\"write_calls\":%lld,"
+			"\"hits\":%ld,\"misses\":%ld,\"evictions\":%ld,"
+			"\"write_backs\":%ld}\n",
+			workload, params, numOps, numOps / secs, p50, p99,
+			io.readCalls - run.io.readCalls - 1,
+			io.writeCalls - run.io.writeCalls,
+			stats.hits - run.stats.hits, stats.misses - run.stats.misses,
+			stats.evictions - run.stats.evictions,
+			stats.writeBacks - run.stats.writeBacks);
+	fflush(stdout);
+}
+
+//
+// BenchSeq
+//
+// Scan a file of numPages pages with GetNextPage through a buffer of
+// poolPages pages, cold from disk or warm in the OS cache
+//
+RC BenchSeq(int poolPages, int numPages, int readAhead, int bCold)
+{
+	PF_Manager pfm;
+	PF_FileHandle fh;
+	PF_PageHandle ph;
+	PageNum pageNum;
+	SuiteRun run;
+	char params[128];
+	RC rc;
+
+	if ((rc = pfm.ResizeBuffer(poolPages)) ||
+			(rc = CreatePages(pfm, fh, numPages)) ||
+			(rc = pfm.CloseFile(fh)))
+		return (rc);
+	if (bCold)
+		DropCache(FILE1);
+	if ((rc = pfm.SetReadAhead(readAhead)) ||
+			(rc = pfm.OpenFile(FILE1, fh)))
+		return (rc);
+
+	run.Start(pfm, numPages);
+	long long last = PF_Nanos();
+	for (rc = fh.GetFirstPage(ph); rc == 0; rc = fh.GetNextPage(pageNum, ph)) {
+		if ((rc = ph.GetPageNum(pageNum)) ||
+				(rc = fh.UnpinPage(pageNum)))
+			return (rc);
+		long long now = PF_Nanos();
+		run.nanos.push_back(now - last);
+		last = now;
+	}
+	if (rc != PF_EOF)
+		return (rc);
+
+	sprintf(params, "\"pool\":%d,\"pages\":%d,\"readahead\":%d,\"cold\":%d",
+			poolPages, numPages, readAhead, bCold);
+	Report(pfm, run, "seq", params);
+
+	if ((rc = pfm.CloseFile(fh)) ||
+			(rc = pfm.DestroyFile(FILE1)))
+		return (rc);
+
+	return (0);
+}
+
+//
+// MakeRefs
+//
+// numRefs page numbers out of numPages, uniform if theta is 0 and
+// following a Zipf distribution of parameter theta otherwise.  The
+// popular pages are spread over the file rather than at its start.
+//
+static void MakeRefs(int numPages, double theta, int numRefs,
+		vector<PageNum> &refs)
+{
+	unsigned int seed = 1;
+	refs.resize(numRefs);
+
+	if (theta == 0) {
+		for (int i = 0; i < numRefs; i++)
+			refs[i] = rand_r(&seed) % numPages;
+		return;
+	}
+
+	// Cumulative weights of the ranks, then a page for each rank
+	vector<double> cdf(numPages);
+	double sum = 0;
+	for (int i = 0; i < numPages; i++)
+		cdf[i] = (sum += 1.0 / pow(i + 1.0, theta));
+	vector<PageNum> pageOfRank(numPages);
+	for (int i = 0; i < numPages; i++)
+		pageOfRank[i] = i;
+	for (int i = numPages - 1; i > 0; i--)
+		swap(pageOfRank[i], pageOfRank[rand_r(&seed) % (i + 1)]);
+
+	for (int i = 0; i < numRefs; i++) {
+		double u = (double)rand_r(&seed) / ((double)RAND_MAX + 1) * sum;
+		int rank = lower_bound(cdf.begin(), cdf.end(), u) - cdf.begin();
+		refs[i] = pageOfRank[min(rank, numPages - 1)];
+	}
+}
+
+//
+// BenchRandom
+//
+// SUITE_OPS GetThisPage of pages of a file of numPages pages, drawn by
+// MakeRefs, through a buffer of poolPages pages which is filled before the
+// clock starts.  Each page is written to and marked dirty if bDirty, with
+// the background writer set to tailPct.
+//
+RC BenchRandom(const char *workload, int poolPages, int numPages,
+		double theta, int bDirty, int tailPct)
+{
+	PF_Manager pfm;
+	PF_FileHandle fh;
+	PF_PageHandle ph;
+	vector<PageNum> refs;
+	SuiteRun run;
+	char params[160];
+	char *pData;
+	RC rc;
+
+	if ((rc = pfm.ResizeBuffer(poolPages)) ||
+			(rc = CreatePages(pfm, fh, numPages)) ||
+			(rc = fh.FlushPages()) ||
+			(rc = pfm.SetBgWriter(tailPct, 50, 90)))
+		return (rc);
+	MakeRefs(numPages, theta, SUITE_OPS, refs);
+
+	// Fill the buffer with the pages referenced first
+	for (int i = 0; i < SUITE_OPS && i < 4 * poolPages; i++)
+		if ((rc = fh.GetThisPage(refs[i], ph)) ||
+				(rc = fh.UnpinPage(refs[i])))
+			return (rc);
+
+	run.Start(pfm, SUITE_OPS);
+	for (int i = 0; i < SUITE_OPS; i++) {
+		long long start = PF_Nanos();
+		if ((rc = fh.GetThisPage(refs[i], ph)))
+			return (rc);
+		if (bDirty) {
+			if ((rc = ph.GetData(pData)))
+				return (rc);
+			pData[sizeof(int)]++;
+			if ((rc = fh.MarkDirty(refs[i])))
+				return (rc);
+		}
+		if ((rc = fh.UnpinPage(refs[i])))
+			return (rc);
+		run.nanos.push_back(PF_Nanos() - start);
+	}
+
+	sprintf(params, "\"pool\":%d,\"pages\":%d,\"theta\":%.2f,\"dirty\":%d,"
+			"\"bgwriter\":%d", poolPages, numPages, theta, bDirty, tailPct);
+	Report(pfm, run, workload, params);
+
+	if ((rc = pfm.CloseFile(fh)) ||
+			(rc = pfm.DestroyFile(FILE1)))
+		return (rc);
+
+	return (0);
+}
+
+//
+// RunSuite
+//
+// Every workload of the suite selected by name
+//
+RC RunSuite(int argc, char *argv[])
+{
+	RC rc;
+
+	if (Selected(argc, argv, "seq", TRUE))
+		if ((rc = BenchSeq(SUITE_POOL, 4 * SUITE_POOL, 0, TRUE)) ||
+				(rc = BenchSeq(SUITE_POOL, 4 * SUITE_POOL, 32, TRUE)) ||
+				(rc = BenchSeq(SUITE_POOL, 4 * SUITE_POOL, 32, FALSE)))
+			return (rc);
+
+	// The working set fits: the cost of a hit
+	if (Selected(argc, argv, "uniform", TRUE))
+		if ((rc = BenchRandom("uniform", SUITE_POOL, SUITE_POOL, 0,
+				FALSE, 0)))
+			return (rc);
+
+	// Skewed references to a working set larger than the buffer
+	if (Selected(argc, argv, "zipf", TRUE))
+		for (int ratio = 4; ratio <= 16; ratio *= 4)
+			if ((rc = BenchRandom("zipf", SUITE_POOL, ratio * SUITE_POOL,
+					0.99, FALSE, 0)))
+				return (rc);
+
+	// Uniform references with the buffer a shrinking share of the file
+	if (Selected(argc, argv, "churn", TRUE))
+		for (int ratio = 2; ratio <= 16; ratio *= 2)
+			if ((rc = BenchRandom("churn", SUITE_POOL, ratio * SUITE_POOL,
+					0, FALSE, 0)))
+				return (rc);
+
+	// Every page dirtied, each miss writing back a page or the background
+	// writer doing it
+	if (Selected(argc, argv, "storm", TRUE))
+		if ((rc = BenchRandom("storm", SUITE_POOL, 4 * SUITE_POOL, 0,
+					TRUE, 0)) ||
+				(rc = BenchRandom("storm", SUITE_POOL, 4 * SUITE_POOL, 0,
+					TRUE, 25)))
+			return (rc);
+
+	return (0);
+}
+
+int main(int argc, char *argv[])
+{
+	RC rc;
+
+	cout << "Starting PF benchmarks.\n";
+
+	if (Selected(argc, argv, "lookup", FALSE))
+		for (int numPages = 64; numPages <= 16384; numPages *= 4)
+			if ((rc = BenchLookup(numPages))) {
+				PF_PrintError(rc);
+				return (1);
+			}
+
+	if ((Selected(argc, argv, "scan", FALSE) &&
+				((rc = BenchScan(0)) ||
+				 (rc = BenchScan(32)))) ||
+			(Selected(argc, argv, "sparse", FALSE) &&
+				((rc = BenchSparse(SPARSE_STRIDE)) ||
+				 (rc = BenchSparse(1)))) ||
+			(Selected(argc, argv, "flush", FALSE) &&
+				(rc = BenchFlush())) ||
+			(Selected(argc, argv, "update", FALSE) &&
+				((rc = BenchUpdate(0)) ||
+				 (rc = BenchUpdate(25)))) ||
+			(Selected(argc, argv, "mmap", FALSE) &&
+				((rc = BenchMmap(PF_MODE_BUFFERED)) ||
+				 (rc = BenchMmap(PF_MODE_MMAP)))) ||
+			(Selected(argc, argv, "extent", FALSE) &&
+				((rc = BenchExtent(1, 0)) ||
+				 (rc = BenchExtent(8, 0)) ||
+				 (rc = BenchExtent(1024, 0)) ||
+				 (rc = BenchExtent(256, 25)))) ||
+			(Selected(argc, argv, "compress", FALSE) &&
+				((rc = BenchCompress(FALSE)) ||
+				 (rc = BenchCompress(TRUE)))) ||
+			(rc = RunSuite(argc, argv))) {
+		PF_PrintError(rc);
+		return (1);
+	}
+
+#ifdef PF_STATS
+	if (Selected(argc, argv, "stats", FALSE) && (rc = BenchStats())) {
+		PF_PrintError(rc);
+		return (1);
+	}
+#endif
+
+	cout << "Ending PF benchmarks.\n";
+
+	return (0);
+}
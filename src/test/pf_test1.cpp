@@ -10,7 +10,9 @@
 #include <cstdio>
 #include <iostream>
 #include <cstring>
+#include <utility>
 #include <unistd.h>
+#include <sys/stat.h>
 #include "pf.h"
 #include "pf_internal.h"
 #include "pf_hashtable.h"
@@ -18,14 +20,14 @@
 using namespace std;
 
 // The PF_STATS indicates that we will be tracking statistics for the PF
-// Layer.  The Manager is defined within pf_buffermgr.cc.  Here we must
+// Layer.  The counters are defined within pf_buffermgr.cc.  Here we must
 // place the initializer and then the final call to printout the statistics
 // once main has finished
 #ifdef PF_STATS
 #include "statistics.h"
 
 // This is defined within pf_buffermgr.cc
-extern StatisticsMgr *pStatisticsMgr;
+extern StatCounters pfStats;
 
 // This method is defined within pf_statistics.cc.  It is called at the end
 // to display the final statistics, or by the debugger to monitor progress.
@@ -40,61 +42,62 @@ extern void PF_Statistics();
 // These numbers have been confirmed.  Note that if you change any of the
 // tests, you will also need to change these numbers as well.
 //
+//
+// Stat
+//
+// Look a counter up by name.  Returns FALSE if there is no such counter.
+//
+static int Stat(const char *psName, long &value)
+{
+	int key = pfStats.Find(psName);
+	if (key < 0)
+		return (FALSE);
+	value = pfStats.Get(key);
+	return (TRUE);
+}
+
 void PF_ConfirmStatistics()
 {
-	// Must remember to delete the memory returned from StatisticsMgr::Get
+	long gp, pf, pnf, wp, rp, fp;
+
 	cout << "Verifying the statistics for buffer manager: ";
-	int *piGP = pStatisticsMgr->Get("GetPage");
-	int *piPF = pStatisticsMgr->Get("PageFound");
-	int *piPNF = pStatisticsMgr->Get("PageNotFound");
-	int *piWP = pStatisticsMgr->Get("WritePage");
-	int *piRP = pStatisticsMgr->Get("ReadPage");
-	int *piFP = pStatisticsMgr->Get("FlushPage");
-
-	if (piGP && (*piGP != 702)) {
-		cout << "Number of GetPages is incorrect! (" << *piGP << ")\n";
+
+	if (Stat("GetPage", gp) && (gp != 702)) {
+		cout << "Number of GetPages is incorrect! (" << gp << ")\n";
 		// No built in error code for this
 		exit(1);
 	}
-	if (piPF && (*piPF != 23)) {
+	if (Stat("PageFound", pf) && (pf != 23)) {
 		cout << "Number of pages found in the buffer is incorrect! (" <<
-		  *piPF << ")\n";
+		  pf << ")\n";
 		// No built in error code for this
 		exit(1);
 	}
-	if (piPNF && (*piPNF != 679)) {
+	if (Stat("PageNotFound", pnf) && (pnf != 679)) {
 		cout << "Number of pages not found in the buffer is incorrect! (" <<
-		  *piPNF << ")\n";
+		  pnf << ")\n";
 		// No built in error code for this
 		exit(1);
 	}
-	if (piRP && (*piRP != 679)) {
+	if (Stat("ReadPage", rp) && (rp != 679)) {
 		cout << "Number of read requests to the Unix file system is " <<
-			"incorrect! (" << *piPNF << ")\n";
+			"incorrect! (" << rp << ")\n";
 		// No built in error code for this
 		exit(1);
 	}
-	if (piWP && (*piWP != 339)) {
+	if (Stat("WritePage", wp) && (wp != 339)) {
 		cout << "Number of write requests to the Unix file system is "<<
-			"incorrect! (" << *piPNF << ")\n";
+			"incorrect! (" << wp << ")\n";
 		// No built in error code for this
 		exit(1);
 	}
-	if (piFP && (*piFP != 16)) {
+	if (Stat("FlushPage", fp) && (fp != 16)) {
 		cout << "Number of requests to flush the buffer is "<<
-			"incorrect! (" << *piPNF << ")\n";
+			"incorrect! (" << fp << ")\n";
 		// No built in error code for this
 		exit(1);
 	}
 	cout << " Correct!\n";
-
-	// Delete the memory returned from StatisticsMgr::Get
-	delete piGP;
-	delete piPF;
-	delete piPNF;
-	delete piWP;
-	delete piRP;
-	delete piFP;
 }
 #endif    // PF_STATS
 
@@ -114,6 +117,10 @@ RC PrintFile(PF_FileHandle &fh);
 RC ReadFile(PF_Manager &pfm, char* fname);
 RC TestPF();
 RC TestHash();
+RC TestFileMode(PF_FileMode mode);
+RC TestPageSize(int pageSize);
+RC TestBitmap();
+RC TestPageGuard(PF_FileMode mode);
 
 RC WriteFile(PF_Manager &pfm, char *fname)
 {
@@ -468,7 +475,7 @@ printf("get bock size returned %d\n",len);
 
 RC TestHash()
 {
-	PF_HashTable ht(PF_HASH_TBL_SIZE);
+	PF_HashTable ht(PF_BUFFER_SIZE);
 	RC           rc;
 	int          i, s;
 	PageNum      p;
@@ -482,6 +489,40 @@ RC TestHash()
 
 	cout << "Searching for entries\n";
 
+	for (i = 1; i < 11; i++)
+		for (p = 1; p < 11; p++) {
+			if ((rc = ht.Find(i, p, s)))
+				return(rc);
+			if (s != i + p) {
+				cout << "Found slot " << s << " for (" << i << "," << p << ")\n";
+				exit(1);
+			}
+		}
+
+	cout << "Deleting and reinserting every other entry\n";
+
+	for (i = 1; i < 11; i++)
+		for (p = 1 + i % 2; p < 11; p += 2)
+			if ((rc = ht.Delete(i, p)))
+				return(rc);
+	for (i = 1; i < 11; i++)
+		for (p = 1 + i % 2; p < 11; p += 2)
+			if ((rc = ht.Find(i, p, s)) != PF_HASHNOTFOUND ||
+					(rc = ht.Insert(i, p, i + p)))
+				return(rc ? rc : PF_HASHPAGEEXIST);
+
+	cout << "Resizing the table repeatedly\n";
+
+	// The size depends on the entries, not on how often it was resized
+	int size = ht.GetSize();
+	for (int n = 0; n < 20; n++)
+		if ((rc = ht.Resize(PF_BUFFER_SIZE)))
+			return(rc);
+	if (ht.GetSize() != size) {
+		cout << "Table grew from " << size << " to " << ht.GetSize() <<
+			" entries\n";
+		exit(1);
+	}
 	for (i = 1; i < 11; i++)
 		for (p = 1; p < 11; p++)
 			if ((rc = ht.Find(i, p, s)))
@@ -507,6 +548,448 @@ RC TestHash()
 	return (0);
 }
 
+//
+// TestFileMode
+//
+// Write a file larger than the buffer in the given file mode and read it
+// back through the buffer
+//
+RC TestFileMode(PF_FileMode mode)
+{
+	PF_Manager    pfm;
+	PF_FileHandle fh;
+	PF_PageHandle ph;
+	RC            rc;
+	char          *pData;
+	PageNum       pageNum, temp;
+	int           i;
+	struct stat   st;
+
+	cout << "Testing the " << (mode == PF_MODE_MMAP ? "mmap" : "direct") <<
+		" file mode.  Allocating more pages than the buffer holds\n";
+
+	if ((rc = pfm.SetFileMode(mode)) ||
+			(rc = pfm.CreateFile(FILE1)) ||
+			(rc = pfm.OpenFile(FILE1, fh)))
+		return(rc);
+
+	for (i = 0; i < PF_BUFFER_SIZE * 3; i++) {
+		if ((rc = fh.AllocatePage(ph)) ||
+				(rc = ph.GetData(pData)) ||
+				(rc = ph.GetPageNum(pageNum)))
+			return(rc);
+		if (i != pageNum) {
+			cout << "Page number incorrect: " << (int)pageNum << " " << i << "\n";
+			exit(1);
+		}
+		memcpy(pData, (char *)&pageNum, sizeof(PageNum));
+
+		// The buffer cannot hold all the pages pinned
+		if (mode == PF_MODE_DIRECT &&
+				((rc = fh.MarkDirty(pageNum)) ||
+				(rc = fh.UnpinPage(pageNum))))
+			return(rc);
+	}
+
+	if (mode == PF_MODE_DIRECT &&
+			(rc = fh.GetThisPage(1, ph)))
+		return(rc);
+	if ((rc = fh.DisposePage(1)) != PF_PAGEPINNED) {
+		cout << "Dispose pinned page should fail: ";
+		return(rc);
+	}
+	if ((rc = pfm.CloseFile(fh)) != PF_PAGEPINNED) {
+		cout << "Close file with pinned pages should fail: ";
+		return(rc);
+	}
+
+	for (i = 0; i < PF_BUFFER_SIZE * 3; i++) {
+		if (mode == PF_MODE_DIRECT && i != 1)
+			continue;
+		if ((rc = fh.MarkDirty(i)) ||
+				(rc = fh.UnpinPage(i)))
+			return(rc);
+	}
+
+	if ((rc = fh.UnpinPage(1)) != PF_PAGEUNPINNED) {
+		cout << "Unpin unpinned page should fail: ";
+		return(rc);
+	}
+
+	cout << "Disposing of odd pages and reusing them\n";
+
+	for (i = 1; i < PF_BUFFER_SIZE * 3; i += 2)
+		if ((rc = fh.DisposePage(i)))
+			return(rc);
+	if ((rc = fh.AllocatePage(ph)) ||
+			(rc = ph.GetPageNum(pageNum)) ||
+			(rc = fh.UnpinPage(pageNum)))
+		return(rc);
+	if (pageNum != 1) {
+		cout << "Got page " << (int)pageNum << " instead of a free page\n";
+		exit(1);
+	}
+
+	if ((rc = pfm.CloseFile(fh)))
+		return(rc);
+
+	// The room the mapping added must be gone, and the direct writes
+	// must have reached the file
+	if (stat(FILE1, &st) < 0 ||
+			st.st_size != PF_FILE_HDR_SIZE +
+				PF_BUFFER_SIZE * 3 * (PF_PAGE_SIZE + sizeof(PF_PageHdr))) {
+		cout << "File size is wrong after closing the mapping\n";
+		exit(1);
+	}
+
+	cout << "Reading the mapped file through the buffer\n";
+
+	if ((rc = pfm.SetFileMode(PF_MODE_BUFFERED)) ||
+			(rc = pfm.OpenFile(FILE1, fh)))
+		return(rc);
+
+	for (i = 0; i < PF_BUFFER_SIZE * 3; i += 2) {
+		if ((rc = fh.GetThisPage(i, ph)) ||
+				(rc = ph.GetData(pData)))
+			return(rc);
+		memcpy((char *)&temp, pData, sizeof(PageNum));
+		if (temp != i) {
+			cout << "Page " << i << " holds " << (int)temp << "\n";
+			exit(1);
+		}
+		if ((rc = fh.UnpinPage(i)))
+			return(rc);
+	}
+	if ((rc = fh.GetThisPage(3, ph)) != PF_INVALIDPAGE) {
+		cout << "Get disposed page should fail: ";
+		return(rc);
+	}
+
+	if ((rc = pfm.CloseFile(fh)) ||
+			(rc = pfm.DestroyFile(FILE1)))
+		return(rc);
+
+	// Return ok
+	return (0);
+}
+
+//
+// TestPageSize
+//
+// Write a file of pageSize pages, larger than the buffer, next to a file
+// of default pages, and read both back
+//
+RC TestPageSize(int pageSize)
+{
+	PF_Manager    pfm;
+	PF_FileHandle fh1, fh2;
+	PF_PageHandle ph;
+	RC            rc;
+	char          *pData;
+	PageNum       pageNum, temp;
+	int           i, length;
+	struct stat   st;
+
+	cout << "Testing pages of " << pageSize << " bytes\n";
+
+	if ((rc = pfm.CreateFile(FILE1, 5000)) != PF_BADPARAM) {
+		cout << "Create file of 5000 byte pages should fail: ";
+		return(rc);
+	}
+
+	if ((rc = pfm.CreateFile(FILE1, pageSize)) ||
+			(rc = pfm.CreateFile(FILE2)) ||
+			(rc = pfm.OpenFile(FILE1, fh1)) ||
+			(rc = pfm.OpenFile(FILE2, fh2)) ||
+			(rc = fh1.GetPageSize(length)))
+		return(rc);
+	if (length != PF_PageDataSize(pageSize)) {
+		cout << "Page size is " << length << "\n";
+		exit(1);
+	}
+
+	// Number the first and last bytes of every page of both files
+	for (i = 0; i < PF_BUFFER_SIZE * 3; i++) {
+		if ((rc = fh1.AllocatePage(ph)) ||
+				(rc = ph.GetData(pData)) ||
+				(rc = ph.GetPageNum(pageNum)))
+			return(rc);
+		memcpy(pData, (char *)&pageNum, sizeof(PageNum));
+		memcpy(pData + length - sizeof(PageNum), (char *)&pageNum,
+				sizeof(PageNum));
+		if ((rc = fh1.MarkDirty(pageNum)) ||
+				(rc = fh1.UnpinPage(pageNum)))
+			return(rc);
+
+		if ((rc = fh2.AllocatePage(ph)) ||
+				(rc = ph.GetData(pData)) ||
+				(rc = ph.GetPageNum(pageNum)))
+			return(rc);
+		memcpy(pData, (char *)&pageNum, sizeof(PageNum));
+		if ((rc = fh2.MarkDirty(pageNum)) ||
+				(rc = fh2.UnpinPage(pageNum)))
+			return(rc);
+	}
+
+	if ((rc = pfm.CloseFile(fh1)) ||
+			(rc = pfm.CloseFile(fh2)))
+		return(rc);
+
+	if (stat(FILE1, &st) < 0 ||
+			st.st_size != PF_FILE_HDR_SIZE + PF_BUFFER_SIZE * 3 * pageSize) {
+		cout << "File size is wrong for pages of " << pageSize << " bytes\n";
+		exit(1);
+	}
+
+	if ((rc = pfm.OpenFile(FILE1, fh1)) ||
+			(rc = pfm.OpenFile(FILE2, fh2)))
+		return(rc);
+
+	for (i = PF_BUFFER_SIZE * 3 - 1; i >= 0; i--) {
+		if ((rc = fh1.GetThisPage(i, ph)) ||
+				(rc = ph.GetData(pData)))
+			return(rc);
+		memcpy((char *)&temp, pData + length - sizeof(PageNum),
+				sizeof(PageNum));
+		if (temp != i) {
+			cout << "Page " << i << " ends with " << (int)temp << "\n";
+			exit(1);
+		}
+		if ((rc = fh1.UnpinPage(i)) ||
+				(rc = fh2.GetThisPage(i, ph)) ||
+				(rc = ph.GetData(pData)))
+			return(rc);
+		memcpy((char *)&temp, pData, sizeof(PageNum));
+		if (temp != i) {
+			cout << "Page " << i << " holds " << (int)temp << "\n";
+			exit(1);
+		}
+		if ((rc = fh2.UnpinPage(i)))
+			return(rc);
+	}
+
+	if ((rc = pfm.CloseFile(fh1)) ||
+			(rc = pfm.CloseFile(fh2)) ||
+			(rc = pfm.DestroyFile(FILE1)) ||
+			(rc = pfm.DestroyFile(FILE2)))
+		return(rc);
+
+	// Return ok
+	return (0);
+}
+
+//
+// TestBitmap
+//
+// Fill a file past the pages whose allocation bits fit in the header
+// page, keep one page out of STRIDE, and check that the scans and the
+// allocations use the bitmap after the file is reopened
+//
+RC TestBitmap()
+{
+	const int     STRIDE = 1000;
+	PF_Manager    pfm;
+	PF_FileHandle fh;
+	PF_PageHandle ph;
+	RC            rc;
+	PageNum       pageNum, next;
+	int           i, numPages = PF_HDR_BITMAP_BITS + 2 * STRIDE;
+
+	cout << "Testing the allocation bitmap\n";
+
+	if ((rc = pfm.CreateFile(FILE1)) ||
+			(rc = pfm.OpenFile(FILE1, fh)))
+		return(rc);
+
+	// The first bitmap page is skipped by the allocation
+	for (i = 0; i < numPages; i++) {
+		if ((rc = fh.AllocatePage(ph)) ||
+				(rc = ph.GetPageNum(pageNum)))
+			return(rc);
+		if (pageNum != i + (i >= PF_HDR_BITMAP_BITS)) {
+			cout << "Allocated page " << (int)pageNum << " for " << i << "\n";
+			exit(1);
+		}
+		if ((rc = fh.UnpinPage(pageNum)))
+			return(rc);
+	}
+	numPages++;
+
+	if ((rc = fh.GetThisPage(PF_HDR_BITMAP_BITS, ph)) != PF_INVALIDPAGE) {
+		cout << "Get bitmap page should fail: ";
+		return(rc);
+	}
+
+	for (i = 0; i < numPages; i++)
+		if (i % STRIDE && i != PF_HDR_BITMAP_BITS &&
+				(rc = fh.DisposePage(i)))
+			return(rc);
+
+	if ((rc = pfm.CloseFile(fh)) ||
+			(rc = pfm.OpenFile(FILE1, fh)))
+		return(rc);
+
+	// Only the pages kept must be found, forwards and backwards
+	next = 0;
+	for (rc = fh.GetFirstPage(ph); rc == 0; rc = fh.GetNextPage(pageNum, ph)) {
+		if ((rc = ph.GetPageNum(pageNum)) ||
+				(rc = fh.UnpinPage(pageNum)))
+			return(rc);
+		if (pageNum != next) {
+			cout << "Scan found page " << (int)pageNum << " instead of "
+				<< (int)next << "\n";
+			exit(1);
+		}
+		next += STRIDE;
+	}
+	if (rc != PF_EOF || next < numPages)
+		return(rc ? rc : PF_EOF);
+
+	for (rc = fh.GetLastPage(ph); rc == 0; rc = fh.GetPrevPage(pageNum, ph)) {
+		if ((rc = ph.GetPageNum(pageNum)) ||
+				(rc = fh.UnpinPage(pageNum)))
+			return(rc);
+		next -= STRIDE;
+		if (pageNum != next) {
+			cout << "Backward scan found page " << (int)pageNum
+				<< " instead of " << (int)next << "\n";
+			exit(1);
+		}
+	}
+	if (rc != PF_EOF || next != 0)
+		return(rc ? rc : PF_EOF);
+
+	// The lowest free pages are reused, the bitmap page is not
+	for (i = 1; i < numPages; i++) {
+		if (i % STRIDE == 0 || i == PF_HDR_BITMAP_BITS)
+			continue;
+		if ((rc = fh.AllocatePage(ph)) ||
+				(rc = ph.GetPageNum(pageNum)) ||
+				(rc = fh.UnpinPage(pageNum)))
+			return(rc);
+		if (pageNum != i) {
+			cout << "Reused page " << (int)pageNum << " instead of " << i << "\n";
+			exit(1);
+		}
+		if (i == 10)
+			break;
+	}
+
+	if ((rc = pfm.CloseFile(fh)) ||
+			(rc = pfm.DestroyFile(FILE1)))
+		return(rc);
+
+	// Return ok
+	return (0);
+}
+
+//
+// TestPageGuard
+//
+// Write and scan a file through page guards, which must unpin every page
+// they held, check that the pages marked dirty through them were written,
+// and that a page unpinned through its handle cannot be unpinned twice
+//
+RC TestPageGuard(PF_FileMode mode)
+{
+	const int     NUM_PAGES = 10;
+	PF_Manager    pfm;
+	PF_FileHandle fh;
+	PF_PageHandle ph;
+	RC            rc;
+	PageNum       pageNum;
+	char          *pData;
+	int           i;
+
+	cout << "Testing page guards in file mode " << (int)mode << "\n";
+
+	if ((rc = pfm.SetFileMode(mode)) ||
+			(rc = pfm.CreateFile(FILE1)) ||
+			(rc = pfm.OpenFile(FILE1, fh)))
+		return(rc);
+
+	// Each page is unpinned when its guard goes out of scope
+	for (i = 0; i < NUM_PAGES; i++) {
+		PF_PageGuard page;
+		if ((rc = fh.AllocatePage(page)) ||
+				(rc = page.GetData(pData)))
+			return(rc);
+		memcpy(pData, &i, sizeof(int));
+		if ((rc = page.MarkDirty()))
+			return(rc);
+	}
+
+	// A failed fetch leaves the guard without a page
+	{
+		PF_PageGuard page;
+		if ((rc = fh.GetThisPage(0, page)))
+			return(rc);
+		if ((rc = fh.GetThisPage(NUM_PAGES, page)) != PF_INVALIDPAGE) {
+			cout << "Get of page past the end should fail: ";
+			return(rc);
+		}
+		if ((rc = page.GetData(pData)) != PF_PAGEUNPINNED) {
+			cout << "Guard should hold no page: ";
+			return(rc);
+		}
+	}
+
+	// A moved pin is released once
+	{
+		PF_PageGuard page;
+		if ((rc = fh.GetThisPage(1, page)))
+			return(rc);
+		PF_PageGuard moved(std::move(page));
+		if ((rc = page.Release()) ||
+				(rc = moved.Release()) ||
+				(rc = moved.Release()))
+			return(rc);
+	}
+
+	if ((rc = fh.FlushPages()) ||
+			(rc = pfm.CloseFile(fh)) ||
+			(rc = pfm.OpenFile(FILE1, fh)))
+		return(rc);
+
+	// One guard walks the file, unpinning each page as it goes
+	{
+		PF_PageGuard page;
+		i = 0;
+		for (rc = fh.GetFirstPage(page); rc == 0;
+				rc = fh.GetNextPage(pageNum, page)) {
+			int stored;
+			if ((rc = page.GetPageNum(pageNum)) ||
+					(rc = page.GetData(pData)))
+				return(rc);
+			memcpy(&stored, pData, sizeof(int));
+			if (stored != pageNum || pageNum != i) {
+				cout << "Page " << (int)pageNum << " contains " << stored << "\n";
+				exit(1);
+			}
+			i++;
+		}
+		if (rc != PF_EOF || i != NUM_PAGES)
+			return(rc ? rc : PF_EOF);
+	}
+
+	// Unpinning through the handle checks the pin like UnpinPage
+	if ((rc = fh.GetThisPage(2, ph)) ||
+			(rc = fh.MarkDirty(ph)) ||
+			(rc = fh.UnpinPage(ph)))
+		return(rc);
+	if ((rc = fh.UnpinPage(ph)) != PF_PAGEUNPINNED) {
+		cout << "Unpin of an unpinned page should fail: ";
+		return(rc);
+	}
+
+	if ((rc = pfm.CloseFile(fh)) ||
+			(rc = pfm.DestroyFile(FILE1)))
+		return(rc);
+
+	// Return ok
+	return (0);
+}
+
 int main()
 {
 	RC rc;
@@ -528,7 +1011,13 @@ int main()
 
 	// Do tests
 	if ((rc = TestPF()) ||
-			(rc = TestHash())) {
+			(rc = TestHash()) ||
+			(rc = TestFileMode(PF_MODE_MMAP)) ||
+			(rc = TestFileMode(PF_MODE_DIRECT)) ||
+			(rc = TestPageSize(65536)) ||
+			(rc = TestBitmap()) ||
+			(rc = TestPageGuard(PF_MODE_BUFFERED)) ||
+			(rc = TestPageGuard(PF_MODE_MMAP))) {
 		PF_PrintError(rc);
 		return (1);
 	}
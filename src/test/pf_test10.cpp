@@ -0,0 +1,257 @@
+//
+// File:        pf_test10.cc
+// Description: Test the extents reserved when a file grows
+//
+// The length of the file shows the room reserved: a page at a time by
+// default, by a fixed extent, with a growth percentage and with
+// ReservePages.  The room
+// left at the end of a file is used again after it is closed and opened,
+// in the buffered and the mmap file modes, and the pages written come
+// back.
+//
+
+#include <cstdio>
+#include <iostream>
+#include <cstring>
+#include <cstdlib>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "pf.h"
+#include "pf_internal.h"
+
+using namespace std;
+
+//
+// Defines
+//
+#define FILE1        "file1"
+#define NUM_RESERVED 100         // pages reserved by ReservePages
+
+//
+// FilePages
+//
+// Pages the file has room for, from its length
+//
+static long long FilePages(const char *fileName)
+{
+	struct stat st;
+	if (stat(fileName, &st) < 0 || st.st_size < PF_FILE_HDR_SIZE)
+		return (0);
+	return ((st.st_size - PF_FILE_HDR_SIZE) / PF_DEFAULT_PAGE_SIZE);
+}
+
+//
+// Expect
+//
+// Check the room in FILE1
+//
+static void Expect(long long numPages, const char *when)
+{
+	if (FilePages(FILE1) != numPages) {
+		cout << "The file has room for " << FilePages(FILE1)
+			<< " pages instead of " << numPages << " " << when << "\n";
+		exit(1);
+	}
+}
+
+//
+// AddPages
+//
+// Allocate numPages pages, each holding its number, and write them
+//
+RC AddPages(PF_FileHandle &fh, int numPages)
+{
+	PF_PageHandle ph;
+	PageNum pageNum;
+	char *pData;
+	RC rc;
+
+	for (int i = 0; i < numPages; i++) {
+		if ((rc = fh.AllocatePage(ph)) ||
+				(rc = ph.GetData(pData)) ||
+				(rc = ph.GetPageNum(pageNum)))
+			return (rc);
+		memcpy(pData, &pageNum, sizeof(int));
+		if ((rc = fh.MarkDirty(pageNum)) ||
+				(rc = fh.UnpinPage(pageNum)))
+			return (rc);
+	}
+	return (fh.FlushPages());
+}
+
+//
+// CheckPages
+//
+// Read the pages of a file back
+//
+RC CheckPages(PF_FileHandle &fh, int numPages)
+{
+	PF_PageHandle ph;
+	PageNum pageNum;
+	char *pData;
+	int count = 0;
+	RC rc;
+
+	for (rc = fh.GetFirstPage(ph); rc == 0; rc = fh.GetNextPage(pageNum, ph)) {
+		if ((rc = ph.GetData(pData)) ||
+				(rc = ph.GetPageNum(pageNum)))
+			return (rc);
+		if (memcmp(pData, &pageNum, sizeof(int)) != 0) {
+			cout << "Page " << pageNum << " did not come back\n";
+			exit(1);
+		}
+		count++;
+		if ((rc = fh.UnpinPage(pageNum)))
+			return (rc);
+	}
+	if (rc != PF_EOF)
+		return (rc);
+
+	if (count != numPages) {
+		cout << count << " pages were read instead of " << numPages << "\n";
+		exit(1);
+	}
+	return (0);
+}
+
+//
+// TestExtents
+//
+// Grow a file with each setting
+//
+RC TestExtents()
+{
+	PF_Manager pfm;
+	PF_FileHandle fh;
+	RC rc;
+
+	cout << "Growing a file by extents\n";
+
+	unlink(FILE1);
+	if ((rc = pfm.CreateFile(FILE1)) ||
+			(rc = pfm.OpenFile(FILE1, fh)))
+		return (rc);
+
+	// By default, a page at a time
+	if ((rc = AddPages(fh, 3)))
+		return (rc);
+	Expect(3, "growing a page at a time");
+
+	// The first page reserves a whole extent, the others use it
+	if ((rc = fh.SetExtent(8)) ||
+			(rc = AddPages(fh, 1)))
+		return (rc);
+	Expect(3 + 8, "after the first page");
+	if ((rc = AddPages(fh, 8 - 1)))
+		return (rc);
+	Expect(3 + 8, "once the extent is used");
+
+	// With a growth percentage, the extent follows the size of the file
+	int numPages = 3 + 8;
+	if ((rc = fh.SetExtent(1, 100)) ||
+			(rc = AddPages(fh, 200 - numPages)))
+		return (rc);
+	numPages = 200;
+	if (FilePages(FILE1) < 2 * 100 || FilePages(FILE1) > 2 * numPages) {
+		cout << "The file has room for " << FilePages(FILE1)
+			<< " pages growing by 100%\n";
+		exit(1);
+	}
+
+	// Reserved ahead of a load
+	long long before = FilePages(FILE1);
+	if ((rc = fh.SetExtent(1)) ||
+			(rc = fh.ReservePages(before - numPages + NUM_RESERVED)))
+		return (rc);
+	Expect(before + NUM_RESERVED, "after ReservePages");
+	if ((rc = AddPages(fh, before - numPages + NUM_RESERVED)))
+		return (rc);
+	numPages = before + NUM_RESERVED;
+	Expect(numPages, "after filling the reserved pages");
+
+	// Bad settings are refused
+	if (fh.SetExtent(0) != PF_BADPARAM || fh.SetExtent(1, -1) != PF_BADPARAM ||
+			fh.ReservePages(-1) != PF_BADPARAM) {
+		cout << "Bad extents were accepted\n";
+		exit(1);
+	}
+
+	if ((rc = CheckPages(fh, numPages)) ||
+			(rc = pfm.CloseFile(fh)))
+		return (rc);
+
+	return (0);
+}
+
+//
+// TestReopen
+//
+// The room left at the end of a file is found again when it is opened
+//
+RC TestReopen()
+{
+	PF_Manager pfm;
+	PF_FileHandle fh;
+	RC rc;
+
+	cout << "Using the room of a closed file\n";
+
+	unlink(FILE1);
+	if ((rc = pfm.CreateFile(FILE1)) ||
+			(rc = pfm.OpenFile(FILE1, fh)) ||
+			(rc = fh.ReservePages(NUM_RESERVED)) ||
+			(rc = AddPages(fh, 10)) ||
+			(rc = pfm.CloseFile(fh)))
+		return (rc);
+	Expect(NUM_RESERVED, "after closing it");
+
+	// Reopened with another extent, the pages still fit
+	if ((rc = pfm.OpenFile(FILE1, fh)) ||
+			(rc = fh.SetExtent(1000)) ||
+			(rc = CheckPages(fh, 10)) ||
+			(rc = AddPages(fh, NUM_RESERVED - 10)) ||
+			(rc = pfm.CloseFile(fh)))
+		return (rc);
+	Expect(NUM_RESERVED, "once reopened");
+
+	// A file with room at its end can be mapped
+	if ((rc = pfm.ClearBuffer()) ||
+			(rc = pfm.OpenFile(FILE1, fh)) ||
+			(rc = fh.ReservePages(NUM_RESERVED)) ||
+			(rc = pfm.CloseFile(fh)) ||
+			(rc = pfm.SetFileMode(PF_MODE_MMAP)) ||
+			(rc = pfm.OpenFile(FILE1, fh)) ||
+			(rc = CheckPages(fh, NUM_RESERVED)) ||
+			(rc = AddPages(fh, 1)) ||
+			(rc = pfm.CloseFile(fh)) ||
+			(rc = pfm.SetFileMode(PF_MODE_BUFFERED)) ||
+			(rc = pfm.OpenFile(FILE1, fh)) ||
+			(rc = CheckPages(fh, NUM_RESERVED + 1)) ||
+			(rc = pfm.CloseFile(fh)) ||
+			(rc = pfm.DestroyFile(FILE1)))
+		return (rc);
+
+	return (0);
+}
+
+int main()
+{
+	RC rc;
+
+	// Write out initial starting message
+	cerr.flush();
+	cout.flush();
+	cout << "Starting PF extent test.\n";
+	cout.flush();
+
+	if ((rc = TestExtents()) ||
+			(rc = TestReopen())) {
+		PF_PrintError(rc);
+		return (1);
+	}
+
+	// Write ending message and exit
+	cout << "Ending PF extent test.\n\n";
+
+	return (0);
+}
@@ -0,0 +1,239 @@
+//
+// File:        pf_test11.cc
+// Description: Test the arenas carved out of buffer blocks
+//
+// Objects of every size are allocated, filled and checked for overlap.
+// Freed objects are reused by their size class, the budget stops an arena
+// from taking more blocks, and Release gives every block back to the
+// buffer.
+//
+
+#include <cstdio>
+#include <iostream>
+#include <cstring>
+#include <cstdlib>
+#include <vector>
+#include "pf.h"
+
+using namespace std;
+
+//
+// Defines
+//
+#define NUM_OBJECTS  2000        // objects allocated by TestAlloc
+#define ALLOC_PAGES  512         // buffer pages of TestAlloc
+#define BUFFER_PAGES 16          // buffer pages of TestRelease
+#define OBJECT_SIZE  1000        // size of the objects of TestBudget
+
+//
+// Fail
+//
+// Print an error and leave
+//
+static void Fail(const char *what)
+{
+	cout << what << "\n";
+	exit(1);
+}
+
+//
+// TestAlloc
+//
+// Allocate objects of every size, each filled with its number
+//
+RC TestAlloc()
+{
+	PF_Manager pfm;
+	PF_BlockArena arena(pfm);
+	vector<char *> objects(NUM_OBJECTS);
+	vector<int> sizes(NUM_OBJECTS);
+	RC rc;
+
+	cout << "Allocating objects of every size\n";
+
+	if ((rc = pfm.ResizeBuffer(ALLOC_PAGES)))
+		return (rc);
+
+	srand(11);
+	long long bytes = 0;
+	for (int i = 0; i < NUM_OBJECTS; i++) {
+		// Mostly small objects, some up to the largest
+		sizes[i] = (i % 10 == 0) ? 1 + rand() % PF_ARENA_MAX_ALLOC :
+			1 + rand() % 200;
+		if ((rc = arena.Alloc(sizes[i], objects[i])))
+			return (rc);
+		if ((size_t)objects[i] % PF_ARENA_MIN_CLASS != 0)
+			Fail("An object is not aligned");
+		memset(objects[i], i & 0xff, sizes[i]);
+		bytes += sizes[i];
+	}
+
+	for (int i = 0; i < NUM_OBJECTS; i++)
+		for (int j = 0; j < sizes[i]; j++)
+			if (objects[i][j] != (char)(i & 0xff))
+				Fail("Objects overlap");
+
+	// The blocks are filled well, more than half of each is used
+	if (arena.GetBytesHeld() % PF_DEFAULT_PAGE_SIZE != 0 ||
+			arena.GetBytesHeld() > 2 * bytes)
+		Fail("The arena holds too many blocks");
+
+	// The sizes out of range are refused
+	char *pData;
+	if (arena.Alloc(0, pData) != PF_BADPARAM ||
+			arena.Alloc(PF_ARENA_MAX_ALLOC + 1, pData) != PF_BADPARAM ||
+			arena.Free(objects[0], 0) != PF_BADPARAM)
+		Fail("A bad size was accepted");
+
+	return (arena.Release());
+}
+
+//
+// TestFree
+//
+// Freed objects are found again by size class, in the current block and
+// in what is left at the end of a block
+//
+RC TestFree()
+{
+	PF_Manager pfm;
+	PF_BlockArena arena(pfm);
+	char *pFirst, *pSecond, *pData;
+	RC rc;
+
+	cout << "Reusing freed objects\n";
+
+	// Same size class: 20 and 30 bytes both take 32
+	if ((rc = arena.Alloc(20, pFirst)) ||
+			(rc = arena.Alloc(20, pSecond)) ||
+			(rc = arena.Free(pFirst, 20)) ||
+			(rc = arena.Alloc(30, pData)))
+		return (rc);
+	if (pData != pFirst)
+		Fail("A freed object was not reused");
+	if ((rc = arena.Alloc(30, pData)))
+		return (rc);
+	if (pData == pFirst || pData == pSecond)
+		Fail("An object was handed out twice");
+
+	// The largest object takes a block of its own.  What was left of the
+	// first block then holds an object of the largest class.
+	long long held = arena.GetBytesHeld();
+	if ((rc = arena.Alloc(PF_ARENA_MAX_ALLOC, pData)))
+		return (rc);
+	if (arena.GetBytesHeld() != held + PF_DEFAULT_PAGE_SIZE)
+		Fail("The largest object did not take a block");
+	if ((rc = arena.Alloc(PF_ARENA_MAX_CLASS, pData)))
+		return (rc);
+	if (arena.GetBytesHeld() != held + PF_DEFAULT_PAGE_SIZE)
+		Fail("The end of a block was not used");
+
+	return (arena.Release());
+}
+
+//
+// TestBudget
+//
+// An arena stops at its budget
+//
+RC TestBudget()
+{
+	PF_Manager pfm;
+	PF_BlockArena arena(pfm, 2 * PF_DEFAULT_PAGE_SIZE);
+	char *pData;
+	RC rc;
+
+	cout << "Staying within the budget\n";
+
+	int count = 0;
+	while (!(rc = arena.Alloc(OBJECT_SIZE, pData)))
+		count++;
+	if (rc != PF_OVERBUDGET)
+		return (rc);
+	if (arena.GetBytesHeld() != 2 * PF_DEFAULT_PAGE_SIZE || count < 4)
+		Fail("The budget was not kept");
+
+	// Freed objects can still be allocated over budget
+	if ((rc = arena.Free(pData, OBJECT_SIZE)) ||
+			(rc = arena.Alloc(OBJECT_SIZE, pData)))
+		return (rc);
+
+	// Raising the budget lets the arena grow again
+	if ((rc = arena.SetBudget(0)) ||
+			(rc = arena.Alloc(OBJECT_SIZE, pData)))
+		return (rc);
+	if (arena.SetBudget(-1) != PF_BADPARAM)
+		Fail("A bad budget was accepted");
+
+	return (arena.Release());
+}
+
+//
+// TestRelease
+//
+// Release gives the buffer back, and an arena stops when the buffer is
+// full
+//
+RC TestRelease()
+{
+	PF_Manager pfm;
+	char *blocks[BUFFER_PAGES];
+	char *pData;
+	RC rc;
+
+	cout << "Giving the blocks back\n";
+
+	if ((rc = pfm.ResizeBuffer(BUFFER_PAGES)))
+		return (rc);
+
+	for (int round = 0; round < 2; round++) {
+		PF_BlockArena arena(pfm);
+		while (!(rc = arena.Alloc(PF_ARENA_MAX_ALLOC, pData)))
+			;
+		if (rc != PF_NOBUF)
+			return (rc);
+		if (arena.GetBytesHeld() != BUFFER_PAGES * PF_DEFAULT_PAGE_SIZE)
+			Fail("The arena did not fill the buffer");
+		if ((rc = arena.Release()))
+			return (rc);
+		if (arena.GetBytesHeld() != 0)
+			Fail("Bytes are still held");
+		// The second time, the destructor gives the blocks back
+		if (round == 1 && (rc = arena.Alloc(1, pData)))
+			return (rc);
+	}
+
+	// Every page of the buffer is free again
+	for (int i = 0; i < BUFFER_PAGES; i++)
+		if ((rc = pfm.AllocateBlock(blocks[i])))
+			return (rc);
+	for (int i = 0; i < BUFFER_PAGES; i++)
+		if ((rc = pfm.DisposeBlock(blocks[i])))
+			return (rc);
+
+	return (0);
+}
+
+int main()
+{
+	RC rc;
+
+	// Write out initial starting message
+	cerr.flush();
+	cout.flush();
+	cout << "Starting PF arena test.\n";
+	cout.flush();
+
+	if ((rc = TestAlloc()) ||
+			(rc = TestFree()) ||
+			(rc = TestBudget()) ||
+			(rc = TestRelease())) {
+		PF_PrintError(rc);
+		return (1);
+	}
+
+	// Write ending message and exit
+	cout << "Ending PF arena test.\n\n";
+
+	return (0);
+}
@@ -0,0 +1,244 @@
+//
+// File:        pf_test12.cc
+// Description: Test the background writer of the PF component
+//
+// Threads update random pages of a file larger than the buffer while the
+// background writer, with aggressive watermarks, keeps writing the pages
+// about to be replaced.  A page being written must be neither replaced
+// nor updated until the write is done.  Every page holds the number of
+// updates made to it, repeated over the whole page, so that a lost or torn
+// write shows.  The pages are checked in the buffer, after
+// FlushPages and after the file is opened again.  With PF_STATS, the test
+// also checks that the writer wrote pages.
+//
+
+#include <cstdio>
+#include <iostream>
+#include <cstring>
+#include <unistd.h>
+#include <thread>
+#include <vector>
+#include "pf.h"
+#include "pf_internal.h"
+
+using namespace std;
+
+#ifdef PF_STATS
+#include "statistics.h"
+
+// This is defined within pf_buffermgr.cc
+extern StatCounters pfStats;
+#endif
+
+//
+// Defines
+//
+#define FILE1        "file1"
+#define NUM_PAGES    400         // pages in the file
+#define NUM_FRAMES   64          // pages in the buffer
+#define NUM_SHARDS   4           // partitions of the buffer
+#define NUM_THREADS  4           // threads updating pages
+#define NUM_OPS      60000       // pages fetched by each thread
+#define TAIL_PCT     50          // watermarks of the background writer
+#define LOW_PCT      90
+#define HIGH_PCT     100
+
+// Counters of updates per page, each page is only updated by its owner
+static int counts[NUM_PAGES];
+
+//
+// CheckPage
+//
+// Check that the page pageNum holds its number and count updates
+//
+static void CheckPage(char *pData, PageNum pageNum, int count)
+{
+	int stored;
+
+	memcpy(&stored, pData, sizeof(int));
+	if (stored != pageNum) {
+		cout << "Page " << pageNum << " contains " << stored << "!\n";
+		exit(1);
+	}
+	for (int i = sizeof(int); i + (int)sizeof(int) <= PF_PAGE_SIZE;
+			i += sizeof(int)) {
+		memcpy(&stored, pData + i, sizeof(int));
+		if (stored != count) {
+			cout << "Page " << pageNum << " was updated " << count
+				<< " times but holds " << stored << " at " << i << "!\n";
+			exit(1);
+		}
+	}
+}
+
+//
+// Worker
+//
+// Body of a thread: fetch random pages and update the ones it owns
+//
+void Worker(PF_FileHandle *pfh, int id, RC *pRc)
+{
+	unsigned int seed = id + 1;
+	PF_PageHandle ph;
+	char *pData;
+	RC rc;
+
+	*pRc = 0;
+	for (int i = 0; i < NUM_OPS; i++) {
+		PageNum pageNum = rand_r(&seed) % NUM_PAGES;
+		int bOwner = (pageNum % NUM_THREADS == id);
+
+		if ((rc = pfh->GetThisPage(pageNum, ph)) ||
+				(rc = ph.GetData(pData))) {
+			*pRc = rc;
+			return;
+		}
+
+		// Only the owner changes the page, so its count is stable
+		if (bOwner) {
+			CheckPage(pData, pageNum, counts[pageNum]);
+			int count = ++counts[pageNum];
+			for (int j = sizeof(int); j + (int)sizeof(int) <= PF_PAGE_SIZE;
+					j += sizeof(int))
+				memcpy(pData + j, &count, sizeof(int));
+			if ((rc = pfh->MarkDirty(pageNum))) {
+				*pRc = rc;
+				return;
+			}
+		}
+
+		if ((rc = pfh->UnpinPage(pageNum))) {
+			*pRc = rc;
+			return;
+		}
+	}
+}
+
+//
+// CheckCounts
+//
+// Check that every page holds the number of updates made to it
+//
+RC CheckCounts(PF_FileHandle &fh)
+{
+	PF_PageHandle ph;
+	char *pData;
+	RC rc;
+
+	for (PageNum pageNum = 0; pageNum < NUM_PAGES; pageNum++) {
+		if ((rc = fh.GetThisPage(pageNum, ph)) ||
+				(rc = ph.GetData(pData)))
+			return (rc);
+
+		CheckPage(pData, pageNum, counts[pageNum]);
+
+		if ((rc = fh.UnpinPage(pageNum)))
+			return (rc);
+	}
+
+	return (0);
+}
+
+//
+// TestBgWriter
+//
+// Update the pages from several threads with the background writer on
+//
+RC TestBgWriter()
+{
+	PF_Manager pfm(PF_REPLACE_CLOCK, NUM_SHARDS);
+	PF_FileHandle fh;
+	PF_PageHandle ph;
+	char *pData;
+	PageNum pageNum;
+	RC rc;
+	int i;
+
+	cout << "Updating pages from " << NUM_THREADS
+		<< " threads with the background writer on\n";
+
+	unlink(FILE1);
+	if ((rc = pfm.ResizeBuffer(NUM_FRAMES)) ||
+			(rc = pfm.CreateFile(FILE1)) ||
+			(rc = pfm.OpenFile(FILE1, fh)))
+		return (rc);
+
+	for (i = 0; i < NUM_PAGES; i++) {
+		if ((rc = fh.AllocatePage(ph)) ||
+				(rc = ph.GetData(pData)) ||
+				(rc = ph.GetPageNum(pageNum)))
+			return (rc);
+		memset(pData, 0, PF_PAGE_SIZE);
+		memcpy(pData, &pageNum, sizeof(int));
+		if ((rc = fh.MarkDirty(pageNum)) ||
+				(rc = fh.UnpinPage(pageNum)))
+			return (rc);
+	}
+	if ((rc = fh.FlushPages()))
+		return (rc);
+
+#ifdef PF_STATS
+	int bgWrites = (int)pfStats.Get(PF_BGWRITE);
+#endif
+
+	if ((rc = pfm.SetBgWriter(TAIL_PCT, LOW_PCT, HIGH_PCT)))
+		return (rc);
+
+	vector<thread> threads;
+	vector<RC> results(NUM_THREADS);
+	for (i = 0; i < NUM_THREADS; i++)
+		threads.push_back(thread(Worker, &fh, i, &results[i]));
+	for (i = 0; i < NUM_THREADS; i++)
+		threads[i].join();
+	for (i = 0; i < NUM_THREADS; i++)
+		if (results[i])
+			return (results[i]);
+
+#ifdef PF_STATS
+	if ((int)pfStats.Get(PF_BGWRITE) == bgWrites) {
+		cout << "The background writer wrote no page!\n";
+		exit(1);
+	}
+#endif
+
+	// The pages in the buffer, then the ones read from disk, with the
+	// writer still running
+	if ((rc = CheckCounts(fh)) ||
+			(rc = fh.FlushPages()) ||
+			(rc = CheckCounts(fh)))
+		return (rc);
+
+	// And once the file is opened again, the writer turned off
+	if ((rc = pfm.CloseFile(fh)) ||
+			(rc = pfm.SetBgWriter(0, 0, 0)) ||
+			(rc = pfm.OpenFile(FILE1, fh)) ||
+			(rc = CheckCounts(fh)))
+		return (rc);
+
+	if ((rc = pfm.CloseFile(fh)) ||
+			(rc = pfm.DestroyFile(FILE1)))
+		return (rc);
+
+	return (0);
+}
+
+int main()
+{
+	RC rc;
+
+	// Write out initial starting message
+	cerr.flush();
+	cout.flush();
+	cout << "Starting PF background writer test.\n";
+	cout.flush();
+
+	if ((rc = TestBgWriter())) {
+		PF_PrintError(rc);
+		return (1);
+	}
+
+	// Write ending message and exit
+	cout << "Ending PF background writer test.\n\n";
+
+	return (0);
+}
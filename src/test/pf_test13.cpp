@@ -0,0 +1,262 @@
+//
+// File:        pf_test13.cc
+// Description: Test the read-ahead of the PF component
+//
+// A sparse file much larger than the buffer is scanned with read-ahead
+// on, and every page is checked to hold its own contents.  Then two files,
+// opened without the cache of the OS, are opened in turn, each closed right
+// after its scan started, while the pages read ahead for it are still being
+// loaded.  The second file gets the file descriptor of the first one, so
+// that a page of the first file loaded after it was closed would show in
+// the scan of the second.  With PF_STATS, the test also checks that pages
+// were read ahead.
+//
+
+#include <cstdio>
+#include <iostream>
+#include <cstring>
+#include <unistd.h>
+#include <vector>
+#include "pf.h"
+#include "pf_internal.h"
+
+using namespace std;
+
+#ifdef PF_STATS
+#include "statistics.h"
+
+// This is defined within pf_buffermgr.cc
+extern StatCounters pfStats;
+#endif
+
+//
+// Defines
+//
+#define FILE1        "file1"
+#define FILE2        "file2"
+#define NUM_PAGES    1000        // pages in the files
+#define NUM_FRAMES   64          // pages in the buffer
+#define READ_AHEAD   32          // pages read ahead of a scan
+#define FREE_EVERY   7           // one page out of 7 is disposed of
+#define NUM_ROUNDS   50          // files closed during a scan
+#define SCAN_START   4           // pages fetched before closing
+
+//
+// Word
+//
+// Word i of page pageNum of file fileNo
+//
+static int Word(int fileNo, PageNum pageNum, int i)
+{
+	return (fileNo * 10000000 + pageNum * 1000 + i);
+}
+
+//
+// CheckPage
+//
+// Check that the page pageNum holds its contents in file fileNo
+//
+static void CheckPage(char *pData, int fileNo, PageNum pageNum)
+{
+	for (int i = 0; i < PF_PAGE_SIZE / (int)sizeof(int); i++) {
+		int stored;
+		memcpy(&stored, pData + i * sizeof(int), sizeof(int));
+		if (stored != Word(fileNo, pageNum, i)) {
+			cout << "Page " << pageNum << " of file " << fileNo
+				<< " holds " << stored << " at word " << i << "!\n";
+			exit(1);
+		}
+	}
+}
+
+//
+// CreateFile
+//
+// Create file fileNo of NUM_PAGES pages, one out of FREE_EVERY disposed of
+//
+static RC CreateFile(PF_Manager &pfm, const char *fileName, int fileNo)
+{
+	PF_FileHandle fh;
+	PF_PageHandle ph;
+	PageNum pageNum;
+	char *pData;
+	RC rc;
+
+	unlink(fileName);
+	if ((rc = pfm.CreateFile(fileName)) ||
+			(rc = pfm.OpenFile(fileName, fh)))
+		return (rc);
+
+	for (int i = 0; i < NUM_PAGES; i++) {
+		if ((rc = fh.AllocatePage(ph)) ||
+				(rc = ph.GetData(pData)) ||
+				(rc = ph.GetPageNum(pageNum)))
+			return (rc);
+		for (int j = 0; j < PF_PAGE_SIZE / (int)sizeof(int); j++) {
+			int word = Word(fileNo, pageNum, j);
+			memcpy(pData + j * sizeof(int), &word, sizeof(int));
+		}
+		if ((rc = fh.MarkDirty(pageNum)) ||
+				(rc = fh.UnpinPage(pageNum)))
+			return (rc);
+	}
+	for (pageNum = 0; pageNum < NUM_PAGES; pageNum += FREE_EVERY)
+		if ((rc = fh.DisposePage(pageNum)))
+			return (rc);
+
+	return (pfm.CloseFile(fh));
+}
+
+//
+// Scan
+//
+// Scan file fileNo with hint, checking every page, and stop after
+// numPages pages or at the end of the file
+//
+static RC Scan(PF_FileHandle &fh, int fileNo, ClientHint hint, int numPages)
+{
+	PF_PageHandle ph;
+	PageNum pageNum = -1;
+	char *pData;
+	RC rc;
+	int n = 0;
+
+	while (n < numPages &&
+			(rc = fh.GetNextPage(pageNum, ph, hint)) != PF_EOF) {
+		PageNum next;
+		if (rc ||
+				(rc = ph.GetData(pData)) ||
+				(rc = ph.GetPageNum(next)))
+			return (rc);
+
+		// The disposed of pages are skipped, and only them
+		for (pageNum++; pageNum < next; pageNum++)
+			if (pageNum % FREE_EVERY != 0) {
+				cout << "Page " << pageNum << " was skipped!\n";
+				exit(1);
+			}
+		if (pageNum % FREE_EVERY == 0) {
+			cout << "Page " << pageNum << " was disposed of!\n";
+			exit(1);
+		}
+
+		CheckPage(pData, fileNo, pageNum);
+		if ((rc = fh.UnpinPage(pageNum)))
+			return (rc);
+		n++;
+	}
+
+	// A whole scan saw every page
+	if (n < numPages &&
+			n != NUM_PAGES - (NUM_PAGES + FREE_EVERY - 1) / FREE_EVERY) {
+		cout << "The scan of file " << fileNo << " saw " << n << " pages!\n";
+		exit(1);
+	}
+	return (0);
+}
+
+//
+// TestScan
+//
+// Scan a file with read-ahead on, with and without the scan hint
+//
+RC TestScan()
+{
+	PF_Manager pfm;
+	PF_FileHandle fh;
+	RC rc;
+
+	cout << "Scanning with read-ahead\n";
+
+	if ((rc = pfm.ResizeBuffer(NUM_FRAMES)) ||
+			(rc = pfm.SetReadAhead(READ_AHEAD)) ||
+			(rc = CreateFile(pfm, FILE1, 1)))
+		return (rc);
+
+#ifdef PF_STATS
+	int prefetched = (int)pfStats.Get(PF_PREFETCHPAGE);
+#endif
+
+	if ((rc = pfm.OpenFile(FILE1, fh)) ||
+			(rc = Scan(fh, 1, NO_HINT, NUM_PAGES)) ||
+			(rc = Scan(fh, 1, SEQUENTIAL_SCAN, NUM_PAGES)) ||
+			(rc = pfm.CloseFile(fh)))
+		return (rc);
+
+#ifdef PF_STATS
+	if ((int)pfStats.Get(PF_PREFETCHPAGE) == prefetched) {
+		cout << "No page was read ahead!\n";
+		exit(1);
+	}
+#endif
+
+	return (pfm.DestroyFile(FILE1));
+}
+
+//
+// TestClose
+//
+// Close files while pages are read ahead for them, then scan the file
+// opened next
+//
+RC TestClose()
+{
+	PF_Manager pfm;
+	PF_FileHandle fh;
+	RC rc;
+
+	cout << "Closing files while pages are read ahead\n";
+
+	// Without the cache of the OS, the pages read ahead take long enough
+	// to be still on their way when the file is closed
+	if ((rc = pfm.SetFileMode(PF_MODE_DIRECT)) ||
+			(rc = pfm.ResizeBuffer(NUM_FRAMES)) ||
+			(rc = pfm.SetReadAhead(READ_AHEAD)) ||
+			(rc = CreateFile(pfm, FILE1, 1)) ||
+			(rc = CreateFile(pfm, FILE2, 2)))
+		return (rc);
+
+	for (int i = 0; i < NUM_ROUNDS; i++) {
+		const char *fileName = (i % 2) ? FILE2 : FILE1;
+		int fileNo = (i % 2) ? 2 : 1;
+
+		// The file opened before was closed during its scan
+		if ((rc = pfm.OpenFile(fileName, fh)) ||
+				(rc = Scan(fh, fileNo, NO_HINT, NUM_PAGES)) ||
+				(rc = pfm.CloseFile(fh)))
+			return (rc);
+
+		if ((rc = pfm.OpenFile(fileName, fh)) ||
+				(rc = Scan(fh, fileNo, NO_HINT, SCAN_START)) ||
+				(rc = pfm.CloseFile(fh)))
+			return (rc);
+	}
+
+	if ((rc = pfm.DestroyFile(FILE1)) ||
+			(rc = pfm.DestroyFile(FILE2)))
+		return (rc);
+
+	return (0);
+}
+
+int main()
+{
+	RC rc;
+
+	// Write out initial starting message
+	cerr.flush();
+	cout.flush();
+	cout << "Starting PF read-ahead test.\n";
+	cout.flush();
+
+	if ((rc = TestScan()) ||
+			(rc = TestClose())) {
+		PF_PrintError(rc);
+		return (1);
+	}
+
+	// Write ending message and exit
+	cout << "Ending PF read-ahead test.\n\n";
+
+	return (0);
+}
@@ -13,6 +13,7 @@
 #include <iostream>
 #include <cstring>
 #include <unistd.h>
+#include <thread>
 #include "pf.h"
 #include "pf_internal.h"
 #include "pf_hashtable.h"
@@ -20,14 +21,15 @@
 using namespace std;
 
 // The PF_STATS indicates that we will be tracking statistics for the PF
-// Layer.  The Manager is defined within pf_buffermgr.cc.  Here we must
+// Layer.  The counters are defined within pf_buffermgr.cc.  Here we must
 // place the initializer and then the final call to printout the statistics
 // once main has finished
 #ifdef PF_STATS
 #include "statistics.h"
 
-// This is defined within pf_buffermgr.cc
-extern StatisticsMgr *pStatisticsMgr;
+// These are defined within pf_buffermgr.cc
+extern StatCounters pfStats;
+extern StatHistograms pfTimes;
 
 // This method is defined within pf_statistics.cc.  It is called at the end
 // to display the final statistics, or by the debugger to monitor progress.
@@ -94,33 +96,29 @@ RC TestPF()
 	// Also that PF_PAGENOTFOUND = PF_BUFFER_SIZE.
 #ifdef PF_STATS
 	cout << "Verifying the statistics for buffer manager: ";
-	int *piGP = pStatisticsMgr->Get(PF_GETPAGE);
-	int *piPF = pStatisticsMgr->Get(PF_PAGEFOUND);
-	int *piPNF = pStatisticsMgr->Get(PF_PAGENOTFOUND);
+	long gp = pfStats.Get(PF_GETPAGE);
+	long pf = pfStats.Get(PF_PAGEFOUND);
+	long pnf = pfStats.Get(PF_PAGENOTFOUND);
 
-	if (piGP && (*piGP != PF_BUFFER_SIZE)) {
-		cout << "Number of GetPages is incorrect! (" << *piGP << ")\n";
+	if (gp && (gp != PF_BUFFER_SIZE)) {
+		cout << "Number of GetPages is incorrect! (" << gp << ")\n";
 		// No built in error code for this
 		exit(1);
 	}
-	if (piPF && (*piPF != PF_BUFFER_SIZE)) {
+	if (pf && (pf != PF_BUFFER_SIZE)) {
 		cout << "Number of pages found in the buffer is incorrect! (" <<
-		  *piPF << ")\n";
+		  pf << ")\n";
 		// No built in error code for this
 		exit(1);
 	}
-	if (piPNF!=NULL) {
+	if (pnf != 0) {
 		cout << "Number of pages not found in the buffer is incorrect! (" <<
-		  *piPNF << ")\n";
+		  pnf << ")\n";
 		// No built in error code for this
 		exit(1);
 	}
 	cout << " Correct!\n";
 
-	delete piGP;
-	delete piPF;
-	delete piPNF;
-
 #endif                 // PF_STATS
 
 	cout << "Unpinning pages.\n";
@@ -134,25 +132,22 @@ RC TestPF()
 	// pages.
 #ifdef PF_STATS
 	cout << "Verifying the write statistics for buffer manager: ";
-	int *piWP = pStatisticsMgr->Get(PF_WRITEPAGE);
-	int *piRP = pStatisticsMgr->Get(PF_READPAGE);
+	long wp = pfStats.Get(PF_WRITEPAGE);
+	long rp = pfStats.Get(PF_READPAGE);
 
-	if (piWP && (*piWP != PF_BUFFER_SIZE)) {
-		cout << "Number of write pages is incorrect! (" << *piGP << ")\n";
+	if (wp && (wp != PF_BUFFER_SIZE)) {
+		cout << "Number of write pages is incorrect! (" << gp << ")\n";
 		// No built in error code for this
 		exit(1);
 	}
-	if (piRP!=NULL) {
+	if (rp != 0) {
 		cout << "Number of pages read in is incorrect! (" <<
-		  *piPNF << ")\n";
+		  pnf << ")\n";
 		// No built in error code for this
 		exit(1);
 	}
 	cout << " Correct!\n";
 
-	delete piWP;
-	delete piRP;
-
 #endif          // PF_STATS
 
 	// Goal here is to push out of the buffer manager the old pages by
@@ -195,17 +190,16 @@ RC TestPF()
 	// not have had any of the pages.
 #ifdef PF_STATS
 	cout << "Verifying that pages were not found in buffer pool: ";
-	piPNF = pStatisticsMgr->Get(PF_PAGENOTFOUND);
+	pnf = pfStats.Get(PF_PAGENOTFOUND);
 
-	if (piPNF && (*piPNF != PF_BUFFER_SIZE)) {
+	if (pnf && (pnf != PF_BUFFER_SIZE)) {
 		cout << "Number of pages not found in the buffer is incorrect! (" <<
-		  *piPF << ")\n";
+		  pf << ")\n";
 		// No built in error code for this
 		exit(1);
 	}
 	cout << " Correct!\n";
 
-	delete piPNF;
 #endif          // PF_STATS
 
 	// Now we will Flush the buffer manager to disk and count the number of
@@ -216,24 +210,22 @@ RC TestPF()
 
 #ifdef PF_
 	cout << "Testing flush to disk: ";
-	int *piFP = pStatisticsMgr->Get(PF_FLUSHPAGES);
-	piWP = pStatisticsMgr->Get(PF_WRITEPAGE);
+	long fp = pfStats.Get(PF_FLUSHPAGES);
+	wp = pfStats.Get(PF_WRITEPAGE);
 
-	if (piFP && (*piFP != 1)) {
+	if (fp && (fp != 1)) {
 		cout << "Number of times Flush pages routine has been called " <<
-			"is incorrect! (" << *piFP << ")\n";
+			"is incorrect! (" << fp << ")\n";
 		// No built in error code for this
 		exit(1);
 	}
-	if (piWP && (*piWP != 2*PF_BUFFER_SIZE)) {
-		cout << "Number of written pages is incorrect! (" << *piWP << ")\n";
+	if (wp && (wp != 2*PF_BUFFER_SIZE)) {
+		cout << "Number of written pages is incorrect! (" << wp << ")\n";
 		// No built in error code for this
 		exit(1);
 	}
 	cout << " Correct!\n";
 
-	delete piFP;
-	delete piWP;
 #endif
 
 
@@ -245,23 +237,42 @@ RC TestPF()
 	// increased!  Since everything was already flushed.
 #ifdef PF_STATS
 	cout << "Testing number of pages written to disk: ";
-	piWP = pStatisticsMgr->Get(PF_WRITEPAGE);
+	wp = pfStats.Get(PF_WRITEPAGE);
 
 	// This number should not have increased since last time!
-	if (piWP && (*piWP != 2*PF_BUFFER_SIZE)) {
-		cout << "Number of written pages is incorrect! (" << *piWP << ")\n";
+	if (wp && (wp != 2*PF_BUFFER_SIZE)) {
+		cout << "Number of written pages is incorrect! (" << wp << ")\n";
 		// No built in error code for this
 		exit(1);
 	}
 	cout << " Correct!\n";
 
-	delete piWP;
 #endif
 
 	// Close the file
 	if ((rc = pfm.CloseFile(fh)))
 		return(rc);
 
+	// Every read and write call must have been timed
+#ifdef PF_STATS
+	cout << "Verifying the timing of the reads and writes: ";
+	if (pfTimes.Count(PF_READTIME) != pfStats.Get(PF_READPAGE) ||
+			pfTimes.Count(PF_WRITETIME) != pfStats.Get(PF_WRITEPAGE) -
+			pfStats.Get(PF_WRITESAVED)) {
+		cout << "Number of timed calls is incorrect! (" <<
+			pfTimes.Count(PF_READTIME) << ", " <<
+			pfTimes.Count(PF_WRITETIME) << ")\n";
+		// No built in error code for this
+		exit(1);
+	}
+	if (pfTimes.Percentile(PF_READTIME, 50) >
+			pfTimes.Percentile(PF_READTIME, 99)) {
+		cout << "The percentiles of the read times are out of order!\n";
+		exit(1);
+	}
+	cout << " Correct!\n";
+#endif
+
 	// If we are dealing with statistics then we might as well output the
 	// final numbers
 #ifdef PF_STATS
@@ -272,6 +283,44 @@ RC TestPF()
 	return (0);
 }
 
+#ifdef PF_STATS
+//
+// TestThreadSlots
+//
+// Threads which exit give their copy of the counters back, so that the
+// threads started later still count without sharing one
+//
+RC TestThreadSlots()
+{
+	static const char *psNames[] = { "COUNT" };
+	StatCounters counters(1, psNames);
+	int numThreads = 4 * STAT_NUM_SLOTS;
+
+	cout << "Counting from " << numThreads << " threads in turn";
+	for (int i = 0; i < numThreads; i++) {
+		int slot;
+		thread t([&]() {
+			slot = StatThreadSlot();
+			counters.Add(0);
+		});
+		t.join();
+		if (slot >= STAT_NUM_SLOTS - 1) {
+			cout << "\nThread " << i << " got the shared copy!\n";
+			exit(1);
+		}
+	}
+	if (counters.Get(0) != numThreads) {
+		cout << "\nCounted " << counters.Get(0) << " instead of " <<
+			numThreads << "!\n";
+		exit(1);
+	}
+	cout << " Correct!\n";
+
+	// Return ok
+	return (0);
+}
+#endif
+
 int main()
 {
 	RC rc;
@@ -294,7 +343,11 @@ int main()
 	// Delete files from last time
 	unlink(FILE1);
 
-	if ((rc = TestPF())) {
+	if ((rc = TestPF())
+#ifdef PF_STATS
+			|| (rc = TestThreadSlots())
+#endif
+			) {
 		PF_PrintError(rc);
 		return (1);
 	}
@@ -0,0 +1,317 @@
+//
+// File:        pf_test4.cc
+// Description: Test the page replacement policies of the PF component
+//
+// A small set of hot pages is used over and over while a large file is
+// scanned, and then the file is scanned once more on its own.  Every
+// policy must return the right page contents.  With 2Q and LRU-K the hot
+// pages must survive the last scan, while plain LRU is expected to lose
+// them.  A scan with the SEQUENTIAL_SCAN hint goes through the scan ring
+// of the buffer and must leave the hot pages there under every policy.
+// Compile with -DPF_STATS to check the hits.
+//
+
+#include <cstdio>
+#include <iostream>
+#include <cstring>
+#include <cstdlib>
+#include <unistd.h>
+#include "pf.h"
+#include "pf_internal.h"
+
+using namespace std;
+
+#ifdef PF_STATS
+#include "statistics.h"
+
+// This is defined within pf_buffermgr.cc
+extern StatCounters pfStats;
+#endif
+
+//
+// Defines
+//
+#define FILE1       "file1"
+#define NUM_HOT     10                    // pages used over and over
+#define NUM_PAGES   (5 * PF_BUFFER_SIZE)  // size of the scanned file
+#define HOT_EVERY   4                     // scanned pages per hot page
+
+static const char *PolicyName(PF_ReplacePolicy policy)
+{
+	switch (policy) {
+	case PF_REPLACE_LRU:   return "LRU";
+	case PF_REPLACE_CLOCK: return "CLOCK";
+	case PF_REPLACE_2Q:    return "2Q";
+	case PF_REPLACE_LRUK:  return "LRU-K";
+	}
+	return "?";
+}
+
+//
+// ReadPage
+//
+// Fetch a page, check that it holds its own number and unpin it
+//
+RC ReadPage(PF_FileHandle &fh, PageNum pageNum, ClientHint hint = NO_HINT)
+{
+	RC rc;
+	PF_PageHandle ph;
+	char *pData;
+	int stored;
+
+	if ((rc = fh.GetThisPage(pageNum, ph, hint)) ||
+			(rc = ph.GetData(pData)))
+		return (rc);
+
+	memcpy(&stored, pData, sizeof(int));
+	if (stored != pageNum) {
+		cout << "Page " << pageNum << " contains " << stored << "!\n";
+		exit(1);
+	}
+
+	return (fh.UnpinPage(pageNum));
+}
+
+//
+// Stat
+//
+// Value of a statistic so far, 0 without PF_STATS
+//
+int Stat(int key)
+{
+#ifdef PF_STATS
+	return ((int)pfStats.Get(key));
+#else
+	return (0);
+#endif
+}
+
+//
+// FoundPages
+//
+// Number of GetPage calls satisfied by the buffer so far
+//
+int FoundPages()
+{
+#ifdef PF_STATS
+	return (Stat(PF_PAGEFOUND));
+#else
+	return (0);
+#endif
+}
+
+//
+// TestPolicy
+//
+// Write the file, then scan it while using the hot pages.  Returns the
+// number of hits on the hot pages after a final plain scan in iHotHits.
+//
+RC TestPolicy(PF_ReplacePolicy policy, int &iHotHits)
+{
+	PF_Manager pfm(policy);
+	PF_FileHandle fh;
+	PF_PageHandle ph;
+	RC rc;
+	char *pData;
+	PageNum pageNum;
+	int i, round;
+
+	cout << "Testing " << PolicyName(policy) << " policy.\n";
+
+	unlink(FILE1);
+	if ((rc = pfm.CreateFile(FILE1)) ||
+			(rc = pfm.OpenFile(FILE1, fh)))
+		return (rc);
+
+	for (i = 0; i < NUM_PAGES; i++) {
+		if ((rc = fh.AllocatePage(ph)) ||
+				(rc = ph.GetData(pData)) ||
+				(rc = ph.GetPageNum(pageNum)))
+			return (rc);
+		memcpy(pData, &pageNum, sizeof(int));
+		if ((rc = fh.UnpinPage(pageNum)))
+			return (rc);
+	}
+
+	// Start from an empty buffer
+	if ((rc = fh.FlushPages()))
+		return (rc);
+
+	// Scan the file a few times while the hot pages keep being used
+	for (round = 0; round < 3; round++)
+		for (i = NUM_HOT; i < NUM_PAGES; i++)
+			if ((rc = ReadPage(fh, i)) ||
+					(i % HOT_EVERY == 0 &&
+					 (rc = ReadPage(fh, (i / HOT_EVERY) % NUM_HOT))))
+				return (rc);
+
+	// Then scan it once more without touching the hot pages
+	for (i = NUM_HOT; i < NUM_PAGES; i++)
+		if ((rc = ReadPage(fh, i)))
+			return (rc);
+
+	// Count the hot pages which survived the last scan
+	int found = FoundPages();
+	for (i = 0; i < NUM_HOT; i++)
+		if ((rc = ReadPage(fh, i)))
+			return (rc);
+	iHotHits = FoundPages() - found;
+
+	// Switching policy must keep the buffer consistent
+	if ((rc = pfm.SetReplacePolicy(PF_REPLACE_CLOCK)))
+		return (rc);
+	for (i = 0; i < NUM_PAGES; i++)
+		if ((rc = ReadPage(fh, i)))
+			return (rc);
+
+	if ((rc = pfm.CloseFile(fh)) ||
+			(rc = pfm.DestroyFile(FILE1)))
+		return (rc);
+
+	return (0);
+}
+
+//
+// TestScanRing
+//
+// Warm the hot pages, then scan the file with the SEQUENTIAL_SCAN hint
+// while using them, and once more on its own.  The scan must go through
+// the ring and leave all the hot pages in the buffer.
+//
+RC TestScanRing(PF_ReplacePolicy policy)
+{
+	PF_Manager pfm(policy);
+	PF_FileHandle fh;
+	PF_PageHandle ph;
+	RC rc;
+	char *pData;
+	PageNum pageNum;
+	int i, round;
+
+	cout << "Testing the scan ring with " << PolicyName(policy)
+		<< " policy.\n";
+
+	unlink(FILE1);
+	if ((rc = pfm.CreateFile(FILE1)) ||
+			(rc = pfm.OpenFile(FILE1, fh)))
+		return (rc);
+
+	for (i = 0; i < NUM_PAGES; i++) {
+		if ((rc = fh.AllocatePage(ph)) ||
+				(rc = ph.GetData(pData)) ||
+				(rc = ph.GetPageNum(pageNum)))
+			return (rc);
+		memcpy(pData, &pageNum, sizeof(int));
+		if ((rc = fh.MarkDirty(pageNum)) ||
+				(rc = fh.UnpinPage(pageNum)))
+			return (rc);
+	}
+	if ((rc = fh.FlushPages()))
+		return (rc);
+
+	// The hot pages are used twice, so that every policy keeps them
+	for (round = 0; round < 2; round++)
+		for (i = 0; i < NUM_HOT; i++)
+			if ((rc = ReadPage(fh, i)))
+				return (rc);
+
+	int reused = Stat(PF_RINGREUSE);
+	for (i = NUM_HOT; i < NUM_PAGES; i++)
+		if ((rc = ReadPage(fh, i, SEQUENTIAL_SCAN)) ||
+				(i % HOT_EVERY == 0 &&
+				 (rc = ReadPage(fh, (i / HOT_EVERY) % NUM_HOT))))
+			return (rc);
+	for (i = NUM_HOT; i < NUM_PAGES; i++)
+		if ((rc = ReadPage(fh, i, ONE_SHOT)))
+			return (rc);
+
+	int found = FoundPages();
+	for (i = 0; i < NUM_HOT; i++)
+		if ((rc = ReadPage(fh, i)))
+			return (rc);
+
+#ifdef PF_STATS
+	cout << "  hot pages found after the scans: " << FoundPages() - found
+		<< " of " << NUM_HOT << "\n";
+	if (FoundPages() - found != NUM_HOT) {
+		cout << "Hot pages should have survived the scans!\n";
+		exit(1);
+	}
+	if (Stat(PF_RINGREUSE) == reused) {
+		cout << "The scans did not reuse the ring!\n";
+		exit(1);
+	}
+#endif
+
+	// The pages of the ring are found again without a hint
+	for (i = 0; i < NUM_PAGES; i++)
+		if ((rc = ReadPage(fh, i)))
+			return (rc);
+
+	if ((rc = pfm.CloseFile(fh)) ||
+			(rc = pfm.DestroyFile(FILE1)))
+		return (rc);
+
+	return (0);
+}
+
+RC TestPolicies()
+{
+	PF_ReplacePolicy policies[] = {
+		PF_REPLACE_LRU, PF_REPLACE_CLOCK, PF_REPLACE_2Q, PF_REPLACE_LRUK
+	};
+	RC rc;
+
+	for (int i = 0; i < 4; i++) {
+		int iHotHits;
+
+		if ((rc = TestPolicy(policies[i], iHotHits)))
+			return (rc);
+
+#ifdef PF_STATS
+		cout << "  hot pages found after the scans: " << iHotHits
+			<< " of " << NUM_HOT << "\n";
+		if ((policies[i] == PF_REPLACE_2Q || policies[i] == PF_REPLACE_LRUK)
+				&& iHotHits != NUM_HOT) {
+			cout << "Hot pages should have survived the scans!\n";
+			exit(1);
+		}
+		if (policies[i] == PF_REPLACE_LRU && iHotHits != 0) {
+			cout << "LRU should have lost the hot pages!\n";
+			exit(1);
+		}
+#endif
+
+		if ((rc = TestScanRing(policies[i])))
+			return (rc);
+	}
+
+	return (0);
+}
+
+int main()
+{
+	RC rc;
+
+	// Write out initial starting message
+	cerr.flush();
+	cout.flush();
+	cout << "Starting PF replacement policy test.\n";
+	cout.flush();
+
+	// If we are tracking the PF Layer statistics
+#ifndef PF_STATS
+	cout << " ** The PF layer was not compiled with the -DPF_STATS flag **\n";
+	cout << " **    Only the page contents will be checked.             **\n";
+#endif
+
+	if ((rc = TestPolicies())) {
+		PF_PrintError(rc);
+		return (1);
+	}
+
+	// Write ending message and exit
+	cout << "Ending PF replacement policy test.\n\n";
+
+	return (0);
+}
@@ -0,0 +1,335 @@
+//
+// File:        pf_test5.cc
+// Description: Test the PF component with several threads
+//
+// Threads pick random pages of a file much larger than the buffer, check
+// that each page holds its own number and bump a counter on the pages
+// they own.  The counters are checked at the end of every round.  The
+// number of threads doubles from one round to the next, up to the number
+// of cores, and the throughput of each round is printed.  Then threads
+// allocate pages at once through copies of one file handle.
+//
+
+#include <cstdio>
+#include <iostream>
+#include <cstring>
+#include <cstdlib>
+#include <unistd.h>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "pf.h"
+#include "pf_internal.h"
+
+using namespace std;
+
+//
+// Defines
+//
+#define FILE1        "file1"
+#define NUM_PAGES    2000        // pages in the file
+#define NUM_FRAMES   512         // pages in the buffer
+#define NUM_SHARDS   16          // partitions of the buffer
+#define NUM_OPS      50000       // pages fetched by each thread
+#define WRITE_EVERY  4           // fetches per update of an owned page
+#define ALLOC_PAGES  500         // pages allocated by each thread
+
+// Counters of updates per page, each page is only updated by its owner
+static int counts[NUM_PAGES];
+
+//
+// Worker
+//
+// Body of a thread: fetch random pages and update the ones it owns
+//
+void Worker(PF_FileHandle *pfh, int id, int numThreads, RC *pRc)
+{
+	unsigned int seed = id + 1;
+	PF_PageHandle ph;
+	char *pData;
+	RC rc;
+
+	*pRc = 0;
+	for (int i = 0; i < NUM_OPS; i++) {
+		PageNum pageNum = rand_r(&seed) % NUM_PAGES;
+		int stored;
+
+		if ((rc = pfh->GetThisPage(pageNum, ph)) ||
+				(rc = ph.GetData(pData))) {
+			*pRc = rc;
+			return;
+		}
+
+		memcpy(&stored, pData, sizeof(int));
+		if (stored != pageNum) {
+			cout << "Page " << pageNum << " contains " << stored << "!\n";
+			exit(1);
+		}
+
+		if (pageNum % numThreads == id && i % WRITE_EVERY == 0) {
+			int count;
+			memcpy(&count, pData + sizeof(int), sizeof(int));
+			count++;
+			memcpy(pData + sizeof(int), &count, sizeof(int));
+			counts[pageNum]++;
+			if ((rc = pfh->MarkDirty(pageNum))) {
+				*pRc = rc;
+				return;
+			}
+		}
+
+		if ((rc = pfh->UnpinPage(pageNum))) {
+			*pRc = rc;
+			return;
+		}
+	}
+}
+
+//
+// CheckCounts
+//
+// Check that every page holds the number of updates made to it
+//
+RC CheckCounts(PF_FileHandle &fh)
+{
+	PF_PageHandle ph;
+	char *pData;
+	RC rc;
+
+	for (PageNum pageNum = 0; pageNum < NUM_PAGES; pageNum++) {
+		int count;
+
+		if ((rc = fh.GetThisPage(pageNum, ph)) ||
+				(rc = ph.GetData(pData)))
+			return (rc);
+
+		memcpy(&count, pData + sizeof(int), sizeof(int));
+		if (count != counts[pageNum]) {
+			cout << "Page " << pageNum << " was updated " << counts[pageNum]
+				<< " times but holds " << count << "!\n";
+			exit(1);
+		}
+
+		if ((rc = fh.UnpinPage(pageNum)))
+			return (rc);
+	}
+
+	return (0);
+}
+
+RC TestThreads()
+{
+	PF_Manager pfm(PF_REPLACE_CLOCK, NUM_SHARDS);
+	PF_FileHandle fh;
+	PF_PageHandle ph;
+	RC rc;
+	char *pData;
+	PageNum pageNum;
+	int i;
+
+	int maxThreads = thread::hardware_concurrency();
+	if (maxThreads < 2)
+		maxThreads = 2;
+
+	if ((rc = pfm.ResizeBuffer(NUM_FRAMES)))
+		return (rc);
+
+	unlink(FILE1);
+	if ((rc = pfm.CreateFile(FILE1)) ||
+			(rc = pfm.OpenFile(FILE1, fh)))
+		return (rc);
+
+	for (i = 0; i < NUM_PAGES; i++) {
+		if ((rc = fh.AllocatePage(ph)) ||
+				(rc = ph.GetData(pData)) ||
+				(rc = ph.GetPageNum(pageNum)))
+			return (rc);
+		memcpy(pData, &pageNum, sizeof(int));
+		if ((rc = fh.UnpinPage(pageNum)))
+			return (rc);
+	}
+
+	// Start from an empty buffer
+	if ((rc = fh.FlushPages()))
+		return (rc);
+
+	double base = 0;
+	for (int numThreads = 1; numThreads <= maxThreads; numThreads *= 2) {
+		vector<thread> threads;
+		vector<RC> results(numThreads);
+
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		for (i = 0; i < numThreads; i++)
+			threads.push_back(thread(Worker, &fh, i, numThreads, &results[i]));
+		for (i = 0; i < numThreads; i++)
+			threads[i].join();
+		chrono::duration<double> elapsed =
+			chrono::steady_clock::now() - start;
+
+		for (i = 0; i < numThreads; i++)
+			if (results[i])
+				return (results[i]);
+
+		double opsPerSec = numThreads * NUM_OPS / elapsed.count();
+		if (numThreads == 1)
+			base = opsPerSec;
+		printf("%3d threads: %10.0f pages/s  (x%.2f)\n", numThreads,
+				opsPerSec, opsPerSec / base);
+
+		// Check the pages in the buffer and then the ones read from disk
+		if ((rc = CheckCounts(fh)) ||
+				(rc = fh.FlushPages()) ||
+				(rc = CheckCounts(fh)))
+			return (rc);
+	}
+
+	if ((rc = pfm.CloseFile(fh)) ||
+			(rc = pfm.DestroyFile(FILE1)))
+		return (rc);
+
+	return (0);
+}
+
+//
+// Allocator
+//
+// Body of a thread: allocate pages through its own copy of the file
+// handle, write their numbers in them and read the pages back
+//
+void Allocator(PF_FileHandle fh, vector<PageNum> *pPages, RC *pRc)
+{
+	PF_PageHandle ph;
+	PageNum pageNum;
+	char *pData;
+	RC rc;
+
+	*pRc = 0;
+	for (int i = 0; i < ALLOC_PAGES; i++) {
+		if ((rc = fh.AllocatePage(ph)) ||
+				(rc = ph.GetData(pData)) ||
+				(rc = ph.GetPageNum(pageNum))) {
+			*pRc = rc;
+			return;
+		}
+		memcpy(pData, &pageNum, sizeof(int));
+		pPages->push_back(pageNum);
+		if ((rc = fh.UnpinPage(pageNum))) {
+			*pRc = rc;
+			return;
+		}
+	}
+
+	for (size_t i = 0; i < pPages->size(); i++) {
+		int stored;
+		if ((rc = fh.GetThisPage((*pPages)[i], ph)) ||
+				(rc = ph.GetData(pData))) {
+			*pRc = rc;
+			return;
+		}
+		memcpy(&stored, pData, sizeof(int));
+		if (stored != (*pPages)[i]) {
+			cout << "Page " << (*pPages)[i] << " holds " << stored << "!\n";
+			exit(1);
+		}
+		if ((rc = fh.UnpinPage((*pPages)[i]))) {
+			*pRc = rc;
+			return;
+		}
+	}
+}
+
+//
+// TestAllocate
+//
+// The copies of a file handle share the pages of the file: pages
+// allocated through one are neither allocated again through another nor
+// lost when the file is closed through a third
+//
+RC TestAllocate()
+{
+	PF_Manager pfm(PF_REPLACE_CLOCK, NUM_SHARDS);
+	PF_FileHandle fh;
+	PF_PageHandle ph;
+	PageNum pageNum;
+	RC rc;
+	int i, numThreads = 4;
+
+	cout << "Allocating pages from " << numThreads << " threads\n";
+
+	unlink(FILE1);
+	if ((rc = pfm.ResizeBuffer(NUM_FRAMES)) ||
+			(rc = pfm.CreateFile(FILE1)) ||
+			(rc = pfm.OpenFile(FILE1, fh)))
+		return (rc);
+
+	vector<thread> threads;
+	vector<vector<PageNum> > pages(numThreads);
+	vector<RC> results(numThreads);
+	for (i = 0; i < numThreads; i++)
+		threads.push_back(thread(Allocator, fh, &pages[i], &results[i]));
+	for (i = 0; i < numThreads; i++)
+		threads[i].join();
+	for (i = 0; i < numThreads; i++)
+		if (results[i])
+			return (results[i]);
+
+	// Every page was handed out once
+	vector<char> seen(numThreads * ALLOC_PAGES * 2, 0);
+	for (i = 0; i < numThreads; i++)
+		for (size_t j = 0; j < pages[i].size(); j++) {
+			pageNum = pages[i][j];
+			if (pageNum < 0 || pageNum >= (PageNum)seen.size() ||
+					seen[pageNum]) {
+				cout << "Page " << pageNum << " allocated twice!\n";
+				exit(1);
+			}
+			seen[pageNum] = 1;
+		}
+
+	// The file holds all of them once reopened
+	int numPages = 0;
+	if ((rc = pfm.CloseFile(fh)) ||
+			(rc = pfm.OpenFile(FILE1, fh)))
+		return (rc);
+	for (rc = fh.GetFirstPage(ph); rc != PF_EOF;
+			rc = fh.GetNextPage(pageNum, ph)) {
+		if (rc ||
+				(rc = ph.GetPageNum(pageNum)) ||
+				(rc = fh.UnpinPage(pageNum)))
+			return (rc);
+		numPages++;
+	}
+	if (numPages != numThreads * ALLOC_PAGES) {
+		cout << "The file has " << numPages << " pages instead of " <<
+			numThreads * ALLOC_PAGES << "!\n";
+		exit(1);
+	}
+
+	if ((rc = pfm.CloseFile(fh)) ||
+			(rc = pfm.DestroyFile(FILE1)))
+		return (rc);
+
+	return (0);
+}
+
+int main()
+{
+	RC rc;
+
+	// Write out initial starting message
+	cerr.flush();
+	cout.flush();
+	cout << "Starting PF multi-threaded test.\n";
+	cout.flush();
+
+	if ((rc = TestThreads()) ||
+			(rc = TestAllocate())) {
+		PF_PrintError(rc);
+		return (1);
+	}
+
+	// Write ending message and exit
+	cout << "Ending PF multi-threaded test.\n\n";
+
+	return (0);
+}
@@ -0,0 +1,304 @@
+//
+// File:        pf_test6.cc
+// Description: Test resizing the buffer while it is in use
+//
+// A file is scanned while the buffer grows and shrinks under it, with the
+// page of the scan pinned, under every replacement policy.  Each scan
+// bumps a counter on every page, so a page lost or written back wrongly
+// during a resize shows up as a bad count.  Then a thread scans while
+// another one resizes.  With PF_STATS, the test also checks that a resize
+// keeps the pages which still fit in the buffer.
+//
+
+#include <cstdio>
+#include <iostream>
+#include <cstring>
+#include <unistd.h>
+#include <thread>
+#include <atomic>
+#include "pf.h"
+#include "pf_internal.h"
+
+using namespace std;
+
+#ifdef PF_STATS
+#include "statistics.h"
+
+// This is defined within pf_buffermgr.cc
+extern StatCounters pfStats;
+
+//
+// Reads
+//
+// Number of pages read from disk so far
+//
+static int Reads()
+{
+	return ((int)pfStats.Get(PF_READPAGE));
+}
+#endif
+
+//
+// Defines
+//
+#define FILE1        "file1"
+#define NUM_PAGES    300         // pages in the file
+#define NUM_SHARDS   4           // partitions of the buffer
+#define NUM_SCANS    20          // scans of the threaded test
+
+// Sizes the buffer goes through during a scan, some below the number of
+// shards' worth of pinned pages
+static const int sizes[] = { 8, 400, 16, 100, 4, 50, 300, 12 };
+static const int numSizes = sizeof(sizes) / sizeof(sizes[0]);
+
+//
+// CreatePages
+//
+// Create and open a file of NUM_PAGES pages, each holding its number and
+// a counter set to 0
+//
+RC CreatePages(PF_Manager &pfm, PF_FileHandle &fh)
+{
+	PF_PageHandle ph;
+	char *pData;
+	PageNum pageNum;
+	RC rc;
+
+	unlink(FILE1);
+	if ((rc = pfm.CreateFile(FILE1)) ||
+			(rc = pfm.OpenFile(FILE1, fh)))
+		return (rc);
+
+	for (int i = 0; i < NUM_PAGES; i++) {
+		if ((rc = fh.AllocatePage(ph)) ||
+				(rc = ph.GetData(pData)) ||
+				(rc = ph.GetPageNum(pageNum)))
+			return (rc);
+		memcpy(pData, &pageNum, sizeof(int));
+		if ((rc = fh.MarkDirty(pageNum)) ||
+				(rc = fh.UnpinPage(pageNum)))
+			return (rc);
+	}
+
+	return (0);
+}
+
+//
+// Scan
+//
+// Scan the file, checking that every page holds its number and count
+// and bumping the count.  If pfm is given, the buffer is resized through
+// sizes while the page of the scan is pinned.
+//
+RC Scan(PF_FileHandle &fh, int count, PF_Manager *pfm)
+{
+	PF_PageHandle ph;
+	PageNum pageNum;
+	char *pData;
+	RC rc;
+	int numPages = 0;
+	int stored;
+
+	for (rc = fh.GetFirstPage(ph); rc == 0; rc = fh.GetNextPage(pageNum, ph)) {
+		if ((rc = ph.GetData(pData)) ||
+				(rc = ph.GetPageNum(pageNum)))
+			return (rc);
+
+		if (pfm && pageNum % 10 == 0 &&
+				(rc = pfm->ResizeBuffer(sizes[pageNum / 10 % numSizes])) &&
+				rc != PF_NOBUF)
+			return (rc);
+
+		// The pinned page must not have moved
+		memcpy(&stored, pData, sizeof(int));
+		if (stored != pageNum) {
+			cout << "Page " << pageNum << " contains " << stored << "!\n";
+			exit(1);
+		}
+		memcpy(&stored, pData + sizeof(int), sizeof(int));
+		if (stored != count) {
+			cout << "Page " << pageNum << " was updated " << stored
+				<< " times instead of " << count << "!\n";
+			exit(1);
+		}
+		stored++;
+		memcpy(pData + sizeof(int), &stored, sizeof(int));
+
+		// Through the slot of the handle, which the resize must keep
+		if ((rc = fh.MarkDirty(ph)) ||
+				(rc = fh.UnpinPage(ph)))
+			return (rc);
+		numPages++;
+	}
+	if (rc != PF_EOF)
+		return (rc);
+
+	if (numPages != NUM_PAGES) {
+		cout << "Scan found " << numPages << " pages!\n";
+		exit(1);
+	}
+
+	return (0);
+}
+
+//
+// TestResizeScan
+//
+// Resize the buffer during scans, then check the pages on disk
+//
+RC TestResizeScan(PF_ReplacePolicy policy)
+{
+	PF_Manager pfm(policy, NUM_SHARDS);
+	PF_FileHandle fh;
+	RC rc;
+	int i;
+
+	cout << "Resizing during scans with policy " << (int)policy << "\n";
+
+	if ((rc = CreatePages(pfm, fh)))
+		return (rc);
+
+	for (i = 0; i < 3; i++)
+		if ((rc = Scan(fh, i, &pfm)))
+			return (rc);
+
+	if ((rc = pfm.CloseFile(fh)) ||
+			(rc = pfm.ResizeBuffer(PF_BUFFER_SIZE)) ||
+			(rc = pfm.OpenFile(FILE1, fh)) ||
+			(rc = Scan(fh, i, NULL)) ||
+			(rc = pfm.CloseFile(fh)) ||
+			(rc = pfm.DestroyFile(FILE1)))
+		return (rc);
+
+	return (0);
+}
+
+//
+// TestResizeThreads
+//
+// One thread scans while another one resizes the buffer
+//
+RC TestResizeThreads()
+{
+	PF_Manager pfm(PF_REPLACE_CLOCK, NUM_SHARDS);
+	PF_FileHandle fh;
+	atomic<int> bDone(FALSE);
+	RC rc, scanRc = 0, resizeRc = 0;
+
+	cout << "Resizing from another thread\n";
+
+	if ((rc = CreatePages(pfm, fh)))
+		return (rc);
+
+	thread scanner([&]() {
+		for (int i = 0; i < NUM_SCANS && !scanRc; i++)
+			scanRc = Scan(fh, i, NULL);
+		bDone = TRUE;
+	});
+	thread resizer([&]() {
+		for (int i = 0; !bDone; i++) {
+			RC rc = pfm.ResizeBuffer(sizes[i % numSizes]);
+			if (rc && rc != PF_NOBUF) {
+				resizeRc = rc;
+				return;
+			}
+			this_thread::yield();
+		}
+	});
+	scanner.join();
+	resizer.join();
+
+	if (scanRc)
+		return (scanRc);
+	if (resizeRc)
+		return (resizeRc);
+
+	if ((rc = pfm.CloseFile(fh)) ||
+			(rc = pfm.OpenFile(FILE1, fh)) ||
+			(rc = Scan(fh, NUM_SCANS, NULL)) ||
+			(rc = pfm.CloseFile(fh)) ||
+			(rc = pfm.DestroyFile(FILE1)))
+		return (rc);
+
+	return (0);
+}
+
+#ifdef PF_STATS
+//
+// TestWarm
+//
+// A resize must keep the pages which still fit in the buffer
+//
+RC TestWarm()
+{
+	PF_Manager pfm;
+	PF_FileHandle fh;
+	PF_PageHandle ph;
+	RC rc;
+	int reads;
+
+	cout << "Checking that a resize keeps the pages\n";
+
+	if ((rc = pfm.ResizeBuffer(NUM_PAGES)) ||
+			(rc = CreatePages(pfm, fh)) ||
+			(rc = Scan(fh, 0, NULL)))
+		return (rc);
+
+	// LRU keeps the last pages of the scan when shrinking
+	reads = Reads();
+	if ((rc = pfm.ResizeBuffer(NUM_PAGES / 2)))
+		return (rc);
+	for (PageNum pageNum = NUM_PAGES / 2; pageNum < NUM_PAGES; pageNum++)
+		if ((rc = fh.GetThisPage(pageNum, ph)) ||
+				(rc = fh.UnpinPage(pageNum)))
+			return (rc);
+
+	// Growing keeps everything
+	if ((rc = pfm.ResizeBuffer(NUM_PAGES * 2)))
+		return (rc);
+	for (PageNum pageNum = NUM_PAGES / 2; pageNum < NUM_PAGES; pageNum++)
+		if ((rc = fh.GetThisPage(pageNum, ph)) ||
+				(rc = fh.UnpinPage(pageNum)))
+			return (rc);
+
+	if (Reads() != reads) {
+		cout << "The resizes made " << Reads() - reads << " pages be read\n";
+		exit(1);
+	}
+
+	if ((rc = pfm.CloseFile(fh)) ||
+			(rc = pfm.DestroyFile(FILE1)))
+		return (rc);
+
+	return (0);
+}
+#endif
+
+int main()
+{
+	RC rc;
+
+	// Write out initial starting message
+	cerr.flush();
+	cout.flush();
+	cout << "Starting PF resize test.\n";
+	cout.flush();
+
+	if ((rc = TestResizeScan(PF_REPLACE_LRU)) ||
+			(rc = TestResizeScan(PF_REPLACE_CLOCK)) ||
+			(rc = TestResizeScan(PF_REPLACE_2Q)) ||
+			(rc = TestResizeScan(PF_REPLACE_LRUK)) ||
+			(rc = TestResizeThreads())
+#ifdef PF_STATS
+			|| (rc = TestWarm())
+#endif
+			) {
+		PF_PrintError(rc);
+		return (1);
+	}
+
+	// Write ending message and exit
+	cout << "Ending PF resize test.\n\n";
+
+	return (0);
+}
@@ -0,0 +1,313 @@
+//
+// File:        pf_test7.cc
+// Description: Test the warm restart of the buffer
+//
+// A file is written and some of its pages read again, then closed and the
+// list of the pages in the buffer saved.  The test checks that the list
+// holds those pages, the hottest first, and that a new PF_Manager which
+// loads the list reads them back when the file is opened.  With PF_STATS,
+// it also checks that fetching them afterwards reads nothing from disk.
+//
+
+#include <cstdio>
+#include <iostream>
+#include <cstring>
+#include <unistd.h>
+#include <thread>
+#include <chrono>
+#include <vector>
+#include "pf.h"
+#include "pf_internal.h"
+
+using namespace std;
+
+#ifdef PF_STATS
+#include "statistics.h"
+
+// This is defined within pf_buffermgr.cc
+extern StatCounters pfStats;
+
+//
+// Reads
+//
+// Number of pages read from disk so far
+//
+static int Reads()
+{
+	return ((int)pfStats.Get(PF_READPAGE));
+}
+#endif
+
+//
+// Defines
+//
+#define FILE1        "file1"
+#define FILE2        "file2"
+#define LIST         "resident.test"
+#define NUM_PAGES    100         // pages in FILE1
+#define HOT_FIRST    10          // pages read again after writing FILE1
+#define HOT_LAST     29
+
+//
+// CreatePages
+//
+// Create and open a file of numPages pages, each holding its number
+//
+RC CreatePages(PF_Manager &pfm, const char *fileName, int numPages,
+		PF_FileHandle &fh)
+{
+	PF_PageHandle ph;
+	char *pData;
+	PageNum pageNum;
+	RC rc;
+
+	unlink(fileName);
+	if ((rc = pfm.CreateFile(fileName)) ||
+			(rc = pfm.OpenFile(fileName, fh)))
+		return (rc);
+
+	for (int i = 0; i < numPages; i++) {
+		if ((rc = fh.AllocatePage(ph)) ||
+				(rc = ph.GetData(pData)) ||
+				(rc = ph.GetPageNum(pageNum)))
+			return (rc);
+		memcpy(pData, &pageNum, sizeof(int));
+		if ((rc = fh.MarkDirty(pageNum)) ||
+				(rc = fh.UnpinPage(pageNum)))
+			return (rc);
+	}
+
+	return (0);
+}
+
+//
+// CheckPage
+//
+// Fetch a page and check that it holds its number
+//
+RC CheckPage(PF_FileHandle &fh, PageNum pageNum)
+{
+	PF_PageHandle ph;
+	char *pData;
+	int stored;
+	RC rc;
+
+	if ((rc = fh.GetThisPage(pageNum, ph)) ||
+			(rc = ph.GetData(pData)))
+		return (rc);
+	memcpy(&stored, pData, sizeof(int));
+	if (stored != pageNum) {
+		cout << "Page " << pageNum << " contains " << stored << "!\n";
+		exit(1);
+	}
+	return (fh.UnpinPage(pageNum));
+}
+
+//
+// ReadList
+//
+// Read the pages of the list saved by the PF_Manager
+//
+void ReadList(vector<string> &files, vector<PageNum> &pageNums)
+{
+	FILE *pFile = fopen(LIST, "r");
+	if (pFile == NULL) {
+		cout << "The list was not saved!\n";
+		exit(1);
+	}
+
+	char fileName[100];
+	PageNum pageNum;
+	while (fscanf(pFile, "%99s %d", fileName, &pageNum) == 2) {
+		files.push_back(fileName);
+		pageNums.push_back(pageNum);
+	}
+	fclose(pFile);
+}
+
+//
+// TestSave
+//
+// Write FILE1 and read its pages HOT_FIRST to HOT_LAST again, and make a
+// small FILE2 which is closed first.  The list must hold the pages LRU
+// kept, the pages read again first, and no page of the destroyed FILE2.
+//
+RC TestSave()
+{
+	PF_Manager pfm;
+	PF_FileHandle fh1, fh2;
+	vector<string> files;
+	vector<PageNum> pageNums;
+	RC rc;
+
+	cout << "Saving the pages of the buffer\n";
+
+	unlink(LIST);
+	if ((rc = pfm.LoadResidentPages(LIST)) ||
+			(rc = CreatePages(pfm, FILE2, 5, fh2)) ||
+			(rc = pfm.CloseFile(fh2)) ||
+			(rc = pfm.DestroyFile(FILE2)) ||
+			(rc = CreatePages(pfm, FILE1, NUM_PAGES, fh1)))
+		return (rc);
+
+	for (PageNum pageNum = HOT_FIRST; pageNum <= HOT_LAST; pageNum++)
+		if ((rc = CheckPage(fh1, pageNum)))
+			return (rc);
+
+	if ((rc = pfm.CloseFile(fh1)) ||
+			(rc = pfm.SaveResidentPages(LIST)))
+		return (rc);
+
+	ReadList(files, pageNums);
+	if ((int)pageNums.size() != PF_BUFFER_SIZE) {
+		cout << "The list holds " << pageNums.size() << " pages!\n";
+		exit(1);
+	}
+
+	// LRU keeps the pages read again and the last pages written
+	int numHot = HOT_LAST - HOT_FIRST + 1;
+	for (int i = 0; i < (int)pageNums.size(); i++) {
+		PageNum expected = (i < numHot) ? HOT_LAST - i :
+			NUM_PAGES - 1 - (i - numHot);
+		if (files[i] != FILE1 || pageNums[i] != expected) {
+			cout << "Entry " << i << " of the list is " << files[i] << " "
+				<< pageNums[i] << " instead of page " << expected << "!\n";
+			exit(1);
+		}
+	}
+
+	return (0);
+}
+
+//
+// TestLoad
+//
+// A new PF_Manager loads the listed pages when FILE1 is opened
+//
+RC TestLoad()
+{
+	PF_Manager pfm;
+	PF_FileHandle fh;
+	vector<string> files;
+	vector<PageNum> pageNums;
+	RC rc;
+
+	cout << "Loading the pages of the list\n";
+
+	ReadList(files, pageNums);
+
+#ifdef PF_STATS
+	int reads = Reads();
+#endif
+
+	if ((rc = pfm.LoadResidentPages(LIST)) ||
+			(rc = pfm.OpenFile(FILE1, fh)))
+		return (rc);
+
+#ifdef PF_STATS
+	// Wait for the read-ahead threads
+	for (int i = 0; i < 500 && Reads() - reads < (int)pageNums.size(); i++)
+		this_thread::sleep_for(chrono::milliseconds(10));
+	if (Reads() - reads != (int)pageNums.size()) {
+		cout << Reads() - reads << " pages were loaded instead of "
+			<< pageNums.size() << "\n";
+		exit(1);
+	}
+	reads = Reads();
+#endif
+
+	for (size_t i = 0; i < pageNums.size(); i++)
+		if ((rc = CheckPage(fh, pageNums[i])))
+			return (rc);
+
+#ifdef PF_STATS
+	if (Reads() != reads) {
+		cout << "Fetching the loaded pages read " << Reads() - reads
+			<< " pages\n";
+		exit(1);
+	}
+#endif
+
+	if ((rc = pfm.CloseFile(fh)) ||
+			(rc = pfm.SaveResidentPages(LIST)))
+		return (rc);
+
+	// The pages fetched are listed again
+	vector<string> newFiles;
+	vector<PageNum> newPageNums;
+	ReadList(newFiles, newPageNums);
+	if (newPageNums.size() != pageNums.size()) {
+		cout << "The new list holds " << newPageNums.size() << " pages!\n";
+		exit(1);
+	}
+
+	return (0);
+}
+
+//
+// TestBadList
+//
+// A list naming pages which are not in the file, or which cannot be
+// parsed, loads nothing wrong
+//
+RC TestBadList()
+{
+	PF_Manager pfm;
+	PF_FileHandle fh;
+	RC rc;
+
+	cout << "Loading a damaged list\n";
+
+	FILE *pFile = fopen(LIST, "w");
+	fprintf(pFile, "%s 3\n%s %d\n%s -1\nnothing here\n%s 4\n",
+			FILE1, FILE1, NUM_PAGES + 10, FILE1, FILE1);
+	fclose(pFile);
+
+	if ((rc = pfm.LoadResidentPages(LIST)) ||
+			(rc = pfm.OpenFile(FILE1, fh)))
+		return (rc);
+
+	for (PageNum pageNum = 0; pageNum < NUM_PAGES; pageNum++)
+		if ((rc = CheckPage(fh, pageNum)))
+			return (rc);
+
+	if ((rc = pfm.CloseFile(fh)) ||
+			(rc = pfm.DestroyFile(FILE1)) ||
+			(rc = pfm.SaveResidentPages(LIST)))
+		return (rc);
+
+	// FILE1 is gone, so is its part of the list
+	vector<string> files;
+	vector<PageNum> pageNums;
+	ReadList(files, pageNums);
+	if (!pageNums.empty()) {
+		cout << "The list holds pages of a destroyed file!\n";
+		exit(1);
+	}
+	unlink(LIST);
+
+	return (0);
+}
+
+int main()
+{
+	RC rc;
+
+	// Write out initial starting message
+	cerr.flush();
+	cout.flush();
+	cout << "Starting PF warm restart test.\n";
+	cout.flush();
+
+	if ((rc = TestSave()) ||
+			(rc = TestLoad()) ||
+			(rc = TestBadList())) {
+		PF_PrintError(rc);
+		return (1);
+	}
+
+	// Write ending message and exit
+	cout << "Ending PF warm restart test.\n\n";
+
+	return (0);
+}
@@ -0,0 +1,230 @@
+//
+// File:        pf_test8.cc
+// Description: Test the counters of the use of the buffer by each file
+//
+// Two files are written and read through a buffer of PF_BUFFER_SIZE
+// pages under LRU, so the hits, misses, evictions and write-backs of
+// each file are known.  The test checks them while the files are open,
+// once they are closed and after a reset, and that the time a page is
+// pinned is counted.  The counters are always kept, without PF_STATS.
+//
+
+#include <cstdio>
+#include <iostream>
+#include <cstring>
+#include <unistd.h>
+#include <thread>
+#include <chrono>
+#include "pf.h"
+#include "pf_internal.h"
+
+using namespace std;
+
+//
+// Defines
+//
+#define FILE1        "file1"
+#define FILE2        "file2"
+#define NUM_PAGES1   60          // pages of FILE1, more than the buffer
+#define NUM_PAGES2   35          // pages of FILE2
+#define NUM_READ     10          // pages of FILE1 read back
+
+//
+// CreatePages
+//
+// Create and open a file of numPages pages
+//
+RC CreatePages(PF_Manager &pfm, const char *fileName, int numPages,
+		PF_FileHandle &fh)
+{
+	PF_PageHandle ph;
+	PageNum pageNum;
+	RC rc;
+
+	unlink(fileName);
+	if ((rc = pfm.CreateFile(fileName)) ||
+			(rc = pfm.OpenFile(fileName, fh)))
+		return (rc);
+
+	for (int i = 0; i < numPages; i++)
+		if ((rc = fh.AllocatePage(ph)) ||
+				(rc = ph.GetPageNum(pageNum)) ||
+				(rc = fh.MarkDirty(pageNum)) ||
+				(rc = fh.UnpinPage(pageNum)))
+			return (rc);
+
+	return (0);
+}
+
+//
+// ReadPages
+//
+// Fetch and release pages 0 to numPages - 1 of a file
+//
+RC ReadPages(PF_FileHandle &fh, int numPages)
+{
+	PF_PageHandle ph;
+	RC rc;
+
+	for (PageNum pageNum = 0; pageNum < numPages; pageNum++)
+		if ((rc = fh.GetThisPage(pageNum, ph)) ||
+				(rc = fh.UnpinPage(pageNum)))
+			return (rc);
+
+	return (0);
+}
+
+//
+// Check
+//
+// Compare the counters of a file with those expected
+//
+void Check(PF_Manager &pfm, const char *fileName, long hits, long misses,
+		long evictions, long writeBacks, long pins)
+{
+	PF_FileStats stats;
+	pfm.GetFileStats(fileName, stats);
+
+	if (stats.hits != hits || stats.misses != misses ||
+			stats.evictions != evictions || stats.writeBacks != writeBacks ||
+			stats.pins != pins) {
+		cout << fileName << " has " << stats.hits << " hits, "
+			<< stats.misses << " misses, " << stats.evictions
+			<< " evictions, " << stats.writeBacks << " write-backs and "
+			<< stats.pins << " pins instead of " << hits << ", " << misses
+			<< ", " << evictions << ", " << writeBacks << " and " << pins
+			<< "!\n";
+		exit(1);
+	}
+	if (pins > 0 && stats.pinNanos <= 0) {
+		cout << "The pins of " << fileName << " were not timed!\n";
+		exit(1);
+	}
+}
+
+//
+// TestCounters
+//
+// Count the use of the buffer by two files
+//
+RC TestCounters()
+{
+	PF_Manager pfm;
+	PF_FileHandle fh1, fh2;
+	RC rc;
+
+	cout << "Counting the use of the buffer by each file\n";
+
+	// Writing FILE1 pushes its first pages out, dirty
+	if ((rc = CreatePages(pfm, FILE1, NUM_PAGES1, fh1)))
+		return (rc);
+	Check(pfm, FILE1, 0, 0, NUM_PAGES1 - PF_BUFFER_SIZE,
+			NUM_PAGES1 - PF_BUFFER_SIZE, NUM_PAGES1);
+
+	// Closing it writes the others
+	if ((rc = pfm.CloseFile(fh1)))
+		return (rc);
+	Check(pfm, FILE1, 0, 0, NUM_PAGES1 - PF_BUFFER_SIZE, NUM_PAGES1,
+			NUM_PAGES1);
+
+	// Reading pages twice misses, then hits
+	if ((rc = pfm.OpenFile(FILE1, fh1)) ||
+			(rc = ReadPages(fh1, NUM_READ)) ||
+			(rc = ReadPages(fh1, NUM_READ)))
+		return (rc);
+	Check(pfm, FILE1, NUM_READ, NUM_READ, NUM_PAGES1 - PF_BUFFER_SIZE,
+			NUM_PAGES1, NUM_PAGES1 + 2 * NUM_READ);
+
+	// FILE2 takes the frames of the oldest pages of FILE1
+	int numEvicted = NUM_READ + NUM_PAGES2 - PF_BUFFER_SIZE;
+	if ((rc = CreatePages(pfm, FILE2, NUM_PAGES2, fh2)))
+		return (rc);
+	Check(pfm, FILE1, NUM_READ, NUM_READ,
+			NUM_PAGES1 - PF_BUFFER_SIZE + numEvicted, NUM_PAGES1,
+			NUM_PAGES1 + 2 * NUM_READ);
+	Check(pfm, FILE2, 0, 0, 0, 0, NUM_PAGES2);
+
+	if ((rc = pfm.CloseFile(fh1)) ||
+			(rc = pfm.CloseFile(fh2)))
+		return (rc);
+	Check(pfm, FILE2, 0, 0, 0, NUM_PAGES2, NUM_PAGES2);
+
+	pfm.PrintFileStats();
+
+	// The counters start again from 0
+	if ((rc = pfm.ResetFileStats()))
+		return (rc);
+	Check(pfm, FILE1, 0, 0, 0, 0, 0);
+	Check(pfm, FILE2, 0, 0, 0, 0, 0);
+	Check(pfm, "nofile", 0, 0, 0, 0, 0);
+
+	if ((rc = pfm.DestroyFile(FILE1)) ||
+			(rc = pfm.DestroyFile(FILE2)))
+		return (rc);
+
+	return (0);
+}
+
+//
+// TestPinTime
+//
+// A page pinned twice and held for a while counts as one long pin
+//
+RC TestPinTime()
+{
+	PF_Manager pfm;
+	PF_FileHandle fh;
+	PF_PageHandle ph1, ph2;
+	PF_FileStats stats;
+	RC rc;
+
+	cout << "Timing the pins\n";
+
+	if ((rc = CreatePages(pfm, FILE1, 1, fh)) ||
+			(rc = pfm.ResetFileStats()) ||
+			(rc = fh.GetThisPage(0, ph1)) ||
+			(rc = fh.GetThisPage(0, ph2)))
+		return (rc);
+
+	this_thread::sleep_for(chrono::milliseconds(20));
+	if ((rc = fh.UnpinPage(ph1)))
+		return (rc);
+	this_thread::sleep_for(chrono::milliseconds(20));
+	if ((rc = fh.UnpinPage(ph2)) ||
+			(rc = pfm.GetFileStats(FILE1, stats)))
+		return (rc);
+
+	if (stats.hits != 2 || stats.pins != 1 || stats.pinNanos < 40000000) {
+		cout << stats.pins << " pins lasted " << stats.pinNanos
+			<< " ns in all!\n";
+		exit(1);
+	}
+
+	if ((rc = pfm.CloseFile(fh)) ||
+			(rc = pfm.DestroyFile(FILE1)))
+		return (rc);
+
+	return (0);
+}
+
+int main()
+{
+	RC rc;
+
+	// Write out initial starting message
+	cerr.flush();
+	cout.flush();
+	cout << "Starting PF file statistics test.\n";
+	cout.flush();
+
+	if ((rc = TestCounters()) ||
+			(rc = TestPinTime())) {
+		PF_PrintError(rc);
+		return (1);
+	}
+
+	// Write ending message and exit
+	cout << "Ending PF file statistics test.\n\n";
+
+	return (0);
+}
@@ -0,0 +1,364 @@
+//
+// File:        pf_test9.cc
+// Description: Test the compressed files
+//
+// The page codec is checked on pages which compress well, on pages
+// which do not and on damaged input.  Then a compressed file is written,
+// rewritten so that its pages move to other extents, and read back
+// after it is closed and opened again, in each file mode.  A file with
+// bitmap pages checks that they are compressed too.
+//
+
+#include <cstdio>
+#include <iostream>
+#include <cstring>
+#include <cstdlib>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "pf.h"
+#include "pf_internal.h"
+#include "pf_compress.h"
+
+using namespace std;
+
+//
+// Defines
+//
+#define FILE1        "file1"
+#define NUM_PAGES    200         // pages in FILE1, more than the buffer
+#define NAME_LENGTH  28          // like the sname column of the examples
+
+//
+// FileSize
+//
+// Size of a file, 0 if it does not exist
+//
+static long long FileSize(const char *fileName)
+{
+	struct stat st;
+	return (stat(fileName, &st) < 0 ? 0 : (long long)st.st_size);
+}
+
+//
+// FillPage
+//
+// Fill the data of a page.  kind 0 makes records of a padded name and a
+// number, kind 1 random bytes, kind 2 zeros.  The page number comes
+// first so that the pages can be told apart.
+//
+static void FillPage(char *pData, int length, PageNum pageNum, int kind)
+{
+	unsigned int seed = pageNum + 1;
+
+	memset(pData, 0, length);
+	if (kind == 0)
+		for (int off = sizeof(int); off + NAME_LENGTH + 4 <= length;
+				off += NAME_LENGTH + 4) {
+			snprintf(pData + off, NAME_LENGTH, "student%d", rand_r(&seed) % 500);
+			int value = rand_r(&seed) % 100;
+			memcpy(pData + off + NAME_LENGTH, &value, sizeof(int));
+		}
+	else if (kind == 1)
+		for (int off = 0; off < length; off++)
+			pData[off] = (char)rand_r(&seed);
+	memcpy(pData, &pageNum, sizeof(int));
+}
+
+//
+// TestCodec
+//
+// Compress and decompress pages of every kind
+//
+void TestCodec()
+{
+	char page[PF_DEFAULT_PAGE_SIZE], packed[PF_DEFAULT_PAGE_SIZE];
+	char unpacked[PF_DEFAULT_PAGE_SIZE];
+	int length;
+
+	cout << "Testing the page codec\n";
+
+	for (int kind = 0; kind < 3; kind++) {
+		FillPage(page, PF_DEFAULT_PAGE_SIZE, 7, kind);
+		length = PF_Compress(page, PF_DEFAULT_PAGE_SIZE, packed,
+				PF_DEFAULT_PAGE_SIZE - 1);
+		if (kind == 1) {
+			if (length != 0) {
+				cout << "Random bytes were compressed to " << length << "\n";
+				exit(1);
+			}
+			continue;
+		}
+		if (length <= 0 || length > PF_DEFAULT_PAGE_SIZE / 2) {
+			cout << "Page of kind " << kind << " compressed to " << length
+				<< " bytes\n";
+			exit(1);
+		}
+		if (PF_Decompress(packed, length, unpacked, PF_DEFAULT_PAGE_SIZE) !=
+				PF_DEFAULT_PAGE_SIZE ||
+				memcmp(page, unpacked, PF_DEFAULT_PAGE_SIZE) != 0) {
+			cout << "Page of kind " << kind << " did not come back\n";
+			exit(1);
+		}
+
+		// Damaged input is refused, not followed out of the buffers
+		if (PF_Decompress(packed, length - 1, unpacked,
+				PF_DEFAULT_PAGE_SIZE) == PF_DEFAULT_PAGE_SIZE ||
+				PF_Decompress(packed, length, unpacked, 100) >= 0) {
+			cout << "Damaged page of kind " << kind << " was accepted\n";
+			exit(1);
+		}
+	}
+
+	// Short inputs have no match at all
+	for (int n = 0; n < 8; n++) {
+		length = PF_Compress("abcdefgh", n, packed, 16);
+		if (PF_Decompress(packed, length, unpacked, 16) != n ||
+				memcmp(unpacked, "abcdefgh", n) != 0) {
+			cout << "Input of " << n << " bytes did not come back\n";
+			exit(1);
+		}
+	}
+}
+
+//
+// AllocatePages
+//
+// Allocate numPages pages in a file and fill them with pages of kind
+//
+RC AllocatePages(PF_FileHandle &fh, int numPages, int kind)
+{
+	PF_PageHandle ph;
+	PageNum pageNum;
+	char *pData;
+	int length;
+	RC rc;
+
+	if ((rc = fh.GetPageSize(length)))
+		return (rc);
+
+	for (int i = 0; i < numPages; i++) {
+		if ((rc = fh.AllocatePage(ph)) ||
+				(rc = ph.GetData(pData)) ||
+				(rc = ph.GetPageNum(pageNum)))
+			return (rc);
+		FillPage(pData, length, pageNum, kind);
+		if ((rc = fh.MarkDirty(pageNum)) ||
+				(rc = fh.UnpinPage(pageNum)))
+			return (rc);
+	}
+
+	return (0);
+}
+
+//
+// RewritePages
+//
+// Fill every page of a file again, with pages of kind, or of a kind
+// depending on the page if kind is -1
+//
+RC RewritePages(PF_FileHandle &fh, int kind)
+{
+	PF_PageHandle ph;
+	PageNum pageNum;
+	char *pData;
+	int length;
+	RC rc;
+
+	if ((rc = fh.GetPageSize(length)))
+		return (rc);
+
+	for (rc = fh.GetFirstPage(ph); rc == 0; rc = fh.GetNextPage(pageNum, ph)) {
+		if ((rc = ph.GetData(pData)) ||
+				(rc = ph.GetPageNum(pageNum)))
+			return (rc);
+		FillPage(pData, length, pageNum, (kind < 0) ? pageNum % 3 : kind);
+		if ((rc = fh.MarkDirty(pageNum)) ||
+				(rc = fh.UnpinPage(pageNum)))
+			return (rc);
+	}
+
+	return (rc == PF_EOF ? 0 : rc);
+}
+
+//
+// CheckPages
+//
+// Read the pages of a file back in order and compare them with what
+// AllocatePages or RewritePages wrote
+//
+RC CheckPages(PF_FileHandle &fh, int numPages, int kind)
+{
+	PF_PageHandle ph;
+	PageNum pageNum;
+	char *pData;
+	char expected[PF_MAX_PAGE_SIZE];
+	int length;
+	int count = 0;
+	RC rc;
+
+	if ((rc = fh.GetPageSize(length)))
+		return (rc);
+
+	for (rc = fh.GetFirstPage(ph); rc == 0; rc = fh.GetNextPage(pageNum, ph)) {
+		if ((rc = ph.GetData(pData)) ||
+				(rc = ph.GetPageNum(pageNum)))
+			return (rc);
+		FillPage(expected, length, pageNum, (kind < 0) ? pageNum % 3 : kind);
+		if (memcmp(pData, expected, length) != 0) {
+			cout << "Page " << pageNum << " is not what was written\n";
+			exit(1);
+		}
+		count++;
+		if ((rc = fh.UnpinPage(pageNum)))
+			return (rc);
+	}
+	if (rc != PF_EOF)
+		return (rc);
+
+	if (count != numPages) {
+		cout << count << " pages were read instead of " << numPages << "\n";
+		exit(1);
+	}
+	return (0);
+}
+
+//
+// TestFile
+//
+// Write a compressed file, rewrite it with pages compressing less and
+// more, and read it back in each file mode
+//
+RC TestFile()
+{
+	PF_Manager pfm;
+	PF_FileHandle fh;
+	RC rc;
+
+	cout << "Writing a compressed file\n";
+
+	unlink(FILE1);
+	if ((rc = pfm.CreateFile(FILE1, PF_DEFAULT_PAGE_SIZE, TRUE)) ||
+			(rc = pfm.OpenFile(FILE1, fh)) ||
+			(rc = AllocatePages(fh, NUM_PAGES, 0)) ||
+			(rc = pfm.CloseFile(fh)))
+		return (rc);
+
+	long long size = FileSize(FILE1);
+	if (size <= 0 || size > (long long)NUM_PAGES * PF_DEFAULT_PAGE_SIZE / 2 ||
+			FileSize(PF_CompressedFile::MapName(FILE1).c_str()) <= 0) {
+		cout << "The file takes " << size << " bytes\n";
+		exit(1);
+	}
+
+	// Random pages need larger extents, zero pages smaller ones
+	cout << "Rewriting it\n";
+	if ((rc = pfm.OpenFile(FILE1, fh)) ||
+			(rc = CheckPages(fh, NUM_PAGES, 0)) ||
+			(rc = RewritePages(fh, -1)) ||
+			(rc = CheckPages(fh, NUM_PAGES, -1)) ||
+			(rc = pfm.CloseFile(fh)))
+		return (rc);
+
+	// Once more, so that the extents given back are reused
+	size = FileSize(FILE1);
+	if ((rc = pfm.OpenFile(FILE1, fh)) ||
+			(rc = RewritePages(fh, 0)) ||
+			(rc = pfm.CloseFile(fh)))
+		return (rc);
+	if (FileSize(FILE1) > size) {
+		cout << "The file grew from " << size << " to " << FileSize(FILE1)
+			<< " bytes\n";
+		exit(1);
+	}
+
+	// The mapped and direct modes fall back to the buffer
+	PF_FileMode modes[] = { PF_MODE_BUFFERED, PF_MODE_MMAP, PF_MODE_DIRECT };
+	for (int m = 0; m < 3; m++) {
+		cout << "Reading it back in mode " << m << "\n";
+		if ((rc = pfm.ClearBuffer()) ||
+				(rc = pfm.SetFileMode(modes[m])) ||
+				(rc = pfm.OpenFile(FILE1, fh)) ||
+				(rc = CheckPages(fh, NUM_PAGES, 0)) ||
+				(rc = pfm.CloseFile(fh)))
+			return (rc);
+	}
+	if ((rc = pfm.SetFileMode(PF_MODE_BUFFERED)))
+		return (rc);
+
+	// Disposed pages are not read back
+	if ((rc = pfm.OpenFile(FILE1, fh)) ||
+			(rc = fh.DisposePage(NUM_PAGES - 1)) ||
+			(rc = pfm.CloseFile(fh)) ||
+			(rc = pfm.ClearBuffer()) ||
+			(rc = pfm.OpenFile(FILE1, fh)) ||
+			(rc = CheckPages(fh, NUM_PAGES - 1, 0)) ||
+			(rc = pfm.CloseFile(fh)))
+		return (rc);
+
+	if ((rc = pfm.DestroyFile(FILE1)))
+		return (rc);
+	if (FileSize(PF_CompressedFile::MapName(FILE1).c_str()) != 0) {
+		cout << "The map was not destroyed with the file\n";
+		exit(1);
+	}
+
+	return (0);
+}
+
+//
+// TestBitmapPages
+//
+// A file with more pages than the header page has bits also has its
+// bitmap pages compressed
+//
+RC TestBitmapPages()
+{
+	PF_Manager pfm;
+	PF_FileHandle fh;
+	int numPages = PF_HDR_BITMAP_BITS + 10;
+	RC rc;
+
+	cout << "Writing " << numPages << " compressed pages\n";
+
+	unlink(FILE1);
+	if ((rc = pfm.CreateFile(FILE1, PF_DEFAULT_PAGE_SIZE, TRUE)) ||
+			(rc = pfm.OpenFile(FILE1, fh)) ||
+			(rc = AllocatePages(fh, numPages, 2)) ||
+			(rc = pfm.CloseFile(fh)) ||
+			(rc = pfm.OpenFile(FILE1, fh)) ||
+			(rc = CheckPages(fh, numPages, 2)) ||
+			(rc = pfm.CloseFile(fh)))
+		return (rc);
+
+	if (FileSize(FILE1) > (long long)(numPages + 2) * PF_EXTENT_UNIT +
+			PF_FILE_HDR_SIZE) {
+		cout << "The file takes " << FileSize(FILE1) << " bytes\n";
+		exit(1);
+	}
+
+	return (pfm.DestroyFile(FILE1));
+}
+
+int main()
+{
+	RC rc;
+
+	// Write out initial starting message
+	cerr.flush();
+	cout.flush();
+	cout << "Starting PF compression test.\n";
+	cout.flush();
+
+	TestCodec();
+
+	if ((rc = TestFile()) ||
+			(rc = TestBitmapPages())) {
+		PF_PrintError(rc);
+		return (1);
+	}
+
+	// Write ending message and exit
+	cout << "Ending PF compression test.\n\n";
+
+	return (0);
+}
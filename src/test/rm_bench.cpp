@@ -0,0 +1,390 @@
+//
+// File:        rm_bench.cc
+// Description: Benchmarks of the RM component
+//
+// Each benchmark prints one line per configuration.
+//
+//   commit  - committed inserts per second.  Without the log each insert
+//             is made durable with ForcePages, and with SyncPages which
+//             also waits for the device.  With the log each insert is
+//             committed alone, from one thread and from several threads
+//             sharing the fsyncs of the log, or in batches.
+//   format  - pages taken and scans per second of a table of people with
+//             short names and cities, in the fixed and slotted formats.
+//             The scans copy each record into an RM_Record, then read it
+//             in place through an RM_RecordView.
+//   scan    - rows per second of a filtered scan of a table of small
+//             rows, returned one at a time as copies or views, or a page
+//             at a time in batches, at each filter level (see
+//             RM_SetFilterLevel) from comparing one record at a time up.
+//
+
+#include <cstdio>
+#include <iostream>
+#include <cstring>
+#include <cstddef>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "redbase.h"
+#include "pf.h"
+#include "rm.h"
+#include "rm_log.h"
+
+using namespace std;
+
+//
+// Defines
+//
+#define FILENAME     "benchrel"  // file name, followed by the thread
+#define LOGNAME      "benchrel.log" // log file name
+#define RECORD_SIZE  40          // bytes per record
+#define COMMIT_RECS  10000       // records inserted per configuration
+#define MAX_THREADS  8           // threads inserting at once
+#define FORMAT_RECS  100000      // records of a format
+#define FORMAT_SCANS 5           // scans of a format
+#define SCAN_RECS    10000000    // records of the scan benchmark
+
+// Record of the format benchmark, with strings of CHAR(255) and CHAR(64)
+struct PersonRec {
+	int   id;
+	float score;
+	char  name[255];
+	char  city[64];
+};
+
+// Record of the scan benchmark
+struct ItemRec {
+	int   id;
+	float price;
+	int   qty;
+	int   shop;
+};
+
+// How the scan benchmark gets its records
+enum ScanMode {
+	SCAN_COPY,                   // GetNextRec into an RM_Record
+	SCAN_VIEW,                   // GetNextRec into an RM_RecordView
+	SCAN_BATCH                   // GetNextBatch
+};
+
+// How each insert is made durable
+enum Durability {
+	DUR_FORCE,                   // ForcePages after each insert
+	DUR_SYNC,                    // SyncPages after each insert
+	DUR_LOG                      // Commit of the log
+};
+
+//
+// Elapsed
+//
+// Seconds since start
+//
+static double Elapsed(chrono::steady_clock::time_point start)
+{
+	chrono::duration<double> d = chrono::steady_clock::now() - start;
+	return (d.count());
+}
+
+//
+// Inserts
+//
+// Insert numRecs records into an open file, making them durable every
+// batch records
+//
+static RC Inserts(RM_FileHandle *pFh, RM_Log *pLog, Durability durability,
+		int numRecs, int batch)
+{
+	char record[RECORD_SIZE];
+	RID rid;
+	RC rc;
+
+	memset(record, 'x', RECORD_SIZE);
+	for (int i = 0; i < numRecs; i++) {
+		memcpy(record, &i, sizeof(int));
+		if ((rc = pFh->InsertRec(record, rid)))
+			return (rc);
+		if ((i + 1) % batch != 0 && i != numRecs - 1)
+			continue;
+		if (durability == DUR_FORCE)
+			rc = pFh->ForcePages();
+		else if (durability == DUR_SYNC)
+			rc = pFh->SyncPages();
+		else
+			rc = pLog->Commit();
+		if (rc)
+			return (rc);
+	}
+	return (0);
+}
+
+//
+// BenchCommit
+//
+// COMMIT_RECS inserts shared by numThreads threads, each into a file of
+// its own
+//
+RC BenchCommit(Durability durability, int numThreads, int batch)
+{
+	PF_Manager pfm;
+	RM_Manager rmm(pfm);
+	RM_Log log;
+	RM_FileHandle fhs[MAX_THREADS];
+	RC rcs[MAX_THREADS];
+	char fileName[32];
+	RC rc;
+
+	unlink(LOGNAME);
+	if (durability == DUR_LOG) {
+		if ((rc = log.Open(LOGNAME)))
+			return (rc);
+		rmm.SetLog(&log);
+	}
+	for (int t = 0; t < numThreads; t++) {
+		sprintf(fileName, "%s%d", FILENAME, t);
+		unlink(fileName);
+		if ((rc = rmm.CreateFile(fileName, RECORD_SIZE)) ||
+				(rc = rmm.OpenFile(fileName, fhs[t])))
+			return (rc);
+	}
+
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	vector<thread> threads;
+	for (int t = 0; t < numThreads; t++)
+		threads.push_back(thread([&, t] {
+			rcs[t] = Inserts(&fhs[t], &log, durability,
+					COMMIT_RECS / numThreads, batch);
+		}));
+	for (int t = 0; t < numThreads; t++)
+		threads[t].join();
+	double secs = Elapsed(start);
+	for (int t = 0; t < numThreads; t++)
+		if (rcs[t])
+			return (rcs[t]);
+
+	const char *names[] = { "force", "sync", "log" };
+	printf("commit  %-5s threads=%d batch=%-3d %10.0f inserts/s\n",
+			names[durability], numThreads, batch, COMMIT_RECS / secs);
+
+	for (int t = 0; t < numThreads; t++) {
+		sprintf(fileName, "%s%d", FILENAME, t);
+		if ((rc = rmm.CloseFile(fhs[t])) ||
+				(rc = rmm.DestroyFile(fileName)))
+			return (rc);
+	}
+	if (durability == DUR_LOG && (rc = log.Close()))
+		return (rc);
+	unlink(LOGNAME);
+
+	return (0);
+}
+
+//
+// BenchFormat
+//
+// FORMAT_RECS people stored in a format, then scanned
+//
+RC BenchFormat(RM_FileFormat format)
+{
+	PF_Manager pfm;
+	RM_Manager rmm(pfm);
+	RM_FileHandle fh;
+	RM_FileScan fs;
+	RM_Record rec;
+	RM_RecordView view;
+	PersonRec person;
+	RID rid;
+	RC rc;
+
+	unlink(FILENAME);
+	if ((rc = rmm.CreateFile(FILENAME, sizeof(PersonRec),
+			PF_DEFAULT_PAGE_SIZE, format)) ||
+			(rc = rmm.OpenFile(FILENAME, fh)))
+		return (rc);
+
+	// Names of 10 to 20 characters, cities of 5 to 12
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	for (int i = 0; i < FORMAT_RECS; i++) {
+		memset(&person, 0, sizeof(person));
+		person.id = i;
+		person.score = (float)(i % 1000);
+		sprintf(person.name, "person%0*d", 4 + i % 11, i);
+		sprintf(person.city, "city%0*d", 1 + i % 8, i % 1000);
+		if ((rc = fh.InsertRec((char *)&person, rid)))
+			return (rc);
+	}
+	double insertSecs = Elapsed(start);
+
+	// Pages of the file, from its length
+	struct stat st;
+	if ((rc = rmm.CloseFile(fh)) ||
+			(rc = rmm.OpenFile(FILENAME, fh)))
+		return (rc);
+	if (stat(FILENAME, &st) < 0)
+		return (PF_UNIX);
+	long long numPages = st.st_size / PF_DEFAULT_PAGE_SIZE;
+
+	// Scans with a condition on the score, matching half the records
+	int count = 0;
+	float value = 500.0f;
+	start = chrono::steady_clock::now();
+	for (int i = 0; i < FORMAT_SCANS; i++) {
+		if ((rc = fs.OpenScan(fh, FLOAT, sizeof(float),
+				offsetof(PersonRec, score), LT_OP, &value, SEQUENTIAL_SCAN)))
+			return (rc);
+		while (!(rc = fs.GetNextRec(rec)))
+			count++;
+		if (rc != RM_EOF || (rc = fs.CloseScan()))
+			return (rc);
+	}
+	double scanSecs = Elapsed(start);
+
+	start = chrono::steady_clock::now();
+	for (int i = 0; i < FORMAT_SCANS; i++) {
+		if ((rc = fs.OpenScan(fh, FLOAT, sizeof(float),
+				offsetof(PersonRec, score), LT_OP, &value, SEQUENTIAL_SCAN)))
+			return (rc);
+		while (!(rc = fs.GetNextRec(view)))
+			count++;
+		if (rc != RM_EOF || (rc = fs.CloseScan()))
+			return (rc);
+	}
+	double viewSecs = Elapsed(start);
+	if (count != 2 * FORMAT_SCANS * FORMAT_RECS / 2) {
+		printf("The scans found %d records\n", count);
+		return (0);
+	}
+
+	const char *names[] = { "fixed", "slotted" };
+	printf("format  %-7s pages=%-6lld %6.1f bytes/rec %9.0f inserts/s "
+			"%10.0f recs copied/s %10.0f recs viewed/s\n", names[format],
+			numPages, (double)numPages * PF_DEFAULT_PAGE_SIZE / FORMAT_RECS,
+			FORMAT_RECS / insertSecs, FORMAT_SCANS * FORMAT_RECS / scanSecs,
+			FORMAT_SCANS * FORMAT_RECS / viewSecs);
+
+	if ((rc = rmm.CloseFile(fh)) ||
+			(rc = rmm.DestroyFile(FILENAME)))
+		return (rc);
+	return (0);
+}
+
+//
+// ScanItems
+//
+// Scan the items whose price is below half of the prices, returning how
+// many were found
+//
+static RC ScanItems(RM_FileHandle &fh, ScanMode mode, int &count)
+{
+	RM_FileScan fs;
+	RM_Record rec;
+	RM_RecordView view;
+	RM_RecordBatch batch;
+	float value = 500.0f;
+	RC rc;
+
+	count = 0;
+	if ((rc = fs.OpenScan(fh, FLOAT, sizeof(float), offsetof(ItemRec, price),
+			LT_OP, &value, SEQUENTIAL_SCAN)))
+		return (rc);
+	if (mode == SCAN_COPY)
+		while (!(rc = fs.GetNextRec(rec)))
+			count++;
+	else if (mode == SCAN_VIEW)
+		while (!(rc = fs.GetNextRec(view)))
+			count++;
+	else
+		while (!(rc = fs.GetNextBatch(batch)))
+			count += batch.GetCount();
+	if (rc != RM_EOF)
+		return (rc);
+	return (fs.CloseScan());
+}
+
+//
+// BenchScan
+//
+// SCAN_RECS items scanned in each mode, at each filter level
+//
+RC BenchScan()
+{
+	PF_Manager pfm;
+	RM_Manager rmm(pfm);
+	RM_FileHandle fh;
+	ItemRec item;
+	RID rid;
+	RC rc;
+
+	unlink(FILENAME);
+	if ((rc = rmm.CreateFile(FILENAME, sizeof(ItemRec))) ||
+			(rc = rmm.OpenFile(FILENAME, fh)) ||
+			(rc = fh.SetBulkLoad(TRUE)))
+		return (rc);
+	for (int i = 0; i < SCAN_RECS; i++) {
+		item.id = i;
+		item.price = (float)(i % 1000);
+		item.qty = i % 7;
+		item.shop = i % 13;
+		if ((rc = fh.InsertRec((char *)&item, rid)))
+			return (rc);
+	}
+	if ((rc = fh.SetBulkLoad(FALSE)))
+		return (rc);
+
+	const char *names[] = { "copy", "view", "batch" };
+	const char *levels[] = { "off", "scalar", "sse2", "avx2" };
+	int oldLevel = RM_GetFilterLevel();
+	for (int mode = SCAN_COPY; mode <= SCAN_BATCH; mode++) {
+		for (int level = RM_FILTER_OFF; level <= RM_FILTER_AVX2; level++) {
+			int count;
+			if (RM_SetFilterLevel(level) != level)
+				break;
+			// The first scan warms the buffer up
+			if ((rc = ScanItems(fh, (ScanMode)mode, count)))
+				return (rc);
+			chrono::steady_clock::time_point start =
+				chrono::steady_clock::now();
+			if ((rc = ScanItems(fh, (ScanMode)mode, count)))
+				return (rc);
+			double secs = Elapsed(start);
+			if (count != SCAN_RECS / 2) {
+				printf("The scan found %d records\n", count);
+				return (0);
+			}
+			printf("scan    %-5s %-6s rows=%d %12.0f rows/s\n", names[mode],
+					levels[level], SCAN_RECS, SCAN_RECS / secs);
+		}
+	}
+	RM_SetFilterLevel(oldLevel);
+
+	if ((rc = rmm.CloseFile(fh)) ||
+			(rc = rmm.DestroyFile(FILENAME)))
+		return (rc);
+	return (0);
+}
+
+int main()
+{
+	RC rc;
+
+	cout << "Starting RM benchmarks.\n";
+
+	if ((rc = BenchCommit(DUR_FORCE, 1, 1)) ||
+			(rc = BenchCommit(DUR_SYNC, 1, 1)) ||
+			(rc = BenchCommit(DUR_LOG, 1, 1)) ||
+			(rc = BenchCommit(DUR_LOG, 4, 1)) ||
+			(rc = BenchCommit(DUR_LOG, MAX_THREADS, 1)) ||
+			(rc = BenchCommit(DUR_LOG, 1, 64)) ||
+			(rc = BenchFormat(RM_FORMAT_FIXED)) ||
+			(rc = BenchFormat(RM_FORMAT_SLOTTED)) ||
+			(rc = BenchScan())) {
+		RM_PrintError(rc);
+		return (1);
+	}
+
+	cout << "Ending RM benchmarks.\n";
+
+	return (0);
+}
@@ -20,6 +20,7 @@
 #include <cstring>
 #include <cstdlib>
 #include <cassert>
+#include <cmath>
 #include <unistd.h>
 
 #include "redbase.h"
@@ -69,6 +70,11 @@ RC Test3(void);
 RC Test4(void);
 RC Test5(void);
 RC Test6(void);
+RC Test7(void);
+RC Test8(void);
+RC Test9(void);
+RC Test10(void);
+RC Test11(void);
 
 void PrintError(RC rc);
 void LsFile(char *fileName);
@@ -97,6 +103,11 @@ int (*tests[])() =                      // RC doesn't work on some compilers
 	Test4,
 	Test5,
 	Test6,
+	Test7,
+	Test8,
+	Test9,
+	Test10,
+	Test11,
 };
 #define NUM_TESTS       ((int)((sizeof(tests)) / sizeof(tests[0])))    // number of tests
 
@@ -679,3 +690,413 @@ RC Test6(void) {
 	printf("\ntest6 done ********************\n");
 	return (0);
 }
+
+//
+// Test7 tests a file of 16K pages used next to a file of default pages
+//
+RC Test7(void) {
+	RC            rc;
+	RM_FileHandle fh, fh16;
+	const char    *fileName16 = FILENAME "16k";
+
+	printf("test7 starting ****************\n");
+
+	unlink(fileName16);
+	if ((rc = CreateFile((char *)FILENAME, sizeof(TestRec))) ||
+		(rc = rmm.CreateFile(fileName16, sizeof(TestRec), 16384)) ||
+		(rc = OpenFile((char *)FILENAME, fh)) ||
+		(rc = OpenFile((char *)fileName16, fh16)) ||
+		(rc = AddRecs(fh, LOTS_OF_RECS)) ||
+		(rc = AddRecs(fh16, LOTS_OF_RECS)) ||
+		(rc = VerifyFile(fh, LOTS_OF_RECS)) ||
+		(rc = VerifyFile(fh16, LOTS_OF_RECS)))
+		return (rc);
+
+	// The records of a 16K page
+	RID rid;
+	PageNum pageNum;
+	SlotNum slotNum;
+	TestRec recBuf;
+	memset((void *)&recBuf, 0, sizeof(recBuf));
+	if ((rc = InsertRec(fh16, (char *)&recBuf, rid)) ||
+		(rc = rid.GetPageNum(pageNum)) ||
+		(rc = rid.GetSlotNum(slotNum)))
+		return (rc);
+	int perPage = 8 * (PF_PageDataSize(16384) - sizeof(int)) /
+		(8 * sizeof(TestRec) + 1) / 8 * 8;
+	assert(pageNum == 1 + LOTS_OF_RECS / perPage);
+	assert(slotNum == LOTS_OF_RECS % perPage);
+
+	if ((rc = CloseFile((char *)FILENAME, fh)) ||
+		(rc = CloseFile((char *)fileName16, fh16)) ||
+		(rc = DestroyFile((char *)FILENAME)) ||
+		(rc = DestroyFile((char *)fileName16)))
+		return (rc);
+
+	// Page sizes which are not powers of two are refused
+	if ((rc = rmm.CreateFile(fileName16, sizeof(TestRec), 10000)) !=
+			PF_BADPARAM) {
+		printf("Create file of 10000 byte pages should fail\n");
+		return (rc ? rc : -1);
+	}
+
+	printf("\ntest7 done ********************\n");
+	return (0);
+}
+
+//
+// Test8 tests scans with hints, which go through the scan ring of the
+// buffer, updating the records on the way
+//
+RC Test8(void) {
+	RC            rc;
+	RM_FileHandle fh;
+	RM_Record     rec;
+	RM_FileScan   sc;
+	TestRec       *data;
+	int           n;
+
+	printf("test8 starting ****************\n");
+
+	if ((rc = CreateFile((char *)FILENAME, sizeof(TestRec))) ||
+		(rc = OpenFile((char *)FILENAME, fh)) ||
+		(rc = AddRecs(fh, LOTS_OF_RECS)))
+		return (rc);
+
+	// Negate r in a sequential scan, restore it in a one-shot scan
+	TRY(sc.OpenScan(fh, INT, sizeof(int), 0, NO_OP, NULL, SEQUENTIAL_SCAN));
+	for (rc = sc.GetNextRec(rec), n = 0; rc != RM_EOF;
+			rc = sc.GetNextRec(rec), n++) {
+		if (rc)
+			return rc;
+		rec.GetData(CVOID(data));
+		data->r = -data->r;
+		TRY(fh.UpdateRec(rec));
+	}
+	TRY(sc.CloseScan());
+	assert(n == LOTS_OF_RECS);
+
+	TRY(sc.OpenScan(fh, INT, sizeof(int), 0, NO_OP, NULL, ONE_SHOT));
+	for (rc = sc.GetNextRec(rec), n = 0; rc != RM_EOF;
+			rc = sc.GetNextRec(rec), n++) {
+		if (rc)
+			return rc;
+		rec.GetData(CVOID(data));
+		assert(data->r == -(float)data->num);
+		data->r = -data->r;
+		TRY(fh.UpdateRec(rec));
+	}
+	TRY(sc.CloseScan());
+	assert(n == LOTS_OF_RECS);
+
+	// A random scan only finds the records asked for
+	int value = LOTS_OF_RECS / 2;
+	TRY(sc.OpenScan(fh, INT, sizeof(int), offsetof(TestRec, num), LT_OP,
+			&value, RANDOM));
+	for (rc = sc.GetNextRec(rec), n = 0; rc != RM_EOF;
+			rc = sc.GetNextRec(rec), n++)
+		if (rc)
+			return rc;
+	TRY(sc.CloseScan());
+	assert(n == value);
+
+	if ((rc = VerifyFile(fh, LOTS_OF_RECS)))
+		return (rc);
+
+	// Values outside of ClientHint are refused
+	if ((rc = sc.OpenScan(fh, INT, sizeof(int), 0, NO_OP, NULL,
+			(ClientHint)42)) != RM_OTHER_HINT_NOT_SUPPORT) {
+		printf("Scan with an unknown hint should fail\n");
+		return (rc ? rc : -1);
+	}
+
+	if ((rc = CloseFile((char *)FILENAME, fh)) ||
+		(rc = DestroyFile((char *)FILENAME)))
+		return (rc);
+
+	printf("\ntest8 done ********************\n");
+	return (0);
+}
+
+//
+// Test9 tests reading records in place through views, in the fixed and
+// the slotted formats
+//
+RC Test9(void) {
+	RC            rc;
+	RM_FileHandle fh;
+	RM_FileScan   sc;
+	RM_RecordView view, other;
+	RM_Record     rec;
+	RID           rid;
+	TestRec       *data;
+	char          *otherData;
+	int           n;
+
+	printf("test9 starting ****************\n");
+
+	for (int format = RM_FORMAT_FIXED; format <= RM_FORMAT_SLOTTED; format++) {
+		if ((rc = rmm.CreateFile(FILENAME, sizeof(TestRec),
+				PF_DEFAULT_PAGE_SIZE, (RM_FileFormat)format)) ||
+			(rc = OpenFile((char *)FILENAME, fh)) ||
+			(rc = AddRecs(fh, LOTS_OF_RECS)))
+			return (rc);
+
+		// A scan through a view finds every record once
+		char *found = new char[LOTS_OF_RECS];
+		memset(found, 0, LOTS_OF_RECS);
+		TRY(sc.OpenScan(fh, INT, sizeof(int), 0, NO_OP, NULL,
+				SEQUENTIAL_SCAN));
+		for (rc = sc.GetNextRec(view), n = 0; rc != RM_EOF;
+				rc = sc.GetNextRec(view), n++) {
+			if (rc)
+				return rc;
+			TRY(view.GetData(CVOID(data)));
+			TRY(view.GetRid(rid));
+			assert(data->num >= 0 && data->num < LOTS_OF_RECS);
+			assert(!found[data->num]);
+			assert(data->r == (float)data->num);
+			found[data->num] = 1;
+
+			// GetRec gives the same record, in the same page when it
+			// is not decoded
+			TRY(fh.GetRec(rid, other));
+			TRY(other.GetData(otherData));
+			assert(memcmp(data, otherData, sizeof(TestRec)) == 0);
+			assert(format == RM_FORMAT_SLOTTED || otherData == (char *)data);
+		}
+		TRY(sc.CloseScan());
+		assert(n == LOTS_OF_RECS);
+		delete[] found;
+
+		// A view is invalid once released, a copy keeps the record
+		TRY(fh.GetRec(rid, rec));
+		RM_Record copy(rec);
+		TRY(copy.GetData(CVOID(data)));
+		TRY(rec.GetData(otherData));
+		assert(otherData != (char *)data &&
+			memcmp(data, otherData, sizeof(TestRec)) == 0);
+		TRY(view.Release());
+		TRY(other.Release());
+		assert(view.GetData(otherData) == RM_RECORD_INVALID);
+
+		// Deleted records are not found
+		TRY(fh.DeleteRec(rid));
+		assert(fh.GetRec(rid, view) == RM_RECORD_NOT_FOUND);
+
+		if ((rc = CloseFile((char *)FILENAME, fh)) ||
+			(rc = DestroyFile((char *)FILENAME)))
+			return (rc);
+	}
+
+	printf("\ntest9 done ********************\n");
+	return (0);
+}
+
+//
+// Test10 tests scanning records a page at a time, in the fixed and the
+// slotted formats
+//
+RC Test10(void) {
+	RC             rc;
+	RM_FileHandle  fh;
+	RM_FileScan    sc;
+	RM_RecordBatch batch;
+	RM_Record      rec;
+	RID            rid;
+	TestRec        *data;
+	char           *recData;
+	int            n, numBatches;
+
+	printf("test10 starting ****************\n");
+
+	for (int format = RM_FORMAT_FIXED; format <= RM_FORMAT_SLOTTED; format++) {
+		if ((rc = rmm.CreateFile(FILENAME, sizeof(TestRec),
+				PF_DEFAULT_PAGE_SIZE, (RM_FileFormat)format)) ||
+			(rc = OpenFile((char *)FILENAME, fh)) ||
+			(rc = AddRecs(fh, LOTS_OF_RECS)))
+			return (rc);
+
+		// Every record is found once, each batch in a page of its own
+		char *found = new char[LOTS_OF_RECS];
+		memset(found, 0, LOTS_OF_RECS);
+		PageNum lastPage = -1;
+		TRY(sc.OpenScan(fh, INT, sizeof(int), 0, NO_OP, NULL,
+				SEQUENTIAL_SCAN));
+		for (rc = sc.GetNextBatch(batch), n = 0, numBatches = 0;
+				rc != RM_EOF; rc = sc.GetNextBatch(batch), numBatches++) {
+			if (rc)
+				return rc;
+			assert(batch.GetCount() > 0);
+			for (int i = 0; i < batch.GetCount(); i++, n++) {
+				PageNum pageNum;
+				TRY(batch.GetData(i, CVOID(data)));
+				TRY(batch.GetRid(i, rid));
+				TRY(rid.GetPageNum(pageNum));
+				assert(pageNum > lastPage || (i > 0 && pageNum == lastPage));
+				lastPage = pageNum;
+				assert(data->num >= 0 && data->num < LOTS_OF_RECS);
+				assert(!found[data->num]);
+				found[data->num] = 1;
+
+				TRY(fh.GetRec(rid, rec));
+				TRY(rec.GetData(recData));
+				assert(memcmp(data, recData, sizeof(TestRec)) == 0);
+			}
+			assert(batch.GetData(batch.GetCount(), recData) ==
+				RM_RECORD_INVALID);
+		}
+		TRY(sc.CloseScan());
+		assert(n == LOTS_OF_RECS && batch.GetCount() == 0);
+		assert(numBatches < LOTS_OF_RECS / 8);
+		delete[] found;
+
+		// With a condition, only the matching records
+		int value = LOTS_OF_RECS / 3;
+		TRY(sc.OpenScan(fh, INT, sizeof(int), offsetof(TestRec, num), GE_OP,
+				&value));
+		for (rc = sc.GetNextBatch(batch), n = 0; rc != RM_EOF;
+				rc = sc.GetNextBatch(batch)) {
+			if (rc)
+				return rc;
+			for (int i = 0; i < batch.GetCount(); i++, n++) {
+				TRY(batch.GetData(i, CVOID(data)));
+				assert(data->num >= value);
+			}
+		}
+		TRY(sc.CloseScan());
+		assert(n == LOTS_OF_RECS - value);
+
+		if ((rc = CloseFile((char *)FILENAME, fh)) ||
+			(rc = DestroyFile((char *)FILENAME)))
+			return (rc);
+	}
+
+	printf("\ntest10 done ********************\n");
+	return (0);
+}
+
+//
+// Test11 tests the conditions on INT and FLOAT attributes at every filter
+// level, against the records themselves
+//
+struct FilterRec {
+	int   num;
+	float r;
+	int   pad;
+};
+
+static Boolean Satisfies(double a, CompOp op, double b)
+{
+	switch (op) {
+	case EQ_OP: return (Boolean)(a == b);
+	case LT_OP: return (Boolean)(a < b);
+	case GT_OP: return (Boolean)(a > b);
+	case LE_OP: return (Boolean)(a <= b);
+	case GE_OP: return (Boolean)(a >= b);
+	default:    return (Boolean)(a != b);
+	}
+}
+
+RC Test11(void) {
+	RC             rc;
+	RM_FileHandle  fh;
+	RM_FileScan    sc;
+	RM_RecordView  view;
+	RM_RecordBatch batch;
+	RID            rid;
+	FilterRec      recBuf, data;
+	char           *pData;
+	CompOp         ops[] = { EQ_OP, LT_OP, GT_OP, LE_OP, GE_OP, NE_OP };
+	int            counts[2][6];
+	int            oldLevel = RM_GetFilterLevel();
+
+	printf("test11 starting ****************\n");
+
+	// Negative values, NaNs, and holes left by deleted records
+	memset(&recBuf, 0, sizeof(recBuf));
+	if ((rc = CreateFile((char *)FILENAME, sizeof(FilterRec))) ||
+		(rc = OpenFile((char *)FILENAME, fh)))
+		return (rc);
+	for (int i = 0; i < LOTS_OF_RECS; i++) {
+		recBuf.num = (i * 7919) % 201 - 100;
+		recBuf.r = (i % 13 == 0) ? NAN : recBuf.num / 4.0f;
+		TRY(fh.InsertRec((char *)&recBuf, rid));
+		if (i % 3 == 0 || (i / 100) % 5 == 0)
+			TRY(fh.DeleteRec(rid));
+	}
+
+	int   intValue = 10;
+	float floatValue = 2.5f;
+	for (int level = RM_FILTER_OFF; level <= RM_FILTER_AVX2; level++) {
+		if (RM_SetFilterLevel(level) != level)
+			continue;
+		printf("filter level %d\n", level);
+		for (int type = 0; type < 2; type++) {
+			AttrType attrType = type ? FLOAT : INT;
+			int offset = type ? offsetof(FilterRec, r) : offsetof(FilterRec, num);
+			void *value = type ? (void *)&floatValue : (void *)&intValue;
+			double b = type ? floatValue : intValue;
+
+			for (int op = 0; op < 6; op++) {
+				// Record at a time
+				int n = 0;
+				TRY(sc.OpenScan(fh, attrType, 4, offset, ops[op], value));
+				while ((rc = sc.GetNextRec(view)) != RM_EOF) {
+					if (rc)
+						return (rc);
+					// In place records need not be aligned
+					TRY(view.GetData(pData));
+					memcpy(&data, pData, sizeof(data));
+					assert(Satisfies(type ? data.r : data.num, ops[op], b));
+					n++;
+				}
+				TRY(sc.CloseScan());
+
+				// Page at a time
+				int m = 0;
+				TRY(sc.OpenScan(fh, attrType, 4, offset, ops[op], value));
+				while ((rc = sc.GetNextBatch(batch)) != RM_EOF) {
+					if (rc)
+						return (rc);
+					for (int i = 0; i < batch.GetCount(); i++, m++) {
+						TRY(batch.GetData(i, pData));
+						memcpy(&data, pData, sizeof(data));
+						assert(Satisfies(type ? data.r : data.num, ops[op], b));
+					}
+				}
+				TRY(sc.CloseScan());
+
+				// Page at a time after the first record
+				int k = 0;
+				TRY(sc.OpenScan(fh, attrType, 4, offset, ops[op], value));
+				if ((rc = sc.GetNextRec(view)) != RM_EOF) {
+					TRY(rc);
+					TRY(view.Release());
+					for (k = 1; (rc = sc.GetNextBatch(batch)) != RM_EOF;
+							k += batch.GetCount())
+						TRY(rc);
+				}
+				TRY(sc.CloseScan());
+
+				// The same records at every level
+				assert(n == m && n == k);
+				if (level == RM_FILTER_OFF)
+					counts[type][op] = n;
+				assert(n == counts[type][op]);
+			}
+		}
+	}
+	RM_SetFilterLevel(oldLevel);
+
+	// Every condition and its negation cover all the records but the NaNs
+	assert(counts[0][1] + counts[0][4] == counts[0][5] + counts[0][0]);
+	assert(counts[1][0] + counts[1][5] > counts[1][1] + counts[1][4]);
+
+	if ((rc = CloseFile((char *)FILENAME, fh)) ||
+		(rc = DestroyFile((char *)FILENAME)))
+		return (rc);
+
+	printf("\ntest11 done ********************\n");
+	return (0);
+}
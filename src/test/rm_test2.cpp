@@ -0,0 +1,608 @@
+//
+// File:        rm_test2.cc
+// Description: Test the redo log of the RM component
+//
+// A child process inserts, deletes and updates records of a file whose
+// changes are logged, commits some of them and dies without closing the
+// file, so that its dirty pages are lost.  The parent opens the log,
+// recovers and checks that the file holds exactly the committed changes.
+// This is done with a buffer which holds the whole file and with one
+// which writes some of its pages back before the crash, but must not
+// write back the changes which were not committed, with several threads
+// committing at once, with a checkpoint taken while some changes were not
+// committed, and with garbage at the end of the log.  Uncommitted changes
+// filling the buffer are refused before they change anything.
+//
+
+#include <cstdio>
+#include <iostream>
+#include <cstring>
+#include <cstdlib>
+#include <vector>
+#include <thread>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "redbase.h"
+#include "pf.h"
+#include "rm.h"
+#include "rm_log.h"
+
+using namespace std;
+
+//
+// Defines
+//
+#define FILENAME     "testrel"   // test file name
+#define LOGNAME      "testrel.log" // log file name
+#define STRLEN       29          // length of string in testrec
+#define NUM_RECS     1000        // records inserted and committed
+#define NUM_LOST     10          // records inserted but not committed
+#define NUM_THREADS  4           // threads committing at once
+#define THREAD_RECS  200         // records inserted by each thread
+#define WHOLE_BUFFER 64          // buffer pages holding the whole file
+#define SMALL_BUFFER 4           // buffer pages writing some back
+
+//
+// Structure of the records we will be using for the tests
+//
+struct TestRec {
+	char  str[STRLEN];
+	int   num;
+	float r;
+};
+
+//
+// Fail
+//
+// Print an error and leave
+//
+static void Fail(const char *what, RC rc)
+{
+	cout << what << " failed\n";
+	if (rc)
+		RM_PrintError(rc);
+	exit(1);
+}
+
+//
+// MakeRec
+//
+// Record number num, updated or not
+//
+static TestRec MakeRec(int num, int bUpdated)
+{
+	TestRec rec;
+	memset(&rec, 0, sizeof(rec));
+	sprintf(rec.str, "a%d", num);
+	rec.num = num;
+	rec.r = bUpdated ? -1.0f : (float)num;
+	return (rec);
+}
+
+//
+// ReadRecs
+//
+// Read all the records of a file.  found[num] counts the records numbered
+// num, updated[num] is TRUE if the last one was updated.
+//
+static RC ReadRecs(RM_Manager &rmm, const char *fileName, vector<int> &found,
+		vector<int> &updated)
+{
+	RM_FileHandle fh;
+	RM_FileScan fs;
+	RM_Record rec;
+	char *pData;
+	RC rc;
+
+	if ((rc = rmm.OpenFile(fileName, fh)) ||
+			(rc = fs.OpenScan(fh, INT, sizeof(int), 0, NO_OP, NULL)))
+		return (rc);
+	while (!(rc = fs.GetNextRec(rec))) {
+		if ((rc = rec.GetData(pData)))
+			return (rc);
+		TestRec *pRec = (TestRec *)pData;
+		if (pRec->num < 0 || pRec->num >= (int)found.size())
+			Fail("Reading an unknown record", 0);
+		found[pRec->num]++;
+		updated[pRec->num] = (pRec->r < 0);
+	}
+	if (rc != RM_EOF)
+		return (rc);
+
+	if ((rc = fs.CloseScan()) ||
+			(rc = rmm.CloseFile(fh)))
+		return (rc);
+	return (0);
+}
+
+//
+// Crash
+//
+// Run work in a child process, which must die with _exit without
+// closing anything
+//
+static void Crash(void (*work)(int), int arg)
+{
+	pid_t pid = fork();
+	if (pid < 0)
+		Fail("fork", 0);
+	if (pid == 0) {
+		work(arg);
+		_exit(0);
+	}
+
+	int status;
+	if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) ||
+			WEXITSTATUS(status) != 0)
+		Fail("The child", 0);
+}
+
+//
+// UpdateRec
+//
+// Mark the record at rid as updated
+//
+static void UpdateRec(RM_FileHandle &fh, const RID &rid)
+{
+	RM_Record rec;
+	char *pData;
+	RC rc;
+
+	if ((rc = fh.GetRec(rid, rec)) ||
+			(rc = rec.GetData(pData)))
+		Fail("GetRec", rc);
+	((TestRec *)pData)->r = -1.0f;
+	if ((rc = fh.UpdateRec(rec)))
+		Fail("UpdateRec", rc);
+}
+
+//
+// ChangeRecs
+//
+// Child of TestRecover: insert NUM_RECS records and checkpoint, delete
+// one out of 3 and update one out of 5 of those left, then insert
+// NUM_LOST records and update NUM_LOST more which are not committed.
+// The updated records are in no log record, so only the rule that
+// uncommitted changes are not written back keeps them from surviving
+// the crash.  All the records are read last, so that a small buffer
+// replaces every page but those holding uncommitted changes.
+//
+static void ChangeRecs(int bufferSize)
+{
+	PF_Manager pfm;
+	RM_Manager rmm(pfm);
+	RM_FileHandle fh;
+	RM_Log log;
+	vector<RID> rids(NUM_RECS);
+	RC rc;
+
+	if ((rc = pfm.ResizeBuffer(bufferSize)) ||
+			(rc = log.Open(LOGNAME)))
+		Fail("Opening the log", rc);
+	rmm.SetLog(&log);
+
+	if ((rc = rmm.CreateFile(FILENAME, sizeof(TestRec))) ||
+			(rc = rmm.OpenFile(FILENAME, fh)))
+		Fail("Creating the file", rc);
+
+	for (int i = 0; i < NUM_RECS; i++) {
+		TestRec rec = MakeRec(i, FALSE);
+		if ((rc = fh.InsertRec((char *)&rec, rids[i])))
+			Fail("InsertRec", rc);
+		// Commit now and then, as statements would
+		if (i % 100 == 99 && (rc = log.Commit()))
+			Fail("Commit", rc);
+	}
+	if ((rc = log.Commit()) ||
+			(rc = log.Checkpoint()))
+		Fail("Checkpoint", rc);
+
+	for (int i = 0; i < NUM_RECS; i++) {
+		if (i % 3 == 0) {
+			if ((rc = fh.DeleteRec(rids[i])))
+				Fail("DeleteRec", rc);
+		}
+		else if (i % 5 == 0)
+			UpdateRec(fh, rids[i]);
+		if (i % 100 == 99 && (rc = log.Commit()))
+			Fail("Commit", rc);
+	}
+	if ((rc = log.Commit()))
+		Fail("Commit", rc);
+
+	for (int i = NUM_RECS; i < NUM_RECS + NUM_LOST; i++) {
+		TestRec rec = MakeRec(i, FALSE);
+		RID rid;
+		if ((rc = fh.InsertRec((char *)&rec, rid)))
+			Fail("InsertRec", rc);
+	}
+	for (int i = 0, n = 0; n < NUM_LOST; i++)
+		if (i % 3 != 0 && i % 5 != 0) {
+			UpdateRec(fh, rids[i]);
+			n++;
+		}
+
+	// Both ways, so that the pages read last are replaced too
+	for (int pass = 0; pass < 2; pass++)
+		for (int j = 0; j < NUM_RECS; j++) {
+			int i = pass ? NUM_RECS - 1 - j : j;
+			RM_Record rec;
+			if (i % 3 != 0 && (rc = fh.GetRec(rids[i], rec)))
+				Fail("GetRec", rc);
+		}
+
+	// Die before the destructors can write anything
+	_exit(0);
+}
+
+//
+// TestRecover
+//
+// Recover the changes of ChangeRecs
+//
+RC TestRecover(int bufferSize)
+{
+	PF_Manager pfm;
+	RM_Manager rmm(pfm);
+	RM_FileHandle fh;
+	RM_Log log;
+	RC rc;
+
+	cout << "Recovering with a buffer of " << bufferSize << " pages\n";
+
+	unlink(FILENAME);
+	unlink(LOGNAME);
+	Crash(ChangeRecs, bufferSize);
+
+	// A torn record at the end of the log is dropped
+	int fd = open(LOGNAME, O_WRONLY | O_APPEND);
+	if (fd < 0 || write(fd, "torn record", 11) != 11)
+		Fail("Writing the log", 0);
+	close(fd);
+
+	if ((rc = log.Open(LOGNAME)) ||
+			(rc = log.Recover(rmm)))
+		return (rc);
+
+	vector<int> found(NUM_RECS + NUM_LOST), updated(NUM_RECS + NUM_LOST);
+	if ((rc = ReadRecs(rmm, FILENAME, found, updated)))
+		return (rc);
+	for (int i = 0; i < NUM_RECS + NUM_LOST; i++) {
+		int expected = (i < NUM_RECS && i % 3 != 0);
+		if (found[i] != expected ||
+				(expected && updated[i] != (i % 5 == 0))) {
+			cout << "Record " << i << " was found " << found[i]
+				<< " times after recovery"
+				<< (updated[i] ? ", updated\n" : "\n");
+			exit(1);
+		}
+	}
+
+	// The free pages were found again: inserting fills the holes first
+	rmm.SetLog(&log);
+	if ((rc = rmm.OpenFile(FILENAME, fh)))
+		return (rc);
+	for (int i = 0; i < NUM_RECS / 3; i++) {
+		TestRec rec = MakeRec(NUM_RECS + NUM_LOST, FALSE);
+		RID rid;
+		PageNum pageNum;
+		if ((rc = fh.InsertRec((char *)&rec, rid)) ||
+				(rc = rid.GetPageNum(pageNum)))
+			return (rc);
+		// Page 0 is the header, a page holds somewhat less than
+		// PF_PAGE_SIZE / sizeof(TestRec) records
+		if (pageNum > NUM_RECS / (PF_PAGE_SIZE / (int)sizeof(TestRec) - 8) + 1) {
+			cout << "Record went to page " << pageNum << "\n";
+			exit(1);
+		}
+	}
+	if ((rc = log.Commit()) ||
+			(rc = rmm.CloseFile(fh)) ||
+			(rc = rmm.DestroyFile(FILENAME)) ||
+			(rc = log.Close()))
+		return (rc);
+
+	unlink(LOGNAME);
+	return (0);
+}
+
+//
+// CheckpointRecs
+//
+// Child of TestCheckpoint: insert NUM_RECS records and checkpoint, update
+// one out of 7 and commit, then update the next ones without committing
+// and checkpoint again.  Those pages must stay unwritten, and the log
+// must be kept for the committed updates in them.
+//
+static void CheckpointRecs(int)
+{
+	PF_Manager pfm;
+	RM_Manager rmm(pfm);
+	RM_FileHandle fh;
+	RM_Log log;
+	vector<RID> rids(NUM_RECS);
+	RC rc;
+
+	if ((rc = pfm.ResizeBuffer(WHOLE_BUFFER)) ||
+			(rc = log.Open(LOGNAME)))
+		Fail("Opening the log", rc);
+	rmm.SetLog(&log);
+
+	if ((rc = rmm.CreateFile(FILENAME, sizeof(TestRec))) ||
+			(rc = rmm.OpenFile(FILENAME, fh)))
+		Fail("Creating the file", rc);
+	for (int i = 0; i < NUM_RECS; i++) {
+		TestRec rec = MakeRec(i, FALSE);
+		if ((rc = fh.InsertRec((char *)&rec, rids[i])))
+			Fail("InsertRec", rc);
+	}
+	if ((rc = log.Commit()) ||
+			(rc = log.Checkpoint()))
+		Fail("Checkpoint", rc);
+
+	for (int i = 0; i < NUM_RECS; i += 7)
+		UpdateRec(fh, rids[i]);
+	if ((rc = log.Commit()))
+		Fail("Commit", rc);
+	for (int i = 1; i < NUM_RECS; i += 7)
+		UpdateRec(fh, rids[i]);
+
+	// Nothing can be closed or destroyed before the updates are committed
+	if ((rc = log.Checkpoint()) != RM_UNCOMMITTED)
+		Fail("Checkpoint with uncommitted updates", rc);
+	if ((rc = rmm.CloseFile(fh)) != RM_UNCOMMITTED)
+		Fail("CloseFile with uncommitted updates", rc);
+	if ((rc = rmm.DestroyFile(FILENAME)) != RM_UNCOMMITTED)
+		Fail("DestroyFile with uncommitted updates", rc);
+
+	// Die before the destructors can write anything
+	_exit(0);
+}
+
+//
+// TestCheckpoint
+//
+// Recover the changes of CheckpointRecs
+//
+RC TestCheckpoint()
+{
+	PF_Manager pfm;
+	RM_Manager rmm(pfm);
+	RM_Log log;
+	RC rc;
+
+	cout << "Recovering after a checkpoint with uncommitted updates\n";
+
+	unlink(FILENAME);
+	unlink(LOGNAME);
+	Crash(CheckpointRecs, 0);
+
+	if ((rc = log.Open(LOGNAME)) ||
+			(rc = log.Recover(rmm)))
+		return (rc);
+
+	vector<int> found(NUM_RECS), updated(NUM_RECS);
+	if ((rc = ReadRecs(rmm, FILENAME, found, updated)))
+		return (rc);
+	for (int i = 0; i < NUM_RECS; i++)
+		if (found[i] != 1 || updated[i] != (i % 7 == 0)) {
+			cout << "Record " << i << " was found " << found[i]
+				<< " times after recovery"
+				<< (updated[i] ? ", updated\n" : "\n");
+			exit(1);
+		}
+
+	if ((rc = rmm.DestroyFile(FILENAME)) ||
+			(rc = log.Close()))
+		return (rc);
+
+	unlink(LOGNAME);
+	return (0);
+}
+
+//
+// TestLogFull
+//
+// Update one record of each page without committing, with a buffer too
+// small for all of them.  The update which would not fit is refused with
+// RM_LOG_FULL before it changes its page, and done after a commit.
+//
+RC TestLogFull()
+{
+	PF_Manager pfm;
+	RM_Manager rmm(pfm);
+	RM_FileHandle fh;
+	RM_Log log;
+	vector<RID> rids(NUM_RECS);
+	RM_Record rec;
+	char *pData;
+	RC rc;
+
+	cout << "Filling the buffer with uncommitted updates\n";
+
+	unlink(FILENAME);
+	unlink(LOGNAME);
+	if ((rc = pfm.ResizeBuffer(SMALL_BUFFER)) ||
+			(rc = log.Open(LOGNAME)))
+		return (rc);
+	rmm.SetLog(&log);
+	if ((rc = rmm.CreateFile(FILENAME, sizeof(TestRec))) ||
+			(rc = rmm.OpenFile(FILENAME, fh)))
+		return (rc);
+	for (int i = 0; i < NUM_RECS; i++) {
+		TestRec rec = MakeRec(i, FALSE);
+		if ((rc = fh.InsertRec((char *)&rec, rids[i])) ||
+				(i % 10 == 9 && (rc = log.Commit())))
+			return (rc);
+	}
+	if ((rc = log.Commit()))
+		return (rc);
+
+	// The first record of each page
+	int numHeld = 0;
+	PageNum last = -1;
+	for (int i = 0; i < NUM_RECS; i++) {
+		PageNum pageNum;
+		if ((rc = rids[i].GetPageNum(pageNum)))
+			return (rc);
+		if (pageNum == last)
+			continue;
+		last = pageNum;
+
+		if ((rc = fh.GetRec(rids[i], rec)) ||
+				(rc = rec.GetData(pData)))
+			return (rc);
+		((TestRec *)pData)->r = -1.0f;
+		if ((rc = fh.UpdateRec(rec)) == 0) {
+			numHeld++;
+			continue;
+		}
+		// Some pages are left to read records with
+		if (rc != RM_LOG_FULL ||
+				numHeld != SMALL_BUFFER - RM_LOG_SPARE_PAGES) {
+			cout << "Update " << numHeld << " returned " << rc << "\n";
+			exit(1);
+		}
+
+		// Nothing was changed, and the update is done once committed
+		if ((rc = fh.GetRec(rids[i], rec)) ||
+				(rc = rec.GetData(pData)))
+			return (rc);
+		if (((TestRec *)pData)->r < 0)
+			Fail("Refusing the update", 0);
+		((TestRec *)pData)->r = -1.0f;
+		if ((rc = log.Commit()) ||
+				(rc = fh.UpdateRec(rec)) ||
+				(rc = log.Commit()) ||
+				(rc = rmm.CloseFile(fh)) ||
+				(rc = rmm.DestroyFile(FILENAME)) ||
+				(rc = log.Close()))
+			return (rc);
+		unlink(LOGNAME);
+		return (0);
+	}
+
+	Fail("Filling the buffer", 0);
+	return (0);
+}
+
+//
+// ThreadInserts
+//
+// Insert THREAD_RECS records into a file of its own, committing each one
+//
+static void ThreadInserts(RM_Manager *pRmm, RM_Log *pLog, int thread)
+{
+	char fileName[32];
+	RM_FileHandle fh;
+	RC rc;
+
+	sprintf(fileName, "%s%d", FILENAME, thread);
+	if ((rc = pRmm->OpenFile(fileName, fh)))
+		Fail("OpenFile", rc);
+	for (int i = 0; i < THREAD_RECS; i++) {
+		TestRec rec = MakeRec(i, FALSE);
+		RID rid;
+		if ((rc = fh.InsertRec((char *)&rec, rid)) ||
+				(rc = pLog->Commit()))
+			Fail("Inserting", rc);
+	}
+}
+
+//
+// CommitThreads
+//
+// Child of TestThreads
+//
+static void CommitThreads(int)
+{
+	PF_Manager pfm;
+	RM_Manager rmm(pfm);
+	RM_Log log;
+	char fileName[32];
+	RC rc;
+
+	for (int t = 0; t < NUM_THREADS; t++) {
+		sprintf(fileName, "%s%d", FILENAME, t);
+		if ((rc = rmm.CreateFile(fileName, sizeof(TestRec))))
+			Fail("CreateFile", rc);
+	}
+	if ((rc = log.Open(LOGNAME)))
+		Fail("Opening the log", rc);
+	rmm.SetLog(&log);
+
+	vector<thread> threads;
+	for (int t = 0; t < NUM_THREADS; t++)
+		threads.push_back(thread(ThreadInserts, &rmm, &log, t));
+	for (int t = 0; t < NUM_THREADS; t++)
+		threads[t].join();
+	_exit(0);
+}
+
+//
+// TestThreads
+//
+// Recover the inserts committed by several threads at once
+//
+RC TestThreads()
+{
+	PF_Manager pfm;
+	RM_Manager rmm(pfm);
+	RM_Log log;
+	char fileName[32];
+	RC rc;
+
+	cout << "Recovering the commits of " << NUM_THREADS << " threads\n";
+
+	unlink(LOGNAME);
+	Crash(CommitThreads, 0);
+
+	if ((rc = log.Open(LOGNAME)) ||
+			(rc = log.Recover(rmm)) ||
+			(rc = log.Close()))
+		return (rc);
+
+	for (int t = 0; t < NUM_THREADS; t++) {
+		vector<int> found(THREAD_RECS), updated(THREAD_RECS);
+		sprintf(fileName, "%s%d", FILENAME, t);
+		if ((rc = ReadRecs(rmm, fileName, found, updated)))
+			return (rc);
+		for (int i = 0; i < THREAD_RECS; i++)
+			if (found[i] != 1) {
+				cout << "Record " << i << " of " << fileName << " was found "
+					<< found[i] << " times after recovery\n";
+				exit(1);
+			}
+		if ((rc = rmm.DestroyFile(fileName)))
+			return (rc);
+	}
+
+	unlink(LOGNAME);
+	return (0);
+}
+
+int main()
+{
+	RC rc;
+
+	// Write out initial starting message
+	cerr.flush();
+	cout.flush();
+	cout << "Starting RM log test.\n";
+	cout.flush();
+
+	if ((rc = TestRecover(WHOLE_BUFFER)) ||
+			(rc = TestRecover(SMALL_BUFFER)) ||
+			(rc = TestCheckpoint()) ||
+			(rc = TestLogFull()) ||
+			(rc = TestThreads())) {
+		RM_PrintError(rc);
+		return (1);
+	}
+
+	// Write ending message and exit
+	cout << "Ending RM log test.\n\n";
+
+	return (0);
+}
@@ -0,0 +1,621 @@
+//
+// File:        rm_test3.cc
+// Description: Test the slotted record format of the RM component
+//
+// Records whose strings are mostly empty take less room than in the fixed
+// format.  Random inserts, updates which make records grow and shrink,
+// and deletes are checked against a copy kept in memory: the RIDs stay
+// the same when pages are compacted and when records move to other
+// pages, and scans return each record once.  A child process then makes
+// such changes to a logged file and dies, and recovery must give back the
+// committed records.  Updates which cannot move their record because
+// every buffer page is pinned must leave it as it was.
+//
+
+#include <cstdio>
+#include <iostream>
+#include <cstring>
+#include <cstdlib>
+#include <cstddef>
+#include <vector>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "redbase.h"
+#include "pf.h"
+#include "rm.h"
+#include "rm_log.h"
+
+using namespace std;
+
+//
+// Defines
+//
+#define FILENAME     "testrel"   // test file name
+#define LOGNAME      "testrel.log" // log file name
+#define NAMELEN      200         // length of the string in testrec
+#define SHORT_NAME   12          // longest name of TestSize
+#define NUM_RECS     2000        // records of TestSize
+#define NUM_OPS      20000       // random changes of TestChanges
+#define RECOVER_OPS  3000        // random changes before the crash
+#define NUM_LOST     50          // changes not committed
+#define WHOLE_BUFFER 64          // buffer pages holding the whole file
+#define SMALL_BUFFER 8           // buffer pages writing some back
+#define TINY_BUFFER  8           // buffer pages of TestNoBuffer
+#define PINNAME      "testrel.pin" // file pinning the buffer
+
+//
+// Structure of the records we will be using for the tests
+//
+struct TestRec {
+	int   num;
+	float r;
+	char  name[NAMELEN];
+};
+
+//
+// Fail
+//
+// Print an error and leave
+//
+static void Fail(const char *what, RC rc)
+{
+	cout << what << " failed\n";
+	if (rc)
+		RM_PrintError(rc);
+	exit(1);
+}
+
+//
+// MakeRec
+//
+// Record number num whose name is length characters long
+//
+static TestRec MakeRec(int num, int length)
+{
+	TestRec rec;
+	memset(&rec, 0, sizeof(rec));
+	rec.num = num;
+	for (int i = 0; i < length; i++)
+		rec.name[i] = 'a' + (num + length + i) % 26;
+	rec.r = (float)length;
+	return (rec);
+}
+
+//
+// Random
+//
+// Random numbers which are the same in the child and the parent
+//
+static unsigned int seed;
+static int Random(int n)
+{
+	seed = seed * 1103515245 + 12345;
+	return ((seed >> 8) % n);
+}
+
+//
+// SameRid
+//
+// Whether two RIDs are the same
+//
+static int SameRid(const RID &rid1, const RID &rid2)
+{
+	PageNum pageNum1, pageNum2;
+	SlotNum slotNum1, slotNum2;
+	if (rid1.GetPageNum(pageNum1) || rid1.GetSlotNum(slotNum1) ||
+			rid2.GetPageNum(pageNum2) || rid2.GetSlotNum(slotNum2))
+		return (0);
+	return (pageNum1 == pageNum2 && slotNum1 == slotNum2);
+}
+
+//
+// FilePages
+//
+// Pages in a file, from its length
+//
+static long long FilePages(const char *fileName)
+{
+	struct stat st;
+	if (stat(fileName, &st) < 0)
+		return (0);
+	return (st.st_size / PF_DEFAULT_PAGE_SIZE);
+}
+
+//
+// CheckRecs
+//
+// Check a file against lengths, the name length of each record or -1 when
+// it was deleted.  rids are the RIDs of the records, or empty when they
+// are not known; then they are taken from the scan.
+//
+static RC CheckRecs(RM_FileHandle &fh, const vector<int> &lengths,
+		vector<RID> &rids)
+{
+	RM_FileScan fs;
+	RM_Record rec;
+	RID rid;
+	char *pData;
+	vector<int> found(lengths.size());
+	Boolean bKnown = !rids.empty();
+	RC rc;
+
+	rids.resize(lengths.size());
+
+	// Each record is found once by a scan, under its RID
+	if ((rc = fs.OpenScan(fh, INT, sizeof(int), 0, NO_OP, NULL)))
+		return (rc);
+	while (!(rc = fs.GetNextRec(rec))) {
+		if ((rc = rec.GetData(pData)) ||
+				(rc = rec.GetRid(rid)))
+			return (rc);
+		int num = ((TestRec *)pData)->num;
+		if (num < 0 || num >= (int)lengths.size() || lengths[num] < 0)
+			Fail("Scanning an unknown record", 0);
+		TestRec expected = MakeRec(num, lengths[num]);
+		if (memcmp(pData, &expected, sizeof(TestRec)) != 0)
+			Fail("Scanning a changed record", 0);
+		if (bKnown && !SameRid(rid, rids[num]))
+			Fail("Scanning a record under another RID", 0);
+		rids[num] = rid;
+		found[num]++;
+	}
+	if (rc != RM_EOF || (rc = fs.CloseScan()))
+		return (rc);
+
+	// GetRec returns the same records
+	for (int num = 0; num < (int)lengths.size(); num++) {
+		if (found[num] != (lengths[num] >= 0)) {
+			cout << "Record " << num << " was found " << found[num]
+				<< " times\n";
+			exit(1);
+		}
+		if (lengths[num] < 0)
+			continue;
+		TestRec expected = MakeRec(num, lengths[num]);
+		if ((rc = fh.GetRec(rids[num], rec)) ||
+				(rc = rec.GetData(pData)))
+			return (rc);
+		if (memcmp(pData, &expected, sizeof(TestRec)) != 0)
+			Fail("GetRec of a changed record", 0);
+	}
+
+	// A scan with a condition sees the records as they are
+	int count = 0, expectedCount = 0;
+	float value = SHORT_NAME;
+	if ((rc = fs.OpenScan(fh, FLOAT, sizeof(float),
+			offsetof(TestRec, r), LT_OP, &value)))
+		return (rc);
+	while (!(rc = fs.GetNextRec(rec)))
+		count++;
+	if (rc != RM_EOF || (rc = fs.CloseScan()))
+		return (rc);
+	for (int num = 0; num < (int)lengths.size(); num++)
+		expectedCount += (lengths[num] >= 0 && lengths[num] < SHORT_NAME);
+	if (count != expectedCount)
+		Fail("Scanning with a condition", 0);
+	return (0);
+}
+
+//
+// TestSize
+//
+// Records with short names fill fewer pages than in the fixed format
+//
+RC TestSize()
+{
+	PF_Manager pfm;
+	RM_Manager rmm(pfm);
+	RM_FileHandle fh;
+	vector<int> lengths(NUM_RECS);
+	vector<RID> rids(NUM_RECS);
+	long long pages[2];
+	RC rc;
+
+	cout << "Storing short strings\n";
+
+	for (int format = RM_FORMAT_FIXED; format <= RM_FORMAT_SLOTTED; format++) {
+		unlink(FILENAME);
+		if ((rc = rmm.CreateFile(FILENAME, sizeof(TestRec),
+				PF_DEFAULT_PAGE_SIZE, (RM_FileFormat)format)) ||
+				(rc = rmm.OpenFile(FILENAME, fh)))
+			return (rc);
+		for (int i = 0; i < NUM_RECS; i++) {
+			lengths[i] = i % (SHORT_NAME + 1);
+			TestRec rec = MakeRec(i, lengths[i]);
+			if ((rc = fh.InsertRec((char *)&rec, rids[i])))
+				return (rc);
+		}
+		if ((rc = CheckRecs(fh, lengths, rids)) ||
+				(rc = rmm.CloseFile(fh)))
+			return (rc);
+		pages[format] = FilePages(FILENAME);
+	}
+
+	// A record takes less than a quarter of its size
+	if (pages[RM_FORMAT_SLOTTED] * 4 > pages[RM_FORMAT_FIXED]) {
+		cout << "The slotted file has " << pages[RM_FORMAT_SLOTTED]
+			<< " pages, the fixed one " << pages[RM_FORMAT_FIXED] << "\n";
+		exit(1);
+	}
+
+	// Records which do not fit in a page, with their forwarding, are refused
+	if (rmm.CreateFile(FILENAME "2", PF_DEFAULT_PAGE_SIZE - 32,
+			PF_DEFAULT_PAGE_SIZE, RM_FORMAT_SLOTTED) != RM_LARGE_RECORDSIZE)
+		Fail("Creating a file of too large records", 0);
+
+	return (rmm.DestroyFile(FILENAME));
+}
+
+//
+// ChangeRec
+//
+// Make one random change to the records in lengths.  fh is NULL when the
+// change is only made to lengths.
+//
+static RC ChangeRec(RM_FileHandle *fh, vector<int> &lengths,
+		vector<RID> &rids)
+{
+	RC rc;
+
+	int op = Random(4);
+	int num = Random(lengths.size() + 1);
+	// Long names now and then, so that records move to other pages
+	int length = Random(8) == 0 ? NAMELEN : Random(SHORT_NAME * 2);
+
+	if (num == (int)lengths.size() || (op == 0 && lengths[num] < 0)) {
+		num = lengths.size();
+		lengths.push_back(length);
+		rids.push_back(RID());
+		TestRec rec = MakeRec(num, length);
+		if (fh && (rc = fh->InsertRec((char *)&rec, rids[num])))
+			return (rc);
+	}
+	else if (lengths[num] < 0) {
+		// Deleted records are left alone, their slots may hold others
+	}
+	else if (op == 0) {
+		lengths[num] = -1;
+		if (fh && (rc = fh->DeleteRec(rids[num])))
+			return (rc);
+	}
+	else {
+		lengths[num] = length;
+		RM_Record rec;
+		char *pData;
+		if (fh) {
+			if ((rc = fh->GetRec(rids[num], rec)) ||
+					(rc = rec.GetData(pData)))
+				return (rc);
+			TestRec changed = MakeRec(num, length);
+			memcpy(pData, &changed, sizeof(TestRec));
+			if ((rc = fh->UpdateRec(rec)))
+				return (rc);
+		}
+	}
+	return (0);
+}
+
+//
+// TestChanges
+//
+// Random changes, checked now and then and once the file is opened again
+//
+RC TestChanges()
+{
+	PF_Manager pfm;
+	RM_Manager rmm(pfm);
+	RM_FileHandle fh;
+	vector<int> lengths;
+	vector<RID> rids;
+	RC rc;
+
+	cout << "Growing, shrinking and moving records\n";
+
+	unlink(FILENAME);
+	if ((rc = rmm.CreateFile(FILENAME, sizeof(TestRec),
+			PF_DEFAULT_PAGE_SIZE, RM_FORMAT_SLOTTED)) ||
+			(rc = rmm.OpenFile(FILENAME, fh)))
+		return (rc);
+
+	seed = 1;
+	for (int i = 0; i < NUM_OPS; i++) {
+		if ((rc = ChangeRec(&fh, lengths, rids)))
+			return (rc);
+		if (i % (NUM_OPS / 10) == 0 && (rc = CheckRecs(fh, lengths, rids)))
+			return (rc);
+	}
+	if ((rc = CheckRecs(fh, lengths, rids)) ||
+			(rc = rmm.CloseFile(fh)) ||
+			(rc = rmm.OpenFile(FILENAME, fh)) ||
+			(rc = CheckRecs(fh, lengths, rids)))
+		return (rc);
+
+	// Every record grows, most of them move
+	for (int num = 0; num < (int)lengths.size(); num++) {
+		if (lengths[num] < 0)
+			continue;
+		RM_Record rec;
+		char *pData;
+		lengths[num] = NAMELEN;
+		TestRec changed = MakeRec(num, NAMELEN);
+		if ((rc = fh.GetRec(rids[num], rec)) ||
+				(rc = rec.GetData(pData)))
+			return (rc);
+		memcpy(pData, &changed, sizeof(TestRec));
+		if ((rc = fh.UpdateRec(rec)))
+			return (rc);
+	}
+	if ((rc = CheckRecs(fh, lengths, rids)) ||
+			(rc = rmm.CloseFile(fh)) ||
+			(rc = rmm.DestroyFile(FILENAME)))
+		return (rc);
+
+	return (0);
+}
+
+//
+// SetRec
+//
+// Give record num a name of length characters
+//
+static RC SetRec(RM_FileHandle &fh, const RID &rid, int num, int length)
+{
+	RM_Record rec;
+	char *pData;
+	RC rc;
+
+	if ((rc = fh.GetRec(rid, rec)) ||
+			(rc = rec.GetData(pData)))
+		return (rc);
+	TestRec changed = MakeRec(num, length);
+	memcpy(pData, &changed, sizeof(TestRec));
+	return (fh.UpdateRec(rec));
+}
+
+//
+// InsertUntil
+//
+// Insert records with empty names until one goes to page pageNum
+//
+static RC InsertUntil(RM_FileHandle &fh, vector<int> &lengths,
+		vector<RID> &rids, PageNum pageNum)
+{
+	PageNum last = 0;
+	RC rc;
+
+	while (last < pageNum) {
+		int num = lengths.size();
+		TestRec rec = MakeRec(num, 0);
+		lengths.push_back(0);
+		rids.push_back(RID());
+		if ((rc = fh.InsertRec((char *)&rec, rids[num])) ||
+				(rc = rids[num].GetPageNum(last)))
+			return (rc);
+	}
+	return (0);
+}
+
+//
+// PinRec
+//
+// Pin the page holding record num with a scan
+//
+static RC PinRec(RM_FileHandle &fh, RM_FileScan &fs, RM_RecordView &view,
+		int num)
+{
+	char *pData;
+	RC rc;
+
+	if ((rc = fs.OpenScan(fh, INT, sizeof(int), 0, EQ_OP, &num)) ||
+			(rc = fs.GetNextRec(view)) ||
+			(rc = view.GetData(pData)))
+		return (rc);
+	return (0);
+}
+
+//
+// TestNoBuffer
+//
+// The records of the first page grow while the pages they could move to
+// cannot be read: the updates fail and the records stay as they were.
+// Record 0 is in its home page, record 1 has moved to a full page.
+//
+RC TestNoBuffer()
+{
+	PF_Manager pfm;
+	RM_Manager rmm(pfm);
+	RM_FileHandle fh;
+	PF_FileHandle pfh;
+	PF_PageHandle ph;
+	RM_FileScan fs[2];
+	RM_RecordView views[2];
+	vector<int> lengths;
+	vector<RID> rids;
+	vector<PageNum> pinned;
+	PageNum pageNum;
+	RC rc;
+
+	cout << "Moving records without a free buffer page\n";
+
+	unlink(FILENAME);
+	unlink(PINNAME);
+	if ((rc = pfm.ResizeBuffer(TINY_BUFFER)) ||
+			(rc = rmm.CreateFile(FILENAME, sizeof(TestRec),
+				PF_DEFAULT_PAGE_SIZE, RM_FORMAT_SLOTTED)) ||
+			(rc = rmm.OpenFile(FILENAME, fh)) ||
+			(rc = pfm.CreateFile(PINNAME)) ||
+			(rc = pfm.OpenFile(PINNAME, pfh)))
+		return (rc);
+
+	// Page 3 holds record 1 and is full, page 4 is the next free one
+	if ((rc = InsertUntil(fh, lengths, rids, 3)) ||
+			(rc = SetRec(fh, rids[1], 1, NAMELEN)) ||
+			(rc = InsertUntil(fh, lengths, rids, 4)))
+		return (rc);
+	lengths[1] = NAMELEN;
+
+	for (int num = 0; num < 2; num++) {
+		// Pin the pages of the record, then the rest of the buffer
+		if ((rc = PinRec(fh, fs[0], views[0], 0)) ||
+				(num == 1 && (rc = PinRec(fh, fs[1], views[1], 1))))
+			return (rc);
+		while (!(rc = pfh.AllocatePage(ph))) {
+			if ((rc = ph.GetPageNum(pageNum)))
+				return (rc);
+			pinned.push_back(pageNum);
+		}
+		if (rc != PF_NOBUF)
+			return (rc);
+
+		if ((rc = SetRec(fh, rids[num], num, NAMELEN - 1)) != PF_NOBUF) {
+			cout << "Moving record " << num << " returned " << rc << "\n";
+			exit(1);
+		}
+
+		for (int i = 0; i < (int)pinned.size(); i++)
+			if ((rc = pfh.UnpinPage(pinned[i])))
+				return (rc);
+		pinned.clear();
+		for (int i = 0; i <= num; i++)
+			if ((rc = views[i].Release()) ||
+					(rc = fs[i].CloseScan()))
+				return (rc);
+		if ((rc = CheckRecs(fh, lengths, rids)))
+			return (rc);
+	}
+
+	// With the buffer back, the records move
+	for (int num = 0; num < 2; num++) {
+		lengths[num] = NAMELEN - 1;
+		if ((rc = SetRec(fh, rids[num], num, NAMELEN - 1)))
+			return (rc);
+	}
+	if ((rc = CheckRecs(fh, lengths, rids)) ||
+			(rc = rmm.CloseFile(fh)) ||
+			(rc = rmm.DestroyFile(FILENAME)) ||
+			(rc = pfm.CloseFile(pfh)) ||
+			(rc = pfm.DestroyFile(PINNAME)))
+		return (rc);
+
+	return (0);
+}
+
+//
+// ChangeLogged
+//
+// Child of TestRecover: random changes to a logged file, all committed
+// but the last NUM_LOST
+//
+static void ChangeLogged(int bufferSize)
+{
+	PF_Manager pfm;
+	RM_Manager rmm(pfm);
+	RM_FileHandle fh;
+	RM_Log log;
+	vector<int> lengths;
+	vector<RID> rids;
+	RC rc;
+
+	if ((rc = pfm.ResizeBuffer(bufferSize)) ||
+			(rc = log.Open(LOGNAME)))
+		Fail("Opening the log", rc);
+	rmm.SetLog(&log);
+
+	if ((rc = rmm.CreateFile(FILENAME, sizeof(TestRec),
+			PF_DEFAULT_PAGE_SIZE, RM_FORMAT_SLOTTED)) ||
+			(rc = rmm.OpenFile(FILENAME, fh)))
+		Fail("Creating the file", rc);
+
+	seed = 2;
+	for (int i = 0; i < RECOVER_OPS + NUM_LOST; i++) {
+		if ((rc = ChangeRec(&fh, lengths, rids)))
+			Fail("Changing a record", rc);
+		if ((i % 100 == 99 || i == RECOVER_OPS - 1) && i < RECOVER_OPS &&
+				(rc = log.Commit()))
+			Fail("Commit", rc);
+	}
+
+	// Die before the destructors can write anything
+	_exit(0);
+}
+
+//
+// TestRecover
+//
+// Recover the changes of ChangeLogged
+//
+RC TestRecover(int bufferSize)
+{
+	PF_Manager pfm;
+	RM_Manager rmm(pfm);
+	RM_FileHandle fh;
+	RM_Log log;
+	vector<int> lengths;
+	vector<RID> rids;
+	RC rc;
+
+	cout << "Recovering with a buffer of " << bufferSize << " pages\n";
+
+	unlink(FILENAME);
+	unlink(LOGNAME);
+	pid_t pid = fork();
+	if (pid < 0)
+		Fail("fork", 0);
+	if (pid == 0)
+		ChangeLogged(bufferSize);
+	int status;
+	if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) ||
+			WEXITSTATUS(status) != 0)
+		Fail("The child", 0);
+
+	// The same changes, up to the last commit
+	seed = 2;
+	for (int i = 0; i < RECOVER_OPS; i++)
+		ChangeRec(NULL, lengths, rids);
+	rids.clear();
+
+	if ((rc = log.Open(LOGNAME)) ||
+			(rc = log.Recover(rmm)) ||
+			(rc = rmm.OpenFile(FILENAME, fh)) ||
+			(rc = CheckRecs(fh, lengths, rids)))
+		return (rc);
+
+	// The file can still be changed
+	for (int i = 0; i < RECOVER_OPS; i++)
+		if ((rc = ChangeRec(&fh, lengths, rids)))
+			return (rc);
+	if ((rc = CheckRecs(fh, lengths, rids)) ||
+			(rc = rmm.CloseFile(fh)) ||
+			(rc = rmm.DestroyFile(FILENAME)) ||
+			(rc = log.Close()))
+		return (rc);
+
+	unlink(LOGNAME);
+	return (0);
+}
+
+int main()
+{
+	RC rc;
+
+	// Write out initial starting message
+	cerr.flush();
+	cout.flush();
+	cout << "Starting RM slotted format test.\n";
+	cout.flush();
+
+	if ((rc = TestSize()) ||
+			(rc = TestChanges()) ||
+			(rc = TestNoBuffer()) ||
+			(rc = TestRecover(WHOLE_BUFFER)) ||
+			(rc = TestRecover(SMALL_BUFFER))) {
+		RM_PrintError(rc);
+		return (1);
+	}
+
+	// Write ending message and exit
+	cout << "Ending RM slotted format test.\n\n";
+
+	return (0);
+}
@@ -0,0 +1,250 @@
+//
+// statcounters.cc
+//
+
+// This file holds the implementation for the StatCounters and
+// StatHistograms classes.
+
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <iostream>
+#include "statcounters.h"
+
+using namespace std;
+
+// Bit i is set while copy i is free, the shared copy has no bit
+static atomic<unsigned> statFreeSlots((1u << (STAT_NUM_SLOTS - 1)) - 1);
+
+//
+// StatTakeSlot
+//
+// Take the lowest free copy.  The one who had it before wrote it last
+// before giving it back, so it is only written by one thread at a time.
+//
+int StatTakeSlot()
+{
+	unsigned free = statFreeSlots.load(memory_order_relaxed);
+	while (free != 0)
+		if (statFreeSlots.compare_exchange_weak(free, free & (free - 1),
+				memory_order_acquire, memory_order_relaxed))
+			return (__builtin_ctz(free));
+	return (STAT_NUM_SLOTS - 1);
+}
+
+//
+// ~StatSlotHolder
+//
+// Give the copy of an exiting thread back.  Statistics counted later by
+// the thread, while its other objects are destroyed, go to the shared
+// copy.
+//
+StatSlotHolder::~StatSlotHolder()
+{
+	if (slot >= 0 && slot < STAT_NUM_SLOTS - 1)
+		statFreeSlots.fetch_or(1u << slot, memory_order_release);
+	slot = STAT_NUM_SLOTS - 1;
+}
+
+//
+// NewValues
+//
+// Allocate n zeroed atomic counters starting on a cache line
+//
+static atomic<long> *NewValues(int n)
+{
+	void *p;
+	if (posix_memalign(&p, STAT_CACHE_LINE, n * sizeof(atomic<long>)))
+		throw bad_alloc();
+
+	atomic<long> *pValues = (atomic<long> *)p;
+	for (int i = 0; i < n; i++)
+		new (&pValues[i]) atomic<long>(0);
+	return (pValues);
+}
+
+// --------------------------------------------------------------
+
+//
+// StatCounters class
+//
+
+//
+// Constructor
+//
+// The counters of a slot are padded to whole cache lines so that threads
+// using different slots never write to the same line.
+//
+StatCounters::StatCounters(int numKeys_, const char *const *psNames_)
+{
+	const int perLine = STAT_CACHE_LINE / sizeof(atomic<long>);
+
+	numKeys = numKeys_;
+	psNames = psNames_;
+	stride = (numKeys + perLine - 1) / perLine * perLine;
+	pValues = NewValues(STAT_NUM_SLOTS * stride);
+}
+
+StatCounters::~StatCounters()
+{
+	free(pValues);
+}
+
+//
+// Get
+//
+// Sum the copies of a counter.  Counts added meanwhile by other threads
+// may or may not be seen.
+//
+long StatCounters::Get(int key) const
+{
+	long value = 0;
+	for (int slot = 0; slot < STAT_NUM_SLOTS; slot++)
+		value += pValues[slot * stride + key].load(memory_order_relaxed);
+	return (value);
+}
+
+//
+// Find
+//
+// Look a counter up by name, for the callers which only know the name
+//
+int StatCounters::Find(const char *psName) const
+{
+	for (int key = 0; key < numKeys; key++)
+		if (strcmp(psNames[key], psName) == 0)
+			return (key);
+	return (-1);
+}
+
+//
+// Print
+//
+// Print out the counters, in the format of StatisticsMgr::Print
+//
+void StatCounters::Print() const
+{
+	for (int key = 0; key < numKeys; key++)
+		cout << psNames[key] << "::" << Get(key) << "\n";
+}
+
+//
+// Reset
+//
+void StatCounters::Reset()
+{
+	for (int i = 0; i < STAT_NUM_SLOTS * stride; i++)
+		pValues[i].store(0, memory_order_relaxed);
+}
+
+// --------------------------------------------------------------
+
+//
+// StatHistograms class
+//
+
+//
+// Constructor
+//
+// A histogram takes STAT_NUM_BUCKETS counters, whole cache lines.
+//
+StatHistograms::StatHistograms(int numKeys_, const char *const *psNames_)
+{
+	numKeys = numKeys_;
+	psNames = psNames_;
+	pCounts = NewValues(STAT_NUM_SLOTS * numKeys * STAT_NUM_BUCKETS);
+}
+
+StatHistograms::~StatHistograms()
+{
+	free(pCounts);
+}
+
+//
+// Sum
+//
+// Sum the copies of the buckets of a histogram
+//
+void StatHistograms::Sum(int key, long *counts) const
+{
+	for (int b = 0; b < STAT_NUM_BUCKETS; b++)
+		counts[b] = 0;
+	for (int slot = 0; slot < STAT_NUM_SLOTS; slot++) {
+		const atomic<long> *pSlot =
+			&pCounts[(slot * numKeys + key) * STAT_NUM_BUCKETS];
+		for (int b = 0; b < STAT_NUM_BUCKETS; b++)
+			counts[b] += pSlot[b].load(memory_order_relaxed);
+	}
+}
+
+//
+// Count
+//
+long StatHistograms::Count(int key) const
+{
+	long counts[STAT_NUM_BUCKETS];
+	long count = 0;
+
+	Sum(key, counts);
+	for (int b = 0; b < STAT_NUM_BUCKETS; b++)
+		count += counts[b];
+	return (count);
+}
+
+//
+// Percentile
+//
+// The upper bound of the bucket holding the pct percentile, pct from 0
+// to 100
+//
+long long StatHistograms::Percentile(int key, double pct) const
+{
+	long counts[STAT_NUM_BUCKETS];
+	long count = 0;
+
+	Sum(key, counts);
+	for (int b = 0; b < STAT_NUM_BUCKETS; b++)
+		count += counts[b];
+	if (count == 0)
+		return (0);
+
+	long rank = (long)(count * pct / 100.0);
+	if (rank >= count)
+		rank = count - 1;
+	for (int b = 0; b < STAT_NUM_BUCKETS; b++) {
+		if (rank < counts[b])
+			return (b == 0 ? 1 : 1LL << (b < 63 ? b : 62));
+		rank -= counts[b];
+	}
+	return (0);
+}
+
+int StatHistograms::Find(const char *psName) const
+{
+	for (int key = 0; key < numKeys; key++)
+		if (strcmp(psNames[key], psName) == 0)
+			return (key);
+	return (-1);
+}
+
+//
+// Print
+//
+// Print out "NAME::count p50<value p99<value" for each histogram
+//
+void StatHistograms::Print() const
+{
+	for (int key = 0; key < numKeys; key++)
+		cout << psNames[key] << "::" << Count(key)
+			<< " p50<" << Percentile(key, 50)
+			<< " p99<" << Percentile(key, 99) << "\n";
+}
+
+//
+// Reset
+//
+void StatHistograms::Reset()
+{
+	for (int i = 0; i < STAT_NUM_SLOTS * numKeys * STAT_NUM_BUCKETS; i++)
+		pCounts[i].store(0, memory_order_relaxed);
+}
@@ -0,0 +1,154 @@
+//
+// statcounters.h
+//
+
+// This file contains the interface for the StatCounters and
+// StatHistograms classes, which track a fixed set of statistics known
+// when the program is compiled.
+
+// StatisticsMgr looks a statistic up by comparing its name with those of
+// a linked list, under a lock when several threads share it, so counting
+// an event cost more than a buffer hit.  Here a statistic is an index
+// into an array.  Each thread adds to its own copy of the array, kept on
+// cache lines of its own, and the copies are summed when a value is read.
+// The names are only used to print the values and to look them up by
+// name.
+
+#ifndef STATCOUNTERS_H
+#define STATCOUNTERS_H
+
+#include <atomic>
+
+const int STAT_CACHE_LINE = 64;    // bytes of a cache line
+const int STAT_NUM_SLOTS = 16;     // copies of the statistics, threads
+                                   // beyond that share them
+const int STAT_NUM_BUCKETS = 64;   // buckets of a histogram
+
+//
+// StatThreadSlot
+//
+// Copy of the statistics used by the calling thread.  A thread takes one
+// of the first STAT_NUM_SLOTS - 1 copies which is not in use and gives it
+// back when it exits, so that threads come and go without running out of
+// copies.  The threads beyond STAT_NUM_SLOTS - 1 at a time share the
+// last copy.  The values a thread counted stay in its copy.
+//
+struct StatSlotHolder {
+	StatSlotHolder () : slot(-1) {}
+	~StatSlotHolder();                   // gives the slot back
+
+	int slot;
+};
+
+// Take a free copy, the shared one if there is none
+int StatTakeSlot();
+
+inline int StatThreadSlot()
+{
+	static thread_local StatSlotHolder holder;
+	if (holder.slot < 0)
+		holder.slot = StatTakeSlot();
+	return (holder.slot);
+}
+
+//
+// StatCounters - counters indexed by an enum
+//
+class StatCounters {
+public:
+	// numKeys counters named psNames[0..numKeys-1], which must stay valid
+	StatCounters (int numKeys, const char *const *psNames);
+	~StatCounters();
+
+	// Add value to counter key.  Any thread may call it without a lock.
+	// Only the thread owning a copy writes it, so it needs no locked
+	// instruction, unless the copy is the shared one.
+	void Add (int key, long value = 1)
+		{ int slot = StatThreadSlot();
+		  std::atomic<long> &v = pValues[slot * stride + key];
+		  if (slot < STAT_NUM_SLOTS - 1)
+		      v.store(v.load(std::memory_order_relaxed) + value,
+		              std::memory_order_relaxed);
+		  else
+		      v.fetch_add(value, std::memory_order_relaxed); }
+
+	// Value of counter key, summed over the threads
+	long Get (int key) const;
+
+	// Name view
+	int  NumKeys () const { return numKeys; }
+	const char *Name (int key) const { return psNames[key]; }
+	// Counter named psName, -1 if there is none
+	int  Find (const char *psName) const;
+
+	// Print out all the counters as "NAME::value"
+	void Print () const;
+
+	// Set all the counters to 0.  An event counted meanwhile by another
+	// thread may undo the reset of its counter.
+	void Reset ();
+
+private:
+	StatCounters (const StatCounters &);
+	StatCounters &operator= (const StatCounters &);
+
+	int numKeys;
+	int stride;                          // counters per slot, padded
+	const char *const *psNames;
+	std::atomic<long> *pValues;          // STAT_NUM_SLOTS slots
+};
+
+//
+// StatHistograms - histograms indexed by an enum
+//
+// Bucket b counts the values v with 2^(b-1) <= v < 2^b, bucket 0 the
+// values below 1.  Meant for latencies in nanoseconds, the percentiles
+// are known within a factor of 2.
+//
+class StatHistograms {
+public:
+	// numKeys histograms named psNames[0..numKeys-1]
+	StatHistograms (int numKeys, const char *const *psNames);
+	~StatHistograms();
+
+	// Count value in histogram key.  Any thread may call it, as Add.
+	void Record (int key, long long value)
+		{ int slot = StatThreadSlot();
+		  std::atomic<long> &c = pCounts[(slot * numKeys + key) *
+		                                 STAT_NUM_BUCKETS + Bucket(value)];
+		  if (slot < STAT_NUM_SLOTS - 1)
+		      c.store(c.load(std::memory_order_relaxed) + 1,
+		              std::memory_order_relaxed);
+		  else
+		      c.fetch_add(1, std::memory_order_relaxed); }
+
+	// Number of values recorded in histogram key
+	long Count (int key) const;
+	// Upper bound of the pct percentile of histogram key, 0 if empty
+	long long Percentile (int key, double pct) const;
+
+	int  NumKeys () const { return numKeys; }
+	const char *Name (int key) const { return psNames[key]; }
+	int  Find (const char *psName) const;
+
+	// Print out the count, median and 99th percentile of each histogram
+	void Print () const;
+
+	void Reset ();
+
+private:
+	StatHistograms (const StatHistograms &);
+	StatHistograms &operator= (const StatHistograms &);
+
+	static int Bucket (long long value)
+		{ int b = (value <= 0) ? 0 : 64 - __builtin_clzll(value);
+		  return (b < STAT_NUM_BUCKETS ? b : STAT_NUM_BUCKETS - 1); }
+	// Counts of histogram key summed over the slots
+	void Sum (int key, long *counts) const;
+
+	int numKeys;
+	const char *const *psNames;
+	std::atomic<long> *pCounts;          // STAT_NUM_SLOTS slots
+};
+
+#endif
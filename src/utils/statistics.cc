@@ -23,15 +23,28 @@
 using namespace std;
 
 //
-// Here are Statistics Keys utilized by the PF layer of the Redbase
-// project.
-//
-const char *PF_GETPAGE = "GETPAGE";
-const char *PF_PAGEFOUND = "PAGEFOUND";
-const char *PF_PAGENOTFOUND = "PAGENOTFOUND";
-const char *PF_READPAGE = "READPAGE";           // IO
-const char *PF_WRITEPAGE = "WRITEPAGE";         // IO
-const char *PF_FLUSHPAGES = "FLUSHPAGES";
+// Here are the names of the statistics of the PF layer of the Redbase
+// project, in the order of PF_StatKey and PF_TimeKey.
+//
+const char *const PF_STAT_NAMES[PF_NUM_STATS] = {
+	"GETPAGE",
+	"PAGEFOUND",
+	"PAGENOTFOUND",
+	"READPAGE",
+	"WRITEPAGE",
+	"FLUSHPAGES",
+	"EVICTPAGE",
+	"PREFETCHPAGE",
+	"WRITESAVED",
+	"EVICTDIRTY",
+	"BGWRITE",
+	"RINGREUSE"
+};
+
+const char *const PF_TIME_NAMES[PF_NUM_TIMES] = {
+	"READTIME",
+	"WRITETIME"
+};
 
 //
 // Statistic class
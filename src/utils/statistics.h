@@ -47,6 +47,7 @@ const int STAT_BASE = 9000;
 
 // This include must come after the common defines
 #include "linkedlist.h"    // Template class for the link list
+#include "statcounters.h"  // Counters of a fixed set of statistics
 
 // A single statistic will be tracked by a Statistic class
 class Statistic {
@@ -127,15 +128,39 @@ const int STAT_UNKNOWN_KEY  = STAT_BASE+2;  // No such Key being tracked
 
 //
 // The following are specifically for tracking the statistics in the PF
-// component of Redbase.  When statistics are utilized, these constants
-// will be used as the keys for the statistics manager.
+// component of Redbase.  They are kept in StatCounters and
+// StatHistograms (see statcounters.h) rather than in a StatisticsMgr, so
+// that counting is cheap enough to leave on.  PF_STAT_NAMES and
+// PF_TIME_NAMES give the names under which they are printed.
 //
-extern const char *PF_GETPAGE;
-extern const char *PF_PAGEFOUND;
-extern const char *PF_PAGENOTFOUND;
-extern const char *PF_READPAGE;         // IO
-extern const char *PF_WRITEPAGE;        // IO
-extern const char *PF_FLUSHPAGES;
+enum PF_StatKey {
+	PF_GETPAGE,
+	PF_PAGEFOUND,
+	PF_PAGENOTFOUND,
+	PF_READPAGE,         // IO
+	PF_WRITEPAGE,        // IO
+	PF_FLUSHPAGES,
+	PF_EVICTPAGE,        // replaced by the policy
+	PF_PREFETCHPAGE,     // loaded by read-ahead
+	PF_WRITESAVED,       // write calls saved by coalescing
+	PF_EVICTDIRTY,       // IO, dirty victim written by a miss
+	PF_BGWRITE,          // IO, by the background writer
+	PF_RINGREUSE,        // scan ring slot reused
+	PF_NUM_STATS
+};
+extern const char *const PF_STAT_NAMES[PF_NUM_STATS];
 
-#endif
+// Latencies of the system calls of the PF layer, in nanoseconds
+enum PF_TimeKey {
+	PF_READTIME,         // pread of a page
+	PF_WRITETIME,        // pwrite of a page or pwritev of a run
+	PF_NUM_TIMES
+};
+extern const char *const PF_TIME_NAMES[PF_NUM_TIMES];
 
+// These are defined within pf_buffermgr.cc when PF_STATS is on, and
+// reset when a PF_BufferMgr is created
+extern StatCounters pfStats;
+extern StatHistograms pfTimes;
+
+#endif